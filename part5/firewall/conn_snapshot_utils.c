@@ -0,0 +1,200 @@
+#include "conn_tab_utils.h"
+
+/**
+ *	The conn_tab char-device (/dev/fw) lets user save the connection-table
+ *	before the module is unloaded, and restore it after it's loaded again
+ *	(so established connections survive an upgrade):
+ *		1. Opening it for reading takes a snapshot of the table, reading
+ *		   returns that snapshot (see conn_snapshot_utils.h for its format).
+ *		2. Opening it for writing lets user write such a snapshot back,
+ *		   every complete row is restored as soon as it's written.
+ **/
+
+/**
+ *	The device open function - called each time the device is opened.
+ *	Opening for both reading & writing isn't allowed.
+ *
+ *	Returns 0 on success, negative number if failed.
+ **/
+int conn_snapshot_open(struct inode* inodep, struct file* filp){
+	conn_snapshot_file_t* snap_file;
+	conn_snapshot_hdr_t* hdr;
+	unsigned int max_rows;
+	struct timespec ts = { .tv_sec = 0,.tv_nsec = 0};
+
+	if ((filp->f_mode & FMODE_READ) && (filp->f_mode & FMODE_WRITE)) {
+		printk(KERN_ERR "Error: conn_tab device can be opened either for reading or for writing.\n");
+		return -EINVAL;
+	}
+
+	if ((snap_file = kmalloc(sizeof(conn_snapshot_file_t), GFP_KERNEL)) == NULL) {
+		printk(KERN_ERR "Failed allocating space for conn_tab device's state.\n");
+		return -ENOMEM;
+	}
+	memset(snap_file, 0, sizeof(conn_snapshot_file_t));
+
+	if (filp->f_mode & FMODE_READ) {
+		//Some spare rows, for rows added while we allocate:
+		max_rows = min_t(unsigned int, get_num_of_conn_rows() + 16, MAX_CONN_SNAPSHOT_ROWS);
+		snap_file->snapshot = vmalloc(sizeof(conn_snapshot_hdr_t) + max_rows*sizeof(conn_snapshot_row_t));
+		if (snap_file->snapshot == NULL) {
+			printk(KERN_ERR "Failed allocating space for connection-table snapshot.\n");
+			kfree(snap_file);
+			return -ENOMEM;
+		}
+
+		hdr = (conn_snapshot_hdr_t*)snap_file->snapshot;
+		hdr->magic = CONN_SNAPSHOT_MAGIC;
+		hdr->version = CONN_SNAPSHOT_VERSION;
+		getnstimeofday(&ts);
+		hdr->export_time = (__u64)ts.tv_sec;
+		hdr->num_of_rows = export_conn_rows(
+				(conn_snapshot_row_t*)(snap_file->snapshot + sizeof(conn_snapshot_hdr_t)),
+				max_rows);
+		snap_file->snapshot_len = sizeof(conn_snapshot_hdr_t) +
+				hdr->num_of_rows*sizeof(conn_snapshot_row_t);
+	}
+
+	filp->private_data = snap_file;
+	return 0;
+}
+
+/**
+ *	The device read function - copies the snapshot taken when device was
+ *	opened to buffer, starting at *offset.
+ *
+ *	Returns number of bytes copied, 0 when whole snapshot was read,
+ *	negative number if failed.
+ **/
+ssize_t conn_snapshot_read(struct file* filp, char* buffer, size_t len, loff_t* offset){
+	conn_snapshot_file_t* snap_file = (conn_snapshot_file_t*)filp->private_data;
+
+	if (snap_file == NULL || snap_file->snapshot == NULL) {
+		return -EINVAL;
+	}
+
+	return simple_read_from_buffer(buffer, len, offset, snap_file->snapshot,
+			snap_file->snapshot_len);
+}
+
+/**
+ *	Helper function: copies up to "len" bytes from user's buffer to the
+ *	end of dst (of dst_size bytes, snap_file->pending_len of them were
+ *	already written).
+ *
+ *	Returns number of bytes copied, negative number if failed.
+ **/
+static ssize_t fill_pending(conn_snapshot_file_t* snap_file, char* dst,
+		size_t dst_size, const char* buffer, size_t len)
+{
+	size_t to_copy = min_t(size_t, len, dst_size - snap_file->pending_len);
+
+	if (copy_from_user(dst + snap_file->pending_len, buffer, to_copy)) {
+		return -EFAULT;
+	}
+	snap_file->pending_len += to_copy;
+	return to_copy;
+}
+
+/**
+ *	The device write function - gets (a part of) a snapshot, in the format
+ *	conn_snapshot_read() returns it.
+ *	Every row is restored once all its bytes were written, with the time
+ *	that passed since the snapshot was taken subtracted from its
+ *	remaining_seconds (rows that timedout since then aren't restored).
+ *
+ *	Returns number of bytes "written", negative number if failed
+ *	(invalid header / snapshot older than TIMEOUT_SECONDS / too many rows).
+ **/
+ssize_t conn_snapshot_write(struct file* filp, const char* buffer, size_t len, loff_t* offset){
+	conn_snapshot_file_t* snap_file = (conn_snapshot_file_t*)filp->private_data;
+	size_t written = 0;
+	ssize_t ret;
+	struct timespec ts = { .tv_sec = 0,.tv_nsec = 0};
+
+	if (snap_file == NULL || snap_file->snapshot != NULL) {
+		return -EINVAL;
+	}
+
+	while (written < len) {
+
+		if (!snap_file->hdr_is_valid) {
+			if ((ret = fill_pending(snap_file, (char*)&snap_file->hdr,
+					sizeof(conn_snapshot_hdr_t), buffer + written, len - written)) < 0)
+			{
+				return ret;
+			}
+			written += ret;
+			if (snap_file->pending_len < sizeof(conn_snapshot_hdr_t)) {
+				break;
+			}
+			if (snap_file->hdr.magic != CONN_SNAPSHOT_MAGIC ||
+				snap_file->hdr.version != CONN_SNAPSHOT_VERSION ||
+				snap_file->hdr.num_of_rows > MAX_CONN_SNAPSHOT_ROWS)
+			{
+				printk(KERN_ERR "Error: user wrote an invalid connection-table snapshot header.\n");
+				return -EINVAL;
+			}
+			getnstimeofday(&ts);
+			//A clock that went backwards counts as no time passed:
+			snap_file->elapsed_seconds = ((__u64)ts.tv_sec > snap_file->hdr.export_time) ?
+					(unsigned long)((__u64)ts.tv_sec - snap_file->hdr.export_time) : 0;
+			if (snap_file->elapsed_seconds >= TIMEOUT_SECONDS) {
+				printk(KERN_ERR "Error: connection-table snapshot was taken %lu seconds ago, all its rows timedout.\n",
+						snap_file->elapsed_seconds);
+				return -EINVAL;
+			}
+			snap_file->hdr_is_valid = true;
+			snap_file->pending_len = 0;
+			continue;
+		}
+
+		if (snap_file->num_of_rows_written == snap_file->hdr.num_of_rows) {
+			printk(KERN_ERR "Error: user wrote more rows than connection-table snapshot's header declared.\n");
+			return (written > 0) ? (ssize_t)written : -EINVAL;
+		}
+
+		if ((ret = fill_pending(snap_file, (char*)&snap_file->pending_row,
+				sizeof(conn_snapshot_row_t), buffer + written, len - written)) < 0)
+		{
+			return ret;
+		}
+		written += ret;
+		if (snap_file->pending_len < sizeof(conn_snapshot_row_t)) {
+			break;
+		}
+
+		++snap_file->num_of_rows_written;
+		if (import_conn_row(&snap_file->pending_row, snap_file->elapsed_seconds)) {
+			++snap_file->num_of_rows_restored;
+		}
+		snap_file->pending_len = 0;
+	}
+
+	return written;
+}
+
+/**
+ *	The device release function - called whenever the device is
+ *	closed/released by the userspace program.
+ *	Frees the snapshot, and reports how many rows were restored (if
+ *	device was written).
+ **/
+int conn_snapshot_release(struct inode* inodep, struct file* filp){
+	conn_snapshot_file_t* snap_file = (conn_snapshot_file_t*)filp->private_data;
+
+	if (snap_file == NULL) {
+		return 0;
+	}
+
+	if (snap_file->snapshot != NULL) {
+		vfree(snap_file->snapshot);
+	} else if (snap_file->hdr_is_valid) {
+		printk(KERN_INFO "fw_conn_tab: restored %u of %u connection-rows.\n",
+				snap_file->num_of_rows_restored, snap_file->hdr.num_of_rows);
+	}
+
+	kfree(snap_file);
+	filp->private_data = NULL;
+	return 0;
+}
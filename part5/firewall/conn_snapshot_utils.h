@@ -0,0 +1,66 @@
+#ifndef _CONN_SNAPSHOT_UTILS_H_
+#define _CONN_SNAPSHOT_UTILS_H_
+
+#include "fw.h"
+#include <linux/vmalloc.h>
+
+/**
+ *	Binary snapshot of the connection-table, read from / written to the
+ *	conn_tab char-device (/dev/fw):
+ *		<conn_snapshot_hdr_t><conn_snapshot_row_t>*num_of_rows
+ *	All fields are in LOCAL endianness (ips & ports too, like in
+ *	connection_row_t).
+ *	A row's remaining_seconds is counted from export_time, so writing a
+ *	snapshot back subtracts the time that passed since then (a snapshot
+ *	older than TIMEOUT_SECONDS is rejected, all its rows timedout).
+ **/
+#define CONN_SNAPSHOT_MAGIC (0x54435746)	// "FWCT" (in little endian)
+#define CONN_SNAPSHOT_VERSION (2)
+#define MAX_CONN_SNAPSHOT_ROWS (65536)
+
+typedef struct {
+	__u32	magic;
+	__u32	version;
+	__u32	num_of_rows;
+	__u64	export_time;			// Seconds since epoch (getnstimeofday()), when snapshot was taken
+} __attribute__((packed)) conn_snapshot_hdr_t;
+
+typedef struct {
+	__u32	src_ip;
+	__u16	src_port;
+	__u32	dst_ip;
+	__u16	dst_port;
+	__u8	tcp_state;
+	__u8	remaining_seconds;		// Until the row timesout, 1..TIMEOUT_SECONDS
+	__u32	fake_src_ip;
+	__u16	fake_src_port;
+	__u32	fake_dst_ip;
+	__u16	fake_dst_port;
+	__u8	need_to_fake_connection;
+	__u8	fake_tcp_state;
+} __attribute__((packed)) conn_snapshot_row_t;
+
+//State of an opened conn_tab char-device (saved in its file's private_data):
+typedef struct {
+
+	//When opened for reading - the snapshot taken when device was opened:
+	char*				snapshot;
+	size_t				snapshot_len;
+
+	//When opened for writing - the part of the snapshot written so far:
+	conn_snapshot_hdr_t	hdr;
+	conn_snapshot_row_t	pending_row;
+	size_t				pending_len;	// Bytes of hdr/pending_row written so far
+	bool				hdr_is_valid;
+	unsigned long		elapsed_seconds;	// Since the written snapshot was taken
+	__u32				num_of_rows_written;
+	__u32				num_of_rows_restored;
+
+} conn_snapshot_file_t;
+
+int conn_snapshot_open(struct inode* inodep, struct file* filp);
+ssize_t conn_snapshot_read(struct file* filp, char* buffer, size_t len, loff_t* offset);
+ssize_t conn_snapshot_write(struct file* filp, const char* buffer, size_t len, loff_t* offset);
+int conn_snapshot_release(struct inode* inodep, struct file* filp);
+
+#endif /* _CONN_SNAPSHOT_UTILS_H_ */
@@ -0,0 +1,292 @@
+#include "conn_tab_utils.h"
+
+/**
+ *	Recorded messages are kept in g_sync_ring until the sync daemon reads
+ *	them. When the ring is full, all pending messages are thrown away and
+ *	the reader gets a CONN_SYNC_OP_OVERRUN message instead - it should
+ *	then send a full snapshot of the table to its peer.
+ **/
+atomic_t g_conn_sync_active = ATOMIC_INIT(0);
+
+static conn_sync_msg_t* g_sync_ring = NULL;
+static unsigned int g_sync_head = 0;	// Next index to write
+static unsigned int g_sync_tail = 0;	// Next index to read
+static __u32 g_sync_seq = 0;
+static bool g_sync_overrun = false;
+static unsigned long g_num_of_sync_overruns = 0;
+static unsigned long g_num_of_sync_applied = 0;
+static DEFINE_SPINLOCK(g_sync_lock);
+
+static int conn_sync_dev_major_number = 0;
+static struct device* conn_sync_device = NULL;
+
+// Prototype functions declarations for the character driver - must come before the struct definition
+static int conn_sync_dev_open(struct inode* inodep, struct file* filp);
+static ssize_t conn_sync_dev_read(struct file* filp, char* buffer, size_t len, loff_t* offset);
+static ssize_t conn_sync_dev_write(struct file* filp, const char* buffer, size_t len, loff_t* offset);
+static int conn_sync_dev_release(struct inode* inodep, struct file* filp);
+
+static struct file_operations conn_sync_fops = {
+	.owner = THIS_MODULE,
+	.open = conn_sync_dev_open,
+	.read = conn_sync_dev_read,
+	.write = conn_sync_dev_write,
+	.release = conn_sync_dev_release
+};
+
+/**
+ *	Records a change in the connection-table, to be read by the sync daemon.
+ *	Does nothing if no daemon reads /dev/fw_conn_sync.
+ *
+ *	@op - the change
+ *	@snap_row - the changed row (see export_conn_rows())
+ **/
+void record_conn_sync_event(conn_sync_op_t op, const conn_snapshot_row_t* snap_row){
+	conn_sync_msg_t* msg;
+
+	if (!is_conn_sync_active() || snap_row == NULL) {
+		return;
+	}
+
+	spin_lock_bh(&g_sync_lock);
+
+	if (g_sync_head - g_sync_tail == CONN_SYNC_RING_SIZE) {
+		//Ring is full: pending messages are useless now, reader should resync
+		g_sync_tail = g_sync_head;
+		g_sync_overrun = true;
+		++g_num_of_sync_overruns;
+	}
+
+	msg = &g_sync_ring[g_sync_head & (CONN_SYNC_RING_SIZE - 1)];
+	msg->seq = g_sync_seq++;
+	msg->op = (__u8)op;
+	msg->row = *snap_row;
+	++g_sync_head;
+
+	spin_unlock_bh(&g_sync_lock);
+}
+
+/**
+ *	The device open function - called each time the device is opened.
+ *	Only one reader is allowed at a time, opening for both reading &
+ *	writing isn't allowed.
+ *
+ *	Returns 0 on success, negative number if failed.
+ **/
+static int conn_sync_dev_open(struct inode* inodep, struct file* filp){
+
+	if ((filp->f_mode & FMODE_READ) && (filp->f_mode & FMODE_WRITE)) {
+		printk(KERN_ERR "Error: conn_sync device can be opened either for reading or for writing.\n");
+		return -EINVAL;
+	}
+
+	if (filp->f_mode & FMODE_READ) {
+		if (atomic_cmpxchg(&g_conn_sync_active, 0, 1) != 0) {
+			return -EBUSY;
+		}
+		//Starts recording from now on:
+		spin_lock_bh(&g_sync_lock);
+		g_sync_tail = g_sync_head;
+		g_sync_overrun = false;
+		spin_unlock_bh(&g_sync_lock);
+	}
+
+	return 0;
+}
+
+/**
+ *	The device read function - copies as many whole recorded messages as
+ *	fit in buffer.
+ *	If messages were lost since last read, the first message copied is
+ *	a CONN_SYNC_OP_OVERRUN message.
+ *
+ *	Returns number of bytes copied (0 if there's nothing to read),
+ *	negative number if failed.
+ **/
+static ssize_t conn_sync_dev_read(struct file* filp, char* buffer, size_t len, loff_t* offset){
+	conn_sync_msg_t* msgs;
+	size_t max_msgs = min_t(size_t, len / sizeof(conn_sync_msg_t), CONN_SYNC_RING_SIZE);
+	size_t num_of_msgs = 0;
+	ssize_t ret;
+
+	if (max_msgs == 0) {
+		return -EINVAL;
+	}
+
+	//Copy to a temporary buffer, since copy_to_user might sleep:
+	if ((msgs = vmalloc(max_msgs * sizeof(conn_sync_msg_t))) == NULL) {
+		return -ENOMEM;
+	}
+
+	spin_lock_bh(&g_sync_lock);
+	if (g_sync_overrun) {
+		memset(&msgs[0], 0, sizeof(conn_sync_msg_t));
+		msgs[0].seq = g_sync_seq;
+		msgs[0].op = CONN_SYNC_OP_OVERRUN;
+		g_sync_overrun = false;
+		++num_of_msgs;
+	}
+	while (num_of_msgs < max_msgs && g_sync_tail != g_sync_head) {
+		msgs[num_of_msgs++] = g_sync_ring[g_sync_tail & (CONN_SYNC_RING_SIZE - 1)];
+		++g_sync_tail;
+	}
+	spin_unlock_bh(&g_sync_lock);
+
+	ret = num_of_msgs * sizeof(conn_sync_msg_t);
+	if (num_of_msgs > 0 && copy_to_user(buffer, msgs, ret) != 0) {
+		printk(KERN_INFO "Function copy_to_user failed - writing sync messages to user's buffer failed\n");
+		ret = -EFAULT;
+	}
+
+	vfree(msgs);
+	return ret;
+}
+
+/**
+ *	The device write function - gets messages (as read from a peer's
+ *	/dev/fw_conn_sync) and applies them to the connection-table.
+ *	Buffer should contain whole messages only.
+ *
+ *	Returns len on success, negative number if failed.
+ **/
+static ssize_t conn_sync_dev_write(struct file* filp, const char* buffer, size_t len, loff_t* offset){
+	conn_sync_msg_t msg;
+	size_t i;
+
+	if (len == 0 || (len % sizeof(conn_sync_msg_t)) != 0) {
+		printk(KERN_ERR "*** Error: user sent invalid input format to conn_sync device ***\n");
+		return -EINVAL;
+	}
+
+	for (i = 0; i < len; i += sizeof(conn_sync_msg_t)) {
+		if (copy_from_user(&msg, buffer + i, sizeof(conn_sync_msg_t))) {
+			return -EFAULT;
+		}
+
+		switch (msg.op) {
+			case (CONN_SYNC_OP_CREATE):
+			case (CONN_SYNC_OP_UPDATE):
+				import_conn_row(&msg.row, 0);	//Sent as soon as it changed
+				break;
+			case (CONN_SYNC_OP_DELETE):
+				delete_conn_row_by_tuple(&msg.row);
+				break;
+			case (CONN_SYNC_OP_FLUSH):
+				delete_all_conn_rows();	//Takes the table's lock
+				break;
+			default: //CONN_SYNC_OP_OVERRUN is handled by the peer's daemon
+				break;
+		}
+		++g_num_of_sync_applied;
+	}
+
+	return len;
+}
+
+/**
+ *	The device release function - stops recording if it's the reader.
+ **/
+static int conn_sync_dev_release(struct inode* inodep, struct file* filp){
+	if (filp->f_mode & FMODE_READ) {
+		atomic_set(&g_conn_sync_active, 0);
+	}
+	return 0;
+}
+
+ /**
+ *	This function will be called when user tries to read from "conn_sync_stats"
+ *
+ *  NOTE: writes to "buf", in (string) format:
+ * 		<active (0/1)> <next seq> <pending messages> <overruns> <messages applied>
+ **/
+ssize_t read_conn_sync_stats(struct device* dev, struct device_attribute* attr, char* buf){
+		ssize_t ret;
+
+		spin_lock_bh(&g_sync_lock);
+		ret = scnprintf(buf, PAGE_SIZE, "%d %u %u %lu %lu",
+				atomic_read(&g_conn_sync_active), g_sync_seq,
+				g_sync_head - g_sync_tail, g_num_of_sync_overruns,
+				g_num_of_sync_applied);
+		spin_unlock_bh(&g_sync_lock);
+
+		if (ret <= 0){
+			printk(KERN_ERR "*** Error: failed writing to user's buffer in function read_conn_sync_stats() ***\n");
+		}
+		return ret;
+}
+
+/**
+ * 	Declaring a variable of type struct device_attribute, its name would be "dev_attr_conn_sync_stats"
+ * 		.attr.mode = S_IRUSR | S_IROTH, giving the owner and other user read permissions
+ * 		.show = read_conn_sync_stats() function
+ * 		.store = NULL (no writing function)
+ **/
+static DEVICE_ATTR(conn_sync_stats, S_IRUSR | S_IROTH, read_conn_sync_stats, NULL);
+
+/**
+ * Help function that cleans up everything associated with creating this device,
+ * According to the state that's been given.
+ **/
+static void destroyConnSyncDevice(struct class* fw_class, enum s_state_to_fold stateToFold){
+	switch (stateToFold){
+		case(S_ALL_DES):
+			device_remove_file(conn_sync_device, (const struct device_attribute *)&dev_attr_conn_sync_stats.attr);
+		case(S_RING_DES):
+			vfree(g_sync_ring);
+			g_sync_ring = NULL;
+		case(S_DEVICE_DES):
+			device_destroy(fw_class, MKDEV(conn_sync_dev_major_number, MINOR_CONN_SYNC));
+		case (S_UNREG_DES):
+			unregister_chrdev(conn_sync_dev_major_number, DEVICE_NAME_CONN_SYNC);
+	}
+}
+
+/**
+ *	Initiates conn_sync-device.
+ *	Returns: 0 on success, -1 if failed.
+ *
+ *	Note: user should destroy fw_class if this function returned -1!
+ **/
+int init_conn_sync_device(struct class* fw_class){
+
+	//Create char device
+	conn_sync_dev_major_number = register_chrdev(0, DEVICE_NAME_CONN_SYNC, &conn_sync_fops);
+	if (conn_sync_dev_major_number < 0){
+		printk(KERN_ERR "Error: failed registering connection sync char device.\n");
+		return -1;
+	}
+
+	conn_sync_device = device_create(fw_class, NULL, MKDEV(conn_sync_dev_major_number, MINOR_CONN_SYNC), NULL, CLASS_NAME "_" DEVICE_NAME_CONN_SYNC);
+	if (IS_ERR(conn_sync_device))
+	{
+		printk(KERN_ERR "Error: failed creating connection sync char-device.\n");
+		destroyConnSyncDevice(fw_class, S_UNREG_DES);
+		return -1;
+	}
+
+	if ((g_sync_ring = vmalloc(CONN_SYNC_RING_SIZE * sizeof(conn_sync_msg_t))) == NULL)
+	{
+		printk(KERN_ERR "Error: failed allocating connection sync ring.\n");
+		destroyConnSyncDevice(fw_class, S_DEVICE_DES);
+		return -1;
+	}
+
+	if (device_create_file(conn_sync_device, (const struct device_attribute *)&dev_attr_conn_sync_stats.attr))
+	{
+		printk(KERN_ERR "Error: failed creating conn_sync_stats-sysfs-file inside connection sync char-device.\n");
+		destroyConnSyncDevice(fw_class, S_RING_DES);
+		return -1;
+	}
+
+	printk(KERN_INFO "fw_conn_sync: device successfully initiated.\n");
+
+	return 0;
+}
+
+/**
+ *	Destroys conn_sync-device
+ **/
+void destroy_conn_sync_device(struct class* fw_class){
+	destroyConnSyncDevice(fw_class, S_ALL_DES);
+	printk(KERN_INFO "fw_conn_sync: device destroyed.\n");
+}
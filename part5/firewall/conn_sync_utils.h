@@ -0,0 +1,58 @@
+#ifndef _CONN_SYNC_UTILS_H_
+#define _CONN_SYNC_UTILS_H_
+
+#include "fw.h"
+#include "conn_snapshot_utils.h"
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/atomic.h>
+
+/**
+ *	Connection-state replication (between an active & a standby firewall):
+ *	while a sync daemon reads /dev/fw_conn_sync, every change in the
+ *	connection-table is recorded there as a conn_sync_msg_t.
+ *	On the standby, the daemon writes those messages back to
+ *	/dev/fw_conn_sync, and they're applied to its own table.
+ **/
+#define CONN_SYNC_RING_SIZE (4096)	// Must be a power of 2
+
+typedef enum {
+	CONN_SYNC_OP_CREATE		= 1,	// Row was added
+	CONN_SYNC_OP_UPDATE		= 2,	// Row's (fake) tcp state / fake details changed
+	CONN_SYNC_OP_DELETE		= 3,	// Row was deleted
+	CONN_SYNC_OP_FLUSH		= 4,	// All rows were deleted
+	CONN_SYNC_OP_OVERRUN	= 5		// Reader was too slow, messages were lost (read only)
+} conn_sync_op_t;
+
+//A change in the connection-table, all fields are in LOCAL endianness:
+typedef struct {
+	__u32				seq;	// Increases by 1 for every recorded message
+	__u8				op;		// conn_sync_op_t
+	conn_snapshot_row_t	row;	// Only the tuple is relevant for delete/flush/overrun
+} __attribute__((packed)) conn_sync_msg_t;
+
+//Enum that helps "folding" up stages,
+//used when: 1. initiating device stopped because of some error
+//			 2. device is destroyed.
+enum s_state_to_fold {
+	S_UNREG_DES,
+	S_DEVICE_DES,
+	S_RING_DES,
+	S_ALL_DES
+};
+
+extern atomic_t g_conn_sync_active;
+
+/**
+ *	Returns true if changes should be recorded
+ *	(a sync daemon has /dev/fw_conn_sync open for reading)
+ **/
+static inline bool is_conn_sync_active(void){
+	return (atomic_read(&g_conn_sync_active) != 0);
+}
+
+void record_conn_sync_event(conn_sync_op_t op, const conn_snapshot_row_t* snap_row);
+int init_conn_sync_device(struct class* fw_class);
+void destroy_conn_sync_device(struct class* fw_class);
+
+#endif /* _CONN_SYNC_UTILS_H_ */
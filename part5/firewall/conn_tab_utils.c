@@ -1,13 +1,57 @@
 #include "conn_tab_utils.h"
+#include "fw_trace.h"
 
 //Declares (static) g_connections_list of type struct list_head:
 static LIST_HEAD(g_connections_list); 
 
+/**
+ *	g_connections_list is read under rcu_read_lock() only, every change
+ *	of the list (adding/deleting a row) is done holding g_conn_tab_lock.
+ *	A deleted row is marked "dead" (so it's deleted once, even if a few
+ *	cpus find it timedout together), and freed only after an RCU grace
+ *	period - so rows found by search_relevant_rows() can be used for as
+ *	long as the caller holds rcu_read_lock().
+ **/
+static DEFINE_SPINLOCK(g_conn_tab_lock);
+
+/**
+ *	Per-cpu cache of the last flow found by search_relevant_rows().
+ *	Every deleted row is cleared from all cpus' entries before it's freed
+ *	(see invalidate_last_flow_caches()), so a cached row is never
+ *	dereferenced after it was freed, and adding rows doesn't touch
+ *	the caches at all.
+ **/
+static DEFINE_PER_CPU(last_flow_cache_t, g_last_flow);
+static DEFINE_PER_CPU(unsigned long, g_last_flow_hits);
+static DEFINE_PER_CPU(unsigned long, g_last_flow_misses);
+
+//See check_established_tcp_packet():
+static bool g_conn_fast_path = true;
+module_param_named(conn_fast_path, g_conn_fast_path, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(conn_fast_path, "Accept packets of plain established TCP connections without the full checks (and without logging them)");
+
+/**
+ *	Connection-table statistics: counters are per-cpu, so updating them
+ *	costs nothing but an increment. The number of rows is shared (it's
+ *	needed for the peak value).
+ *	Counters are only exported as totals (since module's load), rates
+ *	are calculated by the reader (so concurrent readers don't disturb
+ *	each other's rates).
+ **/
+static DEFINE_PER_CPU(conn_tab_stats_t, g_conn_stats);
+static atomic_t g_num_of_conn_rows = ATOMIC_INIT(0);
+static unsigned int g_peak_conn_rows = 0;
+
 static int conn_tab_dev_major_number = 0;
 static struct device* conn_tab_device = NULL;
 
+//Reading/writing the device saves/restores a snapshot of the table (see conn_snapshot_utils.h):
 static struct file_operations conn_tab_fops = {
-	.owner = THIS_MODULE
+	.owner = THIS_MODULE,
+	.open = conn_snapshot_open,
+	.read = conn_snapshot_read,
+	.write = conn_snapshot_write,
+	.release = conn_snapshot_release
 };
 
 //Function declaration:
@@ -127,39 +171,186 @@ static void print_conn_row(connection_row_t* conn_row){
 
 
 /**
- *	Deletes a specific row from connection-list, by specific node
- * 
- *	@node - a pointer to the relevant list_head object to be deleted. 
- * 
- *	NOTE: USE SAFELY!! (WITH "list_for_each_safe()")
+ *	Helper function: copies row's details to snap_row,
+ *	remaining_seconds is the time left (at "now") until row timesout,
+ *	but at least 1 (so a timedout row is still a valid snapshot row).
  **/
-static void delete_specific_row_by_list_node(struct list_head* node){
-	connection_row_t* temp_row;
-	if (node == NULL) {
-		printk(KERN_ERR "In delete_specific_row_by_list_node(), function got NULL argument\n");
+static void fill_snapshot_row(conn_snapshot_row_t* snap_row,
+		connection_row_t* row, unsigned long now)
+{
+	unsigned long age = now - row->timestamp;
+
+	snap_row->src_ip = row->src_ip;
+	snap_row->src_port = row->src_port;
+	snap_row->dst_ip = row->dst_ip;
+	snap_row->dst_port = row->dst_port;
+	snap_row->tcp_state = (__u8)row->tcp_state;
+	snap_row->remaining_seconds = (age >= TIMEOUT_SECONDS) ? 1 : (__u8)(TIMEOUT_SECONDS - age);
+	snap_row->fake_src_ip = row->fake_src_ip;
+	snap_row->fake_src_port = row->fake_src_port;
+	snap_row->fake_dst_ip = row->fake_dst_ip;
+	snap_row->fake_dst_port = row->fake_dst_port;
+	snap_row->need_to_fake_connection = row->need_to_fake_connection ? 1 : 0;
+	snap_row->fake_tcp_state = (__u8)row->fake_tcp_state;
+}
+
+/**
+ *	Records a change of row, to be replicated to a standby firewall
+ *	(does nothing if no sync daemon is running, see conn_sync_utils.h)
+ **/
+static void sync_conn_row(conn_sync_op_t op, connection_row_t* row){
+	conn_snapshot_row_t snap_row;
+	struct timespec ts = { .tv_sec = 0,.tv_nsec = 0};
+
+	if (!is_conn_sync_active() || row == NULL) {
 		return;
 	}
-	temp_row = list_entry(node, connection_row_t, list);
-	list_del(node);
-	kfree(temp_row);
-} 
+
+	getnstimeofday(&ts);
+	fill_snapshot_row(&snap_row, row, ts.tv_sec);
+	record_conn_sync_event(op, &snap_row);
+}
+
+/**
+ *	Records row's change if its tcp_state / fake_tcp_state isn't
+ *	old_tcp_state / old_fake_tcp_state anymore (row might be NULL)
+ **/
+static void sync_conn_row_if_changed(connection_row_t* row,
+		tcp_state_t old_tcp_state, tcp_state_t old_fake_tcp_state)
+{
+	if (row != NULL && (row->tcp_state != old_tcp_state ||
+			row->fake_tcp_state != old_fake_tcp_state))
+	{
+		sync_conn_row(CONN_SYNC_OP_UPDATE, row);
+	}
+}
+
+/**
+ *	Changes a listed row's tcp_state (traces the change, if any).
+ *	Every transition of a row's state machine goes through here.
+ **/
+static inline void set_conn_row_tcp_state(connection_row_t* row, tcp_state_t tcp_state){
+	tcp_state_t old_tcp_state = row->tcp_state;
+
+	row->tcp_state = tcp_state;
+	if (old_tcp_state != tcp_state) {
+		trace_fw_conn_state(row, old_tcp_state, row->fake_tcp_state);
+	}
+}
+
+/**
+ *	Changes a listed row's fake_tcp_state (traces the change, if any)
+ **/
+static inline void set_conn_row_fake_tcp_state(connection_row_t* row, tcp_state_t fake_tcp_state){
+	tcp_state_t old_fake_tcp_state = row->fake_tcp_state;
+
+	row->fake_tcp_state = fake_tcp_state;
+	if (old_fake_tcp_state != fake_tcp_state) {
+		trace_fw_conn_state(row, row->tcp_state, old_fake_tcp_state);
+	}
+}
+
+/**
+ *	Should be called whenever a row is added to g_connections_list:
+ *	updates statistics.
+ **/
+static inline void conn_row_added(void){
+	unsigned int num_of_rows = (unsigned int)atomic_inc_return(&g_num_of_conn_rows);
+
+	this_cpu_inc(g_conn_stats.inserts);
+	//Might miss a concurrent insertion, good enough for a statistic:
+	if (num_of_rows > g_peak_conn_rows) {
+		g_peak_conn_rows = num_of_rows;
+	}
+}
+
+/**
+ *	Adds a new (initialized) row to g_connections_list
+ **/
+static void add_conn_row_to_list(connection_row_t* row){
+	INIT_LIST_HEAD(&(row->list));
+	row->dead = false;
+
+	spin_lock_bh(&g_conn_tab_lock);
+	list_add_rcu(&(row->list), &g_connections_list);
+	spin_unlock_bh(&g_conn_tab_lock);
+
+	conn_row_added();
+	trace_fw_conn_create(row);
+}
+
+/**
+ *	Clears a (deleted) row from all cpus' last-flow caches.
+ *	Row should already be marked dead: a cpu that caches it concurrently
+ *	sees that and clears its own entry (see update_last_flow_cache()).
+ **/
+static void invalidate_last_flow_caches(connection_row_t* row){
+	last_flow_cache_t* entry;
+	unsigned int cpu;
+
+	smp_mb();	//Pairs with update_last_flow_cache()
+	for_each_possible_cpu(cpu) {
+		entry = per_cpu_ptr(&g_last_flow, cpu);
+		cmpxchg(&entry->conn_row, row, NULL);
+		cmpxchg(&entry->opposite_conn_row, row, NULL);
+	}
+}
+
+/**
+ *	Helper function: takes an (alive) row off g_connections_list.
+ *	NOTE: caller should hold g_conn_tab_lock!
+ **/
+static void unlink_conn_row(connection_row_t* row){
+	row->dead = true;
+	list_del_rcu(&(row->list));
+	atomic_dec(&g_num_of_conn_rows);
+	this_cpu_inc(g_conn_stats.deletes);
+}
 
 /**
  *	Deletes a specific row from connection-list, by specific connection_row_t
  * 
  *	@row - a pointer to the relevant row to be deleted. 
  * 
- *	NOTE: USE SAFELY!! (WITH "list_for_each_safe()")
+ *	NOTE: 1. caller should hold rcu_read_lock() (row might be freed otherwise)
+ *		  2. row might be deleted by another cpu at the same time, only one
+ *			 of them deletes it.
+ *
+ *	Returns true if row was deleted by this call, false if it was already
+ *	deleted.
  **/
-static void delete_specific_row_by_conn_ptr(connection_row_t* row){
+static bool delete_specific_row_by_conn_ptr(connection_row_t* row){
 	if (row == NULL) {
 		printk(KERN_ERR "In delete_specific_row_by_conn_ptr(), function got NULL argument\n");
-		return;
+		return false;
+	}
+
+	spin_lock_bh(&g_conn_tab_lock);
+	if (row->dead) {
+		spin_unlock_bh(&g_conn_tab_lock);
+		return false;
 	}
-	list_del(&(row->list));
-	kfree(row);
+	unlink_conn_row(row);
+	spin_unlock_bh(&g_conn_tab_lock);
+
+	invalidate_last_flow_caches(row);
+	sync_conn_row(CONN_SYNC_OP_DELETE, row);
+	trace_fw_conn_delete(row);
+	kfree_rcu(row, rcu);
+	return true;
 } 
 
+/**
+ *	Deletes a row that timedout (found while passing over g_connections_list).
+ *	NOTE: caller should hold rcu_read_lock()
+ **/
+static void expire_conn_row(connection_row_t* row){
+	if (delete_specific_row_by_conn_ptr(row)) {
+		this_cpu_inc(g_conn_stats.expiries);
+		trace_fw_conn_expire(row);
+	}
+}
+
 /**
  *	Deletes all connection-rows from g_connections_list
  *	(frees all allocated memory)
@@ -167,11 +358,21 @@ static void delete_specific_row_by_conn_ptr(connection_row_t* row){
 void delete_all_conn_rows(void){
 
 	connection_row_t *row, *temp_row;
+
+	if (is_conn_sync_active() && !list_empty(&g_connections_list)) {
+		conn_snapshot_row_t snap_row;
+		memset(&snap_row, 0, sizeof(conn_snapshot_row_t));
+		record_conn_sync_event(CONN_SYNC_OP_FLUSH, &snap_row);
+	}
 	
+	spin_lock_bh(&g_conn_tab_lock);
 	list_for_each_entry_safe(row, temp_row, &g_connections_list, list) {
-		list_del(&row->list);
-		kfree(row);
+		unlink_conn_row(row);
+		invalidate_last_flow_caches(row);
+		trace_fw_conn_delete(row);
+		kfree_rcu(row, rcu);
 	}
+	spin_unlock_bh(&g_conn_tab_lock);
 
 }
 
@@ -201,7 +402,6 @@ ssize_t display(struct device *dev, struct device_attribute *attr, char *buf)
 
 	char connections_str[PAGE_SIZE];
 	char conn_row_str[MAX_STRLEN_OF_CONN_ROW_FORMAT];
-	struct list_head *pos, *q;
 	connection_row_t* temp_row;
 	unsigned int offset = 0;
 	int len = 0;
@@ -210,12 +410,16 @@ ssize_t display(struct device *dev, struct device_attribute *attr, char *buf)
 	memset(connections_str, '\0', PAGE_SIZE);
 	
 	//Build connections_str to contain all (not-timeout) connection-rows:
-	list_for_each_safe(pos, q, &g_connections_list){
-		temp_row = list_entry(pos, connection_row_t, list);
+	rcu_read_lock();
+	list_for_each_entry_rcu(temp_row, &g_connections_list, list){
 		
+		if (ACCESS_ONCE(temp_row->dead)) {
+			continue;
+		}
+
 		//If a row is too old - deletes it and continues to next row:
 		if(is_row_timedout(temp_row)){
-			delete_specific_row_by_list_node(pos);
+			expire_conn_row(temp_row);
 			continue;
 		}
 		
@@ -237,6 +441,7 @@ ssize_t display(struct device *dev, struct device_attribute *attr, char *buf)
 					temp_row->fake_dst_port,
 					temp_row->fake_tcp_state)) ) < 11)
 		{
+			rcu_read_unlock();
 			printk(KERN_ERR "Error converting to connection-row format.\n");
 			return -1;
 		}
@@ -251,6 +456,7 @@ ssize_t display(struct device *dev, struct device_attribute *attr, char *buf)
 		}
 
 	}
+	rcu_read_unlock();
 	
 	return scnprintf(buf, PAGE_SIZE, "%s", connections_str);
 }
@@ -264,6 +470,135 @@ ssize_t display(struct device *dev, struct device_attribute *attr, char *buf)
  **/
 static DEVICE_ATTR(conn_tab, S_IRUGO | S_IWUGO, display, write_new_ftp_data_conn_row);
 
+ /**
+ *	This function will be called when user tries to read from "conn_cache_stats"
+ *
+ *  NOTE: writes to "buf" the last-flow cache's counters (summed over all
+ *		  cpus), in (string) format:
+ * 		<number of hits> <number of misses>
+ **/
+ssize_t read_conn_cache_stats(struct device* dev, struct device_attribute* attr, char* buf){
+		unsigned long hits = 0, misses = 0;
+		ssize_t ret;
+		int cpu;
+
+		for_each_possible_cpu(cpu) {
+			hits += per_cpu(g_last_flow_hits, cpu);
+			misses += per_cpu(g_last_flow_misses, cpu);
+		}
+
+		ret = scnprintf(buf, PAGE_SIZE, "%lu %lu", hits, misses);
+		if (ret <= 0){
+			printk(KERN_ERR "*** Error: failed writing to user's buffer in function read_conn_cache_stats() ***\n");
+		}
+		return ret;
+}
+
+/**
+ * 	Declaring a variable of type struct device_attribute, its name would be "dev_attr_conn_cache_stats"
+ * 		.attr.mode = S_IRUSR | S_IROTH, giving the owner and other user read permissions
+ * 		.show = read_conn_cache_stats() function
+ * 		.store = NULL (no writing function)
+ **/
+static DEVICE_ATTR(conn_cache_stats, S_IRUSR | S_IROTH, read_conn_cache_stats, NULL);
+
+/**
+ *	Helper function: sums all cpus' connection-table counters into *sum
+ **/
+static void sum_conn_stats(conn_tab_stats_t* sum){
+	conn_tab_stats_t* cpu_stats;
+	int cpu, i;
+
+	memset(sum, 0, sizeof(conn_tab_stats_t));
+	for_each_possible_cpu(cpu) {
+		cpu_stats = &per_cpu(g_conn_stats, cpu);
+		sum->inserts += cpu_stats->inserts;
+		sum->deletes += cpu_stats->deletes;
+		sum->expiries += cpu_stats->expiries;
+		sum->lookups += cpu_stats->lookups;
+		sum->probes += cpu_stats->probes;
+		sum->alloc_failures += cpu_stats->alloc_failures;
+		sum->fast_path_hits += cpu_stats->fast_path_hits;
+		for (i = 0; i < CONN_STATS_NUM_DEPTH_BUCKETS; ++i) {
+			sum->depth_hist[i] += cpu_stats->depth_hist[i];
+		}
+	}
+}
+
+ /**
+ *	This function will be called when user tries to read from "conn_stats"
+ *
+ *  NOTE: writes to "buf" connection-table's statistics, a line per value:
+ *		rows <current number of rows>
+ *		peak_rows <peak number of rows>
+ *		inserts <total>
+ *		deletes <total>
+ *		expiries <total>
+ *		lookups <total>
+ *		avg_probes <average rows passed per lookup, 2 decimal digits>
+ *		alloc_failures <total>
+ *		fast_path <total>	(see check_established_tcp_packet())
+ *		state_rows <rows in TCP_STATE_CLOSED> ... <rows in TCP_STATE_TIME_WAIT>
+ *		probe_depth <0> <1> <2-3> <4-7> <8-15> <16-31> <32-63> <64+>
+ *
+ *	Totals are since module's load, and never decrease: a reader that
+ *	wants rates reads twice (like show_verdicts does).
+ *	Rows being deleted (marked dead) aren't counted in state_rows.
+ **/
+ssize_t read_conn_stats(struct device* dev, struct device_attribute* attr, char* buf){
+		conn_tab_stats_t stats;
+		unsigned long state_rows[TCP_STATE_TIME_WAIT+1];
+		unsigned long avg_probes_x100;
+		connection_row_t* row;
+		ssize_t ret;
+		int i;
+
+		sum_conn_stats(&stats);
+
+		//Rows per TCP state (same way display() passes over the table):
+		memset(state_rows, 0, sizeof(state_rows));
+		rcu_read_lock();
+		list_for_each_entry_rcu(row, &g_connections_list, list) {
+			if (ACCESS_ONCE(row->dead)) {
+				continue;
+			}
+			if (row->tcp_state >= TCP_STATE_CLOSED && row->tcp_state <= TCP_STATE_TIME_WAIT) {
+				++state_rows[row->tcp_state];
+			}
+		}
+		rcu_read_unlock();
+
+		avg_probes_x100 = (stats.lookups == 0) ? 0 : ((stats.probes * 100) / stats.lookups);
+
+		ret = scnprintf(buf, PAGE_SIZE,
+				"rows %d\npeak_rows %u\ninserts %lu\ndeletes %lu\nexpiries %lu\nlookups %lu\navg_probes %lu.%02lu\nalloc_failures %lu\nfast_path %lu\nstate_rows",
+				atomic_read(&g_num_of_conn_rows), g_peak_conn_rows,
+				stats.inserts, stats.deletes, stats.expiries,
+				stats.lookups, avg_probes_x100 / 100, avg_probes_x100 % 100,
+				stats.alloc_failures, stats.fast_path_hits);
+		for (i = TCP_STATE_CLOSED; i <= TCP_STATE_TIME_WAIT; ++i) {
+			ret += scnprintf(buf + ret, PAGE_SIZE - ret, " %lu", state_rows[i]);
+		}
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret, "\nprobe_depth");
+		for (i = 0; i < CONN_STATS_NUM_DEPTH_BUCKETS; ++i) {
+			ret += scnprintf(buf + ret, PAGE_SIZE - ret, " %lu", stats.depth_hist[i]);
+		}
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret, "\n");
+
+		if (ret <= 0){
+			printk(KERN_ERR "*** Error: failed writing to user's buffer in function read_conn_stats() ***\n");
+		}
+		return ret;
+}
+
+/**
+ * 	Declaring a variable of type struct device_attribute, its name would be "dev_attr_conn_stats"
+ * 		.attr.mode = S_IRUSR | S_IROTH, giving the owner and other user read permissions
+ * 		.show = read_conn_stats() function
+ * 		.store = NULL (no writing function)
+ **/
+static DEVICE_ATTR(conn_stats, S_IRUSR | S_IROTH, read_conn_stats, NULL);
+
 /**
  *	Gets a pointer to packet's info, and a connection-row
  *
@@ -303,9 +638,81 @@ static bool packet_fits_opp_conn_row(log_row_t* pckt_lg_info, connection_row_t*
 			 (pckt_lg_info->dst_port == row->src_port) );
 }
 
+/**
+ *	Helper function: checks this cpu's last-flow cache for pckt_lg_info's tuple.
+ *	NOTE: caller should hold rcu_read_lock()
+ *
+ *	Returns true (and updates both pointers) on a valid hit:
+ *	same tuple, none of its rows was deleted (or timedout).
+ **/
+static bool search_last_flow_cache(log_row_t* pckt_lg_info,
+		connection_row_t** ptr_relevant_conn_row,
+		connection_row_t** ptr_relevant_opposite_conn_row)
+{
+	last_flow_cache_t* entry = this_cpu_ptr(&g_last_flow);
+	//Might be cleared by another cpu (see invalidate_last_flow_caches()):
+	connection_row_t* conn_row = ACCESS_ONCE(entry->conn_row);
+	connection_row_t* opposite_conn_row = ACCESS_ONCE(entry->opposite_conn_row);
+
+	if ( conn_row == NULL || opposite_conn_row == NULL ||
+		 entry->src_ip != pckt_lg_info->src_ip ||
+		 entry->src_port != pckt_lg_info->src_port ||
+		 entry->dst_ip != pckt_lg_info->dst_ip ||
+		 entry->dst_port != pckt_lg_info->dst_port )
+	{
+		return false;
+	}
+
+	//A row that's being deleted isn't cleared from caches yet,
+	//a timedout row should be deleted, which only the full search does:
+	if ( ACCESS_ONCE(conn_row->dead) || ACCESS_ONCE(opposite_conn_row->dead) ||
+		 is_row_timedout(conn_row) || is_row_timedout(opposite_conn_row) )
+	{
+		return false;
+	}
+
+	*ptr_relevant_conn_row = conn_row;
+	*ptr_relevant_opposite_conn_row = opposite_conn_row;
+	return true;
+}
+
+/**
+ *	Helper function: saves the result of a full search in this cpu's
+ *	last-flow cache (only flows that have both rows are saved, so adding
+ *	a row never changes the result of a cached flow).
+ *	NOTE: caller should hold rcu_read_lock()
+ **/
+static void update_last_flow_cache(log_row_t* pckt_lg_info,
+		connection_row_t* relevant_conn_row,
+		connection_row_t* relevant_opposite_conn_row)
+{
+	last_flow_cache_t* entry = this_cpu_ptr(&g_last_flow);
+
+	if (relevant_conn_row == NULL || relevant_opposite_conn_row == NULL) {
+		return;
+	}
+
+	entry->src_ip = pckt_lg_info->src_ip;
+	entry->src_port = pckt_lg_info->src_port;
+	entry->dst_ip = pckt_lg_info->dst_ip;
+	entry->dst_port = pckt_lg_info->dst_port;
+	ACCESS_ONCE(entry->conn_row) = relevant_conn_row;
+	ACCESS_ONCE(entry->opposite_conn_row) = relevant_opposite_conn_row;
+
+	//A row deleted meanwhile might have been missed by
+	//invalidate_last_flow_caches(), then its dead flag is seen here:
+	smp_mb();
+	if (ACCESS_ONCE(relevant_conn_row->dead) || ACCESS_ONCE(relevant_opposite_conn_row->dead)) {
+		ACCESS_ONCE(entry->conn_row) = NULL;
+		ACCESS_ONCE(entry->opposite_conn_row) = NULL;
+	}
+}
+
 /**
  *	Passes over g_connections_list in search of connection-rows that are
  * 	relevant to pckt_lg_info's data.
+ *	Checks this cpu's last-flow cache first (bulk transfers send many
+ *	packets of the same flow one after another).
  *
  *	Updates:
  *		1. ptr_relevant_conn_row: to point at the relevant, same direction,
@@ -313,13 +720,15 @@ static bool packet_fits_opp_conn_row(log_row_t* pckt_lg_info, connection_row_t*
  * 		2. ptr_relevant_opposite_conn_row: to point at the relevant
  * 		 OPPOSITE direction connection-row, or NULL if none was found.
  * 
+ *	NOTE: caller should hold rcu_read_lock() for as long as it uses the
+ *		  rows found (they might be deleted meanwhile, but aren't freed).
  **/
 void search_relevant_rows(log_row_t* pckt_lg_info,
 		connection_row_t** ptr_relevant_conn_row,
 		connection_row_t** ptr_relevant_opposite_conn_row)
 {
-	struct list_head *pos, *q;
 	connection_row_t* temp_row;
+	unsigned long num_of_probes = 0;
 	*ptr_relevant_conn_row = NULL;
 	*ptr_relevant_opposite_conn_row = NULL;
 
@@ -328,20 +737,36 @@ void search_relevant_rows(log_row_t* pckt_lg_info,
 		return;
 	}
 
-	list_for_each_safe(pos, q, &g_connections_list){
+	this_cpu_inc(g_conn_stats.lookups);
+
+	if (search_last_flow_cache(pckt_lg_info, ptr_relevant_conn_row,
+			ptr_relevant_opposite_conn_row))
+	{
+		this_cpu_inc(g_last_flow_hits);
+		this_cpu_inc(g_conn_stats.depth_hist[0]);
+		return;
+	}
+	this_cpu_inc(g_last_flow_misses);
+
+	list_for_each_entry_rcu(temp_row, &g_connections_list, list){
 		
 		//Check if we've already found both.
 		if ((*ptr_relevant_conn_row != NULL) && 
 			(*ptr_relevant_opposite_conn_row != NULL))
 		{ 
-			return;
+			break;
 		}
 		
-		temp_row = list_entry(pos, connection_row_t, list);
+		++num_of_probes;
+
+		//Deleted by another cpu while we pass over it:
+		if (ACCESS_ONCE(temp_row->dead)) {
+			continue;
+		}
 		
 		//If a row is too old - deletes it and continues to next row:
 		if(is_row_timedout(temp_row)){
-			delete_specific_row_by_list_node(pos);
+			expire_conn_row(temp_row);
 			continue;
 		}
 		
@@ -358,6 +783,12 @@ void search_relevant_rows(log_row_t* pckt_lg_info,
 			*ptr_relevant_opposite_conn_row = temp_row;
 		}	
 	}
+
+	this_cpu_add(g_conn_stats.probes, num_of_probes);
+	this_cpu_inc(g_conn_stats.depth_hist[min_t(int, fls(num_of_probes), CONN_STATS_NUM_DEPTH_BUCKETS-1)]);
+
+	update_last_flow_cache(pckt_lg_info, *ptr_relevant_conn_row,
+			*ptr_relevant_opposite_conn_row);
 }
 
 /**
@@ -370,8 +801,10 @@ void search_relevant_rows(log_row_t* pckt_lg_info,
  * 		2. ptr_opposite_fake_conn_row: to point at the relevant
  * 		 	OTHER proxy-client connection, or NULL if none was found.
  * 
- * NOTE: *At most* one of ptr_fake_conn_row / ptr_opposite_fake_conn_row
- *		can be not-NULL
+ * NOTE: 1. *At most* one of ptr_fake_conn_row / ptr_opposite_fake_conn_row
+ *		   can be not-NULL
+ *		 2. caller should hold rcu_read_lock() for as long as it uses the
+ *		   rows found (like search_relevant_rows()).
  * 
  **/
 void search_fake_connection_row(__be32 packet_src_ip, __be32 packet_dst_ip,
@@ -379,18 +812,20 @@ void search_fake_connection_row(__be32 packet_src_ip, __be32 packet_dst_ip,
 		connection_row_t** ptr_fake_conn_row,
 		connection_row_t** ptr_opposite_fake_conn_row)
 {
-	struct list_head *pos, *q;
 	connection_row_t* temp_row;
 	*ptr_fake_conn_row = NULL;
 	*ptr_opposite_fake_conn_row = NULL;
 
-	list_for_each_safe(pos, q, &g_connections_list){
+	list_for_each_entry_rcu(temp_row, &g_connections_list, list){
 		
-		temp_row = list_entry(pos, connection_row_t, list);
+		//Deleted by another cpu while we pass over it:
+		if (ACCESS_ONCE(temp_row->dead)) {
+			continue;
+		}
 		
 		//If a row is too old - deletes it and continues to next row:
 		if(is_row_timedout(temp_row)){
-			delete_specific_row_by_list_node(pos);
+			expire_conn_row(temp_row);
 			continue;
 		}
 		
@@ -439,6 +874,7 @@ static connection_row_t* add_new_connection_row(log_row_t* pckt_lg_info, bool is
 	//Allocates memory for connection-row:
     if((new_conn = kmalloc(sizeof(connection_row_t),GFP_ATOMIC)) == NULL){
 		printk(KERN_ERR "Failed allocating space for new connection row.\n");
+		this_cpu_inc(g_conn_stats.alloc_failures);
 		return NULL;
 	}
 	memset(new_conn, 0, sizeof(connection_row_t)); 
@@ -458,9 +894,7 @@ static connection_row_t* add_new_connection_row(log_row_t* pckt_lg_info, bool is
 	//TCP_STATE_SYN_RCVD when it's a (first) SYN-ACK packet:
 	new_conn->tcp_state = (is_syn_packet ? TCP_STATE_SYN_SENT : TCP_STATE_SYN_RCVD);	
 
-	INIT_LIST_HEAD(&(new_conn->list));
-	
-	list_add(&(new_conn->list), &g_connections_list);
+	add_conn_row_to_list(new_conn);
 #ifdef CONN_DEBUG_MODE
 	printk(KERN_INFO "Added row to connection-table. Its info:\n");
 	print_conn_row(new_conn);
@@ -517,12 +951,14 @@ static bool update_conn_rows_fake_details_if_needed(log_row_t* ptr_pckt_lg_info,
 	if(is_syn_packet)
 	{
 		//Checks if destination port is one of those we need to fake
-		if ( (ptr_pckt_lg_info->dst_port == PORT_HTTP) ||
+		//(new connections aren't redirected while "proxy" feature is off):
+		if ( is_proxy_on() &&
+			((ptr_pckt_lg_info->dst_port == PORT_HTTP) ||
 			 (ptr_pckt_lg_info->dst_port == PORT_FTP) ||
-			 (ptr_pckt_lg_info->dst_port == PORT_SMTP) )
+			 (ptr_pckt_lg_info->dst_port == PORT_SMTP)) )
 		{
 			relevant_conn_row->need_to_fake_connection = true;
-			relevant_conn_row->fake_tcp_state = TCP_STATE_SYN_SENT;
+			set_conn_row_fake_tcp_state(relevant_conn_row, TCP_STATE_SYN_SENT);
 			relevant_conn_row->fake_dst_ip = f_d_ip;
 			
 			switch(ptr_pckt_lg_info->dst_port){
@@ -556,7 +992,7 @@ static bool update_conn_rows_fake_details_if_needed(log_row_t* ptr_pckt_lg_info,
 	
 	//If gets here, it's a fake connection:
 	relevant_conn_row->need_to_fake_connection = true;
-	relevant_conn_row->fake_tcp_state = TCP_STATE_SYN_RCVD;
+	set_conn_row_fake_tcp_state(relevant_conn_row, TCP_STATE_SYN_RCVD);
 	relevant_conn_row->fake_dst_ip = relevant_opposite_conn_row->fake_src_ip;
 	relevant_conn_row->fake_dst_port = relevant_opposite_conn_row->fake_src_port;
 	relevant_conn_row->fake_src_ip = relevant_opposite_conn_row->fake_dst_ip;
@@ -565,31 +1001,70 @@ static bool update_conn_rows_fake_details_if_needed(log_row_t* ptr_pckt_lg_info,
 }
 
 /**
- *	Gets a pointer to a SYN,src_port==PORT_FTP_DATA packet's log_row_t, 
+ *	Helper function: adds a new FTP_DATA_connection_row, for a SYN packet
+ *	that had a matching expectation (in the expectations-table).
+ *
+ *	All ftp-data connection-rows are "faked", and start at state
+ *	TCP_STATE_SYN_SENT (both tcp_state & fake_tcp_state).
+ **/
+static connection_row_t* add_FTP_DATA_connection_row(log_row_t* pckt_lg_info){
+
+	connection_row_t* new_conn = NULL;
+
+	//Allocates memory for connection-row:
+    if((new_conn = kmalloc(sizeof(connection_row_t),GFP_ATOMIC)) == NULL){
+		printk(KERN_ERR "Failed allocating space for new FTP-DATA connection row.\n");
+		this_cpu_inc(g_conn_stats.alloc_failures);
+		return NULL;
+	}
+	memset(new_conn, 0, sizeof(connection_row_t));
+
+	//Default values:
+	new_conn->tcp_state = TCP_STATE_SYN_SENT;
+	new_conn->need_to_fake_connection = true;
+	new_conn->fake_tcp_state = TCP_STATE_SYN_SENT;
+	new_conn->fake_dst_ip = (is_relevant_ip(FW_IP_ETH_1, FW_NET_MASK, pckt_lg_info->src_ip))?
+			FW_IP_ETH_1: FW_IP_ETH_2;
+	new_conn->fake_dst_port = FAKE_FTP_DATA_PORT;
+
+	//Update values:
+	new_conn->src_ip = pckt_lg_info->src_ip;
+	new_conn->src_port = pckt_lg_info->src_port;
+	new_conn->dst_ip = pckt_lg_info->dst_ip;
+	new_conn->dst_port = pckt_lg_info->dst_port;
+	new_conn->timestamp = pckt_lg_info->timestamp;
+
+	add_conn_row_to_list(new_conn);
+	sync_conn_row(CONN_SYNC_OP_CREATE, new_conn);
+
+	return new_conn;
+}
+
+/**
+ *	Gets a pointer to a SYN,src_port==PORT_FTP_DATA packet's log_row_t,
  *	and 2 pointers to relevant connection rows (if any).
- *	Checks if that connection already have relevant "TCP_STATE_LISTEN" connection-row,
- *	and if so - UPDATES it.
+ *	Checks if the proxy server registered a matching FTP-DATA expectation,
+ *	and if so - uses it up and adds a new connection-row.
  *
  *	@pckt_lg_info - the information about the packet we check
  *	@relevant_conn_row - a connection-row with the same IPs & ports,
- * 						might be NULL if no such was found
+ * 						should be NULL.
  *	@relevant_opposite_conn_row - a connection-row with the opposite side
  * 						IPs & ports, should be NULL.
- * 
+ *
  *	Updates:	1. pckt_lg_info->action
  * 				2. pckt_lg_info->reason
- * 				3. relevant_conn_row->fake_tcp_state (if packet is relevant)
- * 				4. relevant_conn_row->timestamp (if packet is relevant)
- * 
+ * 				3. g_connections_list (if packet is relevant)
+ *
  *	Returns true on success, false if any error occured.
- *	
+ *
  *	NOTE:	1. If returned false, user should handle values of:
  * 				pckt_lg_info->action, pckt_lg_info->reason!
- * 			2. A valid (SYN+ source-port=20) packet will have 
- * 				relevant_conn_row!=NULL and relevant_opposite_conn_row==NULL.
+ * 			2. A valid (SYN+ source-port=20) packet will have
+ * 				relevant_conn_row==NULL and relevant_opposite_conn_row==NULL.
  *			3. All ftp-data connection-rows are "faked".
  **/
-static bool handle_SYN_packet_src_port_ftp_data(log_row_t* pckt_lg_info, 
+static bool handle_SYN_packet_src_port_ftp_data(log_row_t* pckt_lg_info,
 		connection_row_t* relevant_conn_row,
 		connection_row_t* relevant_opposite_conn_row )
 {
@@ -597,30 +1072,23 @@ static bool handle_SYN_packet_src_port_ftp_data(log_row_t* pckt_lg_info,
 		printk(KERN_ERR "In handle_SYN_packet_src_port_ftp_data(), function got NULL argument.\n");
 		return false;
 	}
-	
-	if ( (relevant_opposite_conn_row != NULL) || (relevant_conn_row == NULL))
+
+	if ( (relevant_opposite_conn_row != NULL) || (relevant_conn_row != NULL) ||
+		 (!take_ftp_data_expectation(pckt_lg_info)) )
 	{
-	//Means no prior *inserted by proxy* connection-row found OR
-	//A prior, opposite direction connection was found: drop this packet.
+	//Means a prior connection-row of this tuple was found OR
+	//no expectation was registered by the proxy: drop this packet.
 		pckt_lg_info->action = NF_DROP;
 		pckt_lg_info->reason = REASON_NO_MATCHING_TCP_CONNECTION;
-	} 
-	else //relevant_opposite_conn_row==NULL and relevant_conn_row!=NULL
-	{ 	
-		//Make sure connection status is "TCP_STATE_LISTEN" (that's
-		//how I defined):
-		if (relevant_conn_row->tcp_state == TCP_STATE_LISTEN){
-			relevant_conn_row->tcp_state = TCP_STATE_SYN_SENT;
-			relevant_conn_row->fake_tcp_state = TCP_STATE_SYN_SENT;
-			relevant_conn_row->timestamp = pckt_lg_info->timestamp;
-			pckt_lg_info->action = NF_ACCEPT;
-			pckt_lg_info->reason = REASON_FOUND_MATCHING_TCP_CONNECTION;
-		} else {
-			pckt_lg_info->action = NF_DROP;
-			pckt_lg_info->reason = REASON_NO_MATCHING_TCP_CONNECTION;
-		}			
+		return true;
 	}
-	
+
+	if (add_FTP_DATA_connection_row(pckt_lg_info) == NULL){
+		return false; //Error already printed in add_FTP_DATA_connection_row()
+	}
+	pckt_lg_info->action = NF_ACCEPT;
+	pckt_lg_info->reason = REASON_FOUND_MATCHING_TCP_CONNECTION;
+
 	return true;
 }
 
@@ -680,12 +1148,13 @@ static bool handle_SYN_ACK_packet(log_row_t* pckt_lg_info,
 				}
 				pckt_lg_info->action = NF_ACCEPT;
 				pckt_lg_info->reason = REASON_FOUND_MATCHING_TCP_CONNECTION;
-				update_conn_rows_fake_details_if_needed(pckt_lg_info, conn_row, relevant_opposite_conn_row, false);					
+				update_conn_rows_fake_details_if_needed(pckt_lg_info, conn_row, relevant_opposite_conn_row, false);
+				sync_conn_row(CONN_SYNC_OP_CREATE, conn_row);
 			} 
 			else
 			{
 				//Since other side of faked connection should be in state: 
-				printk(KERN_INFO "In handle_SYN_ACK_packet, opposite_conn_row fake_tcp_state IS TCP_STATE_CLOSED.\n");
+				trace_fw_conn_unexpected_packet(relevant_opposite_conn_row, TCP_SYN_ACK_PACKET);
 				pckt_lg_info->action = NF_DROP;
 				pckt_lg_info->reason = REASON_NO_MATCHING_TCP_CONNECTION;
 			}
@@ -772,7 +1241,7 @@ static bool handle_OTHER_tcp_packet(log_row_t* pckt_lg_info,
 				)
 			{
 				//Next line won't change anything if both states were ESTABLISHED:
-				relevant_conn_row->tcp_state = TCP_STATE_ESTABLISHED;
+				set_conn_row_tcp_state(relevant_conn_row, TCP_STATE_ESTABLISHED);
 				relevant_conn_row->timestamp = pckt_lg_info->timestamp;
 				pckt_lg_info->action = NF_ACCEPT;
 				pckt_lg_info->reason = REASON_FOUND_MATCHING_TCP_CONNECTION;
@@ -788,10 +1257,10 @@ static bool handle_OTHER_tcp_packet(log_row_t* pckt_lg_info,
 				(relevant_opposite_conn_row->tcp_state == TCP_STATE_LAST_ACK))
 			{
 				//This is the only time we update the TCP state of both sides:
-				relevant_conn_row->tcp_state = TCP_STATE_TIME_WAIT;
+				set_conn_row_tcp_state(relevant_conn_row, TCP_STATE_TIME_WAIT);
 				relevant_conn_row->timestamp = pckt_lg_info->timestamp;
 				//Since no other packet supposed to arrive from the opposite side:
-				relevant_opposite_conn_row->tcp_state = TCP_STATE_CLOSED;
+				set_conn_row_tcp_state(relevant_opposite_conn_row, TCP_STATE_CLOSED);
 				relevant_opposite_conn_row->timestamp = pckt_lg_info->timestamp;
 				//Both rows will be deleted when timedout.
 				pckt_lg_info->action = NF_ACCEPT;
@@ -812,7 +1281,7 @@ static bool handle_OTHER_tcp_packet(log_row_t* pckt_lg_info,
 				//First valid case:
 				//1. this packet is an ack of a handshake between client&proxy server
 				//	(when other-side's fake-connection wasn't established yet): 
-				relevant_conn_row->fake_tcp_state = TCP_STATE_ESTABLISHED;
+				set_conn_row_fake_tcp_state(relevant_conn_row, TCP_STATE_ESTABLISHED);
 				relevant_conn_row->timestamp = pckt_lg_info->timestamp;
 				pckt_lg_info->action = NF_ACCEPT;
 				pckt_lg_info->reason = REASON_PART_OF_PROXY_HANDSHAKE;
@@ -829,7 +1298,7 @@ static bool handle_OTHER_tcp_packet(log_row_t* pckt_lg_info,
 				(relevant_conn_row->fake_tcp_state == TCP_STATE_SYN_RCVD ||
 				 relevant_conn_row->fake_tcp_state == TCP_STATE_ESTABLISHED) )
 			{
-				relevant_conn_row->tcp_state = TCP_STATE_ESTABLISHED;
+				set_conn_row_tcp_state(relevant_conn_row, TCP_STATE_ESTABLISHED);
 				relevant_conn_row->fake_tcp_state == TCP_STATE_ESTABLISHED;
 				relevant_conn_row->timestamp = pckt_lg_info->timestamp;
 				pckt_lg_info->action = NF_ACCEPT;
@@ -872,7 +1341,7 @@ static bool handle_OTHER_tcp_packet(log_row_t* pckt_lg_info,
 					 relevant_conn_row->fake_tcp_state == TCP_STATE_TIME_WAIT))))
 			)	
 			{
-				relevant_conn_row->tcp_state = TCP_STATE_ESTABLISHED;
+				set_conn_row_tcp_state(relevant_conn_row, TCP_STATE_ESTABLISHED);
 				relevant_conn_row->timestamp = pckt_lg_info->timestamp;
 				pckt_lg_info->action = NF_ACCEPT;
 				pckt_lg_info->reason = REASON_FOUND_MATCHING_TCP_CONNECTION;
@@ -892,15 +1361,15 @@ static bool handle_OTHER_tcp_packet(log_row_t* pckt_lg_info,
 			{
 				//This is the only time we update the TCP state of both sides:
 				if (relevant_opposite_conn_row->tcp_state == TCP_STATE_LAST_ACK){
-					relevant_conn_row->tcp_state = TCP_STATE_TIME_WAIT;
+					set_conn_row_tcp_state(relevant_conn_row, TCP_STATE_TIME_WAIT);
 					//Since no other packet supposed to arrive from the opposite side:
-					relevant_opposite_conn_row->tcp_state = TCP_STATE_CLOSED;
+					set_conn_row_tcp_state(relevant_opposite_conn_row, TCP_STATE_CLOSED);
 					relevant_opposite_conn_row->timestamp = pckt_lg_info->timestamp;
 					//Both rows will be deleted when timedout.
 				}
 				//Otherwise, relevant_conn_row->tcp_state remains TCP_STATE_FIN_WAIT_1
 				//And relevant_opposite_conn_row->tcp_state remains as is
-				relevant_conn_row->fake_tcp_state = TCP_STATE_TIME_WAIT;
+				set_conn_row_fake_tcp_state(relevant_conn_row, TCP_STATE_TIME_WAIT);
 				relevant_conn_row->timestamp = pckt_lg_info->timestamp;
 				pckt_lg_info->action = NF_ACCEPT;
 				pckt_lg_info->reason = REASON_FOUND_MATCHING_TCP_CONNECTION;
@@ -983,7 +1452,8 @@ static bool handle_RESET_tcp_packet(log_row_t* pckt_lg_info,
 			if(delete_opposite_row){		
 				delete_specific_row_by_conn_ptr(relevant_opposite_conn_row);
 			} else {
-				relevant_opposite_conn_row->fake_tcp_state = TCP_STATE_CLOSED;
+				set_conn_row_fake_tcp_state(relevant_opposite_conn_row, TCP_STATE_CLOSED);
+				sync_conn_row(CONN_SYNC_OP_UPDATE, relevant_opposite_conn_row);
 			}
 		}
 			
@@ -1048,9 +1518,9 @@ static bool handle_FIN_tcp_packet(log_row_t* pckt_lg_info,
 			||(relevant_opposite_conn_row->tcp_state == TCP_STATE_FIN_WAIT_1)) )
 		{
 			if (relevant_opposite_conn_row->tcp_state == TCP_STATE_FIN_WAIT_1){
-				relevant_conn_row->tcp_state = TCP_STATE_LAST_ACK; //2nd FIN
+				set_conn_row_tcp_state(relevant_conn_row, TCP_STATE_LAST_ACK); //2nd FIN
 			} else {
-				relevant_conn_row->tcp_state = TCP_STATE_FIN_WAIT_1; //1st FIN
+				set_conn_row_tcp_state(relevant_conn_row, TCP_STATE_FIN_WAIT_1); //1st FIN
 			}
 			relevant_conn_row->timestamp = pckt_lg_info->timestamp;
 			pckt_lg_info->action = NF_ACCEPT;
@@ -1078,8 +1548,8 @@ static bool handle_FIN_tcp_packet(log_row_t* pckt_lg_info,
 			relevant_conn_row->fake_tcp_state == TCP_STATE_ESTABLISHED &&
 			relevant_opposite_conn_row->fake_tcp_state == TCP_STATE_ESTABLISHED))
 		{
-			relevant_conn_row->tcp_state = TCP_STATE_FIN_WAIT_1;
-			relevant_conn_row->fake_tcp_state = TCP_STATE_FIN_WAIT_1;
+			set_conn_row_tcp_state(relevant_conn_row, TCP_STATE_FIN_WAIT_1);
+			set_conn_row_fake_tcp_state(relevant_conn_row, TCP_STATE_FIN_WAIT_1);
 			relevant_conn_row->timestamp = pckt_lg_info->timestamp;
 			pckt_lg_info->action = NF_ACCEPT;
 			pckt_lg_info->reason = REASON_FOUND_MATCHING_TCP_CONNECTION;
@@ -1093,7 +1563,7 @@ static bool handle_FIN_tcp_packet(log_row_t* pckt_lg_info,
 			relevant_opposite_conn_row->tcp_state == TCP_STATE_FIN_WAIT_1 &&
 			relevant_conn_row->fake_tcp_state == TCP_STATE_FIN_WAIT_1 )
 		{
-			relevant_conn_row->tcp_state = TCP_STATE_LAST_ACK;
+			set_conn_row_tcp_state(relevant_conn_row, TCP_STATE_LAST_ACK);
 			relevant_conn_row->fake_tcp_state == TCP_STATE_LAST_ACK;
 			relevant_conn_row->timestamp = pckt_lg_info->timestamp;
 			pckt_lg_info->action = NF_ACCEPT;
@@ -1110,31 +1580,286 @@ static bool handle_FIN_tcp_packet(log_row_t* pckt_lg_info,
 }
 
 /**
- *	Sets a TCP packet's action, according to current connection-list
- *	
- *	NOTE:	if packet is a SYN packet, it HAS TO BE with 
- *			source port==PORT_FTP_DATA! (assuming other SYN packets were 
- * 		  	already been taking care of).
- * 
- *	Updates:	1. pckt_lg_info->action
- * 				2. pckt_lg_info->reason
- * 				3. if packet's valid: g_connections_list to fit the connection state
- *	
- *	Returns: true on success, false if any error occured
- * 
- *	NOTE: if returned false, take care of pckt_lg_info->action, pckt_lg_info->reason!
+ *	Helper function: adds both connection-rows of a connection whose
+ *	3-way-handshake was completed in the half-open table (by the ACK
+ *	packet represented by ack_pckt_lg_info).
+ *
+ *	Updates:	1. *ptr_conn_row to the client's row (TCP_STATE_SYN_SENT)
+ * 				2. *ptr_opposite_conn_row to the server's row (TCP_STATE_SYN_RCVD)
+ *
+ *	Returns true on success, false if any allocation failed
+ *	(then no row is added).
  **/
-bool check_tcp_packet(log_row_t* pckt_lg_info, tcp_packet_t tcp_pckt_type){
-	connection_row_t* relevant_conn_row = NULL;
-	connection_row_t* relevant_opposite_conn_row = NULL;
-		
-	if(pckt_lg_info == NULL){
-		printk(KERN_ERR "In function check_tcp_packet(), function got NULL argument.\n");
+static bool add_connection_rows_of_half_open(log_row_t* ack_pckt_lg_info,
+		connection_row_t** ptr_conn_row,
+		connection_row_t** ptr_opposite_conn_row)
+{
+	log_row_t reversed_lg_info = *ack_pckt_lg_info;
+
+	reversed_lg_info.src_ip = ack_pckt_lg_info->dst_ip;
+	reversed_lg_info.src_port = ack_pckt_lg_info->dst_port;
+	reversed_lg_info.dst_ip = ack_pckt_lg_info->src_ip;
+	reversed_lg_info.dst_port = ack_pckt_lg_info->src_port;
+
+	if ((*ptr_conn_row = add_new_connection_row(ack_pckt_lg_info, true)) == NULL){
+		return false; //Error already printed in add_new_connection_row()
+	}
+	if ((*ptr_opposite_conn_row = add_new_connection_row(&reversed_lg_info, false)) == NULL){
+		delete_specific_row_by_conn_ptr(*ptr_conn_row);
+		*ptr_conn_row = NULL;
+		return false;
+	}
+
+	sync_conn_row(CONN_SYNC_OP_CREATE, *ptr_conn_row);
+	sync_conn_row(CONN_SYNC_OP_CREATE, *ptr_opposite_conn_row);
+	return true;
+}
+
+/**
+ *	Returns the number of rows in g_connections_list
+ **/
+unsigned int get_num_of_conn_rows(void){
+	return (unsigned int)atomic_read(&g_num_of_conn_rows);
+}
+
+/**
+ *	Copies up to max_rows (not timedout) rows of g_connections_list
+ *	to snap_rows, each with the number of seconds left until it timesout.
+ *
+ *	Returns the number of rows copied.
+ **/
+unsigned int export_conn_rows(conn_snapshot_row_t* snap_rows, unsigned int max_rows){
+	connection_row_t* row;
+	unsigned int num_of_rows = 0;
+	struct timespec ts = { .tv_sec = 0,.tv_nsec = 0};
+	getnstimeofday(&ts);
+
+	if (snap_rows == NULL) {
+		printk(KERN_ERR "In export_conn_rows(), function got NULL argument.\n");
+		return 0;
+	}
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(row, &g_connections_list, list) {
+		if (num_of_rows == max_rows) {
+			break;
+		}
+		if (ts.tv_sec - row->timestamp >= TIMEOUT_SECONDS) {
+			continue;
+		}
+		fill_snapshot_row(&snap_rows[num_of_rows], row, ts.tv_sec);
+		++num_of_rows;
+	}
+	rcu_read_unlock();
+
+	return num_of_rows;
+}
+
+/**
+ *	Helper function: checks if a snapshot row has valid values
+ **/
+static bool is_valid_snapshot_row(const conn_snapshot_row_t* snap_row){
+	return ( snap_row->tcp_state >= TCP_STATE_CLOSED &&
+			 snap_row->tcp_state <= TCP_STATE_TIME_WAIT &&
+			 snap_row->fake_tcp_state >= TCP_STATE_CLOSED &&
+			 snap_row->fake_tcp_state <= TCP_STATE_TIME_WAIT &&
+			 snap_row->need_to_fake_connection <= 1 &&
+			 snap_row->remaining_seconds > 0 &&
+			 snap_row->remaining_seconds <= TIMEOUT_SECONDS );
+}
+
+/**
+ *	Gets a snapshot row (see export_conn_rows()), adds it to
+ *	g_connections_list - or, if a row with the same IPs & ports already
+ *	exists, updates that row.
+ *	The row will timeout snap_row->remaining_seconds (counted from when
+ *	the snapshot was taken, elapsed_seconds ago) from then - a row that
+ *	already timedout isn't added.
+ *
+ *	NOTE: called from process context (while packets are handled in
+ *		  softirq), the table's lock is held (with softirqs disabled)
+ *		  while the table is changed.
+ *
+ *	Returns true on success, false if row is invalid, timedout or
+ *	allocation failed.
+ **/
+bool import_conn_row(const conn_snapshot_row_t* snap_row, unsigned long elapsed_seconds){
+	connection_row_t* row;
+	connection_row_t* new_conn = NULL;
+	bool is_new_row = false;
+	struct timespec ts = { .tv_sec = 0,.tv_nsec = 0};
+	getnstimeofday(&ts);
+
+	if (snap_row == NULL || !is_valid_snapshot_row(snap_row)) {
+		printk(KERN_ERR "In import_conn_row(), function got invalid row.\n");
+		return false;
+	}
+	if (snap_row->remaining_seconds <= elapsed_seconds) {
+		return false;
+	}
+
+	spin_lock_bh(&g_conn_tab_lock);
+
+	list_for_each_entry(row, &g_connections_list, list) {
+		if (row->src_ip == snap_row->src_ip && row->src_port == snap_row->src_port &&
+			row->dst_ip == snap_row->dst_ip && row->dst_port == snap_row->dst_port)
+		{
+			new_conn = row;
+			break;
+		}
+	}
+
+	if (new_conn == NULL) {
+		if((new_conn = kmalloc(sizeof(connection_row_t),GFP_ATOMIC)) == NULL){
+			spin_unlock_bh(&g_conn_tab_lock);
+			printk(KERN_ERR "Failed allocating space for restored connection row.\n");
+			this_cpu_inc(g_conn_stats.alloc_failures);
+			return false;
+		}
+		memset(new_conn, 0, sizeof(connection_row_t));
+		new_conn->src_ip = snap_row->src_ip;
+		new_conn->src_port = snap_row->src_port;
+		new_conn->dst_ip = snap_row->dst_ip;
+		new_conn->dst_port = snap_row->dst_port;
+		INIT_LIST_HEAD(&(new_conn->list));
+		list_add_rcu(&(new_conn->list), &g_connections_list);
+		conn_row_added();
+		is_new_row = true;
+	}
+
+	new_conn->tcp_state = (tcp_state_t)snap_row->tcp_state;
+	new_conn->timestamp = ts.tv_sec - (TIMEOUT_SECONDS - (snap_row->remaining_seconds - elapsed_seconds));
+	new_conn->fake_src_ip = snap_row->fake_src_ip;
+	new_conn->fake_src_port = snap_row->fake_src_port;
+	new_conn->fake_dst_ip = snap_row->fake_dst_ip;
+	new_conn->fake_dst_port = snap_row->fake_dst_port;
+	new_conn->need_to_fake_connection = (snap_row->need_to_fake_connection == 1);
+	new_conn->fake_tcp_state = (tcp_state_t)snap_row->fake_tcp_state;
+	if (is_new_row) {
+		trace_fw_conn_create(new_conn);
+	}
+
+	spin_unlock_bh(&g_conn_tab_lock);
+	return true;
+}
+
+/**
+ *	Deletes the connection-row that has snap_row's IPs & ports
+ *	(used to replicate a deletion on a standby firewall).
+ *
+ *	NOTE: called from process context, like import_conn_row().
+ *
+ *	Returns true if such row was found (and deleted), false otherwise.
+ **/
+bool delete_conn_row_by_tuple(const conn_snapshot_row_t* snap_row){
+	connection_row_t* row;
+	bool found = false;
+
+	if (snap_row == NULL) {
+		printk(KERN_ERR "In delete_conn_row_by_tuple(), function got NULL argument.\n");
 		return false;
 	}
 
+	rcu_read_lock();
+	list_for_each_entry_rcu(row, &g_connections_list, list) {
+		if (row->src_ip == snap_row->src_ip && row->src_port == snap_row->src_port &&
+			row->dst_ip == snap_row->dst_ip && row->dst_port == snap_row->dst_port &&
+			delete_specific_row_by_conn_ptr(row))
+		{
+			found = true;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return found;
+}
+
+/**
+ *	Helper function (used by check_tcp_packet, when SYN_ADMISSION_DEFERRED):
+ *	takes care of a TCP packet that has no connection-rows, but might
+ *	belong to a handshake in the half-open table.
+ *		1. SYN-ACK answering a half-open SYN - accepted, updates the half-open row.
+ *		2. RESET of a half-open handshake - accepted, deletes the half-open row.
+ *		3. Last ACK of a half-open handshake - adds both connection-rows
+ *		   (updates *ptr_relevant_conn_row, *ptr_relevant_opposite_conn_row),
+ *		   the packet itself should still be checked by the caller.
+ *
+ *	Returns true if packet was handled (pckt_lg_info->action & reason
+ *	were updated), false if caller should continue checking it.
+ **/
+static bool handle_half_open_tcp_packet(log_row_t* pckt_lg_info,
+		tcp_packet_t tcp_pckt_type,
+		connection_row_t** ptr_relevant_conn_row,
+		connection_row_t** ptr_relevant_opposite_conn_row)
+{
+	switch (tcp_pckt_type){
+
+		case(TCP_SYN_ACK_PACKET):
+			if (!update_half_open_row_by_SYN_ACK(pckt_lg_info)) {
+				return false;
+			}
+			break;
+
+		case(TCP_RESET_PACKET):
+			if (!delete_half_open_row_by_RESET(pckt_lg_info)) {
+				return false;
+			}
+			break;
+
+		case(TCP_OTHER_PACKET):
+			if (take_half_open_row_by_ACK(pckt_lg_info) &&
+				!add_connection_rows_of_half_open(pckt_lg_info,
+						ptr_relevant_conn_row, ptr_relevant_opposite_conn_row))
+			{
+				printk(KERN_ERR "Error: failed adding connection-rows of a completed handshake.\n");
+			}
+			return false;
+
+		default:
+			return false;
+	}
+
+	pckt_lg_info->action = NF_ACCEPT;
+	pckt_lg_info->reason = REASON_FOUND_MATCHING_TCP_CONNECTION;
+	return true;
+}
+
+/**
+ *	Helper function: check_tcp_packet()'s implementation.
+ *	NOTE: caller should hold rcu_read_lock()
+ **/
+static bool check_tcp_packet_rcu(log_row_t* pckt_lg_info, tcp_packet_t tcp_pckt_type){
+	connection_row_t* relevant_conn_row = NULL;
+	connection_row_t* relevant_opposite_conn_row = NULL;
+	tcp_state_t old_states[4] = {TCP_STATE_CLOSED, TCP_STATE_CLOSED,
+			TCP_STATE_CLOSED, TCP_STATE_CLOSED};
+	bool ret;
+
 	search_relevant_rows(pckt_lg_info, &relevant_conn_row,
 			&relevant_opposite_conn_row);
+
+	//A handshake that's still in the half-open table has no connection-rows yet:
+	if (relevant_conn_row == NULL && relevant_opposite_conn_row == NULL &&
+		g_syn_admission == SYN_ADMISSION_DEFERRED)
+	{
+		if (handle_half_open_tcp_packet(pckt_lg_info, tcp_pckt_type,
+				&relevant_conn_row, &relevant_opposite_conn_row))
+		{
+			return true;
+		}
+	}
+	
+	//FIN & OTHER packets only change rows' states, remember them so
+	//changes can be replicated (see sync_conn_row_if_changed()):
+	if (relevant_conn_row) {
+		old_states[0] = relevant_conn_row->tcp_state;
+		old_states[1] = relevant_conn_row->fake_tcp_state;
+	}
+	if (relevant_opposite_conn_row) {
+		old_states[2] = relevant_opposite_conn_row->tcp_state;
+		old_states[3] = relevant_opposite_conn_row->fake_tcp_state;
+	}
 	
 	switch (tcp_pckt_type){	
 		
@@ -1147,12 +1872,14 @@ bool check_tcp_packet(log_row_t* pckt_lg_info, tcp_packet_t tcp_pckt_type){
 					relevant_conn_row, relevant_opposite_conn_row) );
 		
 		case(TCP_FIN_PACKET):
-			return ( handle_FIN_tcp_packet(pckt_lg_info,
-					relevant_conn_row, relevant_opposite_conn_row) );
+			ret = handle_FIN_tcp_packet(pckt_lg_info,
+					relevant_conn_row, relevant_opposite_conn_row);
+			break;
 		
 		case(TCP_OTHER_PACKET):
-			return( handle_OTHER_tcp_packet(pckt_lg_info, 
-					relevant_conn_row, relevant_opposite_conn_row) );
+			ret = handle_OTHER_tcp_packet(pckt_lg_info, 
+					relevant_conn_row, relevant_opposite_conn_row);
+			break;
 		
 		case(TCP_RESET_PACKET):
 			return ( handle_RESET_tcp_packet(pckt_lg_info, 
@@ -1167,6 +1894,92 @@ bool check_tcp_packet(log_row_t* pckt_lg_info, tcp_packet_t tcp_pckt_type){
 			return false;
 	}
 
+	sync_conn_row_if_changed(relevant_conn_row, old_states[0], old_states[1]);
+	sync_conn_row_if_changed(relevant_opposite_conn_row, old_states[2], old_states[3]);
+	return ret;
+}
+
+/**
+ *	Sets a TCP packet's action, according to current connection-list
+ *	
+ *	NOTE:	if packet is a SYN packet, it HAS TO BE with 
+ *			source port==PORT_FTP_DATA! (assuming other SYN packets were 
+ * 		  	already been taking care of).
+ * 
+ *	Updates:	1. pckt_lg_info->action
+ * 				2. pckt_lg_info->reason
+ * 				3. if packet's valid: g_connections_list to fit the connection state
+ *	
+ *	Returns: true on success, false if any error occured
+ * 
+ *	NOTE: if returned false, take care of pckt_lg_info->action, pckt_lg_info->reason!
+ **/
+bool check_tcp_packet(log_row_t* pckt_lg_info, tcp_packet_t tcp_pckt_type){
+	bool ret;
+		
+	if(pckt_lg_info == NULL){
+		printk(KERN_ERR "In function check_tcp_packet(), function got NULL argument.\n");
+		return false;
+	}
+
+	//Rows found are used (and changed) until the packet is checked:
+	rcu_read_lock();
+	ret = check_tcp_packet_rcu(pckt_lg_info, tcp_pckt_type);
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/**
+ *	Fast path for TCP packets of plain established connections (most
+ *	packets of a bulk transfer), tried before decide_packet_action():
+ *	a packet that only has ACK (of SYN/FIN/RST/ACK) and both its
+ *	connection-rows are TCP_STATE_ESTABLISHED and not faked, is accepted
+ *	after a single lookup (and refreshing its row's timestamp).
+ *	That's what check_tcp_packet() would do with it, and such a packet
+ *	can't be XMAS/Xplico/loopback.
+ *
+ *	Updates (if accepted): pckt_lg_info->action, pckt_lg_info->reason
+ *
+ *	Returns true if packet was accepted, false if it should take the
+ *	full path (or g_conn_fast_path is off).
+ **/
+bool check_established_tcp_packet(const packet_hdrs_t* hdrs, log_row_t* pckt_lg_info){
+	connection_row_t* relevant_conn_row = NULL;
+	connection_row_t* relevant_opposite_conn_row = NULL;
+	const struct tcphdr* tcp_hdr;
+
+	if (!ACCESS_ONCE(g_conn_fast_path) || pckt_lg_info->protocol != PROT_TCP ||
+		(tcp_hdr = hdrs->tcp) == NULL)
+	{
+		return false;
+	}
+
+	if (!tcp_hdr->ack || tcp_hdr->syn || tcp_hdr->fin || tcp_hdr->rst) {
+		return false;
+	}
+
+	rcu_read_lock();
+	search_relevant_rows(pckt_lg_info, &relevant_conn_row,
+			&relevant_opposite_conn_row);
+
+	if ( relevant_conn_row == NULL || relevant_opposite_conn_row == NULL ||
+		 relevant_conn_row->need_to_fake_connection ||
+		 relevant_opposite_conn_row->need_to_fake_connection ||
+		 relevant_conn_row->tcp_state != TCP_STATE_ESTABLISHED ||
+		 relevant_opposite_conn_row->tcp_state != TCP_STATE_ESTABLISHED )
+	{
+		rcu_read_unlock();
+		return false;
+	}
+
+	relevant_conn_row->timestamp = pckt_lg_info->timestamp;
+	rcu_read_unlock();
+
+	pckt_lg_info->action = NF_ACCEPT;
+	pckt_lg_info->reason = REASON_FOUND_MATCHING_TCP_CONNECTION;
+	this_cpu_inc(g_conn_stats.fast_path_hits);
+	return true;
 }
 
 /**
@@ -1197,45 +2010,45 @@ static void update_conn_rows_fake_tcp_state(connection_row_t* fake_conn_row,
 			
 		case(TCP_SYN_ACK_PACKET):
 			if(fake_conn_row->fake_tcp_state == TCP_STATE_SYN_SENT){
-				fake_conn_row->fake_tcp_state = TCP_STATE_SYN_RCVD;
+				set_conn_row_fake_tcp_state(fake_conn_row, TCP_STATE_SYN_RCVD);
 			} 
 			else if(fake_conn_row->fake_tcp_state != TCP_STATE_SYN_RCVD){
-				printk(KERN_INFO "Note: in update_conn_rows_fake_tcp_state, fake_tcp_state is not reasonable for a TCP_SYN_ACK_PACKET.\n");
+				trace_fw_conn_unexpected_packet(fake_conn_row, tcp_pckt_type);
 			}
 			break;
 		
 		case(TCP_FIN_PACKET):
 			if(fake_conn_row->fake_tcp_state == TCP_STATE_ESTABLISHED){
 				//1st FIN:
-				fake_conn_row->fake_tcp_state = TCP_STATE_FIN_WAIT_1;
+				set_conn_row_fake_tcp_state(fake_conn_row, TCP_STATE_FIN_WAIT_1);
 			} 
 			else if(fake_conn_row->fake_tcp_state == TCP_STATE_FIN_WAIT_1){
 				//2nd FIN:
-				fake_conn_row->fake_tcp_state = TCP_STATE_LAST_ACK;
+				set_conn_row_fake_tcp_state(fake_conn_row, TCP_STATE_LAST_ACK);
 			}
 			else {
-				printk(KERN_INFO "Note: in update_conn_rows_fake_tcp_state, fake_tcp_state[%d] is not reasonable for a TCP_FIN_PACKET.\n", fake_conn_row->fake_tcp_state);
+				trace_fw_conn_unexpected_packet(fake_conn_row, tcp_pckt_type);
 			}
 			break;
 		
 		case(TCP_OTHER_PACKET):
 			if(fake_conn_row->fake_tcp_state == TCP_STATE_SYN_RCVD){
-				fake_conn_row->fake_tcp_state = TCP_STATE_ESTABLISHED;
+				set_conn_row_fake_tcp_state(fake_conn_row, TCP_STATE_ESTABLISHED);
 			}
 			else if (fake_conn_row->fake_tcp_state == TCP_STATE_ESTABLISHED
 					|| fake_conn_row->fake_tcp_state == TCP_STATE_FIN_WAIT_1)
 			{//No change (a valid status).
 			}
 			else if(fake_conn_row->fake_tcp_state == TCP_STATE_LAST_ACK){
-				fake_conn_row->fake_tcp_state = TCP_STATE_TIME_WAIT;
+				set_conn_row_fake_tcp_state(fake_conn_row, TCP_STATE_TIME_WAIT);
 			}
 			else {
-				printk(KERN_INFO "Note: in update_conn_rows_fake_tcp_state, fake_tcp_state is not reasonable for a TCP_OTHER_PACKET.\n");
+				trace_fw_conn_unexpected_packet(fake_conn_row, tcp_pckt_type);
 			}
 			break;
 		
 		case(TCP_RESET_PACKET):
-			fake_conn_row->fake_tcp_state = TCP_STATE_CLOSED;
+			set_conn_row_fake_tcp_state(fake_conn_row, TCP_STATE_CLOSED);
 			break;
 			
 		default: //TCP_ERROR_PACKET or TCP_INVALID_PACKET
@@ -1253,20 +2066,22 @@ static void update_conn_rows_fake_tcp_state(connection_row_t* fake_conn_row,
  * 						3. fake_conn_row-> fake_tcp_state, timestamp
  *						4. opposite_fake_conn_row-> fake_src_ip, fake_src_port
  *
+ *	@hdrs - packet's headers (see parse_packet_headers()), hdrs->tcp isn't NULL
  **/
-void handle_outer_tcp_packet(struct sk_buff* skb, struct tcphdr* tcp_hdr)
+void handle_outer_tcp_packet(struct sk_buff* skb, const packet_hdrs_t* hdrs)
 {
 	connection_row_t* fake_conn_row = NULL;
 	connection_row_t* opposite_fake_conn_row = NULL;
-	struct iphdr* ptr_ipv4_hdr;
+	const struct iphdr* ptr_ipv4_hdr;
+	const struct tcphdr* tcp_hdr;
 	__be32 packet_src_ip = 0;	
 	__be16 packet_src_port = 0;
 	__be32 packet_dst_ip = 0;
 	__be16 packet_dst_port = 0;
 	tcp_packet_t tcp_pckt_type;
 	
-	if (skb == NULL || tcp_hdr == NULL ||
-		((ptr_ipv4_hdr = ip_hdr(skb)) == NULL))
+	if (skb == NULL || hdrs == NULL || (tcp_hdr = hdrs->tcp) == NULL ||
+		((ptr_ipv4_hdr = hdrs->ip) == NULL))
 	{
 		printk(KERN_ERR "Error: handle_outer_tcp_packet got NULL argument.\n");
 		return;
@@ -1278,14 +2093,20 @@ void handle_outer_tcp_packet(struct sk_buff* skb, struct tcphdr* tcp_hdr)
 	packet_dst_port = ntohs(tcp_hdr->dest);
 	tcp_pckt_type = get_tcp_packet_type(tcp_hdr); 
 	
+	//Rows found are used (and changed) until the packet is faked:
+	rcu_read_lock();
 	search_fake_connection_row(packet_src_ip, packet_dst_ip,
 			packet_src_port, packet_dst_port, &fake_conn_row,
 			&opposite_fake_conn_row);
 	
 	if(fake_conn_row) //fake_conn_row!=NULL
 	{
+		tcp_state_t old_fake_tcp_state = fake_conn_row->fake_tcp_state;
+
 		//UPDATE fake_conn_row fake_tcp_state (including its timestamp):
 		update_conn_rows_fake_tcp_state(fake_conn_row, tcp_pckt_type);
+		sync_conn_row_if_changed(fake_conn_row, fake_conn_row->tcp_state,
+				old_fake_tcp_state);
 
 		//Fake packet's source according to this relevant connection-row:
 		fake_packets_details(skb, true, fake_conn_row->dst_ip, fake_conn_row->dst_port);
@@ -1293,14 +2114,20 @@ void handle_outer_tcp_packet(struct sk_buff* skb, struct tcphdr* tcp_hdr)
 	else if(opposite_fake_conn_row)
 	{
 		//Update first-seen values (of proxy initiates connection to the "other side"):
-		opposite_fake_conn_row->fake_src_ip = packet_src_ip;
-		opposite_fake_conn_row->fake_src_port = packet_src_port;
+		if (opposite_fake_conn_row->fake_src_ip != packet_src_ip ||
+			opposite_fake_conn_row->fake_src_port != packet_src_port)
+		{
+			opposite_fake_conn_row->fake_src_ip = packet_src_ip;
+			opposite_fake_conn_row->fake_src_port = packet_src_port;
+			sync_conn_row(CONN_SYNC_OP_UPDATE, opposite_fake_conn_row);
+		}
 		
 		//Fake packet's source according to the "other side" connection-row details:
 		fake_packets_details(skb, true, opposite_fake_conn_row->src_ip, 
 				opposite_fake_conn_row->src_port);
 		
 	}//Oterwise, both are NULL - no need to do fake anything
+	rcu_read_unlock();
 }
 
 
@@ -1331,61 +2158,60 @@ connection_row_t* add_first_SYN_connection(log_row_t* syn_pckt_lg_info,
 
 	//If failed, relevant messages printed inside update_conn_rows_fake_details_if_needed():
 	update_conn_rows_fake_details_if_needed(syn_pckt_lg_info, conn_row, NULL, true);
+	sync_conn_row(CONN_SYNC_OP_CREATE, conn_row);
 	
 	return conn_row;
 }
 
 /**
- *	Helper function: adds a new FTP_DATA_connection_row.
+ *	Gets a pointer to an accepted (first) SYN packet's log_row_t,
+ *	admits its connection according to g_syn_admission:
+ *		SYN_ADMISSION_IMMEDIATE - adds a connection-row (add_first_SYN_connection)
+ *		SYN_ADMISSION_DEFERRED - connections that aren't proxied are only
+ *			added to the half-open table, their connection-rows are added
+ *			once the handshake completes (see handle_half_open_tcp_packet).
+ *
+ *	Updates(if half-open table refused the SYN):
+ *			1. syn_pckt_lg_info->action to NF_DROP
+ *			2. syn_pckt_lg_info->reason to REASON_HALF_OPEN_LIMIT
  **/
-static connection_row_t* add_FTP_DATA_connection_row(__be32 src_ip,
-		__be16 src_port, __be32 dst_ip, __be16 dst_port){
-	
-	connection_row_t* new_conn = NULL;
-	struct timespec ts = { .tv_sec = 0,.tv_nsec = 0};
-	getnstimeofday(&ts);	
-	
-	//Allocates memory for connection-row:
-    if((new_conn = kmalloc(sizeof(connection_row_t),GFP_ATOMIC)) == NULL){
-		printk(KERN_ERR "Failed allocating space for new FTP-DATA connection row.\n");
-		return NULL;
-	}
-	memset(new_conn, 0, sizeof(connection_row_t)); 
-	
-	//Default values:
-	new_conn->tcp_state = TCP_STATE_LISTEN;
-	new_conn->need_to_fake_connection = true; 
-	new_conn->fake_tcp_state = TCP_STATE_LISTEN;
-	new_conn->fake_dst_ip = (is_relevant_ip(FW_IP_ETH_1, FW_NET_MASK, src_ip))?
-			FW_IP_ETH_1: FW_IP_ETH_2;
-	new_conn->fake_dst_port = FAKE_FTP_DATA_PORT;
+void admit_first_SYN_connection(log_row_t* syn_pckt_lg_info, struct sk_buff* skb){
 
-	//Update values:
-	new_conn->src_ip = src_ip;
-	new_conn->src_port = src_port;
-	new_conn->dst_ip = dst_ip;
-	new_conn->dst_port = dst_port;
-	new_conn->timestamp = ts.tv_sec;	
+	if (syn_pckt_lg_info == NULL) {
+		printk(KERN_ERR "In admit_first_SYN_connection(), function got NULL argument.\n");
+		return;
+	}
 
-	INIT_LIST_HEAD(&(new_conn->list));
-	
-	list_add(&(new_conn->list), &g_connections_list);
+	if ( (g_syn_admission == SYN_ADMISSION_DEFERRED) &&
+		 (syn_pckt_lg_info->dst_port != PORT_HTTP) &&
+		 (syn_pckt_lg_info->dst_port != PORT_FTP) &&
+		 (syn_pckt_lg_info->dst_port != PORT_SMTP) )
+	{
+		if (!add_half_open_row(syn_pckt_lg_info)) {
+			syn_pckt_lg_info->action = NF_DROP;
+			syn_pckt_lg_info->reason = REASON_HALF_OPEN_LIMIT;
+		}
+		return;
+	}
 
-	return new_conn;
+	add_first_SYN_connection(syn_pckt_lg_info, skb);
 }
 
 /**
  * 	This function will be called when user tries to write to the conn_tab device,
- * 	meaning that the user (proxy server) wants to add a new FTP-DATA connection-row.
+ * 	meaning that the user (proxy server) wants to add a new FTP-DATA expectation.
  *  Returns:	count on success,
  * 				a negative number otherwise.
- * 
+ *
  * 	Buffer should contain a string with this format:
  *	<src ip> <source port> <dst ip> <dest port>'\n'
- * 
+ *
  * 	If user provided buffer containing something other than that,
- * 	function will fail! 
+ * 	function will fail!
  * 	[count represent the length of buf ('\0' not included)]
+ *
+ *	NOTE: kept for backward compatibility, the binary "ftp_data_exp"
+ *		  attribute is the preferred way to register expectations.
  **/
 ssize_t write_new_ftp_data_conn_row(struct device* dev,
 		struct device_attribute* attr, const char* buf, size_t count)
@@ -1407,8 +2233,8 @@ ssize_t write_new_ftp_data_conn_row(struct device* dev,
 		return -EPERM;
 	}
 	
-	if (add_FTP_DATA_connection_row(src_ip, src_port, dst_ip, dst_port) == NULL){
-		return -EPERM; //Error already printed in add_FTP_DATA_connection_row()
+	if (!add_ftp_data_expectation(src_ip, src_port, dst_ip, dst_port)){
+		return -EPERM; //Error already printed in add_ftp_data_expectation()
 	}
 	
 	return count;
@@ -1423,6 +2249,14 @@ ssize_t write_new_ftp_data_conn_row(struct device* dev,
 static void destroyConnDevice(struct class* fw_class, enum c_state_to_fold stateToFold){
 	switch (stateToFold){
 		case(C_ALL_DES):
+			device_remove_file(conn_tab_device, (const struct device_attribute *)&dev_attr_conn_stats.attr);
+		case(C_CACHE_FILE_DES):
+			device_remove_file(conn_tab_device, (const struct device_attribute *)&dev_attr_conn_cache_stats.attr);
+		case(C_HALF_OPEN_DES):
+			destroy_half_open_tab(conn_tab_device);
+		case(C_EXP_TAB_DES):
+			destroy_exp_tab(conn_tab_device);
+		case(C_FIRST_FILE_DES):
 			device_remove_file(conn_tab_device, (const struct device_attribute *)&dev_attr_conn_tab.attr);
 		case(C_DEVICE_DES):
 			device_destroy(fw_class, MKDEV(conn_tab_dev_major_number, MINOR_CONN_TAB));
@@ -1463,7 +2297,39 @@ int init_conn_tab_device(struct class* fw_class){
 		destroyConnDevice(fw_class, C_DEVICE_DES);
 		return -1;
 	}
-	
+
+	//Create FTP-DATA expectations-table (and its sysfs binary attribute):
+	if (init_exp_tab(conn_tab_device) < 0)
+	{
+		//Error msg already been printed inside init_exp_tab()
+		destroyConnDevice(fw_class, C_FIRST_FILE_DES);
+		return -1;
+	}
+
+	//Create half-open table (and its sysfs attributes):
+	if (init_half_open_tab(conn_tab_device) < 0)
+	{
+		//Error msg already been printed inside init_half_open_tab()
+		destroyConnDevice(fw_class, C_EXP_TAB_DES);
+		return -1;
+	}
+
+	//Create last-flow cache's counters sysfs file attribute:
+	if (device_create_file(conn_tab_device, (const struct device_attribute *)&dev_attr_conn_cache_stats.attr))
+	{
+		printk(KERN_ERR "Error: failed creating conn_cache_stats-sysfs-file inside connection table char-device.\n");
+		destroyConnDevice(fw_class, C_HALF_OPEN_DES);
+		return -1;
+	}
+
+	//Create connection-table statistics sysfs file attribute:
+	if (device_create_file(conn_tab_device, (const struct device_attribute *)&dev_attr_conn_stats.attr))
+	{
+		printk(KERN_ERR "Error: failed creating conn_stats-sysfs-file inside connection table char-device.\n");
+		destroyConnDevice(fw_class, C_CACHE_FILE_DES);
+		return -1;
+	}
+
 	printk(KERN_INFO "fw_conn_tab: device successfully initiated.\n");
 
 	return 0;
@@ -2,8 +2,48 @@
 #define _CONN_TAB_UTILS_H_
 
 #include "fw.h"
+#include "exp_tab_utils.h"
+#include "half_open_utils.h"
+#include "conn_snapshot_utils.h"
+#include "conn_sync_utils.h"
+#include "feature_utils.h"
+#include <linux/percpu.h>	//For the last-flow cache
+#include <linux/rcupdate.h>
+#include <linux/spinlock.h>
+#include <linux/bitops.h>	//For fls()
 
 #define TIMEOUT_SECONDS (25)
+
+//Probe-depth histogram's buckets: 0, 1, 2-3, 4-7, ..., 32-63, 64 or more rows passed:
+#define CONN_STATS_NUM_DEPTH_BUCKETS (8)
+
+//Connection-table counters, kept per-cpu (summed when read):
+typedef struct {
+
+	unsigned long	inserts;
+	unsigned long	deletes;		// Including expiries
+	unsigned long	expiries;		// Rows deleted since they timedout
+	unsigned long	lookups;		// Calls to search_relevant_rows()
+	unsigned long	probes;			// Rows passed over by those lookups
+	unsigned long	alloc_failures;
+	unsigned long	fast_path_hits;	// Packets accepted by check_established_tcp_packet()
+	unsigned long	depth_hist[CONN_STATS_NUM_DEPTH_BUCKETS];
+
+}conn_tab_stats_t;
+
+//Last flow looked-up on each cpu, checked before passing over g_connections_list.
+//Only flows that have both rows are cached, a deleted row is cleared from
+//all cpus' entries (see invalidate_last_flow_caches()):
+typedef struct {
+
+	__be32				src_ip;
+	__be16				src_port;
+	__be32				dst_ip;
+	__be16				dst_port;
+	connection_row_t*	conn_row;			// Same direction row (NULL if cleared)
+	connection_row_t*	opposite_conn_row;	// Opposite direction row (NULL if cleared)
+
+}last_flow_cache_t;
 #define MAX_STRLEN_OF_TCP_PACKET_TYPE (13)
 #define MAX_STRLEN_OF_TCP_STATE (11)
 
@@ -24,16 +64,26 @@
 enum c_state_to_fold {
 	C_UNREG_DES,
 	C_DEVICE_DES,
+	C_FIRST_FILE_DES,
+	C_EXP_TAB_DES,
+	C_HALF_OPEN_DES,
+	C_CACHE_FILE_DES,
 	C_ALL_DES
 };
 
 connection_row_t* add_first_SYN_connection(log_row_t* syn_pckt_lg_info, struct sk_buff* skb);
+void admit_first_SYN_connection(log_row_t* syn_pckt_lg_info, struct sk_buff* skb);
 bool check_tcp_packet(log_row_t* pckt_lg_info, tcp_packet_t tcp_pckt_type);
+bool check_established_tcp_packet(const packet_hdrs_t* hdrs, log_row_t* pckt_lg_info);
 void search_relevant_rows(log_row_t* pckt_lg_info,
 		connection_row_t** ptr_relevant_conn_row,
 		connection_row_t** ptr_relevant_opposite_conn_row);
-void handle_outer_tcp_packet(struct sk_buff* skb, struct tcphdr* tcp_hdr);
+void handle_outer_tcp_packet(struct sk_buff* skb, const packet_hdrs_t* hdrs);
 void delete_all_conn_rows(void);
+unsigned int get_num_of_conn_rows(void);
+unsigned int export_conn_rows(conn_snapshot_row_t* snap_rows, unsigned int max_rows);
+bool import_conn_row(const conn_snapshot_row_t* snap_row, unsigned long elapsed_seconds);
+bool delete_conn_row_by_tuple(const conn_snapshot_row_t* snap_row);
 int init_conn_tab_device(struct class* fw_class);
 void destroy_conn_tab_device(struct class* fw_class);
 
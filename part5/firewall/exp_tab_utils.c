@@ -0,0 +1,271 @@
+#include "exp_tab_utils.h"
+
+/**
+ *	FTP-DATA expectations are kept apart from g_connections_list:
+ *	the proxy server registers one for every PORT command it sees, and
+ *	it only turns into a "real" connection-row once the server's SYN
+ *	(source port==PORT_FTP_DATA) arrives.
+ *
+ *	g_exp_tab is a small hash-table, each bucket is a list of rows.
+ *	It's accessed both from the hook (softirq) and from sysfs, so every
+ *	access is done while holding g_exp_tab_lock.
+ **/
+static struct hlist_head g_exp_tab[EXP_TAB_NUM_BUCKETS];
+static DEFINE_SPINLOCK(g_exp_tab_lock);
+static unsigned int g_num_of_exp_rows = 0;
+static u32 g_exp_hash_seed = 0;
+
+//Function declaration:
+static ssize_t write_ftp_data_expectations(struct file* filp, struct kobject* kobj,
+		struct bin_attribute* attr, char* buf, loff_t off, size_t count);
+
+/**
+ *	Declaring a binary sysfs attribute, "ftp_data_exp":
+ *		.attr.mode = S_IWUSR, giving only the owner write permissions (an
+ *					 expectation opens a pinhole through the firewall)
+ *		.size = 0 (no fixed size)
+ *		.read = NULL (no reading function)
+ *		.write = write_ftp_data_expectations
+ **/
+static struct bin_attribute bin_attr_ftp_data_exp = {
+	.attr = { .name = EXP_TAB_ATTR_NAME, .mode = S_IWUSR },
+	.size = 0,
+	.write = write_ftp_data_expectations,
+};
+
+/**
+ *	Returns the index of the bucket the given tuple belongs to
+ **/
+static inline unsigned int get_exp_bucket(__be32 src_ip, __be16 src_port,
+		__be32 dst_ip, __be16 dst_port)
+{
+	return jhash_3words(src_ip, dst_ip, (((u32)src_port) << 16) | dst_port,
+			g_exp_hash_seed) & (EXP_TAB_NUM_BUCKETS - 1);
+}
+
+/**
+ *	Checks if the given row has timedout (at least EXP_TIMEOUT_SECONDS
+ *	passed since it was written)
+ **/
+static bool is_exp_row_timedout(expectation_row_t* row, unsigned long now){
+	return ( (now - (row->timestamp)) >= EXP_TIMEOUT_SECONDS );
+}
+
+/**
+ *	Deletes a specific row from g_exp_tab.
+ *	NOTE: caller should hold g_exp_tab_lock!
+ **/
+static void delete_exp_row(expectation_row_t* row){
+	hlist_del(&(row->hnode));
+	kfree(row);
+	--g_num_of_exp_rows;
+}
+
+/**
+ *	Deletes all timedout rows of a given bucket.
+ *	NOTE: caller should hold g_exp_tab_lock!
+ **/
+static void delete_timedout_rows_in_bucket(unsigned int bucket, unsigned long now){
+	expectation_row_t* row;
+	struct hlist_node* tmp;
+
+	hlist_for_each_entry_safe(row, tmp, &g_exp_tab[bucket], hnode) {
+		if (is_exp_row_timedout(row, now)){
+			delete_exp_row(row);
+		}
+	}
+}
+
+/**
+ *	Adds a new FTP-DATA expectation to g_exp_tab (if one with the same
+ *	tuple already exists, only refreshes its timestamp).
+ *
+ *	@src_ip, src_port - the FTP server's side (src_port should be PORT_FTP_DATA)
+ *	@dst_ip, dst_port - the FTP client's side (from the PORT command)
+ *
+ *	Returns true on success, false if table is full or allocation failed.
+ **/
+bool add_ftp_data_expectation(__be32 src_ip, __be16 src_port,
+		__be32 dst_ip, __be16 dst_port)
+{
+	expectation_row_t* row;
+	unsigned int bucket, i;
+	struct timespec ts = { .tv_sec = 0,.tv_nsec = 0};
+	getnstimeofday(&ts);
+
+	bucket = get_exp_bucket(src_ip, src_port, dst_ip, dst_port);
+
+	spin_lock_bh(&g_exp_tab_lock);
+
+	delete_timedout_rows_in_bucket(bucket, ts.tv_sec);
+
+	hlist_for_each_entry(row, &g_exp_tab[bucket], hnode) {
+		if (row->src_ip == src_ip && row->src_port == src_port &&
+			row->dst_ip == dst_ip && row->dst_port == dst_port)
+		{
+			row->timestamp = ts.tv_sec;
+			spin_unlock_bh(&g_exp_tab_lock);
+			return true;
+		}
+	}
+
+	if (g_num_of_exp_rows >= MAX_EXP_ROWS) {
+		//Try to make room before giving up:
+		for (i = 0; i < EXP_TAB_NUM_BUCKETS; ++i) {
+			delete_timedout_rows_in_bucket(i, ts.tv_sec);
+		}
+		if (g_num_of_exp_rows >= MAX_EXP_ROWS) {
+			spin_unlock_bh(&g_exp_tab_lock);
+			printk(KERN_ERR "FTP-DATA expectations-table is full, expectation wasn't added.\n");
+			return false;
+		}
+	}
+
+	if((row = kmalloc(sizeof(expectation_row_t), GFP_ATOMIC)) == NULL){
+		spin_unlock_bh(&g_exp_tab_lock);
+		printk(KERN_ERR "Failed allocating space for new FTP-DATA expectation.\n");
+		return false;
+	}
+	memset(row, 0, sizeof(expectation_row_t));
+
+	row->src_ip = src_ip;
+	row->src_port = src_port;
+	row->dst_ip = dst_ip;
+	row->dst_port = dst_port;
+	row->timestamp = ts.tv_sec;
+	INIT_HLIST_NODE(&(row->hnode));
+
+	hlist_add_head(&(row->hnode), &g_exp_tab[bucket]);
+	++g_num_of_exp_rows;
+
+	spin_unlock_bh(&g_exp_tab_lock);
+	return true;
+}
+
+/**
+ *	Gets a pointer to a SYN,src_port==PORT_FTP_DATA packet's log_row_t,
+ *	searches g_exp_tab for a (not timedout) expectation that fits it.
+ *
+ *	If found one - DELETES it (an expectation is used only once).
+ *
+ *	Returns true if a fitting expectation was found.
+ **/
+bool take_ftp_data_expectation(log_row_t* pckt_lg_info){
+	expectation_row_t* row;
+	struct hlist_node* tmp;
+	unsigned int bucket;
+	bool found = false;
+
+	if (pckt_lg_info == NULL) {
+		printk(KERN_ERR "In take_ftp_data_expectation(), function got NULL argument.\n");
+		return false;
+	}
+
+	bucket = get_exp_bucket(pckt_lg_info->src_ip, pckt_lg_info->src_port,
+			pckt_lg_info->dst_ip, pckt_lg_info->dst_port);
+
+	spin_lock_bh(&g_exp_tab_lock);
+	hlist_for_each_entry_safe(row, tmp, &g_exp_tab[bucket], hnode) {
+		if (is_exp_row_timedout(row, pckt_lg_info->timestamp)){
+			delete_exp_row(row);
+			continue;
+		}
+		if (row->src_ip == pckt_lg_info->src_ip &&
+			row->src_port == pckt_lg_info->src_port &&
+			row->dst_ip == pckt_lg_info->dst_ip &&
+			row->dst_port == pckt_lg_info->dst_port)
+		{
+			delete_exp_row(row);
+			found = true;
+			break;
+		}
+	}
+	spin_unlock_bh(&g_exp_tab_lock);
+
+	return found;
+}
+
+/**
+ *	Deletes all rows from g_exp_tab
+ *	(frees all allocated memory)
+ **/
+void delete_all_exp_rows(void){
+	expectation_row_t* row;
+	struct hlist_node* tmp;
+	unsigned int i;
+
+	spin_lock_bh(&g_exp_tab_lock);
+	for (i = 0; i < EXP_TAB_NUM_BUCKETS; ++i) {
+		hlist_for_each_entry_safe(row, tmp, &g_exp_tab[i], hnode) {
+			delete_exp_row(row);
+		}
+	}
+	spin_unlock_bh(&g_exp_tab_lock);
+}
+
+/**
+ *	This function will be called when user (proxy server) writes to
+ *	"ftp_data_exp", meaning it wants to add new FTP-DATA expectations.
+ *
+ *	Buffer should contain one or more ftp_data_exp_t records.
+ *
+ *	Returns:	count on success,
+ *				a negative number otherwise.
+ *
+ *	NOTE: if buf's length isn't a multiple of sizeof(ftp_data_exp_t),
+ *		  nothing is added.
+ **/
+static ssize_t write_ftp_data_expectations(struct file* filp, struct kobject* kobj,
+		struct bin_attribute* attr, char* buf, loff_t off, size_t count)
+{
+	ftp_data_exp_t* records = (ftp_data_exp_t*)buf;
+	size_t i, num_of_records;
+
+	if (buf == NULL || count == 0 || (count % sizeof(ftp_data_exp_t)) != 0) {
+		printk(KERN_ERR "*** Error: user sent invalid input format to write_ftp_data_expectations() ***\n");
+		return -EINVAL;
+	}
+
+	num_of_records = count / sizeof(ftp_data_exp_t);
+	for (i = 0; i < num_of_records; ++i) {
+		if (!add_ftp_data_expectation(records[i].src_ip, records[i].src_port,
+				records[i].dst_ip, records[i].dst_port))
+		{
+			//Error already printed in add_ftp_data_expectation()
+			return (i == 0) ? -ENOMEM : (ssize_t)(i * sizeof(ftp_data_exp_t));
+		}
+	}
+
+	return count;
+}
+
+/**
+ *	Initiates g_exp_tab and creates its sysfs binary attribute
+ *	inside conn_tab_device.
+ *
+ *	Returns: 0 on success, -1 if failed.
+ **/
+int init_exp_tab(struct device* conn_tab_device){
+	unsigned int i;
+
+	for (i = 0; i < EXP_TAB_NUM_BUCKETS; ++i) {
+		INIT_HLIST_HEAD(&g_exp_tab[i]);
+	}
+	g_num_of_exp_rows = 0;
+	get_random_bytes(&g_exp_hash_seed, sizeof(g_exp_hash_seed));
+
+	if (device_create_bin_file(conn_tab_device, &bin_attr_ftp_data_exp)) {
+		printk(KERN_ERR "Error: failed creating ftp_data_exp-sysfs-file inside connection table char-device.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ *	Destroys g_exp_tab and removes its sysfs binary attribute
+ **/
+void destroy_exp_tab(struct device* conn_tab_device){
+	device_remove_bin_file(conn_tab_device, &bin_attr_ftp_data_exp);
+	delete_all_exp_rows();
+}
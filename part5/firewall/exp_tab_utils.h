@@ -0,0 +1,48 @@
+#ifndef _EXP_TAB_UTILS_H_
+#define _EXP_TAB_UTILS_H_
+
+#include "fw.h"
+#include <linux/jhash.h>	//For hashing expectations' tuples
+#include <linux/random.h>	//For the hash seed
+#include <linux/spinlock.h>
+
+//An expectation that wasn't used by a SYN packet by then is deleted:
+#define EXP_TIMEOUT_SECONDS (10)
+#define EXP_TAB_HASH_BITS (6)
+#define EXP_TAB_NUM_BUCKETS (1 << EXP_TAB_HASH_BITS)
+#define MAX_EXP_ROWS (256)
+#define EXP_TAB_ATTR_NAME "ftp_data_exp"
+
+//Struct representing a row in FTP-DATA expectations-table:
+typedef struct {
+
+	__be32			src_ip;		// The (real) FTP server
+	__be16			src_port;	// Always PORT_FTP_DATA
+	__be32			dst_ip;		// The client that sent the PORT command
+	__be16			dst_port;	// The port the client listens on
+	unsigned long	timestamp;	// Time of creation
+
+	struct hlist_node hnode;	// For saving the row in its hash-bucket
+
+}expectation_row_t;
+
+/**
+ *	Binary record the proxy server writes to EXP_TAB_ATTR_NAME,
+ *	all fields are in LOCAL endianness.
+ *	User may write several records at once (up to PAGE_SIZE bytes).
+ **/
+typedef struct {
+	__be32	src_ip;
+	__be16	src_port;
+	__be32	dst_ip;
+	__be16	dst_port;
+} __attribute__((packed)) ftp_data_exp_t;
+
+bool add_ftp_data_expectation(__be32 src_ip, __be16 src_port,
+		__be32 dst_ip, __be16 dst_port);
+bool take_ftp_data_expectation(log_row_t* pckt_lg_info);
+void delete_all_exp_rows(void);
+int init_exp_tab(struct device* conn_tab_device);
+void destroy_exp_tab(struct device* conn_tab_device);
+
+#endif /* _EXP_TAB_UTILS_H_ */
@@ -0,0 +1,114 @@
+#include "feature_utils.h"
+
+struct static_key g_fw_active_key = STATIC_KEY_INIT_FALSE;
+struct static_key g_logging_key = STATIC_KEY_INIT_TRUE;
+struct static_key g_proxy_key = STATIC_KEY_INIT_TRUE;
+struct static_key g_xplico_key = STATIC_KEY_INIT_TRUE;
+struct static_key g_verdicts_key = STATIC_KEY_INIT_TRUE;
+
+//Serializes turning features on/off:
+static DEFINE_MUTEX(g_features_mutex);
+
+static feature_state_t g_features[NUM_OF_FEATURES] = {
+	{ .name = "logging", .key = &g_logging_key, .on = true },
+	{ .name = "proxy", .key = &g_proxy_key, .on = true },
+	{ .name = "xplico", .key = &g_xplico_key, .on = true },
+	{ .name = "verdicts", .key = &g_verdicts_key, .on = true },
+};
+
+/**
+ *	Helper function: turns a feature on/off (if it isn't already).
+ *	NOTE: caller should hold g_features_mutex!
+ **/
+static void set_feature(feature_state_t* feature, bool turn_on){
+	if (turn_on && !feature->on) {
+		static_key_slow_inc(feature->key);
+		feature->on = true;
+	} else if (!turn_on && feature->on) {
+		static_key_slow_dec(feature->key);
+		feature->on = false;
+	}
+}
+
+ /**
+ *	This function will be called when user tries to read from "features"
+ *
+ *  NOTE: writes to "buf" a line for every feature, in (string) format:
+ * 		<feature name> <0/1>
+ **/
+ssize_t read_features(struct device* dev, struct device_attribute* attr, char* buf){
+		ssize_t ret = 0;
+		unsigned int i;
+
+		mutex_lock(&g_features_mutex);
+		for (i = 0; i < NUM_OF_FEATURES; ++i) {
+			ret += scnprintf(buf + ret, PAGE_SIZE - ret, "%s %d\n", g_features[i].name,
+					g_features[i].on ? 1 : 0);
+		}
+		mutex_unlock(&g_features_mutex);
+
+		return ret;
+}
+
+/**
+ *	This function will be called when user tries to write to "features".
+ *	Turns a feature on/off, buf format:
+ *		<feature name> <0/1>
+ *
+ *	Returns count on success, negative number if failed.
+ **/
+ssize_t write_features(struct device* dev, struct device_attribute* attr, const char* buf, size_t count){
+	char name[MAX_STRLEN_OF_FEATURE+1];
+	unsigned int turn_on;
+	unsigned int i;
+
+	if (sscanf(buf, "%8s %u", name, &turn_on) != 2 || turn_on > 1) {
+		printk(KERN_ERR "Error: features format is: <feature name> <0/1>\n");
+		return -EINVAL;
+	}
+
+	for (i = 0; i < NUM_OF_FEATURES; ++i) {
+		if (strcmp(g_features[i].name, name) == 0) {
+			break;
+		}
+	}
+	if (i == NUM_OF_FEATURES) {
+		printk(KERN_ERR "Error: there's no feature named %s\n", name);
+		return -EINVAL;
+	}
+
+	mutex_lock(&g_features_mutex);
+	set_feature(&g_features[i], turn_on == 1);
+	mutex_unlock(&g_features_mutex);
+
+	return count;
+}
+
+/**
+ * 	Declaring a variable of type struct device_attribute, its name would be "dev_attr_features"
+ * 		.attr.mode = S_IRUSR | S_IWUSR | S_IROTH, giving the owner read & write permissions,
+ * 					 and other users read permissions
+ * 		.show = read_features
+ * 		.store = write_features
+ **/
+static DEVICE_ATTR(features, S_IRUSR | S_IWUSR | S_IROTH, read_features, write_features);
+
+/**
+ *	Creates "features" sysfs attribute (in rules_dev).
+ *	Returns: 0 on success, -1 if failed.
+ **/
+int init_features(struct device* rules_dev){
+	if (device_create_file(rules_dev, (const struct device_attribute *)&dev_attr_features.attr))
+	{
+		printk(KERN_ERR "Error: failed creating features-sysfs-file inside rules-char-device.\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ *	Removes "features" sysfs attribute
+ **/
+void destroy_features(struct device* rules_dev){
+	device_remove_file(rules_dev, (const struct device_attribute *)&dev_attr_features.attr);
+}
@@ -0,0 +1,73 @@
+#ifndef _FEATURE_UTILS_H_
+#define _FEATURE_UTILS_H_
+
+#include "fw.h"
+#include <linux/jump_label.h>	//For static keys
+#include <linux/mutex.h>
+
+/**
+ *	Features - parts of packets' paths that can be turned on/off while
+ *	firewall runs. Every feature is gated by a static key, so checking it
+ *	costs a single (patched) nop/jump, and a feature that's off runs none
+ *	of its code:
+ *		logging		- log rollups & log-rows (and their rings/netlink events)
+ *		proxy		- redirecting new HTTP/FTP/SMTP connections to the proxy
+ *					  (connections already redirected keep being faked,
+ *					  until they're closed)
+ *		xplico		- dropping incoming SYN packets to Xplico's port
+ *		verdicts	- verdict counters (see verdict_stats_utils.h)
+ *	All are on by default, and are turned on/off through "features" sysfs
+ *	attribute (of rules-device), e.g.:
+ *		echo "proxy 0" > /sys/class/fw/fw_rules/features
+ *
+ *	Firewall's active state (g_fw_active_key, flipped with "active") and
+ *	hook latency (g_hook_latency_key, flipped with "hook_latency") are
+ *	gated the same way, by their own attributes.
+ **/
+#define MAX_STRLEN_OF_FEATURE (8)		// maximum length value of("logging","proxy","xplico","verdicts") = 8
+
+typedef enum {
+	FEATURE_LOGGING		= 0,
+	FEATURE_PROXY		= 1,
+	FEATURE_XPLICO		= 2,
+	FEATURE_VERDICTS	= 3,
+	NUM_OF_FEATURES		= 4
+} feature_t;
+
+typedef struct {
+	const char*			name;
+	struct static_key*	key;
+	bool				on;			// Follows key, only changed holding g_features_mutex
+} feature_state_t;
+
+extern struct static_key g_fw_active_key;
+extern struct static_key g_logging_key;
+extern struct static_key g_proxy_key;
+extern struct static_key g_xplico_key;
+extern struct static_key g_verdicts_key;
+
+int init_features(struct device* rules_dev);
+void destroy_features(struct device* rules_dev);
+
+//Firewall's active state is off by default:
+static inline bool is_fw_active(void){
+	return static_key_false(&g_fw_active_key);
+}
+
+static inline bool is_logging_on(void){
+	return static_key_true(&g_logging_key);
+}
+
+static inline bool is_proxy_on(void){
+	return static_key_true(&g_proxy_key);
+}
+
+static inline bool is_xplico_on(void){
+	return static_key_true(&g_xplico_key);
+}
+
+static inline bool is_verdicts_on(void){
+	return static_key_true(&g_verdicts_key);
+}
+
+#endif /* _FEATURE_UTILS_H_ */
@@ -1,8 +1,10 @@
 #include "fw.h"
+#include "zone_utils.h"
+#include "fw_trace.h"
 
 /**
  *	Returns the direction of the packet,
- *	by comparing the interfaces' names
+ *	by the zones of the interfaces (see zone_utils.h)
  * 
  *	@in
  *  @out
@@ -16,19 +18,23 @@
 direction_t get_direction(const struct net_device* in, const struct net_device* out){
 	
 	if (in){ //"in" isn't NULL
-		if (strcmp(in->name, IN_NET_DEVICE_NAME) == 0){ //Packets' origin is eth1
-			return DIRECTION_OUT;
-		} else if (strcmp(in->name, OUT_NET_DEVICE_NAME) == 0) { //Packets' origin is eth2
-			return DIRECTION_IN;
+		switch (get_iface_zone(in)) {
+			case (ZONE_INSIDE): //Packets' origin is inside (like eth1)
+				return DIRECTION_OUT;
+			case (ZONE_OUTSIDE): //Packets' origin is outside (like eth2)
+				return DIRECTION_IN;
+			default:
+				return DIRECTION_ANY;
 		}
-		return DIRECTION_ANY;
 	} else if (out){
-		if (strcmp(out->name, IN_NET_DEVICE_NAME) == 0){ //Packets' dest is eth1
-			return DIRECTION_IN;
-		} else if (strcmp(out->name, OUT_NET_DEVICE_NAME) == 0) { //Packets' dest is eth2
-			return DIRECTION_OUT;
+		switch (get_iface_zone(out)) {
+			case (ZONE_INSIDE): //Packets' dest is inside (like eth1)
+				return DIRECTION_IN;
+			case (ZONE_OUTSIDE): //Packets' dest is outside (like eth2)
+				return DIRECTION_OUT;
+			default:
+				return DIRECTION_ANY;
 		}
-		return DIRECTION_ANY;
 	}
 	
 	printk(KERN_ERR "Function get_direction() got NULL arguments: both 'in' and 'out'.\n");
@@ -41,7 +47,7 @@ direction_t get_direction(const struct net_device* in, const struct net_device*
  *	[values from tcp_packet_t]
  * 
  **/
-tcp_packet_t get_tcp_packet_type(struct tcphdr* tcp_hdr){
+tcp_packet_t get_tcp_packet_type(const struct tcphdr* tcp_hdr){
 	
 	if (tcp_hdr == NULL) {
 		printk(KERN_ERR "In function get_tcp_packet_type(), function got NULL argument.\n");
@@ -63,7 +69,7 @@ tcp_packet_t get_tcp_packet_type(struct tcphdr* tcp_hdr){
 			}
 		} 
 		
-		printk(KERN_INFO "In function get_tcp_packet_type(), TCP packet has invalid flags (ack is 0).\n");
+		trace_fw_tcp_invalid_flags(tcp_hdr);
 		return TCP_INVALID_PACKET;
 	}
 	
@@ -77,7 +83,7 @@ tcp_packet_t get_tcp_packet_type(struct tcphdr* tcp_hdr){
 			return TCP_SYN_ACK_PACKET;
 		}
 		//Only SYN-ACK packets have ack==1 & syn==1 
-		printk(KERN_INFO "In function get_tcp_packet_type(), TCP packet has invalid flags (ack&syn are 1).\n");
+		trace_fw_tcp_invalid_flags(tcp_hdr);
 		return TCP_INVALID_PACKET;
 	}
 	
@@ -96,18 +102,14 @@ tcp_packet_t get_tcp_packet_type(struct tcphdr* tcp_hdr){
 /**
  * 	Checks if a given IPv4 packet is XMAS packet.
  *	
- *	@skb - pointer to struct sk_buff that represents current packet
+ *	@hdrs - packet's headers (see parse_packet_headers())
  *	
  *	Returns true if it represent a Christmas Tree Packet
  *	(TCP packet with PSH, URG, FIN flags on)
- * 
- *	struct iphdr->protocol values are from: 
- *	http://elixir.free-electrons.com/linux/latest/source/include/uapi/linux/in.h#L37
- *	here we're only interested in values that appear in enum prot_t. 
  **/
-bool is_XMAS(struct sk_buff* skb){
+bool is_XMAS(const packet_hdrs_t* hdrs){
 	
-	struct tcphdr* ptr_tcp_hdr = get_tcp_header(skb); //pointer to tcp header
+	const struct tcphdr* ptr_tcp_hdr = hdrs->tcp; //pointer to tcp header
 	
 	if (ptr_tcp_hdr){ //Means it's a TCP packet, ptr_tcp_hdr isn't NULL
 		if ( (ptr_tcp_hdr->psh == 1) && (ptr_tcp_hdr->urg == 1)
@@ -121,34 +123,56 @@ bool is_XMAS(struct sk_buff* skb){
 }
 
 /**
- * 	Checks if a given IPv4 packet is a TCP packet,
- *  Returns: its tcp header if it is,
- * 			 NULL otherwise.
- *	
+ *	Parses packet's ipv4 header, and its TCP/UDP header (if it has one),
+ *	into *hdrs - once per hook, for all checks that need them.
+ *	Headers are read with skb_header_pointer(), so skb doesn't have to
+ *	be linear (headers are only copied if they aren't in its linear part).
+ *
  *	@skb - pointer to struct sk_buff that represents current packet
+ *	@hdrs - packet_hdrs_t to be updated
  *
+ *	Returns false if packet has no (valid) ipv4 header.
+ * 
+ *	struct iphdr->protocol values are from: 
+ *	http://elixir.free-electrons.com/linux/latest/source/include/uapi/linux/in.h#L37
+ *	here we're only interested in values that appear in enum prot_t. 
  **/
-struct tcphdr* get_tcp_header(struct sk_buff* skb){
-	
-	struct iphdr* ptr_ipv4_hdr; //pointer to ipv4 header
-	
-	if (skb){ 
-		ptr_ipv4_hdr = ip_hdr(skb);
-		if(ptr_ipv4_hdr){
-			//Protocol is 1 byte - no need to consider Endianness
-			if (ptr_ipv4_hdr->protocol == PROT_TCP) {	//Checks in local endianness
-				//ihl holds the ip_header length in number of words, 
-				//each word is 32 bit long = 4 bytes 
-				return ((struct tcphdr*)((char*)ptr_ipv4_hdr + (ptr_ipv4_hdr->ihl * 4)));
-			}
-		} else {
-			printk(KERN_ERR "In get_tcp_header(), couldn't extract ipv4-header from skb.\n");
-		}
-	} else {
-		printk(KERN_ERR "In get_tcp_header(), function got NULL argument.\n");
+bool parse_packet_headers(struct sk_buff* skb, packet_hdrs_t* hdrs){
+	
+	unsigned int ip_offset;
+	
+	hdrs->tcp = NULL;
+	hdrs->udp = NULL;
+	
+	if (skb == NULL) {
+		printk(KERN_ERR "In parse_packet_headers(), function got NULL argument.\n");
+		return false;
+	}
+	
+	ip_offset = skb_network_offset(skb);
+	hdrs->ip = skb_header_pointer(skb, ip_offset, sizeof(struct iphdr), &hdrs->ip_buf);
+	if (hdrs->ip == NULL || hdrs->ip->ihl < 5) {
+		printk(KERN_ERR "In parse_packet_headers(), couldn't extract ipv4-header from skb.\n");
+		return false;
+	}
+	
+	//ihl holds the ip_header length in number of words, 
+	//each word is 32 bit long = 4 bytes 
+	hdrs->l4_offset = ip_offset + (hdrs->ip->ihl * 4);
+	
+	//Only the first fragment has a TCP/UDP header:
+	if (hdrs->ip->frag_off & htons(IP_OFFSET)) {
+		return true;
+	}
+	
+	//Protocol is 1 byte - no need to consider Endianness
+	if (hdrs->ip->protocol == PROT_TCP) {
+		hdrs->tcp = skb_header_pointer(skb, hdrs->l4_offset, sizeof(struct tcphdr), &hdrs->tcp_buf);
+	} else if (hdrs->ip->protocol == PROT_UDP) {
+		hdrs->udp = skb_header_pointer(skb, hdrs->l4_offset, sizeof(struct udphdr), &hdrs->udp_buf);
 	}
 	
-	return NULL;
+	return true;
 }
 
 /**
@@ -160,39 +184,51 @@ struct tcphdr* get_tcp_header(struct sk_buff* skb){
  *	@fake_ip - the ip we want to fake (to), in LOCAL ENDIANNESS!
  *	@fake_port - the port we want to fake (to), in LOCAL ENDIANNESS!
  * 
+ *	Note:	1. Only the headers are made writable (skb isn't linearized),
+ * 			   so headers parsed before (packet_hdrs_t) shouldn't be used after.
+ * 			2. Checksums are updated incrementally (only the changed fields),
+ * 			   so checksum offloading (CHECKSUM_PARTIAL) keeps working.
+ * 
  *	Returns false if failed 
  **/
 bool fake_packets_details(struct sk_buff *skb, bool fake_src, __be32 fake_ip, __be16 fake_port)
 {
 	struct iphdr *ip_header;
 	struct tcphdr *tcp_header;
-	int tcplen;	
+	__be32 *ip_field;
+	__be16 *port_field;
+	__be32 new_ip = htonl(fake_ip);
+	__be16 new_port = htons(fake_port);
 	
 	if ( skb == NULL 
-		|| skb_linearize(skb) != 0
 		|| (ip_header = ip_hdr(skb)) == NULL
-		|| (tcp_header = get_tcp_header(skb)) == NULL )
+		|| ip_header->protocol != PROT_TCP
+		|| !skb_make_writable(skb, skb_network_offset(skb) + (ip_header->ihl * 4) + sizeof(struct tcphdr)) )
 	{
 		printk(KERN_ERR "Error: function fake_packets_details() failed.\n");
 		return false;
 	}
+	
+	//skb_make_writable() might have moved the headers:
+	ip_header = ip_hdr(skb);
+	tcp_header = (struct tcphdr*)((char*)ip_header + (ip_header->ihl * 4));
+	trace_fw_proxy_rewrite(ip_header, tcp_header, fake_src, fake_ip, fake_port);
 
 	//Change routing:
 	if (fake_src){	
-		ip_header->saddr = htonl(fake_ip);
-		tcp_header->source = htons(fake_port);
+		ip_field = &ip_header->saddr;
+		port_field = &tcp_header->source;
 	} else {
-		ip_header->daddr = htonl(fake_ip);
-		tcp_header->dest = htons(fake_port);
+		ip_field = &ip_header->daddr;
+		port_field = &tcp_header->dest;
 	}
 
-	//Fix checksum for both IP and TCP:
-	tcplen = (skb->len - ((ip_header->ihl )<< 2));
-	tcp_header->check = 0;
-	tcp_header->check = tcp_v4_check(tcplen, ip_header->saddr, ip_header->daddr,csum_partial((char*)tcp_header, tcplen,0));
-	skb->ip_summed = CHECKSUM_NONE; //stop offloading
-	ip_header->check = 0;
-	ip_header->check = ip_fast_csum((u8 *)ip_header, ip_header->ihl);
+	//Fix checksum for both IP and TCP (ip is part of TCP's pseudo-header):
+	csum_replace4(&ip_header->check, *ip_field, new_ip);
+	inet_proto_csum_replace4(&tcp_header->check, skb, *ip_field, new_ip, 1);
+	inet_proto_csum_replace2(&tcp_header->check, skb, *port_field, new_port, 0);
+	*ip_field = new_ip;
+	*port_field = new_port;
 
 	return true;
 }
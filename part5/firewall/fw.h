@@ -10,7 +10,7 @@
 #include <linux/netfilter_ipv4.h>
 #include <linux/ip.h>
 #include <linux/tcp.h>
-#include <net/tcp.h>		//For tcp_v4_check()
+#include <net/tcp.h>		//For inet_proto_csum_replace4()
 #include <linux/udp.h>
 #include <linux/types.h> 	//For bool type
 #include <linux/uaccess.h> 	//For allowing user-space access
@@ -56,6 +56,7 @@ typedef enum {
 	REASON_LOOPBACK_PACKET = -10,
 	REASON_PART_OF_PROXY_HANDSHAKE = -11,
 	REASON_XPLICO_PACKET = -12,
+	REASON_HALF_OPEN_LIMIT = -13,
 } reason_t;
 	
 
@@ -63,10 +64,11 @@ typedef enum {
 #define DEVICE_NAME_RULES			"rules"
 #define DEVICE_NAME_LOG				"log"
 #define DEVICE_NAME_CONN_TAB		"conn_tab"
+#define DEVICE_NAME_CONN_SYNC		"conn_sync"
 #define CLASS_NAME					"fw"
 #define LOOPBACK_NET_DEVICE_NAME	"lo"
-#define IN_NET_DEVICE_NAME			"eth1"
-#define OUT_NET_DEVICE_NAME			"eth2"
+#define IN_NET_DEVICE_NAME			"eth1"		// default inside zone (see zone_utils.h)
+#define OUT_NET_DEVICE_NAME			"eth2"		// default outside zone
 
 // auxiliary values, for your convenience
 #define IP_VERSION		(4)
@@ -85,6 +87,7 @@ typedef enum {
 	MINOR_RULES    = 0,
 	MINOR_LOG      = 1,
 	MINOR_CONN_TAB = 2,
+	MINOR_CONN_SYNC = 3,
 } minor_t;
 
 typedef enum {
@@ -130,6 +133,8 @@ typedef struct {
 	reason_t     	reason;       	// rule#index, or values from: reason_t
 	unsigned int   	count;        	// counts this line's hits
 	struct list_head list;			// For saving kernel-list of all log-rows
+	struct hlist_node hnode;		// For saving the row in its hash-bucket
+	unsigned long	seq;			// Insertions to its cpu's log-table, when inserted
 } log_row_t;
 
 //Enum to help deciding about packets
@@ -225,15 +230,35 @@ typedef struct {
 	//		wherever a new connection_row_t is created.
 
 	struct list_head list;			// For saving kernel-list of all connection-rows
+	struct rcu_head rcu;			// For freeing a row only after lockless readers are done
+	bool			dead;			// Set (holding the table's lock) when row is removed from list
 
 }connection_row_t;
 
+/**
+ *	Headers of a packet, parsed once per hook (see parse_packet_headers()).
+ *	Headers are read with skb_header_pointer(), so a header that isn't in
+ *	skb's linear part (or crosses its end) is copied to the *_buf fields,
+ *	and skb never has to be linearized.
+ *	NOTE: pointers are read-only, and only valid until skb is changed
+ *		  (see fake_packets_details()).
+ **/
+typedef struct {
+	const struct iphdr*		ip;
+	const struct tcphdr*	tcp;		// NULL if not TCP, or not the first fragment
+	const struct udphdr*	udp;		// NULL if not UDP, or not the first fragment
+	unsigned int			l4_offset;	// Offset of tcp/udp header (from skb->data)
+	struct iphdr			ip_buf;
+	struct tcphdr			tcp_buf;
+	struct udphdr			udp_buf;
+} packet_hdrs_t;
+
 
 direction_t get_direction(const struct net_device* in, const struct net_device* out);
-tcp_packet_t get_tcp_packet_type(struct tcphdr* tcp_hdr);
+tcp_packet_t get_tcp_packet_type(const struct tcphdr* tcp_hdr);
+bool parse_packet_headers(struct sk_buff* skb, packet_hdrs_t* hdrs);
 bool fake_packets_details(struct sk_buff *skb, bool fake_src, __be32 fake_ip, __be16 fake_port);
-bool is_XMAS(struct sk_buff* skb);
-struct tcphdr* get_tcp_header(struct sk_buff* skb);
+bool is_XMAS(const packet_hdrs_t* hdrs);
 bool is_relevant_ip(__be32 rule_ip, __be32 rule_prefix_mask, __be32 packet_ip);
 
 #endif // _FW_H_
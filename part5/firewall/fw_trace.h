@@ -0,0 +1,280 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM fw
+
+#if !defined(_FW_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _FW_TRACE_H_
+
+/**
+ *	Tracepoints of the firewall's decision stages (under
+ *	/sys/kernel/debug/tracing/events/fw/, or perf's "fw:*" events).
+ *	While a tracepoint isn't enabled it costs a (patched) jump, so these
+ *	replace printk()s of packets' paths.
+ *
+ *	NOTE: all ips & ports are in LOCAL endianness (as in log_row_t and
+ *		  connection_row_t). CREATE_TRACE_POINTS is defined in main.c only.
+ **/
+
+#include <linux/tracepoint.h>
+#include "fw.h"
+
+#define FW_TRACE_TCP_FLAGS					\
+	{ 0x01, "FIN" }, { 0x02, "SYN" }, { 0x04, "RST" },	\
+	{ 0x08, "PSH" }, { 0x10, "ACK" }, { 0x20, "URG" }
+
+/**
+ *	A packet's details (from its log_row_t)
+ **/
+DECLARE_EVENT_CLASS(fw_log_row_class,
+
+	TP_PROTO(const log_row_t* row),
+
+	TP_ARGS(row),
+
+	TP_STRUCT__entry(
+		__field(	__u32,			src_ip		)
+		__field(	__u32,			dst_ip		)
+		__field(	__u16,			src_port	)
+		__field(	__u16,			dst_port	)
+		__field(	__u8,			protocol	)
+		__field(	__u8,			action		)
+		__field(	__u8,			hooknum		)
+		__field(	int,			reason		)
+		__field(	unsigned int,	count		)
+	),
+
+	TP_fast_assign(
+		__entry->src_ip		= row->src_ip;
+		__entry->dst_ip		= row->dst_ip;
+		__entry->src_port	= row->src_port;
+		__entry->dst_port	= row->dst_port;
+		__entry->protocol	= row->protocol;
+		__entry->action		= row->action;
+		__entry->hooknum	= row->hooknum;
+		__entry->reason		= row->reason;
+		__entry->count		= row->count;
+	),
+
+	TP_printk("src=%pI4h:%hu dst=%pI4h:%hu protocol=%hhu action=%s hooknum=%hhu reason=%d count=%u",
+		&__entry->src_ip, __entry->src_port, &__entry->dst_ip, __entry->dst_port,
+		__entry->protocol, (__entry->action == NF_ACCEPT) ? "accept" : "drop",
+		__entry->hooknum, __entry->reason, __entry->count)
+);
+
+//A rule matched a packet (reason is the rule's index):
+DEFINE_EVENT(fw_log_row_class, fw_rule_match,
+	TP_PROTO(const log_row_t* row),
+	TP_ARGS(row)
+);
+
+//A new log-row was added (see insert_row()):
+DEFINE_EVENT(fw_log_row_class, fw_log_insert,
+	TP_PROTO(const log_row_t* row),
+	TP_ARGS(row)
+);
+
+//A packet was counted in a similar log-row (see insert_row()):
+DEFINE_EVENT(fw_log_row_class, fw_log_update,
+	TP_PROTO(const log_row_t* row),
+	TP_ARGS(row)
+);
+
+//The oldest log-row was deleted to make room (see trim_log_tab()):
+DEFINE_EVENT(fw_log_row_class, fw_log_evict,
+	TP_PROTO(const log_row_t* row),
+	TP_ARGS(row)
+);
+
+/**
+ *	A connection-row's details
+ **/
+DECLARE_EVENT_CLASS(fw_conn_row_class,
+
+	TP_PROTO(const connection_row_t* row),
+
+	TP_ARGS(row),
+
+	TP_STRUCT__entry(
+		__field(	__u32,		src_ip			)
+		__field(	__u32,		dst_ip			)
+		__field(	__u16,		src_port		)
+		__field(	__u16,		dst_port		)
+		__field(	int,		tcp_state		)
+		__field(	int,		fake_tcp_state	)
+		__field(	bool,		faked			)
+	),
+
+	TP_fast_assign(
+		__entry->src_ip			= row->src_ip;
+		__entry->dst_ip			= row->dst_ip;
+		__entry->src_port		= row->src_port;
+		__entry->dst_port		= row->dst_port;
+		__entry->tcp_state		= row->tcp_state;
+		__entry->fake_tcp_state	= row->fake_tcp_state;
+		__entry->faked			= row->need_to_fake_connection;
+	),
+
+	TP_printk("src=%pI4h:%hu dst=%pI4h:%hu tcp_state=%d fake_tcp_state=%d faked=%d",
+		&__entry->src_ip, __entry->src_port, &__entry->dst_ip, __entry->dst_port,
+		__entry->tcp_state, __entry->fake_tcp_state, __entry->faked)
+);
+
+//A connection-row was added to the connection-table (in its first state):
+DEFINE_EVENT(fw_conn_row_class, fw_conn_create,
+	TP_PROTO(const connection_row_t* row),
+	TP_ARGS(row)
+);
+
+//A connection-row was deleted (in its last state):
+DEFINE_EVENT(fw_conn_row_class, fw_conn_delete,
+	TP_PROTO(const connection_row_t* row),
+	TP_ARGS(row)
+);
+
+//A timed-out connection-row was deleted (after its fw_conn_delete):
+DEFINE_EVENT(fw_conn_row_class, fw_conn_expire,
+	TP_PROTO(const connection_row_t* row),
+	TP_ARGS(row)
+);
+
+/**
+ *	A connection-row's tcp_state / fake_tcp_state changed
+ **/
+TRACE_EVENT(fw_conn_state,
+
+	TP_PROTO(const connection_row_t* row, tcp_state_t old_tcp_state,
+		tcp_state_t old_fake_tcp_state),
+
+	TP_ARGS(row, old_tcp_state, old_fake_tcp_state),
+
+	TP_STRUCT__entry(
+		__field(	__u32,		src_ip				)
+		__field(	__u32,		dst_ip				)
+		__field(	__u16,		src_port			)
+		__field(	__u16,		dst_port			)
+		__field(	int,		old_tcp_state		)
+		__field(	int,		tcp_state			)
+		__field(	int,		old_fake_tcp_state	)
+		__field(	int,		fake_tcp_state		)
+	),
+
+	TP_fast_assign(
+		__entry->src_ip				= row->src_ip;
+		__entry->dst_ip				= row->dst_ip;
+		__entry->src_port			= row->src_port;
+		__entry->dst_port			= row->dst_port;
+		__entry->old_tcp_state		= old_tcp_state;
+		__entry->tcp_state			= row->tcp_state;
+		__entry->old_fake_tcp_state	= old_fake_tcp_state;
+		__entry->fake_tcp_state		= row->fake_tcp_state;
+	),
+
+	TP_printk("src=%pI4h:%hu dst=%pI4h:%hu tcp_state=%d->%d fake_tcp_state=%d->%d",
+		&__entry->src_ip, __entry->src_port, &__entry->dst_ip, __entry->dst_port,
+		__entry->old_tcp_state, __entry->tcp_state,
+		__entry->old_fake_tcp_state, __entry->fake_tcp_state)
+);
+
+/**
+ *	A TCP packet that doesn't fit its connection-row's (fake) state
+ *	(state wasn't changed)
+ **/
+TRACE_EVENT(fw_conn_unexpected_packet,
+
+	TP_PROTO(const connection_row_t* row, tcp_packet_t tcp_pckt_type),
+
+	TP_ARGS(row, tcp_pckt_type),
+
+	TP_STRUCT__entry(
+		__field(	__u32,		src_ip			)
+		__field(	__u32,		dst_ip			)
+		__field(	__u16,		src_port		)
+		__field(	__u16,		dst_port		)
+		__field(	int,		tcp_pckt_type	)
+		__field(	int,		tcp_state		)
+		__field(	int,		fake_tcp_state	)
+	),
+
+	TP_fast_assign(
+		__entry->src_ip			= row->src_ip;
+		__entry->dst_ip			= row->dst_ip;
+		__entry->src_port		= row->src_port;
+		__entry->dst_port		= row->dst_port;
+		__entry->tcp_pckt_type	= tcp_pckt_type;
+		__entry->tcp_state		= row->tcp_state;
+		__entry->fake_tcp_state	= row->fake_tcp_state;
+	),
+
+	TP_printk("src=%pI4h:%hu dst=%pI4h:%hu tcp_pckt_type=%d tcp_state=%d fake_tcp_state=%d",
+		&__entry->src_ip, __entry->src_port, &__entry->dst_ip, __entry->dst_port,
+		__entry->tcp_pckt_type, __entry->tcp_state, __entry->fake_tcp_state)
+);
+
+/**
+ *	A TCP packet has an invalid combination of flags (see get_tcp_packet_type())
+ **/
+TRACE_EVENT(fw_tcp_invalid_flags,
+
+	TP_PROTO(const struct tcphdr* tcp_hdr),
+
+	TP_ARGS(tcp_hdr),
+
+	TP_STRUCT__entry(
+		__field(	__u16,		src_port	)
+		__field(	__u16,		dst_port	)
+		__field(	__u8,		flags		)
+	),
+
+	TP_fast_assign(
+		__entry->src_port	= ntohs(tcp_hdr->source);
+		__entry->dst_port	= ntohs(tcp_hdr->dest);
+		__entry->flags		= tcp_hdr->fin | (tcp_hdr->syn << 1) | (tcp_hdr->rst << 2) |
+							  (tcp_hdr->psh << 3) | (tcp_hdr->ack << 4) | (tcp_hdr->urg << 5);
+	),
+
+	TP_printk("src_port=%hu dst_port=%hu flags=%s", __entry->src_port, __entry->dst_port,
+		__print_flags(__entry->flags, "|", FW_TRACE_TCP_FLAGS))
+);
+
+/**
+ *	A packet's source/destination is rewritten (see fake_packets_details())
+ **/
+TRACE_EVENT(fw_proxy_rewrite,
+
+	TP_PROTO(const struct iphdr* ip_hdr, const struct tcphdr* tcp_hdr, bool fake_src,
+		__u32 fake_ip, __u16 fake_port),
+
+	TP_ARGS(ip_hdr, tcp_hdr, fake_src, fake_ip, fake_port),
+
+	TP_STRUCT__entry(
+		__field(	__u32,		src_ip		)
+		__field(	__u32,		dst_ip		)
+		__field(	__u16,		src_port	)
+		__field(	__u16,		dst_port	)
+		__field(	bool,		fake_src	)
+		__field(	__u32,		fake_ip		)
+		__field(	__u16,		fake_port	)
+	),
+
+	TP_fast_assign(
+		__entry->src_ip		= ntohl(ip_hdr->saddr);
+		__entry->dst_ip		= ntohl(ip_hdr->daddr);
+		__entry->src_port	= ntohs(tcp_hdr->source);
+		__entry->dst_port	= ntohs(tcp_hdr->dest);
+		__entry->fake_src	= fake_src;
+		__entry->fake_ip	= fake_ip;
+		__entry->fake_port	= fake_port;
+	),
+
+	TP_printk("src=%pI4h:%hu dst=%pI4h:%hu %s=%pI4h:%hu",
+		&__entry->src_ip, __entry->src_port, &__entry->dst_ip, __entry->dst_port,
+		__entry->fake_src ? "new_src" : "new_dst", &__entry->fake_ip, __entry->fake_port)
+);
+
+#endif /* _FW_TRACE_H_ */
+
+//This part must be outside the header's guard (module's trace header isn't in include/trace/events):
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE fw_trace
+#include <trace/define_trace.h>
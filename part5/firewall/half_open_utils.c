@@ -0,0 +1,449 @@
+#include "half_open_utils.h"
+
+/**
+ *	When g_syn_admission == SYN_ADMISSION_DEFERRED, an accepted SYN of a
+ *	connection that isn't proxied doesn't get a connection-row.
+ *	Instead, the handshake is tracked here until its last ACK arrives,
+ *	and only then the connection-rows are added to g_connections_list.
+ *
+ *	All rows are preallocated (g_half_open_pool), so a SYN never allocates
+ *	memory. A source can't hold more than MAX_HALF_OPEN_PER_SRC rows
+ *	(counted per hash-slot of its ip), and the whole table can't hold more
+ *	than MAX_HALF_OPEN_ROWS. A SYN beyond its source's limit is dropped,
+ *	but when the whole table is full, the oldest row is evicted instead
+ *	(after timedout ones), so a flood can't lock out new handshakes for
+ *	HALF_OPEN_TIMEOUT_SECONDS.
+ *
+ *	Used rows are also kept in g_half_open_age_list, oldest first (a
+ *	refreshed row moves to its end), so timedout rows are reaped, and the
+ *	oldest row is found, from its head.
+ **/
+int g_syn_admission = SYN_ADMISSION_IMMEDIATE;
+module_param_named(syn_admission, g_syn_admission, int, S_IRUGO);
+MODULE_PARM_DESC(syn_admission, "0: add a connection-row for every accepted SYN, 1: only after the handshake completes");
+
+static half_open_row_t* g_half_open_pool = NULL;
+static HLIST_HEAD(g_half_open_free_list);
+static struct hlist_head g_half_open_tab[HALF_OPEN_NUM_BUCKETS];
+static LIST_HEAD(g_half_open_age_list);
+static unsigned short g_half_open_per_src[HALF_OPEN_SRC_SLOTS];
+static DEFINE_SPINLOCK(g_half_open_lock);
+static unsigned int g_num_of_half_open_rows = 0;
+static unsigned long g_num_of_dropped_syns = 0;
+static unsigned long g_num_of_evicted_rows = 0;
+static u32 g_half_open_hash_seed = 0;
+
+/**
+ *	Returns the index of the bucket the given tuple belongs to
+ **/
+static inline unsigned int get_half_open_bucket(__be32 src_ip, __be16 src_port,
+		__be32 dst_ip, __be16 dst_port)
+{
+	return jhash_3words(src_ip, dst_ip, (((u32)src_port) << 16) | dst_port,
+			g_half_open_hash_seed) & (HALF_OPEN_NUM_BUCKETS - 1);
+}
+
+/**
+ *	Returns the per-source counter's slot of the given source ip
+ **/
+static inline unsigned int get_src_slot(__be32 src_ip){
+	return jhash_1word(src_ip, g_half_open_hash_seed) % HALF_OPEN_SRC_SLOTS;
+}
+
+/**
+ *	Returns a row back to g_half_open_free_list.
+ *	NOTE: caller should hold g_half_open_lock!
+ **/
+static void delete_half_open_row(half_open_row_t* row){
+	unsigned int slot = get_src_slot(row->src_ip);
+
+	hlist_del(&(row->hnode));
+	list_del(&(row->age_node));
+	hlist_add_head(&(row->hnode), &g_half_open_free_list);
+	--g_num_of_half_open_rows;
+	if (g_half_open_per_src[slot] > 0) {
+		--g_half_open_per_src[slot];
+	}
+}
+
+/**
+ *	Refreshes a row's timestamp (moves it to g_half_open_age_list's end).
+ *	NOTE: caller should hold g_half_open_lock!
+ **/
+static inline void refresh_half_open_row(half_open_row_t* row, unsigned long now){
+	row->timestamp = now;
+	list_move_tail(&(row->age_node), &g_half_open_age_list);
+}
+
+/**
+ *	Deletes all timedout rows (from g_half_open_age_list's head, every row
+ *	is reaped once, so it costs O(1) per row).
+ *	NOTE: caller should hold g_half_open_lock!
+ **/
+static void delete_timedout_half_open_rows(unsigned long now){
+	half_open_row_t* row;
+	half_open_row_t* tmp;
+
+	list_for_each_entry_safe(row, tmp, &g_half_open_age_list, age_node) {
+		if ((now - row->timestamp) < HALF_OPEN_TIMEOUT_SECONDS){
+			break;
+		}
+		delete_half_open_row(row);
+	}
+}
+
+/**
+ *	Searches a bucket for a row with the given tuple.
+ *	NOTE: caller should hold g_half_open_lock!
+ *
+ *	Returns the row, or NULL if none was found.
+ **/
+static half_open_row_t* find_half_open_row(unsigned int bucket, __be32 src_ip,
+		__be16 src_port, __be32 dst_ip, __be16 dst_port)
+{
+	half_open_row_t* row;
+
+	hlist_for_each_entry(row, &g_half_open_tab[bucket], hnode) {
+		if (row->src_ip == src_ip && row->src_port == src_port &&
+			row->dst_ip == dst_ip && row->dst_port == dst_port)
+		{
+			return row;
+		}
+	}
+	return NULL;
+}
+
+/**
+ *	Gets a pointer to an accepted (first) SYN packet's log_row_t,
+ *	adds a row for its handshake to g_half_open_tab (a retransmitted SYN
+ *	only refreshes the existing row).
+ *
+ *	Returns true on success, false if the packet should be dropped since
+ *	its source reached its limit.
+ **/
+bool add_half_open_row(log_row_t* syn_pckt_lg_info){
+	half_open_row_t* row;
+	unsigned int bucket, slot;
+
+	if (syn_pckt_lg_info == NULL) {
+		printk(KERN_ERR "In add_half_open_row(), function got NULL argument.\n");
+		return false;
+	}
+
+	bucket = get_half_open_bucket(syn_pckt_lg_info->src_ip, syn_pckt_lg_info->src_port,
+			syn_pckt_lg_info->dst_ip, syn_pckt_lg_info->dst_port);
+	slot = get_src_slot(syn_pckt_lg_info->src_ip);
+
+	spin_lock_bh(&g_half_open_lock);
+
+	delete_timedout_half_open_rows(syn_pckt_lg_info->timestamp);
+
+	row = find_half_open_row(bucket, syn_pckt_lg_info->src_ip, syn_pckt_lg_info->src_port,
+			syn_pckt_lg_info->dst_ip, syn_pckt_lg_info->dst_port);
+	if (row != NULL) {
+		refresh_half_open_row(row, syn_pckt_lg_info->timestamp);
+		spin_unlock_bh(&g_half_open_lock);
+		return true;
+	}
+
+	if (g_half_open_per_src[slot] >= MAX_HALF_OPEN_PER_SRC) {
+		++g_num_of_dropped_syns;
+		spin_unlock_bh(&g_half_open_lock);
+		return false;
+	}
+
+	//Table is full (of rows that didn't timeout yet) - evict the oldest:
+	if (hlist_empty(&g_half_open_free_list)) {
+		delete_half_open_row(list_first_entry(&g_half_open_age_list, half_open_row_t, age_node));
+		++g_num_of_evicted_rows;
+	}
+
+	row = hlist_entry(g_half_open_free_list.first, half_open_row_t, hnode);
+	hlist_del(&(row->hnode));
+
+	row->src_ip = syn_pckt_lg_info->src_ip;
+	row->src_port = syn_pckt_lg_info->src_port;
+	row->dst_ip = syn_pckt_lg_info->dst_ip;
+	row->dst_port = syn_pckt_lg_info->dst_port;
+	row->tcp_state = TCP_STATE_SYN_SENT;
+	row->timestamp = syn_pckt_lg_info->timestamp;
+
+	hlist_add_head(&(row->hnode), &g_half_open_tab[bucket]);
+	list_add_tail(&(row->age_node), &g_half_open_age_list);
+	++g_half_open_per_src[slot];
+	++g_num_of_half_open_rows;
+
+	spin_unlock_bh(&g_half_open_lock);
+	return true;
+}
+
+/**
+ *	Gets a pointer to a SYN-ACK packet's log_row_t,
+ *	if it answers a SYN in g_half_open_tab - updates that row's state to
+ *	TCP_STATE_SYN_RCVD.
+ *
+ *	Returns true if such a row was found.
+ **/
+bool update_half_open_row_by_SYN_ACK(log_row_t* syn_ack_pckt_lg_info){
+	half_open_row_t* row;
+	unsigned int bucket;
+	bool found = false;
+
+	if (syn_ack_pckt_lg_info == NULL) {
+		printk(KERN_ERR "In update_half_open_row_by_SYN_ACK(), function got NULL argument.\n");
+		return false;
+	}
+
+	//The SYN-ACK is sent by the server - so the tuple is reversed:
+	bucket = get_half_open_bucket(syn_ack_pckt_lg_info->dst_ip, syn_ack_pckt_lg_info->dst_port,
+			syn_ack_pckt_lg_info->src_ip, syn_ack_pckt_lg_info->src_port);
+
+	spin_lock_bh(&g_half_open_lock);
+	row = find_half_open_row(bucket, syn_ack_pckt_lg_info->dst_ip, syn_ack_pckt_lg_info->dst_port,
+			syn_ack_pckt_lg_info->src_ip, syn_ack_pckt_lg_info->src_port);
+	if (row != NULL &&
+		(syn_ack_pckt_lg_info->timestamp - row->timestamp) < HALF_OPEN_TIMEOUT_SECONDS &&
+		(row->tcp_state == TCP_STATE_SYN_SENT || row->tcp_state == TCP_STATE_SYN_RCVD))
+	{
+		row->tcp_state = TCP_STATE_SYN_RCVD;
+		refresh_half_open_row(row, syn_ack_pckt_lg_info->timestamp);
+		found = true;
+	}
+	spin_unlock_bh(&g_half_open_lock);
+
+	return found;
+}
+
+/**
+ *	Gets a pointer to an ACK packet's log_row_t,
+ *	if it's the last ACK of a handshake in g_half_open_tab (the SYN-ACK
+ *	was already seen) - DELETES that row.
+ *
+ *	Returns true if such a row was found, meaning the caller should add
+ *	the connection-rows of this connection.
+ **/
+bool take_half_open_row_by_ACK(log_row_t* ack_pckt_lg_info){
+	half_open_row_t* row;
+	unsigned int bucket;
+	bool found = false;
+
+	if (ack_pckt_lg_info == NULL) {
+		printk(KERN_ERR "In take_half_open_row_by_ACK(), function got NULL argument.\n");
+		return false;
+	}
+
+	bucket = get_half_open_bucket(ack_pckt_lg_info->src_ip, ack_pckt_lg_info->src_port,
+			ack_pckt_lg_info->dst_ip, ack_pckt_lg_info->dst_port);
+
+	spin_lock_bh(&g_half_open_lock);
+	row = find_half_open_row(bucket, ack_pckt_lg_info->src_ip, ack_pckt_lg_info->src_port,
+			ack_pckt_lg_info->dst_ip, ack_pckt_lg_info->dst_port);
+	if (row != NULL && row->tcp_state == TCP_STATE_SYN_RCVD &&
+		(ack_pckt_lg_info->timestamp - row->timestamp) < HALF_OPEN_TIMEOUT_SECONDS)
+	{
+		delete_half_open_row(row);
+		found = true;
+	}
+	spin_unlock_bh(&g_half_open_lock);
+
+	return found;
+}
+
+/**
+ *	Gets a pointer to a RESET packet's log_row_t,
+ *	if it belongs to a handshake in g_half_open_tab (sent by any of its
+ *	sides) - DELETES that row.
+ *
+ *	Returns true if such a row was found.
+ **/
+bool delete_half_open_row_by_RESET(log_row_t* rst_pckt_lg_info){
+	half_open_row_t* row;
+	unsigned int bucket;
+
+	if (rst_pckt_lg_info == NULL) {
+		printk(KERN_ERR "In delete_half_open_row_by_RESET(), function got NULL argument.\n");
+		return false;
+	}
+
+	spin_lock_bh(&g_half_open_lock);
+
+	//Sent by the client:
+	bucket = get_half_open_bucket(rst_pckt_lg_info->src_ip, rst_pckt_lg_info->src_port,
+			rst_pckt_lg_info->dst_ip, rst_pckt_lg_info->dst_port);
+	row = find_half_open_row(bucket, rst_pckt_lg_info->src_ip, rst_pckt_lg_info->src_port,
+			rst_pckt_lg_info->dst_ip, rst_pckt_lg_info->dst_port);
+	if (row == NULL) {
+		//Sent by the server:
+		bucket = get_half_open_bucket(rst_pckt_lg_info->dst_ip, rst_pckt_lg_info->dst_port,
+				rst_pckt_lg_info->src_ip, rst_pckt_lg_info->src_port);
+		row = find_half_open_row(bucket, rst_pckt_lg_info->dst_ip, rst_pckt_lg_info->dst_port,
+				rst_pckt_lg_info->src_ip, rst_pckt_lg_info->src_port);
+	}
+	if (row != NULL) {
+		delete_half_open_row(row);
+	}
+
+	spin_unlock_bh(&g_half_open_lock);
+
+	return (row != NULL);
+}
+
+/**
+ *	Deletes all rows from g_half_open_tab
+ *	(returns them all to the free-list)
+ **/
+void delete_all_half_open_rows(void){
+	half_open_row_t* row;
+	struct hlist_node* tmp;
+	unsigned int i;
+
+	spin_lock_bh(&g_half_open_lock);
+	for (i = 0; i < HALF_OPEN_NUM_BUCKETS; ++i) {
+		hlist_for_each_entry_safe(row, tmp, &g_half_open_tab[i], hnode) {
+			delete_half_open_row(row);
+		}
+	}
+	memset(g_half_open_per_src, 0, sizeof(g_half_open_per_src));
+	spin_unlock_bh(&g_half_open_lock);
+}
+
+ /**
+ *	This function will be called when user tries to read from "syn_admission"
+ *
+ *  NOTE: writes to "buf" the value of g_syn_admission, in (string) format:
+ * 		<g_syn_admission> (would be "0" or "1")
+ **/
+ssize_t read_syn_admission(struct device* dev, struct device_attribute* attr, char* buf){
+		ssize_t ret = scnprintf(buf, PAGE_SIZE, "%d", g_syn_admission);
+		if (ret <= 0){
+			printk(KERN_ERR "*** Error: failed writing to user's buffer in function read_syn_admission() ***\n");
+		}
+		return ret;
+}
+
+/**
+ * 	This function will be called when user tries to write to "syn_admission".
+ *  Returns:	count on success,
+ * 				a negative number otherwise.
+ *
+ * 	Buffer should contain: 	'0' - SYN_ADMISSION_IMMEDIATE,
+ * 							'1' - SYN_ADMISSION_DEFERRED
+ *
+ *	NOTE: when changing back to SYN_ADMISSION_IMMEDIATE, handshakes that
+ *		  are in progress are forgotten (their last ACK would be dropped).
+ **/
+ssize_t change_syn_admission(struct device* dev, struct device_attribute* attr, const char* buf, size_t count){
+
+	if( (buf == NULL) || (count != 1) || ((buf[0] != '0') && (buf[0] != '1')) ){
+		printk(KERN_ERR "*** Error: user sent invalid input to change_syn_admission() ***\n");
+		return -EPERM;
+	}
+
+	g_syn_admission = (buf[0] == '1') ? SYN_ADMISSION_DEFERRED : SYN_ADMISSION_IMMEDIATE;
+	if (g_syn_admission == SYN_ADMISSION_IMMEDIATE) {
+		delete_all_half_open_rows();
+	}
+
+	return count;
+}
+
+ /**
+ *	This function will be called when user tries to read from "half_open_stats"
+ *
+ *  NOTE: writes to "buf", in (string) format:
+ * 		<number of rows> <max number of rows> <max rows per source> <number of dropped SYNs> <number of evicted rows>
+ **/
+ssize_t read_half_open_stats(struct device* dev, struct device_attribute* attr, char* buf){
+		ssize_t ret;
+		unsigned int num_of_rows;
+		unsigned long num_of_dropped_syns, num_of_evicted_rows;
+
+		spin_lock_bh(&g_half_open_lock);
+		num_of_rows = g_num_of_half_open_rows;
+		num_of_dropped_syns = g_num_of_dropped_syns;
+		num_of_evicted_rows = g_num_of_evicted_rows;
+		spin_unlock_bh(&g_half_open_lock);
+
+		ret = scnprintf(buf, PAGE_SIZE, "%u %u %u %lu %lu", num_of_rows,
+				MAX_HALF_OPEN_ROWS, MAX_HALF_OPEN_PER_SRC, num_of_dropped_syns,
+				num_of_evicted_rows);
+		if (ret <= 0){
+			printk(KERN_ERR "*** Error: failed writing to user's buffer in function read_half_open_stats() ***\n");
+		}
+		return ret;
+}
+
+/**
+ * 	Declaring variables of type struct device_attribute:
+ * 		"syn_admission" - read (everyone) & write (owner only, it turns SYN-flood
+ * 						  protection off), .show = read_syn_admission,
+ * 						  .store = change_syn_admission
+ * 		"half_open_stats" - read only, .show = read_half_open_stats
+ **/
+static DEVICE_ATTR(syn_admission, S_IRUSR | S_IWUSR | S_IROTH, read_syn_admission, change_syn_admission);
+static DEVICE_ATTR(half_open_stats, S_IRUSR | S_IROTH, read_half_open_stats, NULL);
+
+/**
+ *	Initiates g_half_open_tab (allocates all its rows) and creates its
+ *	sysfs attributes inside conn_tab_device.
+ *
+ *	Returns: 0 on success, -1 if failed.
+ **/
+int init_half_open_tab(struct device* conn_tab_device){
+	unsigned int i;
+
+	if (g_syn_admission != SYN_ADMISSION_DEFERRED) {
+		g_syn_admission = SYN_ADMISSION_IMMEDIATE;
+	}
+
+	if ((g_half_open_pool = vmalloc(MAX_HALF_OPEN_ROWS * sizeof(half_open_row_t))) == NULL) {
+		printk(KERN_ERR "Error: failed allocating half-open table.\n");
+		return -1;
+	}
+	memset(g_half_open_pool, 0, MAX_HALF_OPEN_ROWS * sizeof(half_open_row_t));
+
+	INIT_HLIST_HEAD(&g_half_open_free_list);
+	for (i = 0; i < MAX_HALF_OPEN_ROWS; ++i) {
+		INIT_HLIST_NODE(&(g_half_open_pool[i].hnode));
+		INIT_LIST_HEAD(&(g_half_open_pool[i].age_node));
+		hlist_add_head(&(g_half_open_pool[i].hnode), &g_half_open_free_list);
+	}
+	for (i = 0; i < HALF_OPEN_NUM_BUCKETS; ++i) {
+		INIT_HLIST_HEAD(&g_half_open_tab[i]);
+	}
+	INIT_LIST_HEAD(&g_half_open_age_list);
+	memset(g_half_open_per_src, 0, sizeof(g_half_open_per_src));
+	g_num_of_half_open_rows = 0;
+	g_num_of_dropped_syns = 0;
+	g_num_of_evicted_rows = 0;
+	get_random_bytes(&g_half_open_hash_seed, sizeof(g_half_open_hash_seed));
+
+	if (device_create_file(conn_tab_device, (const struct device_attribute *)&dev_attr_syn_admission.attr))
+	{
+		printk(KERN_ERR "Error: failed creating syn_admission-sysfs-file inside connection table char-device.\n");
+		vfree(g_half_open_pool);
+		g_half_open_pool = NULL;
+		return -1;
+	}
+
+	if (device_create_file(conn_tab_device, (const struct device_attribute *)&dev_attr_half_open_stats.attr))
+	{
+		printk(KERN_ERR "Error: failed creating half_open_stats-sysfs-file inside connection table char-device.\n");
+		device_remove_file(conn_tab_device, (const struct device_attribute *)&dev_attr_syn_admission.attr);
+		vfree(g_half_open_pool);
+		g_half_open_pool = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ *	Destroys g_half_open_tab and removes its sysfs attributes
+ **/
+void destroy_half_open_tab(struct device* conn_tab_device){
+	device_remove_file(conn_tab_device, (const struct device_attribute *)&dev_attr_half_open_stats.attr);
+	device_remove_file(conn_tab_device, (const struct device_attribute *)&dev_attr_syn_admission.attr);
+	vfree(g_half_open_pool);
+	g_half_open_pool = NULL;
+}
@@ -0,0 +1,47 @@
+#ifndef _HALF_OPEN_UTILS_H_
+#define _HALF_OPEN_UTILS_H_
+
+#include "fw.h"
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/moduleparam.h>
+
+//Values for syn_admission (module parameter / sysfs attribute):
+#define SYN_ADMISSION_IMMEDIATE (0)	//Every accepted SYN adds a connection-row
+#define SYN_ADMISSION_DEFERRED (1)	//Rows are added only after the 3-way-handshake's last ACK
+
+#define HALF_OPEN_TIMEOUT_SECONDS (10)
+#define HALF_OPEN_HASH_BITS (10)
+#define HALF_OPEN_NUM_BUCKETS (1 << HALF_OPEN_HASH_BITS)
+#define MAX_HALF_OPEN_ROWS (4096)
+#define HALF_OPEN_SRC_SLOTS (1024)
+#define MAX_HALF_OPEN_PER_SRC (32)
+
+//Struct representing a row in half-open table (a handshake in progress):
+typedef struct {
+
+	__be32			src_ip;		// The client (the side that sent the SYN)
+	__be16			src_port;
+	__be32			dst_ip;
+	__be16			dst_port;
+	tcp_state_t		tcp_state;	// TCP_STATE_SYN_SENT, or TCP_STATE_SYN_RCVD after the SYN-ACK
+	unsigned long	timestamp;	// Time of creation/last update
+
+	struct hlist_node hnode;	// Its hash-bucket when used, the free-list otherwise
+	struct list_head age_node;	// In g_half_open_age_list when used
+
+}half_open_row_t;
+
+extern int g_syn_admission;
+
+bool add_half_open_row(log_row_t* syn_pckt_lg_info);
+bool update_half_open_row_by_SYN_ACK(log_row_t* syn_ack_pckt_lg_info);
+bool take_half_open_row_by_ACK(log_row_t* ack_pckt_lg_info);
+bool delete_half_open_row_by_RESET(log_row_t* rst_pckt_lg_info);
+void delete_all_half_open_rows(void);
+int init_half_open_tab(struct device* conn_tab_device);
+void destroy_half_open_tab(struct device* conn_tab_device);
+
+#endif /* _HALF_OPEN_UTILS_H_ */
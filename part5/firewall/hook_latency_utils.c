@@ -0,0 +1,177 @@
+#include "hook_latency_utils.h"
+
+struct static_key g_hook_latency_key = STATIC_KEY_INIT_FALSE;
+
+static hook_latency_cpu_t __percpu* g_hook_latency = NULL;
+
+//Serializes turning measuring on/off (g_hook_latency_on follows g_hook_latency_key):
+static DEFINE_MUTEX(g_hook_latency_mutex);
+static bool g_hook_latency_on = false;
+
+static const char* g_lat_stages_names[NUM_OF_LAT_STAGES] = {
+	"parse", "decide", "check_tcp", "insert_row", "fake", "local_out", "hook"
+};
+
+/**
+ *	Counts a sample of ns nanoseconds in stage's histogram
+ *	(of current cpu).
+ **/
+void record_hook_latency(hook_latency_stage_t stage, u64 ns){
+	unsigned int bucket = fls64(ns);
+
+	if (g_hook_latency == NULL) {
+		return;
+	}
+	if (bucket >= HOOK_LATENCY_NUM_BUCKETS) {
+		bucket = HOOK_LATENCY_NUM_BUCKETS - 1;
+	}
+
+	this_cpu_inc(g_hook_latency->samples[stage]);
+	this_cpu_add(g_hook_latency->total_ns[stage], ns);
+	this_cpu_inc(g_hook_latency->buckets[stage][bucket]);
+}
+
+/**
+ *	Helper function: zeroes the histograms of all cpus.
+ *	NOTE: caller should hold g_hook_latency_mutex, while measuring is off!
+ **/
+static void clear_hook_latency(void){
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		memset(per_cpu_ptr(g_hook_latency, cpu), 0, sizeof(hook_latency_cpu_t));
+	}
+}
+
+ /**
+ *	This function will be called when user tries to read from "hook_latency"
+ *
+ *  NOTE: writes to "buf" (in string format) a line saying if measuring is on:
+ *			enabled <0/1>
+ *		  and a line for every stage (merged from all cpus):
+ *			<stage name> <samples> <total ns> <bucket 0> <bucket 1> ... <last non-empty bucket>
+ **/
+ssize_t read_hook_latency(struct device* dev, struct device_attribute* attr, char* buf){
+		static hook_latency_cpu_t merged;	// Too big for the stack, guarded by g_hook_latency_mutex
+		hook_latency_cpu_t* lat;
+		ssize_t ret;
+		unsigned int cpu, stage, bucket, last;
+
+		mutex_lock(&g_hook_latency_mutex);
+
+		memset(&merged, 0, sizeof(merged));
+		for_each_possible_cpu(cpu) {
+			lat = per_cpu_ptr(g_hook_latency, cpu);
+			for (stage = 0; stage < NUM_OF_LAT_STAGES; ++stage) {
+				merged.samples[stage] += lat->samples[stage];
+				merged.total_ns[stage] += lat->total_ns[stage];
+				for (bucket = 0; bucket < HOOK_LATENCY_NUM_BUCKETS; ++bucket) {
+					merged.buckets[stage][bucket] += lat->buckets[stage][bucket];
+				}
+			}
+		}
+
+		ret = scnprintf(buf, PAGE_SIZE, "enabled %d\n", g_hook_latency_on ? 1 : 0);
+		for (stage = 0; stage < NUM_OF_LAT_STAGES; ++stage) {
+			last = 0;
+			for (bucket = 0; bucket < HOOK_LATENCY_NUM_BUCKETS; ++bucket) {
+				if (merged.buckets[stage][bucket] != 0) {
+					last = bucket;
+				}
+			}
+			ret += scnprintf(buf + ret, PAGE_SIZE - ret, "%s %lu %llu", g_lat_stages_names[stage],
+					merged.samples[stage], (unsigned long long)merged.total_ns[stage]);
+			for (bucket = 0; bucket <= last; ++bucket) {
+				ret += scnprintf(buf + ret, PAGE_SIZE - ret, " %lu", merged.buckets[stage][bucket]);
+			}
+			ret += scnprintf(buf + ret, PAGE_SIZE - ret, "\n");
+		}
+
+		mutex_unlock(&g_hook_latency_mutex);
+
+		return ret;
+}
+
+/**
+ * 	This function will be called when user tries to write to "hook_latency",
+ * 	meaning that the user wants to turn measuring on/off.
+ *
+ * 	Buffer should contain: 	'0' - to turn measuring off,
+ * 							'1' - to turn measuring on (clears the histograms)
+ *
+ *	Returns count on success, negative number if failed.
+ **/
+ssize_t write_hook_latency(struct device* dev, struct device_attribute* attr, const char* buf, size_t count){
+	bool turn_on;
+
+	if (buf == NULL || count < 1 || (buf[0] != '0' && buf[0] != '1')) {
+		printk(KERN_ERR "Error: hook_latency should be '0' (off) or '1' (on)\n");
+		return -EINVAL;
+	}
+	turn_on = (buf[0] == '1');
+
+	mutex_lock(&g_hook_latency_mutex);
+	if (turn_on && !g_hook_latency_on) {
+		clear_hook_latency();
+		g_hook_latency_on = true;
+		static_key_slow_inc(&g_hook_latency_key);
+	} else if (!turn_on && g_hook_latency_on) {
+		static_key_slow_dec(&g_hook_latency_key);
+		g_hook_latency_on = false;
+	}
+	mutex_unlock(&g_hook_latency_mutex);
+
+	return count;
+}
+
+/**
+ * 	Declaring a variable of type struct device_attribute, its name would be "dev_attr_hook_latency"
+ * 		.attr.mode = S_IRUSR | S_IWUSR | S_IROTH, giving the owner read & write permissions,
+ * 					 and other users read permissions
+ * 		.show = read_hook_latency
+ * 		.store = write_hook_latency
+ **/
+static DEVICE_ATTR(hook_latency, S_IRUSR | S_IWUSR | S_IROTH, read_hook_latency, write_hook_latency);
+
+/**
+ *	Allocates the histograms of all cpus (measuring is off) and
+ *	creates "hook_latency" sysfs attribute (in rules_dev).
+ *	Returns: 0 on success, -1 if failed.
+ **/
+int init_hook_latency(struct device* rules_dev){
+
+	//alloc_percpu() zeroes the histograms:
+	if ((g_hook_latency = alloc_percpu(hook_latency_cpu_t)) == NULL) {
+		printk(KERN_ERR "Error: failed allocating hook latency histograms.\n");
+		return -1;
+	}
+
+	if (device_create_file(rules_dev, (const struct device_attribute *)&dev_attr_hook_latency.attr))
+	{
+		printk(KERN_ERR "Error: failed creating hook_latency-sysfs-file inside rules-char-device.\n");
+		free_percpu(g_hook_latency);
+		g_hook_latency = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ *	Turns measuring off, removes "hook_latency" sysfs attribute and frees
+ *	the histograms.
+ *	NOTE: hooks should be unregistered before.
+ **/
+void destroy_hook_latency(struct device* rules_dev){
+	device_remove_file(rules_dev, (const struct device_attribute *)&dev_attr_hook_latency.attr);
+
+	mutex_lock(&g_hook_latency_mutex);
+	if (g_hook_latency_on) {
+		static_key_slow_dec(&g_hook_latency_key);
+		g_hook_latency_on = false;
+	}
+	mutex_unlock(&g_hook_latency_mutex);
+
+	free_percpu(g_hook_latency);
+	g_hook_latency = NULL;
+}
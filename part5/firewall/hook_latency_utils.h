@@ -0,0 +1,72 @@
+#ifndef _HOOK_LATENCY_UTILS_H_
+#define _HOOK_LATENCY_UTILS_H_
+
+#include "fw.h"
+#include <linux/percpu.h>
+#include <linux/jump_label.h>	//For static keys
+#include <linux/sched.h>		//For local_clock()
+#include <linux/mutex.h>
+
+/**
+ *	Hook latency - nanoseconds spent in every stage of the hook (see
+ *	hook_latency_stage_t), counted per cpu in log2 histograms: a sample of
+ *	ns nanoseconds is counted in bucket fls64(ns), i.e. bucket b holds
+ *	samples of [2^(b-1), 2^b) nanoseconds (bucket 0 holds 0).
+ *	Stages nest: LAT_STAGE_DECIDE includes LAT_STAGE_CHECK_TCP, and
+ *	LAT_STAGE_HOOK is the whole hook_func_callback().
+ *
+ *	Measuring is off by default, and turned on/off by writing '1'/'0' to
+ *	"hook_latency" sysfs attribute (of rules-device). It's behind a static
+ *	key, so while it's off, every measure point is a single (patched) jump.
+ *	Turning it on clears the histograms.
+ *
+ *	Reading "hook_latency" merges the histograms of all cpus.
+ **/
+#define HOOK_LATENCY_NUM_BUCKETS (32)	// Last bucket also holds all samples of 2^30ns and more
+
+typedef enum {
+	LAT_STAGE_PARSE			= 0,	// parse_packet_headers() & init_log_row()
+	LAT_STAGE_DECIDE		= 1,	// decide_established_packet_action() & decide_packet_action()
+	LAT_STAGE_CHECK_TCP		= 2,	// check_tcp_packet()
+	LAT_STAGE_INSERT_ROW	= 3,	// insert_row()
+	LAT_STAGE_FAKE			= 4,	// fake_packets_details() (NF_INET_PRE_ROUTING)
+	LAT_STAGE_LOCAL_OUT		= 5,	// fake_outer_packet_if_needed() (NF_INET_LOCAL_OUT)
+	LAT_STAGE_HOOK			= 6,	// hook_func_callback()
+	NUM_OF_LAT_STAGES		= 7
+} hook_latency_stage_t;
+
+//Histograms of packets handled by a single cpu:
+typedef struct {
+	unsigned long	samples[NUM_OF_LAT_STAGES];
+	u64				total_ns[NUM_OF_LAT_STAGES];
+	unsigned long	buckets[NUM_OF_LAT_STAGES][HOOK_LATENCY_NUM_BUCKETS];
+} hook_latency_cpu_t;
+
+extern struct static_key g_hook_latency_key;
+
+void record_hook_latency(hook_latency_stage_t stage, u64 ns);
+int init_hook_latency(struct device* rules_dev);
+void destroy_hook_latency(struct device* rules_dev);
+
+/**
+ *	Returns: time a stage starts (in ns), 0 if measuring is off
+ **/
+static inline u64 hook_latency_start(void){
+	if (static_key_false(&g_hook_latency_key)) {
+		return local_clock();
+	}
+	return 0;
+}
+
+/**
+ *	Counts the time since start (as returned by hook_latency_start())
+ *	in stage's histogram. Stages that started while measuring was off
+ *	aren't counted.
+ **/
+static inline void hook_latency_end(hook_latency_stage_t stage, u64 start){
+	if (static_key_false(&g_hook_latency_key) && start != 0) {
+		record_hook_latency(stage, local_clock() - start);
+	}
+}
+
+#endif /* _HOOK_LATENCY_UTILS_H_ */
@@ -10,55 +10,101 @@ static struct nf_hook_ops	nfho_pre_route,
  *	Inserts relevant row to log.
  * 
  *	@skb - contains all of packet's data
+ *	@hdrs - packet's headers (parsed from skb)
+ *	@hook_start - time the hook started (see hook_latency_start())
  *	@in - pointer to net_device representing the network interface
  * 		  the packet pass through. NULL if packet traversal is "out".
  *	@out - pointer to net_device representing the network inteface
  * 		  the packet pass through. NULL if packet traversal is "in".
+ *	@pckt_lg_info - log_row_t to be initiated with packet's details
+ *		  (its reason is counted with the verdict, see record_verdict())
  * 
  *	Returns: NF_ACCEPT/NF_DROP according to packet data & firewall's status
  * 
  * 
  *	Note:	1. In case of allocation error - default is to pass the packet.
- * 			2. User of this function should free memory located for
- * 			   pckt_lg_info (allocated in init_log_row())
+ * 			2. Packet's details are kept on the stack (pckt_lg_info),
+ * 			   a log-row is only allocated if insert_row() needs a new one.
+ * 			3. Packets of plain established TCP connections are only
+ * 			   counted in log rollups (see check_established_tcp_packet()).
+ * 			4. Nothing is logged while "logging" feature is off
+ * 			   (see feature_utils.h).
  **/
 static unsigned int check_packet_hookp_pre_routing(struct sk_buff* skb, 
-		const struct net_device* in, const struct net_device* out)
+		const packet_hdrs_t* hdrs, u64 hook_start,
+		const struct net_device* in, const struct net_device* out,
+		log_row_t* pckt_lg_info)
 {
 	
-	log_row_t* pckt_lg_info = NULL; 
 	ack_t packet_ack;
 	direction_t packet_direction;
 	connection_row_t* relevant_conn_row = NULL;
 	connection_row_t* relevant_opposite_conn_row = NULL;
+	__be32 fake_dst_ip = 0;
+	__be16 fake_dst_port = 0;
+	bool need_to_fake = false;
+	u64 stage_start;
+	bool row_inserted;
 	
 	//Initiate: pckt_lg_info, packet_ack , packet_direction
-	if( (pckt_lg_info = init_log_row(skb, NF_INET_PRE_ROUTING,
-		&packet_ack, &packet_direction, in, out)) == NULL)
+	if (!init_log_row(hdrs, NF_INET_PRE_ROUTING, &packet_ack,
+			&packet_direction, in, out, pckt_lg_info))
 	{
 		//An error occured, never supposed to get here:
 		//(Error already been printed inside init_log_row)
 		return NF_ACCEPT;
 	}
+	hook_latency_end(LAT_STAGE_PARSE, hook_start);
+
+	//Packets of plain established connections skip the checks & the log-rows:
+	stage_start = hook_latency_start();
+	if (decide_established_packet_action(hdrs, pckt_lg_info)) {
+		hook_latency_end(LAT_STAGE_DECIDE, stage_start);
+		if (is_logging_on()) {
+			log_rollup_record(pckt_lg_info);
+		}
+		return NF_ACCEPT;
+	}
 
 	//Calls function that decides packet-action
-	decide_packet_action(skb, pckt_lg_info, &packet_ack, &packet_direction);
+	decide_packet_action(skb, hdrs, pckt_lg_info, &packet_ack, &packet_direction);
+	hook_latency_end(LAT_STAGE_DECIDE, stage_start);
 	
 	//Un-log rows that are of packets that are loopback
-	//Inserts row to log-rows:
-	if ( pckt_lg_info->reason == REASON_LOOPBACK_PACKET ||
-		(!insert_row(pckt_lg_info)))
-	{
-		kfree(pckt_lg_info);
+	if (pckt_lg_info->reason == REASON_LOOPBACK_PACKET) {
 		return NF_ACCEPT;
 	}
 
+	//Every packet is counted in the log rollups, whatever the policy is:
+	if (is_logging_on()) {
+		log_rollup_record(pckt_lg_info);
+	}
+
+	//Inserts row to log-rows, if logging policy says so:
+	if (is_logging_on() && should_log_row(pckt_lg_info)) {
+		stage_start = hook_latency_start();
+		row_inserted = insert_row(pckt_lg_info);
+		hook_latency_end(LAT_STAGE_INSERT_ROW, stage_start);
+		if (!row_inserted) {
+			return NF_ACCEPT;
+		}
+	}
+
 	if(pckt_lg_info->protocol == PROT_TCP && pckt_lg_info->action == NF_ACCEPT){
-		//Fake packet details, if needed:
+		//Fake packet details, if needed (row is only valid under rcu_read_lock()):
+		rcu_read_lock();
 		search_relevant_rows(pckt_lg_info, &relevant_conn_row,
 				&relevant_opposite_conn_row);
 		if (relevant_conn_row && relevant_conn_row->need_to_fake_connection){
-			fake_packets_details(skb, false, relevant_conn_row->fake_dst_ip, relevant_conn_row->fake_dst_port);
+			fake_dst_ip = relevant_conn_row->fake_dst_ip;
+			fake_dst_port = relevant_conn_row->fake_dst_port;
+			need_to_fake = true;
+		}
+		rcu_read_unlock();
+		if (need_to_fake){
+			stage_start = hook_latency_start();
+			fake_packets_details(skb, false, fake_dst_ip, fake_dst_port);
+			hook_latency_end(LAT_STAGE_FAKE, stage_start);
 		}
 	}
 
@@ -72,6 +118,7 @@ static unsigned int check_packet_hookp_pre_routing(struct sk_buff* skb,
  *  for IPv4 packets.
  *
  *	@skb - contains all of packet's data
+ *	@hdrs - packet's headers (parsed from skb)
  *	@in - pointer to net_device.
  *	@out - pointer to net_device.
  *	@hooknum - NF_INET_LOCAL_OUT
@@ -82,10 +129,13 @@ static unsigned int check_packet_hookp_pre_routing(struct sk_buff* skb,
  * 			2.No rules will be checked (only connection table).
  **/
 static unsigned int check_packet_hookp_out(struct sk_buff* skb, 
-		const struct net_device* in, const struct net_device* out,
-		unsigned int hooknum)
+		const packet_hdrs_t* hdrs, const struct net_device* in,
+		const struct net_device* out, unsigned int hooknum)
 {
-	fake_outer_packet_if_needed(skb);
+	u64 stage_start = hook_latency_start();
+
+	fake_outer_packet_if_needed(skb, hdrs);
+	hook_latency_end(LAT_STAGE_LOCAL_OUT, stage_start);
 	return NF_ACCEPT;
 }
 
@@ -96,25 +146,53 @@ static unsigned int check_packet_hookp_out(struct sk_buff* skb,
  * 		check_packet_hookp_pre_routing()
  * to decide what to do with the packet.
  * 
- * NOTE: gets only IPv4 packets!
+ * NOTE:	1. gets only IPv4 packets!
+ *			2. Packet's headers are parsed once (see parse_packet_headers()),
+ *			   skb isn't linearized.
+ *			3. Stages' latencies are measured only when "hook_latency"
+ *			   is on (see hook_latency_utils.h).
+ *			4. Every verdict is counted (see verdict_stats_utils.h),
+ *			   unless "verdicts" feature is off (see feature_utils.h).
  **/
 static unsigned int hook_func_callback(unsigned int hooknum, 
 		struct sk_buff* skb, const struct net_device* in, 
 		const struct net_device* out, int(*okfn)(struct sk_buff*) )
 {
+	packet_hdrs_t hdrs;
+	log_row_t pckt_lg_info;
+	u64 hook_start = hook_latency_start();
+	unsigned int verdict;
+
+	pckt_lg_info.reason = NO_REASON;
+
+	if (!parse_packet_headers(skb, &hdrs)) {
+		//An error occured (already printed), default is to pass the packet:
+		if (is_verdicts_on()) {
+			record_verdict(hooknum, NF_ACCEPT, NO_REASON, skb->len);
+		}
+		return NF_ACCEPT;
+	}
 
 	if (hooknum == NF_INET_PRE_ROUTING) 
 	{
-		return check_packet_hookp_pre_routing(skb, in, out);
+		verdict = check_packet_hookp_pre_routing(skb, &hdrs, hook_start, in, out, &pckt_lg_info);
 	}
 	else if (hooknum == NF_INET_LOCAL_OUT) 
 	{
-		return check_packet_hookp_out(skb, in, out, hooknum);	
+		verdict = check_packet_hookp_out(skb, &hdrs, in, out, hooknum);	
 	}
-	
-	//An error occured, never supposed to get here:
-	printk(KERN_ERR "Function hook_func_callback() got invalid hooknum, accepting packet.\n");
-	return NF_ACCEPT;
+	else
+	{
+		//An error occured, never supposed to get here:
+		printk(KERN_ERR "Function hook_func_callback() got invalid hooknum, accepting packet.\n");
+		return NF_ACCEPT;
+	}
+
+	if (is_verdicts_on()) {
+		record_verdict(hooknum, verdict, pckt_lg_info.reason, skb->len);
+	}
+	hook_latency_end(LAT_STAGE_HOOK, hook_start);
+	return verdict;
 							
 }
 
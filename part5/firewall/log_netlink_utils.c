@@ -0,0 +1,227 @@
+#include "log_netlink_utils.h"
+#include "rules_utils.h"	//For get_rule_name()
+
+/**
+ *	Every cpu gathers its events in a batch of its own (a netlink datagram),
+ *	until it's full or its flush timer expires, and sends it by itself - so
+ *	logging a packet takes no lock shared by cpus. A batch is only touched
+ *	by its cpu, with softirqs disabled (its flush timer is pinned to that
+ *	cpu, and runs as a softirq there). Events are only gathered while
+ *	someone listens to FW_LOG_NL_GROUP.
+ *
+ *	Overruns (listeners' receive buffers were full, see nlmsg_multicast())
+ *	and events dropped since a datagram couldn't be allocated are counted,
+ *	see "log_nl_stats".
+ **/
+static unsigned int g_log_nl_mode = LOG_NL_MODE_OFF;
+module_param_named(log_nl_mode, g_log_nl_mode, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(log_nl_mode, "Netlink log events: 0 - off, 1 - every logged packet, 2 - every new log-row");
+
+static unsigned int g_log_nl_batch = DEFAULT_LOG_NL_BATCH;
+module_param_named(log_nl_batch, g_log_nl_batch, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(log_nl_batch, "Netlink log events sent in one datagram");
+
+static unsigned int g_log_nl_flush_ms = DEFAULT_LOG_NL_FLUSH_MS;
+module_param_named(log_nl_flush_ms, g_log_nl_flush_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(log_nl_flush_ms, "Milliseconds a netlink log event waits for its datagram to fill");
+
+static struct sock* g_nl_sock = NULL;
+static DEFINE_PER_CPU(log_nl_batch_t, g_nl_batches);
+
+/**
+ *	Helper function: multicasts batch's datagram (if any), and frees it.
+ *	NOTE: should be called on batch's cpu, with softirqs disabled!
+ **/
+static void send_nl_batch(log_nl_batch_t* batch){
+	struct sk_buff* skb = batch->skb;
+	struct sock* sock = ACCESS_ONCE(g_nl_sock);
+	int err;
+
+	if (skb == NULL) {
+		return;
+	}
+	batch->skb = NULL;
+	batch->len = 0;
+
+	if (sock == NULL) {
+		kfree_skb(skb);
+		return;
+	}
+
+	err = nlmsg_multicast(sock, skb, 0, FW_LOG_NL_GROUP, GFP_ATOMIC);
+	if (err == -ENOBUFS) {
+		++batch->num_of_overruns;
+	} else if (err == 0) {
+		++batch->num_of_datagrams;
+	}
+}
+
+/**
+ *	Sends a cpu's datagram, since its events waited long enough
+ *	(called when its flush timer expires, on that cpu)
+ **/
+static void flush_nl_batch(unsigned long data){
+	send_nl_batch(per_cpu_ptr(&g_nl_batches, (unsigned int)data));
+}
+
+/**
+ *	Sends an event of a logged packet (to netlink listeners), by
+ *	g_log_nl_mode.
+ *
+ *	@row - the packet's log_row_t, with the updated count of its log-row
+ *	@weight - packets it stands for (log_sample_rate if it was sampled)
+ *	@is_new_row - true if a new log-row was created for the packet
+ **/
+void log_netlink_record(const log_row_t* row, unsigned int weight, bool is_new_row){
+	log_nl_batch_t* batch;
+	fw_log_nl_event_t* event;
+	struct nlmsghdr* nlh;
+	struct sock* sock = ACCESS_ONCE(g_nl_sock);
+	unsigned int mode = ACCESS_ONCE(g_log_nl_mode);
+	unsigned int max_len = clamp_t(unsigned int, ACCESS_ONCE(g_log_nl_batch), 1, MAX_LOG_NL_BATCH);
+
+	if (mode == LOG_NL_MODE_OFF || (mode == LOG_NL_MODE_ROW && !is_new_row) ||
+		sock == NULL || !netlink_has_listeners(sock, FW_LOG_NL_GROUP))
+	{
+		return;
+	}
+
+	local_bh_disable();
+	batch = this_cpu_ptr(&g_nl_batches);
+
+	if (batch->skb == NULL) {
+		batch->skb = nlmsg_new(max_len*nlmsg_total_size(sizeof(fw_log_nl_event_t)), GFP_ATOMIC);
+		if (batch->skb == NULL) {
+			++batch->num_of_dropped;
+			local_bh_enable();
+			return;
+		}
+		mod_timer_pinned(&batch->flush_timer, jiffies + msecs_to_jiffies(ACCESS_ONCE(g_log_nl_flush_ms)));
+	}
+
+	nlh = nlmsg_put(batch->skb, 0, batch->seq++, FW_LOG_NL_MSG_EVENT, sizeof(fw_log_nl_event_t), 0);
+	if (nlh == NULL) { //Never supposed to get here, datagram has room for max_len events
+		++batch->num_of_dropped;
+		send_nl_batch(batch);
+	} else {
+		event = nlmsg_data(nlh);
+		memset(event, 0, sizeof(fw_log_nl_event_t));
+		event->rec.timestamp = row->timestamp;
+		event->rec.src_ip = row->src_ip;
+		event->rec.dst_ip = row->dst_ip;
+		event->rec.src_port = row->src_port;
+		event->rec.dst_port = row->dst_port;
+		event->rec.reason = row->reason;
+		event->rec.protocol = row->protocol;
+		event->rec.action = row->action;
+		event->rec.hooknum = row->hooknum;
+		event->rec.count = row->count;
+		event->rec.weight = weight;
+		get_rule_name(row->reason, event->rule_name, sizeof(event->rule_name));
+		++batch->num_of_events;
+
+		if (++batch->len >= max_len) {
+			send_nl_batch(batch);
+		}
+	}
+
+	local_bh_enable();
+}
+
+ /**
+ *	This function will be called when user tries to read from "log_nl_stats"
+ *
+ *  NOTE: writes to "buf", in (string) format:
+ * 		<events> <datagrams sent> <overruns> <events dropped>
+ *	(an overrun means some listener's receive buffer was full, and it
+ *	lost a whole datagram)
+ **/
+ssize_t read_log_nl_stats(struct device* dev, struct device_attribute* attr, char* buf){
+		const log_nl_batch_t* batch;
+		unsigned long num_of_events = 0, num_of_datagrams = 0;
+		unsigned long num_of_overruns = 0, num_of_dropped = 0;
+		unsigned int cpu;
+		ssize_t ret;
+
+		//Sums all cpus' counters (each might be a little stale):
+		for_each_possible_cpu(cpu) {
+			batch = per_cpu_ptr(&g_nl_batches, cpu);
+			num_of_events += ACCESS_ONCE(batch->num_of_events);
+			num_of_datagrams += ACCESS_ONCE(batch->num_of_datagrams);
+			num_of_overruns += ACCESS_ONCE(batch->num_of_overruns);
+			num_of_dropped += ACCESS_ONCE(batch->num_of_dropped);
+		}
+
+		ret = scnprintf(buf, PAGE_SIZE, "%lu %lu %lu %lu", num_of_events,
+				num_of_datagrams, num_of_overruns, num_of_dropped);
+
+		if (ret <= 0){
+			printk(KERN_ERR "*** Error: failed writing to user's buffer in function read_log_nl_stats() ***\n");
+		}
+		return ret;
+}
+
+/**
+ * 	Declaring a variable of type struct device_attribute, its name would be "dev_attr_log_nl_stats"
+ * 		.attr.mode = S_IRUSR | S_IROTH, giving the owner and other user read permissions
+ * 		.show = read_log_nl_stats
+ * 		.store = NULL (no writing function)
+ **/
+static DEVICE_ATTR(log_nl_stats, S_IRUSR | S_IROTH, read_log_nl_stats, NULL);
+
+/**
+ *	Creates the netlink socket and "log_nl_stats" sysfs attribute (in log_dev).
+ *	Returns: 0 on success, -1 if failed.
+ **/
+int init_log_netlink(struct device* log_dev){
+	struct netlink_kernel_cfg cfg = {
+		.groups = FW_LOG_NL_GROUP,
+	};
+	log_nl_batch_t* batch;
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		batch = per_cpu_ptr(&g_nl_batches, cpu);
+		memset(batch, 0, sizeof(log_nl_batch_t));
+		setup_timer(&batch->flush_timer, flush_nl_batch, cpu);
+	}
+
+	if ((g_nl_sock = netlink_kernel_create(&init_net, NETLINK_FW_LOG, &cfg)) == NULL) {
+		printk(KERN_ERR "Error: failed creating log's netlink socket.\n");
+		return -1;
+	}
+
+	if (device_create_file(log_dev, (const struct device_attribute *)&dev_attr_log_nl_stats.attr))
+	{
+		printk(KERN_ERR "Error: failed creating log_nl_stats-sysfs-file inside log-char-device.\n");
+		netlink_kernel_release(g_nl_sock);
+		g_nl_sock = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ *	Releases the netlink socket (pending events are dropped)
+ **/
+void destroy_log_netlink(struct device* log_dev){
+	struct sock* sock = g_nl_sock;
+	log_nl_batch_t* batch;
+	unsigned int cpu;
+
+	device_remove_file(log_dev, (const struct device_attribute *)&dev_attr_log_nl_stats.attr);
+
+	//Batches are used with softirqs disabled, so once every cpu passed
+	//a schedule, none uses the socket (nor adds events) anymore:
+	g_nl_sock = NULL;
+	synchronize_sched();
+
+	for_each_possible_cpu(cpu) {
+		batch = per_cpu_ptr(&g_nl_batches, cpu);
+		del_timer_sync(&batch->flush_timer);
+		kfree_skb(batch->skb);
+		batch->skb = NULL;
+	}
+	netlink_kernel_release(sock);
+}
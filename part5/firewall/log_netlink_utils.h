@@ -0,0 +1,61 @@
+#ifndef _LOG_NETLINK_UTILS_H_
+#define _LOG_NETLINK_UTILS_H_
+
+#include "log_ring_utils.h"		//For fw_log_rec_t
+#include <linux/netlink.h>
+#include <net/netlink.h>
+#include <net/sock.h>
+#include <linux/timer.h>
+#include <linux/percpu.h>
+
+/**
+ *	Log events are (optionally) multicast to netlink group FW_LOG_NL_GROUP
+ *	of protocol NETLINK_FW_LOG, so log collectors get them without polling.
+ *	Events are batched: every datagram holds up to "log_nl_batch" netlink
+ *	messages (of type FW_LOG_NL_MSG_EVENT, each carrying a fw_log_nl_event_t),
+ *	and is sent when full or "log_nl_flush_ms" milliseconds after its
+ *	first event. Every cpu batches (and sends) its own events, so a
+ *	listener gets each cpu's events in order, but cpus' datagrams are
+ *	interleaved (nlmsg_seq counts a cpu's events).
+ *
+ *	Modes (module parameter "log_nl_mode"):
+ *		LOG_NL_MODE_OFF - nothing is sent (default)
+ *		LOG_NL_MODE_PACKET - an event for every logged packet (with the
+ *							 updated count of its log-row)
+ *		LOG_NL_MODE_ROW - an event only when a new log-row is created
+ **/
+#define NETLINK_FW_LOG (29)
+#define FW_LOG_NL_GROUP (1)
+#define FW_LOG_NL_MSG_EVENT (NLMSG_MIN_TYPE + 1)
+#define DEFAULT_LOG_NL_BATCH (32)
+#define MAX_LOG_NL_BATCH (256)
+#define DEFAULT_LOG_NL_FLUSH_MS (100)
+
+typedef enum {
+	LOG_NL_MODE_OFF		= 0,
+	LOG_NL_MODE_PACKET	= 1,
+	LOG_NL_MODE_ROW		= 2
+} log_nl_mode_t;
+
+typedef struct {
+	fw_log_rec_t	rec;
+	char			rule_name[20];		// Empty if reason isn't a rule's index
+} fw_log_nl_event_t;
+
+//A cpu's batch of events (and its counters, see "log_nl_stats"):
+typedef struct {
+	struct sk_buff*		skb;				// NULL if there are no events yet
+	unsigned int		len;				// Events in skb
+	u32					seq;
+	struct timer_list	flush_timer;
+	unsigned long		num_of_events;
+	unsigned long		num_of_datagrams;
+	unsigned long		num_of_overruns;
+	unsigned long		num_of_dropped;
+} log_nl_batch_t;
+
+void log_netlink_record(const log_row_t* row, unsigned int weight, bool is_new_row);
+int init_log_netlink(struct device* log_dev);
+void destroy_log_netlink(struct device* log_dev);
+
+#endif /* _LOG_NETLINK_UTILS_H_ */
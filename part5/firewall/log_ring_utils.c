@@ -0,0 +1,211 @@
+#include "log_ring_utils.h"
+
+/**
+ *	The rings let a log collector read logged packets without a syscall
+ *	(and a sprintf) per row, see log_ring_utils.h for the area's layout.
+ *	A ring has a single writer (its cpu, while softirqs are disabled) and
+ *	a single reader (user), so no lock is needed. To keep it so, the area
+ *	can only be mapped shared (so user's tails reach the kernel), and by a
+ *	single mapping at a time (see log_ring_mmap()).
+ *
+ *	If g_log_ring_wakeup is set, readers sleeping in poll() are woken up
+ *	whenever a record is written, otherwise they're expected to poll the
+ *	rings' heads by themselves.
+ **/
+static unsigned int g_log_ring_size = DEFAULT_LOG_RING_SIZE;
+module_param_named(log_ring_size, g_log_ring_size, uint, S_IRUGO);
+MODULE_PARM_DESC(log_ring_size, "Binary log records kept per cpu (rounded up to a power of 2), 0 disables the rings");
+
+static bool g_log_ring_wakeup = false;
+module_param_named(log_ring_wakeup, g_log_ring_wakeup, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(log_ring_wakeup, "Wake up readers polling /dev/fw_log on every logged packet");
+
+//The area is mapped writable to user, so its layout is never read back from it:
+static void* g_log_area = NULL;
+static unsigned int g_log_ring_stride = 0;
+static DECLARE_WAIT_QUEUE_HEAD(g_log_ring_wq);
+
+//Number of vmas mapping the area (a split or forked mapping has several):
+static atomic_t g_log_area_num_of_vmas = ATOMIC_INIT(0);
+
+/**
+ *	Returns the header of the given cpu's ring
+ **/
+static inline fw_log_ring_hdr_t* get_log_ring(unsigned int cpu){
+	return (fw_log_ring_hdr_t*)((char*)g_log_area + PAGE_SIZE + cpu*g_log_ring_stride);
+}
+
+/**
+ *	Returns the records of the given ring
+ **/
+static inline fw_log_rec_t* get_log_ring_recs(fw_log_ring_hdr_t* ring){
+	return (fw_log_rec_t*)((char*)ring + PAGE_SIZE);
+}
+
+/**
+ *	Writes row (of a packet that was just logged, standing for weight
+ *	packets) to current cpu's ring. Does nothing if rings are disabled.
+ *
+ *	NOTE: caller should disable softirqs (as insert_row() does).
+ **/
+void log_ring_record(const log_row_t* row, unsigned int weight){
+	fw_log_ring_hdr_t* ring;
+	fw_log_rec_t* rec;
+	__u32 head, tail;
+
+	if (g_log_area == NULL) {
+		return;
+	}
+
+	ring = get_log_ring(smp_processor_id());
+	head = ring->head;
+	tail = ACCESS_ONCE(ring->tail);
+	if (head - tail >= g_log_ring_size) {
+		++ring->dropped;
+		return;
+	}
+
+	rec = &get_log_ring_recs(ring)[head & (g_log_ring_size - 1)];
+	rec->timestamp = row->timestamp;
+	rec->src_ip = row->src_ip;
+	rec->dst_ip = row->dst_ip;
+	rec->src_port = row->src_port;
+	rec->dst_port = row->dst_port;
+	rec->reason = row->reason;
+	rec->protocol = row->protocol;
+	rec->action = row->action;
+	rec->hooknum = row->hooknum;
+	rec->reserved = 0;
+	rec->count = row->count;
+	rec->weight = weight;
+	rec->reserved2 = 0;
+
+	//Record must be visible before the new head is:
+	smp_wmb();
+	ACCESS_ONCE(ring->head) = head + 1;
+
+	if (g_log_ring_wakeup) {
+		smp_mb();
+		if (waitqueue_active(&g_log_ring_wq)) {
+			wake_up_interruptible(&g_log_ring_wq);
+		}
+	}
+}
+
+static void log_area_vma_open(struct vm_area_struct* vma){
+	atomic_inc(&g_log_area_num_of_vmas);
+}
+
+static void log_area_vma_close(struct vm_area_struct* vma){
+	atomic_dec(&g_log_area_num_of_vmas);
+}
+
+static const struct vm_operations_struct g_log_area_vm_ops = {
+	.open = log_area_vma_open,
+	.close = log_area_vma_close
+};
+
+/**
+ *	Maps the rings' area to user (called on mmap() of /dev/fw_log).
+ *	The whole area should be mapped, from offset 0 - user can read its
+ *	length from fw_log_area_hdr_t (at the first page).
+ *	The mapping should be shared (MAP_SHARED), and only one can exist at
+ *	a time, since rings have a single tail - their only reader should
+ *	unmap the area before another one maps it.
+ *
+ *	Returns 0 on success, negative number if failed (-EBUSY if the area
+ *	is already mapped).
+ **/
+int log_ring_mmap(struct file* filp, struct vm_area_struct* vma){
+	int ret;
+
+	if (g_log_area == NULL) {
+		return -ENODEV;
+	}
+	if (vma->vm_pgoff != 0 || !(vma->vm_flags & VM_SHARED)) {
+		return -EINVAL;
+	}
+	if (atomic_cmpxchg(&g_log_area_num_of_vmas, 0, 1) != 0) {
+		return -EBUSY;
+	}
+
+	if ((ret = remap_vmalloc_range(vma, g_log_area, 0)) != 0) {
+		atomic_dec(&g_log_area_num_of_vmas);
+		return ret;
+	}
+	vma->vm_ops = &g_log_area_vm_ops;
+	return 0;
+}
+
+/**
+ *	Returns POLLIN | POLLRDNORM if any ring has records to read.
+ *
+ *	NOTE: sleeping readers are only woken up when g_log_ring_wakeup is set.
+ **/
+unsigned int log_ring_poll(struct file* filp, poll_table* wait){
+	fw_log_ring_hdr_t* ring;
+	unsigned int cpu;
+
+	if (g_log_area == NULL) {
+		return POLLERR;
+	}
+
+	poll_wait(filp, &g_log_ring_wq, wait);
+
+	for (cpu = 0; cpu < nr_cpu_ids; ++cpu) {
+		ring = get_log_ring(cpu);
+		if (ACCESS_ONCE(ring->head) != ACCESS_ONCE(ring->tail)) {
+			return POLLIN | POLLRDNORM;
+		}
+	}
+	return 0;
+}
+
+/**
+ *	Allocates the rings' area (of g_log_ring_size records per cpu).
+ *	Returns: 0 on success (or if rings are disabled), -1 if failed.
+ **/
+int init_log_ring(void){
+	fw_log_area_hdr_t* area_hdr;
+	unsigned int ring_stride;
+	unsigned long area_len;
+
+	if (g_log_ring_size == 0) {
+		printk(KERN_INFO "fw_log: binary log rings are disabled.\n");
+		return 0;
+	}
+	if (g_log_ring_size > MAX_LOG_RING_SIZE) {
+		g_log_ring_size = MAX_LOG_RING_SIZE;
+	}
+	g_log_ring_size = roundup_pow_of_two(g_log_ring_size);
+
+	ring_stride = PAGE_SIZE + PAGE_ALIGN(g_log_ring_size*sizeof(fw_log_rec_t));
+	area_len = PAGE_SIZE + (unsigned long)nr_cpu_ids*ring_stride;
+	g_log_ring_stride = ring_stride;
+
+	//vmalloc_user() zeroes the area, so all rings start empty:
+	if ((g_log_area = vmalloc_user(area_len)) == NULL) {
+		printk(KERN_ERR "Error: failed allocating binary log rings.\n");
+		return -1;
+	}
+
+	area_hdr = (fw_log_area_hdr_t*)g_log_area;
+	area_hdr->magic = LOG_AREA_MAGIC;
+	area_hdr->version = LOG_AREA_VERSION;
+	area_hdr->num_of_rings = nr_cpu_ids;
+	area_hdr->ring_size = g_log_ring_size;
+	area_hdr->ring_offset = PAGE_SIZE;
+	area_hdr->ring_stride = ring_stride;
+	area_hdr->recs_offset = PAGE_SIZE;
+	area_hdr->area_len = area_len;
+
+	return 0;
+}
+
+/**
+ *	Frees the rings' area
+ **/
+void destroy_log_ring(void){
+	vfree(g_log_area);
+	g_log_area = NULL;
+}
@@ -0,0 +1,76 @@
+#ifndef _LOG_RING_UTILS_H_
+#define _LOG_RING_UTILS_H_
+
+#include "fw.h"
+#include <linux/vmalloc.h>
+#include <linux/moduleparam.h>
+#include <linux/log2.h>		//For roundup_pow_of_two()
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
+
+/**
+ *	Besides the (aggregated) log-rows, every logged packet is written as a
+ *	binary record to a ring of the cpu that handled it. All rings are in
+ *	one area that user maps (mmap() of /dev/fw_log, offset 0):
+ *
+ *		page 0:							fw_log_area_hdr_t
+ *		ring_offset + cpu*ring_stride:	fw_log_ring_hdr_t (a whole page),
+ *										followed (at recs_offset) by
+ *										ring_size fw_log_rec_t
+ *
+ *	Kernel only writes ring's head, user only writes its tail: records
+ *	[tail, head) are ready (indexes are taken modulo ring_size). There's
+ *	a single reader: the area is mapped MAP_SHARED, by one mapping at a
+ *	time (mmap() fails with EBUSY while it's mapped).
+ *	When a ring is full new records are dropped (and counted).
+ **/
+#define LOG_AREA_MAGIC (0x474C5746)		// "FWLG" (in little endian)
+#define LOG_AREA_VERSION (2)
+#define DEFAULT_LOG_RING_SIZE (4096)	// Records per cpu
+#define MAX_LOG_RING_SIZE (1 << 16)
+
+typedef struct {
+	__u32	magic;
+	__u32	version;
+	__u32	num_of_rings;		// One for every possible cpu
+	__u32	ring_size;			// Records in each ring, a power of 2
+	__u32	ring_offset;		// Offset of the first ring (from the area's start)
+	__u32	ring_stride;		// Bytes between 2 rings
+	__u32	recs_offset;		// Offset of a ring's first record (from the ring's start)
+	__u32	area_len;			// Bytes to map
+} fw_log_area_hdr_t;
+
+typedef struct {
+	__u32	head;				// Written by kernel - next record to write
+	__u32	pad_head[15];		// Keeps head & tail in different cache lines
+	__u32	tail;				// Written by user - next record to read
+	__u32	pad_tail[15];
+	__u32	dropped;			// Records dropped since ring was full
+} fw_log_ring_hdr_t;
+
+//A logged packet, all fields are in LOCAL endianness:
+typedef struct {
+	__u64	timestamp;
+	__u32	src_ip;
+	__u32	dst_ip;
+	__u16	src_port;
+	__u16	dst_port;
+	__s32	reason;				// rule#index, or values from: reason_t
+	__u8	protocol;
+	__u8	action;
+	__u8	hooknum;
+	__u8	reserved;
+	__u32	count;				// Count of its log-row, after this packet
+	__u32	weight;				// Packets it stands for (log_sample_rate if sampled, 1
+								// otherwise), a log-row's count when a log-row is read
+	__u32	reserved2;			// Keeps records 8-byte aligned
+} fw_log_rec_t;
+
+void log_ring_record(const log_row_t* row, unsigned int weight);
+int log_ring_mmap(struct file* filp, struct vm_area_struct* vma);
+unsigned int log_ring_poll(struct file* filp, poll_table* wait);
+int init_log_ring(void);
+void destroy_log_ring(void);
+
+#endif /* _LOG_RING_UTILS_H_ */
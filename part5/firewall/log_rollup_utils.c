@@ -0,0 +1,243 @@
+#include "log_rollup_utils.h"
+
+static unsigned int g_log_rollup_secs = DEFAULT_LOG_ROLLUP_SECS;
+module_param_named(log_rollup_secs, g_log_rollup_secs, uint, S_IRUGO);
+MODULE_PARM_DESC(log_rollup_secs, "Seconds in every log rollup interval");
+
+//Rollups of every possible cpu:
+static log_rollup_cpu_t __percpu* g_log_rollups = NULL;
+
+/**
+ *	Helper function: returns the slot of a key in an interval's entries
+ **/
+static inline unsigned int get_rollup_slot(__s32 reason, __u8 protocol, __u8 action){
+	return ((unsigned int)reason*31 + protocol*2 + action) & (LOG_ROLLUP_NUM_KEYS - 1);
+}
+
+/**
+ *	Helper function: finds the entry of a key in an interval (entries
+ *	are open-addressed, see get_rollup_slot()). If key has no entry,
+ *	one is added.
+ *
+ *	Returns: the entry, NULL if key has no entry and interval is full.
+ **/
+static log_rollup_entry_t* get_rollup_entry(log_rollup_interval_t* interval,
+		__s32 reason, __u8 protocol, __u8 action)
+{
+	log_rollup_entry_t* entry;
+	unsigned int slot = get_rollup_slot(reason, protocol, action);
+	unsigned int i;
+
+	for (i = 0; i < LOG_ROLLUP_NUM_KEYS; ++i) {
+		entry = &interval->entries[(slot + i) & (LOG_ROLLUP_NUM_KEYS - 1)];
+		if (!entry->used) {
+			entry->used = 1;
+			entry->reason = reason;
+			entry->protocol = protocol;
+			entry->action = action;
+			entry->packets = 0;
+			++interval->num_of_keys;
+			return entry;
+		}
+		if (entry->reason == reason && entry->protocol == protocol && entry->action == action) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/**
+ *	Counts a packet (that reached the log) in its interval of current
+ *	cpu's rollups.
+ *
+ *	@row - the packet's log_row_t, after decide_packet_action()
+ **/
+void log_rollup_record(const log_row_t* row){
+	log_rollup_cpu_t* rollup;
+	log_rollup_interval_t* interval;
+	log_rollup_entry_t* entry;
+	unsigned long number, start;
+
+	if (g_log_rollups == NULL) {
+		return;
+	}
+
+	number = row->timestamp / g_log_rollup_secs;
+	start = number*g_log_rollup_secs;
+
+	//Lock is only contended by readers, stay on this cpu while holding it:
+	local_bh_disable();
+	rollup = this_cpu_ptr(g_log_rollups);
+	spin_lock(&rollup->lock);
+
+	interval = &rollup->intervals[number % LOG_ROLLUP_NUM_INTERVALS];
+	if (interval->start != start) {
+		//Interval is LOG_ROLLUP_NUM_INTERVALS old (or was never used):
+		memset(interval, 0, sizeof(log_rollup_interval_t));
+		interval->start = start;
+	}
+
+	if ((entry = get_rollup_entry(interval, row->reason, row->protocol, row->action)) != NULL) {
+		++entry->packets;
+	} else {
+		++interval->others;
+	}
+
+	spin_unlock(&rollup->lock);
+	local_bh_enable();
+}
+
+/**
+ *	Helper function: adds a cpu's interval to the interval's merged
+ *	records (recs, of *num_of_recs records, the last is its "others").
+ *	NOTE: caller should hold the cpu's rollup lock!
+ **/
+static void merge_rollup_interval(const log_rollup_interval_t* interval,
+		fw_log_rollup_rec_t* recs, unsigned int* num_of_recs)
+{
+	const log_rollup_entry_t* entry;
+	fw_log_rollup_rec_t* others = &recs[LOG_ROLLUP_NUM_KEYS];
+	unsigned int i, j;
+
+	others->packets += interval->others;
+
+	for (i = 0; i < LOG_ROLLUP_NUM_KEYS; ++i) {
+		entry = &interval->entries[i];
+		if (!entry->used) {
+			continue;
+		}
+		for (j = 0; j < *num_of_recs; ++j) {
+			if (recs[j].reason == entry->reason && recs[j].protocol == entry->protocol &&
+				recs[j].action == entry->action)
+			{
+				break;
+			}
+		}
+		if (j == *num_of_recs) {
+			if (j == LOG_ROLLUP_NUM_KEYS) {
+				//Other cpus took all keys of this interval:
+				others->packets += entry->packets;
+				continue;
+			}
+			recs[j] = *others;
+			recs[j].flags = 0;
+			recs[j].reason = entry->reason;
+			recs[j].protocol = entry->protocol;
+			recs[j].action = entry->action;
+			recs[j].packets = 0;
+			++(*num_of_recs);
+		}
+		recs[j].packets += entry->packets;
+	}
+}
+
+/**
+ *	Merges the rollups of all cpus, for the last LOG_ROLLUP_NUM_INTERVALS
+ *	intervals (up to now).
+ *
+ *	@recs - will point to the merged records (vmalloc'ed, caller should
+ *			vfree it), oldest interval first. Intervals without packets
+ *			have no records.
+ *
+ *	Returns: number of records, negative number if failed.
+ **/
+int build_log_rollup_snapshot(fw_log_rollup_rec_t** recs){
+	fw_log_rollup_rec_t* interval_recs;
+	log_rollup_cpu_t* rollup;
+	log_rollup_interval_t* interval;
+	struct timespec ts = { .tv_sec = 0,.tv_nsec = 0};
+	unsigned long now_number, number, start;
+	unsigned int num_of_recs = 0, num_of_interval_recs;
+	int cpu;
+
+	*recs = NULL;
+	if (g_log_rollups == NULL) {
+		return 0;
+	}
+
+	if ((*recs = vmalloc(LOG_ROLLUP_MAX_RECS*sizeof(fw_log_rollup_rec_t))) == NULL) {
+		printk(KERN_ERR "Failed allocating space for log rollups.\n");
+		return -ENOMEM;
+	}
+
+	getnstimeofday(&ts);
+	now_number = ts.tv_sec / g_log_rollup_secs;
+
+	for (number = now_number + 1 - LOG_ROLLUP_NUM_INTERVALS; number <= now_number; ++number) {
+		start = number*g_log_rollup_secs;
+		interval_recs = &(*recs)[num_of_recs];
+		num_of_interval_recs = 0;
+
+		//Keys' records are written before it, at interval_recs[0...]:
+		memset(&interval_recs[LOG_ROLLUP_NUM_KEYS], 0, sizeof(fw_log_rollup_rec_t));
+		interval_recs[LOG_ROLLUP_NUM_KEYS].interval_start = start;
+		interval_recs[LOG_ROLLUP_NUM_KEYS].interval_secs = g_log_rollup_secs;
+		interval_recs[LOG_ROLLUP_NUM_KEYS].flags = LOG_ROLLUP_FLAG_OTHERS;
+
+		for_each_possible_cpu(cpu) {
+			rollup = per_cpu_ptr(g_log_rollups, cpu);
+			spin_lock_bh(&rollup->lock);
+			interval = &rollup->intervals[number % LOG_ROLLUP_NUM_INTERVALS];
+			if (interval->start == start) {
+				merge_rollup_interval(interval, interval_recs, &num_of_interval_recs);
+			}
+			spin_unlock_bh(&rollup->lock);
+		}
+
+		//"Others" goes right after the keys' records (if it has packets):
+		if (interval_recs[LOG_ROLLUP_NUM_KEYS].packets > 0) {
+			interval_recs[num_of_interval_recs++] = interval_recs[LOG_ROLLUP_NUM_KEYS];
+		}
+		num_of_recs += num_of_interval_recs;
+	}
+
+	return num_of_recs;
+}
+
+/**
+ *	Frees the rollups of all cpus
+ **/
+void destroy_log_rollup(void){
+	int cpu;
+
+	if (g_log_rollups == NULL) {
+		return;
+	}
+	for_each_possible_cpu(cpu) {
+		vfree(per_cpu_ptr(g_log_rollups, cpu)->intervals);	//vfree(NULL) does nothing
+	}
+	free_percpu(g_log_rollups);
+	g_log_rollups = NULL;
+}
+
+/**
+ *	Allocates the rollups of all cpus.
+ *	Returns: 0 on success, -1 if failed.
+ **/
+int init_log_rollup(void){
+	log_rollup_cpu_t* rollup;
+	int cpu;
+
+	g_log_rollup_secs = clamp_t(unsigned int, g_log_rollup_secs, 1, MAX_LOG_ROLLUP_SECS);
+
+	//alloc_percpu() zeroes the rollups, so a failure below leaves NULL intervals:
+	if ((g_log_rollups = alloc_percpu(log_rollup_cpu_t)) == NULL) {
+		printk(KERN_ERR "Error: failed allocating log rollups.\n");
+		return -1;
+	}
+	for_each_possible_cpu(cpu) {
+		rollup = per_cpu_ptr(g_log_rollups, cpu);
+		spin_lock_init(&rollup->lock);
+
+		//vzalloc_node() zeroes the intervals, so they all start unused:
+		rollup->intervals = vzalloc_node(LOG_ROLLUP_NUM_INTERVALS*sizeof(log_rollup_interval_t),
+				cpu_to_node(cpu));
+		if (rollup->intervals == NULL) {
+			printk(KERN_ERR "Error: failed allocating log rollups.\n");
+			destroy_log_rollup();
+			return -1;
+		}
+	}
+
+	return 0;
+}
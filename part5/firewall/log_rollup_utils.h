@@ -0,0 +1,75 @@
+#ifndef _LOG_ROLLUP_UTILS_H_
+#define _LOG_ROLLUP_UTILS_H_
+
+#include "fw.h"
+#include <linux/vmalloc.h>
+#include <linux/moduleparam.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+
+/**
+ *	Log rollups - packets counted per time interval (of "log_rollup_secs"
+ *	seconds, set at load), by rule index/reason, protocol and action.
+ *	Unlike log-rows, a rollup isn't split by addresses or ports, so a scan
+ *	adds to a single counter (instead of evicting older log-rows).
+ *	Every packet that reaches the log is counted, whatever the logging
+ *	policy (see should_log_row()) is.
+ *
+ *	Every cpu keeps the last LOG_ROLLUP_NUM_INTERVALS intervals (in a ring,
+ *	indexed by interval number), with up to LOG_ROLLUP_NUM_KEYS keys each.
+ *	Packets of keys that don't fit are counted in the interval's "others".
+ *
+ *	Rollups of all cpus are merged and read (as fw_log_rollup_rec_t
+ *	records, oldest interval first) from the log-device, in read mode
+ *	LOG_READ_MODE_ROLLUP.
+ **/
+#define LOG_ROLLUP_NUM_INTERVALS (30)
+#define DEFAULT_LOG_ROLLUP_SECS (10)
+#define MAX_LOG_ROLLUP_SECS (3600)
+#define LOG_ROLLUP_KEY_BITS (7)
+#define LOG_ROLLUP_NUM_KEYS (1 << LOG_ROLLUP_KEY_BITS)
+#define LOG_ROLLUP_MAX_RECS (LOG_ROLLUP_NUM_INTERVALS*(LOG_ROLLUP_NUM_KEYS + 1))
+
+//fw_log_rollup_rec_t.flags:
+#define LOG_ROLLUP_FLAG_OTHERS (1)		// Packets of keys that didn't fit (key fields are 0)
+
+//A merged rollup counter, all fields are in LOCAL endianness:
+typedef struct {
+	__u64	interval_start;		// Seconds
+	__u32	interval_secs;
+	__s32	reason;				// rule#index, or values from: reason_t
+	__u8	protocol;
+	__u8	action;
+	__u8	flags;
+	__u8	reserved;
+	__u32	packets;
+} fw_log_rollup_rec_t;
+
+typedef struct {
+	__s32	reason;
+	__u8	protocol;
+	__u8	action;
+	__u8	used;
+	__u32	packets;
+} log_rollup_entry_t;
+
+typedef struct {
+	unsigned long		start;		// Seconds, 0 if never used
+	unsigned int		num_of_keys;
+	unsigned int		others;
+	log_rollup_entry_t	entries[LOG_ROLLUP_NUM_KEYS];
+} log_rollup_interval_t;
+
+//Rollups of packets handled by a single cpu (kept per-cpu, the intervals
+//are too big for the per-cpu area, so they're vmalloc'ed on cpu's node):
+typedef struct {
+	log_rollup_interval_t*	intervals;	// LOG_ROLLUP_NUM_INTERVALS of them
+	spinlock_t				lock;		// Only contended when rollups are read
+} log_rollup_cpu_t;
+
+void log_rollup_record(const log_row_t* row);
+int build_log_rollup_snapshot(fw_log_rollup_rec_t** recs);
+int init_log_rollup(void);
+void destroy_log_rollup(void);
+
+#endif /* _LOG_ROLLUP_UTILS_H_ */
@@ -1,20 +1,46 @@
 #include "log_utils.h"
-
-//Global counter of number of rows, to make sure < MAX_LOG_ROWS
-static int g_num_of_rows = 0;
+#include "fw_trace.h"
 
 /**
- *	Variables that will hold all log-row's list:
- *	g_logs_list is the head of the list [it's some kind of a Dummy, won't
- *	contain "real" log-row information].
- * 
- *	New elements will always be inserted first (list is ordered from newest to oldest)
+ *	Log-rows are kept per-cpu (g_log_tabs): each cpu logs the packets it
+ *	handles into its own table, so logging never touches another cpu's
+ *	memory. Every table holds a list (ordered from newest to oldest) and
+ *	a hash of the same rows, by their aggregation key - so finding a
+ *	similar row doesn't require passing over the whole list.
+ *
+ *	Tables are only merged when log is read (see build_log_snapshot()),
+ *	similar rows of different cpus are then counted as one.
  **/
-static LIST_HEAD(g_logs_list); // Declares (static) g_logs_list of type struct list_head
+static log_cpu_tab_t __percpu* g_log_tabs = NULL;
+static u32 g_logs_hash_seed = 0;
+
+//Log-rows are allocated from their own slab cache, so many rows don't
+//fragment memory (and their memory use is easy to tell). insert_row()
+//allocates through g_log_row_pool, which keeps some rows in reserve:
+static struct kmem_cache* g_log_row_cache = NULL;
+static mempool_t* g_log_row_pool = NULL;
+
+static unsigned int g_log_capacity = DEFAULT_LOG_CAPACITY;
+module_param_named(log_capacity, g_log_capacity, uint, S_IRUGO);
+MODULE_PARM_DESC(log_capacity, "Log-rows kept per cpu (can be changed through the log_capacity sysfs attribute)");
+
+static unsigned int g_log_policy = LOG_POLICY_ALL;
+module_param_named(log_policy, g_log_policy, uint, S_IRUGO);
+MODULE_PARM_DESC(log_policy, "Packets logged: 0 - all, 1 - drops, 2 - first packets & drops, 3 - flagged rules (see log_policy sysfs attribute)");
+
+static unsigned int g_log_sample_rate = 1;
+module_param_named(log_sample_rate, g_log_sample_rate, uint, S_IRUGO);
+MODULE_PARM_DESC(log_sample_rate, "Log 1 in every N packets that pass the logging policy (1 logs them all)");
+
+//Rules (by index) whose packets are logged in LOG_POLICY_RULES:
+static u64 g_logged_rules = 0;
+static DEFINE_PER_CPU(unsigned int, g_log_sample_counter);
 
-static int g_num_rows_read = 0;
 static int g_log_usage_counter = 0;
-static struct list_head* g_last_row_read = NULL; 
+
+//Readers following the log sleep on g_log_wq until new rows are logged:
+static DECLARE_WAIT_QUEUE_HEAD(g_log_wq);
+static atomic_t g_num_of_log_followers = ATOMIC_INIT(0);
 
 // Will contain log-device's major number - its unique ID:
 static int log_dev_major_number = 0; 
@@ -24,28 +50,334 @@ static struct device* log_device = NULL;
 static ssize_t lfw_dev_read(struct file *filp, char *buffer, size_t len, loff_t *offset);
 static int lfw_dev_open(struct inode *inodep, struct file *fp);
 static int lfw_dev_release(struct inode *inodep, struct file *fp);
+static long lfw_dev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
+static unsigned int lfw_dev_poll(struct file *filp, poll_table *wait);
  
 static struct file_operations log_fops = {
 	.owner = THIS_MODULE,
 	.open = lfw_dev_open,
 	.read = lfw_dev_read,
+	.mmap = log_ring_mmap,
+	.poll = lfw_dev_poll,
+	.unlocked_ioctl = lfw_dev_ioctl,
 	.release = lfw_dev_release
 };
 
+/**
+ *	Helper function (for sort()): compares 2 log-rows by their aggregation key
+ *	[the fields compared in are_similar()]
+ **/
+static int cmp_log_rows_by_key(const void* a, const void* b){
+	const log_row_t* row_a = (const log_row_t*)a;
+	const log_row_t* row_b = (const log_row_t*)b;
+
+	if (row_a->src_ip != row_b->src_ip) {
+		return (row_a->src_ip < row_b->src_ip) ? -1 : 1;
+	}
+	if (row_a->dst_ip != row_b->dst_ip) {
+		return (row_a->dst_ip < row_b->dst_ip) ? -1 : 1;
+	}
+	if (row_a->src_port != row_b->src_port) {
+		return (row_a->src_port < row_b->src_port) ? -1 : 1;
+	}
+	if (row_a->dst_port != row_b->dst_port) {
+		return (row_a->dst_port < row_b->dst_port) ? -1 : 1;
+	}
+	if (row_a->protocol != row_b->protocol) {
+		return (row_a->protocol < row_b->protocol) ? -1 : 1;
+	}
+	if (row_a->action != row_b->action) {
+		return (row_a->action < row_b->action) ? -1 : 1;
+	}
+	if (row_a->hooknum != row_b->hooknum) {
+		return (row_a->hooknum < row_b->hooknum) ? -1 : 1;
+	}
+	if (row_a->reason != row_b->reason) {
+		return (row_a->reason < row_b->reason) ? -1 : 1;
+	}
+	return 0;
+}
+
+/**
+ *	Helper function (for sort()): compares 2 log-rows by their timestamp,
+ *	newest first
+ **/
+static int cmp_log_rows_by_time(const void* a, const void* b){
+	const log_row_t* row_a = (const log_row_t*)a;
+	const log_row_t* row_b = (const log_row_t*)b;
+
+	if (row_a->timestamp != row_b->timestamp) {
+		return (row_a->timestamp > row_b->timestamp) ? -1 : 1;
+	}
+	return 0;
+}
+
+/**
+ *	Helper function (for sort()): compares 2 log-rows by their timestamp,
+ *	oldest first
+ **/
+static int cmp_log_rows_by_time_asc(const void* a, const void* b){
+	return cmp_log_rows_by_time(b, a);
+}
+
+/**
+ *	Merges the log-rows of all cpus into one (newly allocated) array,
+ *	ordered from newest to oldest: similar rows are merged into one row,
+ *	whose count is their counts' sum and timestamp is the latest.
+ *	At most g_log_capacity (newest) rows are kept.
+ *
+ *	Updates *ptr_rows to point the array (NULL if there are no rows),
+ *	user should vfree it.
+ *
+ *	Returns number of rows in the array, -1 if allocation failed.
+ **/
+static int build_log_snapshot(log_row_t** ptr_rows){
+	log_cpu_tab_t* tab;
+	log_row_t* row;
+	log_row_t* rows;
+	unsigned int max_rows = 0, num_of_rows = 0, i, merged;
+	int cpu;
+
+	*ptr_rows = NULL;
+
+	//Rows added after this count are newer than the snapshot, ignore them:
+	for_each_possible_cpu(cpu) {
+		max_rows += per_cpu_ptr(g_log_tabs, cpu)->num_of_rows;
+	}
+	if (max_rows == 0) {
+		return 0;
+	}
+
+	if ((rows = vmalloc(max_rows*sizeof(log_row_t))) == NULL) {
+		printk(KERN_ERR "Failed allocating space for log-rows snapshot.\n");
+		return -1;
+	}
+
+	for_each_possible_cpu(cpu) {
+		tab = per_cpu_ptr(g_log_tabs, cpu);
+		spin_lock_bh(&tab->lock);
+		list_for_each_entry(row, &tab->rows, list) {
+			if (num_of_rows == max_rows) {
+				break;
+			}
+			rows[num_of_rows++] = *row;
+		}
+		spin_unlock_bh(&tab->lock);
+	}
+
+	//Merge similar rows (of different cpus):
+	sort(rows, num_of_rows, sizeof(log_row_t), cmp_log_rows_by_key, NULL);
+	merged = 0;
+	for (i = 0; i < num_of_rows; ++i) {
+		if (merged > 0 && cmp_log_rows_by_key(&rows[merged - 1], &rows[i]) == 0) {
+			rows[merged - 1].count += rows[i].count;
+			if (rows[i].timestamp > rows[merged - 1].timestamp) {
+				rows[merged - 1].timestamp = rows[i].timestamp;
+			}
+		} else {
+			rows[merged++] = rows[i];
+		}
+	}
+
+	sort(rows, merged, sizeof(log_row_t), cmp_log_rows_by_time, NULL);
+
+	*ptr_rows = rows;
+	return min_t(unsigned int, merged, ACCESS_ONCE(g_log_capacity));
+}
+
+/**
+ *	Returns true if rows were logged (on any cpu) since snapshot's
+ *	cursors were updated
+ **/
+static bool has_new_log_rows(log_snapshot_t* snapshot){
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (ACCESS_ONCE(per_cpu_ptr(g_log_tabs, cpu)->seq) != snapshot->cursors[cpu]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ *	Replaces snapshot's rows by the rows logged (or updated) since its
+ *	cursors were updated, ordered from oldest to newest, and updates its
+ *	cursors.
+ *
+ *	NOTE: rows might be logged after the buffer was sized - then the
+ *		  oldest new rows of a cpu are collected, and its cursor is only
+ *		  advanced to the newest row collected (the rest are collected
+ *		  next time).
+ *
+ *	Returns number of rows collected, -1 if allocation failed.
+ **/
+static int collect_new_log_rows(log_snapshot_t* snapshot){
+	log_cpu_tab_t* tab;
+	log_row_t* row;
+	log_row_t* rows = NULL;
+	unsigned int max_rows = 0, num_of_rows = 0;
+	unsigned int num_of_new, num_to_skip, i;
+	unsigned long newest_seq;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		tab = per_cpu_ptr(g_log_tabs, cpu);
+		max_rows += min_t(unsigned long, ACCESS_ONCE(tab->seq) - snapshot->cursors[cpu],
+				tab->num_of_rows);
+	}
+
+	if (max_rows > 0 && (rows = vmalloc(max_rows*sizeof(log_row_t))) == NULL) {
+		printk(KERN_ERR "Failed allocating space for new log-rows.\n");
+		return -1;
+	}
+
+	for_each_possible_cpu(cpu) {
+		tab = per_cpu_ptr(g_log_tabs, cpu);
+		spin_lock_bh(&tab->lock);
+		//List is ordered from newest to oldest (by seq), so new rows are first:
+		num_of_new = 0;
+		list_for_each_entry(row, &tab->rows, list) {
+			if (row->seq <= snapshot->cursors[cpu]) {
+				break;
+			}
+			++num_of_new;
+		}
+
+		//If there's no room for all, skips the newest:
+		num_to_skip = (num_of_new > max_rows - num_of_rows) ?
+				(num_of_new - (max_rows - num_of_rows)) : 0;
+		newest_seq = 0;
+		i = 0;
+		list_for_each_entry(row, &tab->rows, list) {
+			if (i == num_of_new) {
+				break;
+			}
+			if (i++ < num_to_skip) {
+				continue;
+			}
+			if (i == num_to_skip + 1) {
+				newest_seq = row->seq;
+			}
+			rows[num_of_rows++] = *row;
+		}
+
+		if (num_to_skip == 0) {
+			snapshot->cursors[cpu] = tab->seq;
+		} else if (num_to_skip < num_of_new) {
+			//Rows that weren't collected have seq > newest_seq:
+			snapshot->cursors[cpu] = newest_seq;
+		} //Otherwise nothing was collected, cursor stays
+		spin_unlock_bh(&tab->lock);
+	}
+
+	if (num_of_rows > 0) {
+		sort(rows, num_of_rows, sizeof(log_row_t), cmp_log_rows_by_time_asc, NULL);
+	}
+
+	vfree(snapshot->rows);
+	snapshot->rows = rows;
+	snapshot->num_of_rows = num_of_rows;
+	snapshot->num_rows_read = 0;
+	return num_of_rows;
+}
+
+/**
+ *	Helper function (of lfw_dev_read(), when following the log): makes
+ *	sure snapshot has unread rows - if all were read, waits until new
+ *	rows are logged and collects them.
+ *
+ *	@nonblock - if true, doesn't wait
+ *
+ *	Returns 0 on success, negative number if failed (-EAGAIN if nonblock
+ *	and there are no new rows, -ERESTARTSYS if interrupted).
+ **/
+static int wait_for_followed_rows(log_snapshot_t* snapshot, bool nonblock){
+	int ret;
+
+	while (snapshot->num_rows_read == snapshot->num_of_rows) {
+		if (!has_new_log_rows(snapshot)) {
+			if (nonblock) {
+				return -EAGAIN;
+			}
+			if (wait_event_interruptible(g_log_wq, has_new_log_rows(snapshot))) {
+				return -ERESTARTSYS;
+			}
+		}
+		//Might collect nothing (if new rows were already deleted), then wait again:
+		if ((ret = collect_new_log_rows(snapshot)) < 0) {
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+/**
+ *	Starts following the log (see FW_LOG_IOC_FOLLOW): drops snapshot's
+ *	rows, only rows logged from now on would be read.
+ *
+ *	Returns 0 on success, negative number if failed.
+ **/
+static int start_following_log(log_snapshot_t* snapshot){
+	int cpu;
+
+	if (snapshot->follow) {
+		return 0;
+	}
+
+	snapshot->cursors = kmalloc(nr_cpu_ids*sizeof(unsigned long), GFP_KERNEL);
+	if (snapshot->cursors == NULL) {
+		return -ENOMEM;
+	}
+	for_each_possible_cpu(cpu) {
+		snapshot->cursors[cpu] = ACCESS_ONCE(per_cpu_ptr(g_log_tabs, cpu)->seq);
+	}
+
+	vfree(snapshot->rows);
+	snapshot->rows = NULL;
+	snapshot->num_of_rows = 0;
+	snapshot->num_rows_read = 0;
+	snapshot->follow = true;
+	atomic_inc(&g_num_of_log_followers);
+	return 0;
+}
+
 /** 
  * 	The device open function (called each time the device is opened):
  * 		1. Increments g_log_usage_counter
- *  	2. Updates g_num_rows_read to 0, and g_last_row_read to point
- * 		   the head of the list 
+ *  	2. Takes a snapshot of all cpus' log-rows (build_log_snapshot()),
+ * 		   that would be read by this file
  * 
  *	@inodep - pointer to an inode object)
  *  @fp - pointer to a file object
+ *
+ *	Returns 0 on success, negative number if failed.
  */
 static int lfw_dev_open(struct inode *inodep, struct file *fp){
 	
+	log_snapshot_t* snapshot;
+	int num_of_rows;
+
+	if ((snapshot = kmalloc(sizeof(log_snapshot_t), GFP_KERNEL)) == NULL) {
+		printk(KERN_ERR "Failed allocating space for log-device's state.\n");
+		return -ENOMEM;
+	}
+
+	if ((num_of_rows = build_log_snapshot(&snapshot->rows)) < 0) {
+		kfree(snapshot);
+		return -ENOMEM;
+	}
+	snapshot->num_of_rows = num_of_rows;
+	snapshot->num_rows_read = 0;
+	snapshot->read_mode = LOG_READ_MODE_TEXT;
+	snapshot->rollups = NULL;
+	snapshot->num_of_rollups = 0;
+	snapshot->num_rollups_read = 0;
+	snapshot->follow = false;
+	snapshot->cursors = NULL;
+	fp->private_data = snapshot;
+
 	g_log_usage_counter++;
-	g_num_rows_read = 0;
-	g_last_row_read = &g_logs_list;
 	
 	return 0;
 }
@@ -54,7 +386,7 @@ static int lfw_dev_open(struct inode *inodep, struct file *fp){
  * 	The device release function - called whenever the device is 
  *	closed/released by the userspace program.
  *
- *	Decrements g_log_usage_counter	
+ *	Frees the file's snapshot, decrements g_log_usage_counter	
  * 	 
  *  @inodep - pointer to an inode object
  *  @fp - pointer to a file object
@@ -62,6 +394,19 @@ static int lfw_dev_open(struct inode *inodep, struct file *fp){
  */
 static int lfw_dev_release(struct inode *inodep, struct file *fp){
 	
+	log_snapshot_t* snapshot = (log_snapshot_t*)fp->private_data;
+
+	if (snapshot != NULL) {
+		if (snapshot->follow) {
+			atomic_dec(&g_num_of_log_followers);
+			kfree(snapshot->cursors);
+		}
+		vfree(snapshot->rows);
+		vfree(snapshot->rollups);
+		kfree(snapshot);
+		fp->private_data = NULL;
+	}
+
 	if (g_log_usage_counter != 0){
 		g_log_usage_counter--;
 	}
@@ -70,6 +415,166 @@ static int lfw_dev_release(struct inode *inodep, struct file *fp){
 }
 
 
+/**
+ *	The device ioctl function (see log_utils.h):
+ *		FW_LOG_IOC_SET_MODE - sets the read mode of this opened file.
+ *			Mode can be changed in the middle of reading, next read()
+ *			continues from the next unread row.
+ *		FW_LOG_IOC_FOLLOW - this opened file starts following the log.
+ *
+ *	Returns 0 on success, negative number if failed.
+ **/
+static long lfw_dev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg){
+
+	log_snapshot_t* snapshot = (log_snapshot_t*)filp->private_data;
+
+	if (snapshot == NULL) {
+		return -ENOTTY;
+	}
+
+	switch (cmd) {
+		case (FW_LOG_IOC_SET_MODE):
+			if (arg != LOG_READ_MODE_TEXT && arg != LOG_READ_MODE_BINARY &&
+				arg != LOG_READ_MODE_ROLLUP)
+			{
+				return -EINVAL;
+			}
+			snapshot->read_mode = (int)arg;
+			return 0;
+		case (FW_LOG_IOC_FOLLOW):
+			return start_following_log(snapshot);
+		default:
+			return -ENOTTY;
+	}
+}
+
+/**
+ *	The device poll function:
+ *		1. When following the log - reports if there are unread rows.
+ *		2. Otherwise - reports if the binary log rings have records (see
+ *		   log_ring_poll()).
+ **/
+static unsigned int lfw_dev_poll(struct file *filp, poll_table *wait){
+
+	log_snapshot_t* snapshot = (log_snapshot_t*)filp->private_data;
+
+	if (snapshot == NULL || !snapshot->follow) {
+		return log_ring_poll(filp, wait);
+	}
+
+	poll_wait(filp, &g_log_wq, wait);
+	if (snapshot->num_rows_read < snapshot->num_of_rows || has_new_log_rows(snapshot)) {
+		return POLLIN | POLLRDNORM;
+	}
+	return 0;
+}
+
+/**
+ *	Helper function (of lfw_dev_read(), in LOG_READ_MODE_BINARY):
+ *	copies as many unread rows of snapshot as fit in buffer (of len
+ *	bytes), as fw_log_rec_t records.
+ *
+ *	Returns number of bytes copied (0 if all rows were read - then next
+ *	read starts over), negative number if failed.
+ **/
+static ssize_t read_binary_log_rows(log_snapshot_t* snapshot, char* buffer, size_t len){
+
+	fw_log_rec_t* recs;
+	log_row_t* row;
+	size_t max_rows = len / sizeof(fw_log_rec_t);
+	size_t num_copied = 0, chunk, i;
+
+	if (snapshot->num_rows_read == snapshot->num_of_rows) {
+		snapshot->num_rows_read = 0;//So next read would start over
+		return 0;
+	}
+	if (max_rows == 0) {
+		printk(KERN_ERR "Error: user provided a buffer too small for a binary log-row\n");
+		return -EINVAL;
+	}
+	max_rows = min_t(size_t, max_rows, snapshot->num_of_rows - snapshot->num_rows_read);
+
+	if ((recs = kmalloc(LOG_BINARY_READ_CHUNK*sizeof(fw_log_rec_t), GFP_KERNEL)) == NULL) {
+		return -ENOMEM;
+	}
+
+	while (num_copied < max_rows) {
+		chunk = min_t(size_t, max_rows - num_copied, LOG_BINARY_READ_CHUNK);
+		for (i = 0; i < chunk; ++i) {
+			row = &snapshot->rows[snapshot->num_rows_read + i];
+			memset(&recs[i], 0, sizeof(fw_log_rec_t));
+			recs[i].timestamp = row->timestamp;
+			recs[i].src_ip = row->src_ip;
+			recs[i].dst_ip = row->dst_ip;
+			recs[i].src_port = row->src_port;
+			recs[i].dst_port = row->dst_port;
+			recs[i].reason = row->reason;
+			recs[i].protocol = row->protocol;
+			recs[i].action = row->action;
+			recs[i].hooknum = row->hooknum;
+			recs[i].count = row->count;
+			recs[i].weight = row->count;
+		}
+		if (copy_to_user(buffer + num_copied*sizeof(fw_log_rec_t), recs,
+				chunk*sizeof(fw_log_rec_t)) != 0)
+		{
+			printk(KERN_INFO "Function copy_to_user failed - writing log-rows to user's buffer failed\n");
+			kfree(recs);
+			return (num_copied > 0) ? (ssize_t)(num_copied*sizeof(fw_log_rec_t)) : -EFAULT;
+		}
+		snapshot->num_rows_read += chunk;
+		num_copied += chunk;
+	}
+
+	kfree(recs);
+	return num_copied*sizeof(fw_log_rec_t);
+}
+
+/**
+ *	Helper function (of lfw_dev_read(), in LOG_READ_MODE_ROLLUP):
+ *	copies as many unread rollups as fit in buffer (of len bytes).
+ *	Rollups are merged on the first read, and dropped once all were read.
+ *
+ *	Returns number of bytes copied (0 if all rollups were read - then
+ *	next read takes them again), negative number if failed.
+ **/
+static ssize_t read_log_rollups(log_snapshot_t* snapshot, char* buffer, size_t len){
+
+	size_t max_recs = len / sizeof(fw_log_rollup_rec_t);
+	int num_of_rollups;
+
+	if (max_recs == 0) {
+		printk(KERN_ERR "Error: user provided a buffer too small for a log rollup\n");
+		return -EINVAL;
+	}
+
+	if (snapshot->rollups == NULL) {
+		if ((num_of_rollups = build_log_rollup_snapshot(&snapshot->rollups)) < 0) {
+			return num_of_rollups;
+		}
+		snapshot->num_of_rollups = num_of_rollups;
+		snapshot->num_rollups_read = 0;
+	}
+
+	if (snapshot->num_rollups_read == snapshot->num_of_rollups) {
+		//So next read would take them again:
+		vfree(snapshot->rollups);
+		snapshot->rollups = NULL;
+		return 0;
+	}
+
+	max_recs = min_t(size_t, max_recs, snapshot->num_of_rollups - snapshot->num_rollups_read);
+	if (copy_to_user(buffer, &snapshot->rollups[snapshot->num_rollups_read],
+			max_recs*sizeof(fw_log_rollup_rec_t)) != 0)
+	{
+		printk(KERN_INFO "Function copy_to_user failed - writing log rollups to user's buffer failed\n");
+		return -EFAULT;
+	}
+	snapshot->num_rollups_read += max_recs;
+
+	return max_recs*sizeof(fw_log_rollup_rec_t);
+}
+
 /** 
  * 	This function is called whenever device is being read from user space
  *  i.e. data is being sent from the device to the user. 
@@ -79,38 +584,60 @@ static int lfw_dev_release(struct inode *inodep, struct file *fp){
  *	log-row format:
  * <timestamp> <protocol> <action> <hooknum> <src ip> <dst ip> <source port> <dest port> <reason> <count>'\n'
  * 
- *  @filp - a pointer to a file object (here it's not relevant)
+ *  @filp - a pointer to a file object (holds the snapshot being read)
  *  @buffer - pointer to the buffer to which this function will write data
  *  @len - length of the buffer, excluding '\0'. 
  *  @offset - the offset if required (here it's not relevant)
  * 
  * Note: 1. if len isn't enough for one row, action will fail.
- * 		 2. g_num_rows_read will be updated (+1) on success.
+ * 		 2. snapshot->num_rows_read will be updated (+1) on success.
  * 		 3. User should allocate enough space, and if he wants all rows - 
  * 			read until EOF (0).
  * 		 4. In case of consecutive calls, in USER's responsibility to 
  * 			update buffer's pointer (offset is ignored).
+ * 		 5. Describes LOG_READ_MODE_TEXT, in LOG_READ_MODE_BINARY
+ * 			read_binary_log_rows() is used instead (and in
+ * 			LOG_READ_MODE_ROLLUP - read_log_rollups()).
  * 
  * Returns: 
  * 		 1. In case there were log-rows to read 
- * 			(i.e. g_num_rows_read < g_num_of_rows) returns the number
+ * 			(i.e. num_rows_read < num_of_rows) returns the number
  *			of bytes written (sent) to buffer.
  * 		 2. In case there were NO rows left to read - returns 0 
  * 		 3. (-EFAULT) if copy_to_user failed / (-1) if other failure happened
  */
 static ssize_t lfw_dev_read(struct file *filp, char *buffer, size_t len, loff_t *offset){
 
+	log_snapshot_t* snapshot = (log_snapshot_t*)filp->private_data;
 	log_row_t* rowPtr = NULL;
 	char str[MAX_STRLEN_OF_LOGROW_FORMAT+1]; //for '\0'
 		
+	if (snapshot == NULL) {
+		return -EINVAL;
+	}
+
+	if (snapshot->read_mode == LOG_READ_MODE_ROLLUP) {
+		return read_log_rollups(snapshot, buffer, len);
+	}
+
+	if (snapshot->follow) {
+		ssize_t ret = wait_for_followed_rows(snapshot, (filp->f_flags & O_NONBLOCK) != 0);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	if (snapshot->read_mode == LOG_READ_MODE_BINARY) {
+		return read_binary_log_rows(snapshot, buffer, len);
+	}
+
 	//Checks if user already finished reading all rows:
-	if ((g_num_rows_read == g_num_of_rows) || (g_num_of_rows == 0)){ 
-		g_num_rows_read = 0;//So next user could read
-		g_last_row_read = &g_logs_list; 
+	if ((snapshot->num_rows_read == snapshot->num_of_rows) || (snapshot->num_of_rows == 0)){ 
+		snapshot->num_rows_read = 0;//So next read would start over
 		return 0;
 	}
 	
-	rowPtr = list_entry(g_last_row_read->next, log_row_t, list);
+	rowPtr = &snapshot->rows[snapshot->num_rows_read];
 
 	if ((sprintf(str,
 				"%lu %hhu %hhu %hhu %u %u %hu %hu %d %u\n",
@@ -142,26 +669,64 @@ static ssize_t lfw_dev_read(struct file *filp, char *buffer, size_t len, loff_t
 		return -EFAULT; //Return a bad address message
 	}
 
-	g_last_row_read = g_last_row_read->next;
-	++g_num_rows_read;
+	++snapshot->num_rows_read;
 	return strlen(str);
 }
 
 
 /**
- *	Deletes all log-rows from g_logs_list
+ *	Deletes a specific log-row from its cpu's table
+ *	NOTE: caller should hold tab->lock!
+ **/
+static void delete_log_row(log_cpu_tab_t* tab, log_row_t* row){
+	list_del(&(row->list));
+	hlist_del(&(row->hnode));
+	mempool_free(row, g_log_row_pool);
+	--tab->num_of_rows;
+}
+
+/**
+ *	Deletes the oldest log-rows of a cpu's table, until it has at most
+ *	max_rows rows.
+ *	NOTE: caller should hold tab->lock!
+ *
+ *	Returns false if the table's list is empty although it has too many rows.
+ **/
+static bool trim_log_tab(log_cpu_tab_t* tab, unsigned int max_rows){
+	log_row_t* row;
+
+	while (tab->num_of_rows > max_rows) {
+		//The last row is the oldest:
+		if ( (tab->rows.prev) == &tab->rows) { 
+			//^ Makes sure last element in list isn't the head (empty list)
+			printk(KERN_ERR "In trim_log_tab(), large number of rows but list is empty!\n");
+			return false;
+		}
+		row = list_entry((tab->rows.prev), log_row_t, list);
+		trace_fw_log_evict(row);
+		delete_log_row(tab, row);
+	}
+	return true;
+}
+
+/**
+ *	Deletes all log-rows from all cpus' tables
  *	(frees all allocated memory)
  **/
 static void delete_all_rows(void){
 
+	log_cpu_tab_t* tab;
 	log_row_t *row, *temp_row;
+	int cpu;
 	
-	list_for_each_entry_safe(row, temp_row, &g_logs_list, list) {
-		list_del(&row->list);
-		kfree(row);
+	for_each_possible_cpu(cpu) {
+		tab = per_cpu_ptr(g_log_tabs, cpu);
+		spin_lock_bh(&tab->lock);
+		list_for_each_entry_safe(row, temp_row, &tab->rows, list) {
+			delete_log_row(tab, row);
+		}
+		spin_unlock_bh(&tab->lock);
 	}
-	g_num_of_rows = 0;
-	g_num_rows_read = 0;
 
 }
 
@@ -191,16 +756,34 @@ ssize_t clear_log_list(struct device* dev, struct device_attribute* attr, const
 }
 
 
+/**
+ *	Helper function: returns the number of log-rows kept by all cpus, from
+ *	their running counts (nothing is locked or allocated).
+ *	A flow handled by a few cpus has a row on each of them - those rows
+ *	are merged only when the log is read, so this is an upper bound of
+ *	the number of rows the log-device returns.
+ **/
+static unsigned long get_num_of_kept_rows(void){
+	unsigned long num_of_rows = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		num_of_rows += ACCESS_ONCE(per_cpu_ptr(g_log_tabs, cpu)->num_of_rows);
+	}
+	return num_of_rows;
+}
+
  /**
  *	This function will be called when user tries to read from "log_size"
  * 	
- *  NOTE: writes to "buf" the value of of g_num_of_rows, in (string) format:
- * 		<g_num_of_rows>
+ *  NOTE: writes to "buf" the number of log-rows (see get_num_of_kept_rows()),
+ *	in (string) format:
+ * 		<number of rows>
  * 
  * [writes minimal amount of characters, as it's a kernel function]
  **/
 ssize_t read_log_size(struct device* dev, struct device_attribute* attr, char* buf){
-		ssize_t ret = scnprintf(buf, PAGE_SIZE, "%d", g_num_of_rows);
+		ssize_t ret = scnprintf(buf, PAGE_SIZE, "%lu", get_num_of_kept_rows());
 		if (ret <= 0){
 			printk(KERN_ERR "*** Error: failed writing to user's buffer in function read_log_size() ***\n");
 		}
@@ -227,15 +810,278 @@ static DEVICE_ATTR(log_clear, S_IRUSR | S_IWUSR | S_IROTH | S_IWOTH, NULL, clear
  **/
 static DEVICE_ATTR(log_size, S_IRUSR | S_IROTH, read_log_size, NULL);
 
+/**
+ *	Helper function: returns the bytes the log uses whatever its capacity
+ *	is - every cpu's log_cpu_tab_t (mostly its LOG_NUM_BUCKETS hash
+ *	heads), and the LOG_ROW_POOL_SIZE rows g_log_row_pool reserves.
+ **/
+static unsigned long get_log_fixed_bytes(void){
+	return (unsigned long)num_possible_cpus()*sizeof(log_cpu_tab_t) +
+			(unsigned long)LOG_ROW_POOL_SIZE*kmem_cache_size(g_log_row_cache);
+}
+
+ /**
+ *	This function will be called when user tries to read from "log_capacity"
+ * 	
+ *  NOTE: writes to "buf", in (string) format:
+ * 		<capacity (rows per cpu)> <rows kept (all cpus)> <bytes used> <bytes used at full capacity>
+ *	(bytes include the hash heads & mempool reserve, see get_log_fixed_bytes())
+ **/
+ssize_t read_log_capacity(struct device* dev, struct device_attribute* attr, char* buf){
+		unsigned long num_of_rows = get_num_of_kept_rows();
+		unsigned long row_size = kmem_cache_size(g_log_row_cache);
+		unsigned long fixed_bytes = get_log_fixed_bytes();
+		unsigned int capacity = ACCESS_ONCE(g_log_capacity);
+		ssize_t ret;
+
+		ret = scnprintf(buf, PAGE_SIZE, "%u %lu %lu %lu", capacity, num_of_rows,
+				fixed_bytes + num_of_rows*row_size,
+				fixed_bytes + (unsigned long)capacity*num_possible_cpus()*row_size);
+		if (ret <= 0){
+			printk(KERN_ERR "*** Error: failed writing to user's buffer in function read_log_capacity() ***\n");
+		}
+		return ret;
+}
+
+/**
+ * 	This function will be called when user tries to write to "log_capacity",
+ *	meaning that the user wants to change the log's capacity.
+ *  Returns:	count on success,
+ * 				a negative number otherwise.
+ * 
+ * 	Buffer should contain either:
+ *		<rows> - number of log-rows every cpu keeps, or
+ *		<bytes>K / <bytes>M / <bytes>G - memory budget for the whole log,
+ *			(capacity is the number of rows of all cpus that fit in what's
+ *			left of it after get_log_fixed_bytes())
+ *	Capacity should be in [1, MAX_LOG_CAPACITY].
+ *
+ *	Rows are kept when capacity grows, the oldest rows are deleted
+ *	(immediately) when it shrinks.
+ **/
+ssize_t write_log_capacity(struct device* dev, struct device_attribute* attr, const char* buf, size_t count){
+
+	unsigned long long value;
+	unsigned long long capacity;
+	char* end;
+	log_cpu_tab_t* tab;
+	int cpu;
+
+	if (buf == NULL || count == 0) {
+		return -EINVAL;
+	}
+
+	value = memparse(buf, &end);
+	if (end == buf || (*end != '\0' && *end != '\n')) {
+		printk(KERN_ERR "*** Error: user sent invalid input to log_capacity ***\n");
+		return -EINVAL;
+	}
+
+	capacity = value;
+	if (strchr("KkMmGg", end[-1]) != NULL) {
+		//A memory budget:
+		capacity = (value > get_log_fixed_bytes()) ? (value - get_log_fixed_bytes()) : 0;
+		do_div(capacity, kmem_cache_size(g_log_row_cache));
+		do_div(capacity, num_possible_cpus());
+	}
+
+	if (capacity < 1 || capacity > MAX_LOG_CAPACITY) {
+		printk(KERN_ERR "*** Error: log capacity should be between 1 and %d rows ***\n", MAX_LOG_CAPACITY);
+		return -EINVAL;
+	}
+
+	ACCESS_ONCE(g_log_capacity) = (unsigned int)capacity;
+
+	for_each_possible_cpu(cpu) {
+		tab = per_cpu_ptr(g_log_tabs, cpu);
+		spin_lock_bh(&tab->lock);
+		trim_log_tab(tab, (unsigned int)capacity);
+		spin_unlock_bh(&tab->lock);
+	}
+
+	return count;
+}
+
+/**
+ * 	Declaring a variable of type struct device_attribute, its name would be "dev_attr_log_capacity"
+ * 		.attr.mode = S_IRUSR | S_IWUSR | S_IROTH, giving the owner read & write permissions, others read permissions
+ * 		.show = read_log_capacity
+ * 		.store = write_log_capacity
+ **/
+static DEVICE_ATTR(log_capacity, S_IRUSR | S_IWUSR | S_IROTH, read_log_capacity, write_log_capacity);
+
+ /**
+ *	This function will be called when user tries to read from "log_policy"
+ * 	
+ *  NOTE: writes to "buf", in (string) format:
+ * 		<policy (log_policy_t)> <sample rate>
+ **/
+ssize_t read_log_policy(struct device* dev, struct device_attribute* attr, char* buf){
+		ssize_t ret = scnprintf(buf, PAGE_SIZE, "%u %u", ACCESS_ONCE(g_log_policy),
+				ACCESS_ONCE(g_log_sample_rate));
+		if (ret <= 0){
+			printk(KERN_ERR "*** Error: failed writing to user's buffer in function read_log_policy() ***\n");
+		}
+		return ret;
+}
+
+/**
+ * 	This function will be called when user tries to write to "log_policy".
+ *  Returns:	count on success,
+ * 				a negative number otherwise.
+ * 
+ * 	Buffer should contain: <policy (log_policy_t)> [<sample rate>]
+ *	(sample rate is left unchanged if not given, 1 means no sampling)
+ **/
+ssize_t write_log_policy(struct device* dev, struct device_attribute* attr, const char* buf, size_t count){
+	unsigned int policy;
+	unsigned int sample_rate = ACCESS_ONCE(g_log_sample_rate);
+
+	if (buf == NULL || sscanf(buf, "%u %u", &policy, &sample_rate) < 1 ||
+			policy > MAX_LOG_POLICY || sample_rate < 1 ||
+			sample_rate > MAX_LOG_SAMPLE_RATE)
+	{
+		printk(KERN_ERR "*** Error: user sent invalid input to log_policy ***\n");
+		return -EINVAL;
+	}
+
+	ACCESS_ONCE(g_log_policy) = policy;
+	ACCESS_ONCE(g_log_sample_rate) = sample_rate;
+	return count;
+}
+
+/**
+ * 	Declaring a variable of type struct device_attribute, its name would be "dev_attr_log_policy"
+ * 		.attr.mode = S_IRUSR | S_IWUSR | S_IROTH, giving the owner read & write permissions, others read permissions
+ * 		.show = read_log_policy
+ * 		.store = write_log_policy
+ **/
+static DEVICE_ATTR(log_policy, S_IRUSR | S_IWUSR | S_IROTH, read_log_policy, write_log_policy);
+
+ /**
+ *	This function will be called when user tries to read from "log_rules"
+ * 	
+ *  NOTE: writes to "buf" the indexes of the rules flagged for logging
+ *		(see LOG_POLICY_RULES), in (string) format:
+ * 		<rule index> <rule index> ...
+ **/
+ssize_t read_logged_rules(struct device* dev, struct device_attribute* attr, char* buf){
+		u64 logged_rules = ACCESS_ONCE(g_logged_rules);
+		ssize_t ret = 0;
+		int i;
+
+		for (i = 0; i < MAX_RULES; ++i) {
+			if (logged_rules & (1ULL << i)) {
+				ret += scnprintf(buf + ret, PAGE_SIZE - ret, ret ? " %d" : "%d", i);
+			}
+		}
+		return ret;
+}
+
+/**
+ * 	This function will be called when user tries to write to "log_rules",
+ *	meaning that the user wants to flag rules for logging.
+ *  Returns:	count on success,
+ * 				a negative number otherwise.
+ * 
+ * 	Buffer should contain the indexes of ALL the rules to flag (in the
+ *	rules-table), separated by spaces: <rule index> <rule index> ...
+ *	An empty line un-flags all rules.
+ *	Anything else (a sign, a non-digit, an index >= MAX_RULES) fails the
+ *	whole write, and the flags are left unchanged.
+ *
+ *	Note: rules are flagged by index - if rules-table is rewritten,
+ *		  flags refer to the new rules in the same indexes.
+ **/
+ssize_t write_logged_rules(struct device* dev, struct device_attribute* attr, const char* buf, size_t count){
+	u64 logged_rules = 0;
+	unsigned int index;
+	size_t pos = 0, start;
+
+	if (buf == NULL) {
+		return -EINVAL;
+	}
+
+	while (true) {
+		while (pos < count && isspace(buf[pos])) {
+			++pos;
+		}
+		if (pos == count || buf[pos] == '\0') {
+			break;
+		}
+
+		//Parsed digit by digit (rather than by sscanf), so nothing can overflow:
+		index = 0;
+		start = pos;
+		while (pos < count && isdigit(buf[pos]) && index < MAX_RULES) {
+			index = index*10 + (buf[pos] - '0');
+			++pos;
+		}
+		if (pos == start || index >= MAX_RULES ||
+			(pos < count && buf[pos] != '\0' && !isspace(buf[pos])))
+		{
+			printk(KERN_ERR "*** Error: user sent invalid rule index to log_rules ***\n");
+			return -EINVAL;
+		}
+		logged_rules |= (1ULL << index);
+	}
+
+	ACCESS_ONCE(g_logged_rules) = logged_rules;
+	return count;
+}
 
 /**
- *	Creates (allocates) a new log-row: *ptr_pckt_lg_info.
+ * 	Declaring a variable of type struct device_attribute, its name would be "dev_attr_log_rules"
+ * 		.attr.mode = S_IRUSR | S_IWUSR | S_IROTH, giving the owner read & write permissions, others read permissions
+ * 		.show = read_logged_rules
+ * 		.store = write_logged_rules
+ **/
+static DEVICE_ATTR(log_rules, S_IRUSR | S_IWUSR | S_IROTH, read_logged_rules, write_logged_rules);
+
+ /**
+ *	This function will be called when user tries to read from "log_allocs"
+ * 	
+ *  NOTE: writes to "buf", in (string) format:
+ * 		<packets parsed> <log-rows allocated>
+ *	(every other packet either wasn't logged or updated an existing log-row)
+ **/
+ssize_t read_log_allocs(struct device* dev, struct device_attribute* attr, char* buf){
+		unsigned long num_of_packets = 0, num_of_allocs = 0;
+		log_cpu_tab_t* tab;
+		ssize_t ret;
+		int cpu;
+
+		for_each_possible_cpu(cpu) {
+			tab = per_cpu_ptr(g_log_tabs, cpu);
+			num_of_packets += ACCESS_ONCE(tab->num_of_packets);
+			num_of_allocs += ACCESS_ONCE(tab->num_of_allocs);
+		}
+
+		ret = scnprintf(buf, PAGE_SIZE, "%lu %lu", num_of_packets, num_of_allocs);
+		if (ret <= 0){
+			printk(KERN_ERR "*** Error: failed writing to user's buffer in function read_log_allocs() ***\n");
+		}
+		return ret;
+}
+
+/**
+ * 	Declaring a variable of type struct device_attribute, its name would be "dev_attr_log_allocs"
+ * 		.attr.mode = S_IRUSR | S_IROTH, giving the owner and other user read permissions
+ * 		.show = read_log_allocs
+ * 		.store = NULL (no writing function)
+ **/
+static DEVICE_ATTR(log_allocs, S_IRUSR | S_IROTH, read_log_allocs, NULL);
+
+
+/**
+ *	Initiates a packet's details: *ptr_pckt_lg_info (usually on the
+ *	caller's stack - nothing is allocated).
  *	Updates:
  * 			1. *ptr_pckt_lg_info fields to contain the packet information
  * 			2. *ack to contain the packets ack value (ACK_ANY if not TCP)
  * 			3. *direction to contain the packets direction
  * 
- *	@skb - the packet
+ *	@hdrs - the packet's headers (see parse_packet_headers())
  *	@hooknumber - as received from netfilter hook
  *	@ack - a pointer to ack_t to be updated
  *	@direction - a pointer to direction_t to be updated
@@ -243,29 +1089,21 @@ static DEVICE_ATTR(log_size, S_IRUSR | S_IROTH, read_log_size, NULL);
  * 		  the packet pass through. NULL if packet traversal is "out".
  *	@out - pointer to net_device representing the network inteface
  * 		  the packet pass through. NULL if packet traversal is "in".
+ *	@ptr_pckt_lg_info - the log_row_t to be initiated
  * 
  * 	Note: fields: action, reason, count are only initiallized to default!
  *
- *	Returns a pointer to log_row_t on success, NULL if an error happened
+ *	Returns true on success, false if an error happened
  **/
-log_row_t* init_log_row(struct sk_buff* skb, unsigned char hooknumber,
+bool init_log_row(const packet_hdrs_t* hdrs, unsigned char hooknumber,
 		ack_t* ack, direction_t* direction,	const struct net_device* in,
-		const struct net_device* out)
+		const struct net_device* out, log_row_t* ptr_pckt_lg_info)
 {
-	log_row_t* ptr_pckt_lg_info = NULL;
-	struct iphdr* ptr_ipv4_hdr;		//pointer to ipv4 header
-	struct tcphdr* ptr_tcp_hdr;		//pointer to tcp header
-	struct udphdr* ptr_udp_hdr;		//pointer to udp header
 	__u8 ip_h_protocol = 0;
-	__be16 temp_port_num;
 	struct timespec ts = { .tv_sec = 0,.tv_nsec = 0};
 	getnstimeofday(&ts);
-    
-    //Allocates memory for log-row:
-    if((ptr_pckt_lg_info = kmalloc(sizeof(log_row_t),GFP_ATOMIC)) == NULL){
-		printk(KERN_ERR "Failed allocating space for packet's info (log_row_t)\n");
-		return NULL;
-	}
+
+	this_cpu_inc(g_log_tabs->num_of_packets);
 	memset(ptr_pckt_lg_info, 0, sizeof(log_row_t)); 
     
     //Initiates known values:
@@ -273,6 +1111,7 @@ log_row_t* init_log_row(struct sk_buff* skb, unsigned char hooknumber,
 	ptr_pckt_lg_info->hooknum = hooknumber;
 	*direction = get_direction(in, out);
 	INIT_LIST_HEAD(&(ptr_pckt_lg_info->list));
+	INIT_HLIST_NODE(&(ptr_pckt_lg_info->hnode));
 	
 	//Initiates default values:
 	ptr_pckt_lg_info->count = 1;
@@ -282,52 +1121,42 @@ log_row_t* init_log_row(struct sk_buff* skb, unsigned char hooknumber,
 	ptr_pckt_lg_info->dst_port = PORT_ANY;
 	*ack = ACK_ANY; //Default value, according to rules_0.txt example
 	
-	if (skb) {
-		ptr_ipv4_hdr = ip_hdr(skb);
-		if(ptr_ipv4_hdr){
-			
-			ptr_pckt_lg_info->src_ip = ntohl(ptr_ipv4_hdr->saddr);
-			ptr_pckt_lg_info->dst_ip = ntohl(ptr_ipv4_hdr->daddr);
+	if (hdrs && hdrs->ip) {
 			
-			//Protocol is 1 byte - no need to convert Endianness.
-			ip_h_protocol = ptr_ipv4_hdr->protocol; 
+		ptr_pckt_lg_info->src_ip = ntohl(hdrs->ip->saddr);
+		ptr_pckt_lg_info->dst_ip = ntohl(hdrs->ip->daddr);
 		
-			switch (ip_h_protocol){
-				case (PROT_ICMP):
-				case (PROT_TCP):		
-				case (PROT_UDP):
-				case (PROT_ANY):
-					ptr_pckt_lg_info->protocol = ip_h_protocol;
-					break;
-				default: //PROT_OTHER
-					ptr_pckt_lg_info->protocol = PROT_OTHER;
-			}
+		//Protocol is 1 byte - no need to convert Endianness.
+		ip_h_protocol = hdrs->ip->protocol; 
+	
+		switch (ip_h_protocol){
+			case (PROT_ICMP):
+			case (PROT_TCP):		
+			case (PROT_UDP):
+			case (PROT_ANY):
+				ptr_pckt_lg_info->protocol = ip_h_protocol;
+				break;
+			default: //PROT_OTHER
+				ptr_pckt_lg_info->protocol = PROT_OTHER;
+		}
 
-			if (ip_h_protocol == PROT_TCP){
-				ptr_tcp_hdr = (struct tcphdr*)((char*)ptr_ipv4_hdr + (ptr_ipv4_hdr->ihl * 4));
-				temp_port_num = ptr_tcp_hdr->source;
-				ptr_pckt_lg_info->src_port = ntohs(temp_port_num); //Convert to local-endianness
-				temp_port_num = ptr_tcp_hdr->dest;
-				ptr_pckt_lg_info->dst_port = ntohs(temp_port_num); //Convert to local-endianness
-				*ack = ((ptr_tcp_hdr->ack) == 1) ? ACK_YES : ACK_NO; //Updates *ack
-
-			} else if (ip_h_protocol == PROT_UDP) {
-				ptr_udp_hdr = (struct udphdr*)((char*)ptr_ipv4_hdr + (ptr_ipv4_hdr->ihl * 4));
-				temp_port_num = ptr_udp_hdr->source;
-				ptr_pckt_lg_info->src_port = ntohs(temp_port_num); //Convert to local-endianness
-				temp_port_num = ptr_udp_hdr->dest;
-				ptr_pckt_lg_info->dst_port = ntohs(temp_port_num); //Convert to local-endianness
+		//Ports are left PORT_ANY if packet's TCP/UDP header couldn't be read:
+		if (hdrs->tcp){
+			ptr_pckt_lg_info->src_port = ntohs(hdrs->tcp->source); //Convert to local-endianness
+			ptr_pckt_lg_info->dst_port = ntohs(hdrs->tcp->dest); //Convert to local-endianness
+			*ack = ((hdrs->tcp->ack) == 1) ? ACK_YES : ACK_NO; //Updates *ack
 
-			}
+		} else if (hdrs->udp) {
+			ptr_pckt_lg_info->src_port = ntohs(hdrs->udp->source); //Convert to local-endianness
+			ptr_pckt_lg_info->dst_port = ntohs(hdrs->udp->dest); //Convert to local-endianness
 
-			return ptr_pckt_lg_info;
 		}
-		
+
+		return true;
 	} 
 	
-	printk(KERN_ERR "In init_log_row, skb or ptr_ipv4_hdr is NULL\n"); 
-	kfree(ptr_pckt_lg_info);
-	return NULL;
+	printk(KERN_ERR "In init_log_row, hdrs or its ipv4 header is NULL\n"); 
+	return false;
 	
 }
 
@@ -384,58 +1213,158 @@ static bool are_similar(log_row_t* row_a, log_row_t* row_b) {
 }
 
 /**
- *	Gets a pointer to a new log_row_t which was ALREADY initiated (in
- *	init_log_row()) and allocated (dynamically).
- *	searches g_logs_list for a similar log-row: if finds one, 
- *	UPDATES row's count (by the count of the similar) and deletes 
- *	the old log_row.
+ *	Returns the index of the bucket (in a log_cpu_tab_t's hash) of row's aggregation key
+ *	[the fields compared in are_similar()]
+ **/
+static inline unsigned int get_log_bucket(log_row_t* row){
+	u32 other_fields = ((u32)row->protocol) | (((u32)row->action) << 8) |
+			(((u32)row->hooknum) << 16);
+
+	return jhash_3words(row->src_ip, row->dst_ip,
+			(((u32)row->src_port) << 16) | row->dst_port,
+			g_logs_hash_seed ^ other_fields ^ (u32)row->reason) & (LOG_NUM_BUCKETS - 1);
+}
+
+/**
+ *	Checks if a packet should be logged, by the logging policy & sample rate.
+ *	If it should be logged (and is sampled) updates row->count to the
+ *	number of packets it represents.
+ *
+ *	Note: function should be called AFTER row's action & reason were
+ *		  decided (in decide_packet_action()).
+ *
+ *	Returns true if row should be inserted to log.
+ **/
+bool should_log_row(log_row_t* row){
+	unsigned int sample_rate;
+
+	switch (ACCESS_ONCE(g_log_policy)) {
+		case (LOG_POLICY_DROPS):
+			if (row->action != NF_DROP) {
+				return false;
+			}
+			break;
+		case (LOG_POLICY_FIRST_AND_DROPS):
+			//Packets that weren't checked against the rules-table belong to known connections:
+			if (row->action != NF_DROP && row->reason < 0 &&
+					row->reason != REASON_NO_MATCHING_RULE)
+			{
+				return false;
+			}
+			break;
+		case (LOG_POLICY_RULES):
+			if (row->reason < 0 || row->reason >= MAX_RULES ||
+					!(ACCESS_ONCE(g_logged_rules) & (1ULL << row->reason)))
+			{
+				return false;
+			}
+			break;
+		default: //LOG_POLICY_ALL
+			break;
+	}
+
+	sample_rate = ACCESS_ONCE(g_log_sample_rate);
+	if (sample_rate > 1) {
+		if ((this_cpu_inc_return(g_log_sample_counter) % sample_rate) != 0) {
+			return false;
+		}
+		row->count = sample_rate;
+	}
+	return true;
+}
+
+/**
+ *	Gets a pointer to a packet's log_row_t which was ALREADY initiated
+ *	(in init_log_row()), row itself is never kept in the log.
+ *	searches current cpu's table for a similar log-row: if finds one, 
+ *	UPDATES the similar row's count (adds row's count) and timestamp,
+ *	otherwise allocates a new log-row (from g_log_row_pool) as a copy
+ *	of row. Updates row's count to its log-row's count.
  * 
- *	Inserts row at the start of g_logs_list,
- *	to maintain the order from newest (first) to oldest (last element) 
- *	in g_logs_list.
+ *	The log-row is (re)inserted at the start of current cpu's list,
+ *	to maintain the order from newest (first) to oldest (last element).
  *	
  *	Returns: true on success, false if any error happened.
  **/
 bool insert_row(log_row_t* row){
 	
-	struct list_head *pos, *q;
+	log_cpu_tab_t* tab;
 	log_row_t* temp_row;
+	log_row_t* log_row = NULL;
+	unsigned int bucket;
+	unsigned int weight;
+	bool ret = true;
+	bool is_new_row = false;
 	
 	if (row == NULL) {
 		printk(KERN_ERR "In insert_row(), function got NULL argument.\n");
 		return false;
 	}
+	weight = row->count;	//Packets this one stands for (see should_log_row())
 	
-	list_for_each_safe(pos, q, &g_logs_list){
-		temp_row = list_entry(pos, log_row_t, list);
+	bucket = get_log_bucket(row);
+
+	//Lock is only contended by readers, stay on this cpu while holding it:
+	local_bh_disable();
+	tab = this_cpu_ptr(g_log_tabs);
+	spin_lock(&tab->lock);
+
+	hlist_for_each_entry(temp_row, &tab->hash[bucket], hnode) {
 		if (are_similar(temp_row, row)) {
-			row->count = 1+(temp_row->count);
-			list_del(pos);
-			kfree(temp_row);
-			--g_num_of_rows; //Since we deleted one (will be updated later)
+			//No need for a new log-row, the similar one becomes the newest:
+			temp_row->count += row->count;
+			temp_row->timestamp = row->timestamp;
+			list_move(&(temp_row->list), &tab->rows);
+			log_row = temp_row;
 			break;
 		}
 	}
 	
-	if (g_num_of_rows >= MAX_LOG_ROWS) { //Note: it was enough just to check "=="
+	if (log_row == NULL) {
+		//Delete old rows before inserting (capacity might have just shrunk):
+		ret = trim_log_tab(tab, ACCESS_ONCE(g_log_capacity) - 1);
+
+		if (ret && (log_row = mempool_alloc(g_log_row_pool, GFP_ATOMIC)) == NULL) {
+			printk(KERN_ERR "Failed allocating space for a new log-row\n");
+			ret = false;
+		}
+
+		if (ret) {
+			*log_row = *row;
+			list_add(&(log_row->list), &tab->rows);
+			hlist_add_head(&(log_row->hnode), &tab->hash[bucket]);
+			++tab->num_of_rows;
+			++tab->num_of_allocs;
+			is_new_row = true;
+		}
+	}
 	
-		//Delete old row before inserting - the last row is the oldest:
-		if ( (g_logs_list.prev) != &g_logs_list) { 
-			//^ Makes sure last element in list isn't the head (empty list)
-			temp_row = list_entry((g_logs_list.prev), log_row_t, list);
-			list_del(g_logs_list.prev);
-			kfree(temp_row);
-			--g_num_of_rows;
+	if (ret) {
+		log_row->seq = ++tab->seq;
+		row->count = log_row->count;
+		if (is_new_row) {
+			trace_fw_log_insert(log_row);
 		} else {
-			printk(KERN_ERR "In insert_row(), large number of rows but list is empty!\n");
-			return false;
+			trace_fw_log_update(log_row);
 		}
+		log_ring_record(log_row, weight);
 	}
-	
-	list_add(&(row->list), &g_logs_list);
-	
-	++g_num_of_rows;
-	return true;
+
+	spin_unlock(&tab->lock);
+	local_bh_enable();
+
+	if (ret) {
+		log_netlink_record(row, weight, is_new_row);
+	}
+
+	//Only pay for waking up when someone follows the log:
+	if (ret && atomic_read(&g_num_of_log_followers) > 0) {
+		smp_mb();
+		if (waitqueue_active(&g_log_wq)) {
+			wake_up_interruptible(&g_log_wq);
+		}
+	}
+	return ret;
 	
 }
 
@@ -446,6 +1375,16 @@ bool insert_row(log_row_t* row){
 static void destroyLogDevice(struct class* fw_class, enum l_state_to_fold stateToFold){
 	switch (stateToFold){
 		case(L_ALL_DES):
+			destroy_log_netlink(log_device);
+		case(L_SIXTH_FILE_DES):
+			device_remove_file(log_device, (const struct device_attribute *)&dev_attr_log_allocs.attr);
+		case(L_FIFTH_FILE_DES):
+			device_remove_file(log_device, (const struct device_attribute *)&dev_attr_log_rules.attr);
+		case(L_FOURTH_FILE_DES):
+			device_remove_file(log_device, (const struct device_attribute *)&dev_attr_log_policy.attr);
+		case(L_THIRD_FILE_DES):
+			device_remove_file(log_device, (const struct device_attribute *)&dev_attr_log_capacity.attr);
+		case(L_SECOND_FILE_DES):
 			device_remove_file(log_device, (const struct device_attribute *)&dev_attr_log_size.attr);
 		case(L_FIRST_FILE_DES):
 			device_remove_file(log_device, (const struct device_attribute *)&dev_attr_log_clear.attr);
@@ -453,6 +1392,19 @@ static void destroyLogDevice(struct class* fw_class, enum l_state_to_fold stateT
 			device_destroy(fw_class, MKDEV(log_dev_major_number, MINOR_LOG));
 		case (L_UNREG_DES):
 			unregister_chrdev(log_dev_major_number, DEVICE_NAME_LOG);
+		case (L_ROLLUP_DES):
+			destroy_log_rollup();
+		case (L_RING_DES):
+			destroy_log_ring();
+		case (L_TABS_DES):
+			free_percpu(g_log_tabs);
+			g_log_tabs = NULL;
+		case (L_POOL_DES):
+			mempool_destroy(g_log_row_pool);
+			g_log_row_pool = NULL;
+		case (L_CACHE_DES):
+			kmem_cache_destroy(g_log_row_cache);
+			g_log_row_cache = NULL;
 	}
 }
 
@@ -465,16 +1417,67 @@ static void destroyLogDevice(struct class* fw_class, enum l_state_to_fold stateT
  **/
 int init_log_device(struct class* fw_class){
 	
+	log_cpu_tab_t* tab;
+	int cpu, i;
+
 	//Initiates global values, just to make sure:
-	g_num_of_rows = 0;
-	g_num_rows_read = 0;
 	g_log_usage_counter = 0;
-	g_last_row_read = NULL; 
+	get_random_bytes(&g_logs_hash_seed, sizeof(g_logs_hash_seed));
+	g_log_capacity = clamp_t(unsigned int, g_log_capacity, 1, MAX_LOG_CAPACITY);
+	g_log_sample_rate = clamp_t(unsigned int, g_log_sample_rate, 1, MAX_LOG_SAMPLE_RATE);
+	if (g_log_policy > MAX_LOG_POLICY) {
+		g_log_policy = LOG_POLICY_ALL;
+	}
+
+	//Create log-rows' cache:
+	g_log_row_cache = kmem_cache_create("fw_log_row", sizeof(log_row_t), 0, SLAB_HWCACHE_ALIGN, NULL);
+	if (g_log_row_cache == NULL) {
+		printk(KERN_ERR "Error: failed creating log-rows' cache.\n");
+		return -1;
+	}
+
+	if ((g_log_row_pool = mempool_create_slab_pool(LOG_ROW_POOL_SIZE, g_log_row_cache)) == NULL) {
+		printk(KERN_ERR "Error: failed creating log-rows' pool.\n");
+		destroyLogDevice(fw_class, L_CACHE_DES);
+		return -1;
+	}
+
+	//Create cpus' log-tables:
+	if ((g_log_tabs = alloc_percpu(log_cpu_tab_t)) == NULL) {
+		printk(KERN_ERR "Error: failed allocating log-tables.\n");
+		destroyLogDevice(fw_class, L_POOL_DES);
+		return -1;
+	}
+	for_each_possible_cpu(cpu) {
+		tab = per_cpu_ptr(g_log_tabs, cpu);
+		INIT_LIST_HEAD(&tab->rows);
+		for (i = 0; i < LOG_NUM_BUCKETS; ++i) {
+			INIT_HLIST_HEAD(&tab->hash[i]);
+		}
+		tab->num_of_rows = 0;
+		tab->seq = 0;
+		tab->num_of_packets = 0;
+		tab->num_of_allocs = 0;
+		spin_lock_init(&tab->lock);
+	}
+
+	//Create cpus' binary log rings (if enabled):
+	if (init_log_ring() < 0) {
+		destroyLogDevice(fw_class, L_TABS_DES);
+		return -1;
+	}
+	
+	//Create cpus' log rollups:
+	if (init_log_rollup() < 0) {
+		destroyLogDevice(fw_class, L_RING_DES);
+		return -1;
+	}
 	
 	//Create char device
 	log_dev_major_number = register_chrdev(0, DEVICE_NAME_LOG, &log_fops);
 	if (log_dev_major_number < 0){
 		printk(KERN_ERR "Error: failed registering log-char-device.\n");
+		destroyLogDevice(fw_class, L_ROLLUP_DES);
 		return -1;
 	}
 	
@@ -503,6 +1506,45 @@ int init_log_device(struct class* fw_class){
 		return -1;
 	}
 	
+	//Create "log_capacity"-sysfs file attributes:
+	if (device_create_file(log_device, (const struct device_attribute *)&dev_attr_log_capacity.attr))
+	{
+		printk(KERN_ERR "Error: failed creating log_capacity-sysfs-file inside log-char-device.\n");
+		destroyLogDevice(fw_class, L_SECOND_FILE_DES);
+		return -1;
+	}
+	
+	//Create "log_policy"-sysfs file attributes:
+	if (device_create_file(log_device, (const struct device_attribute *)&dev_attr_log_policy.attr))
+	{
+		printk(KERN_ERR "Error: failed creating log_policy-sysfs-file inside log-char-device.\n");
+		destroyLogDevice(fw_class, L_THIRD_FILE_DES);
+		return -1;
+	}
+	
+	//Create "log_rules"-sysfs file attributes:
+	if (device_create_file(log_device, (const struct device_attribute *)&dev_attr_log_rules.attr))
+	{
+		printk(KERN_ERR "Error: failed creating log_rules-sysfs-file inside log-char-device.\n");
+		destroyLogDevice(fw_class, L_FOURTH_FILE_DES);
+		return -1;
+	}
+	
+	//Create "log_allocs"-sysfs file attributes:
+	if (device_create_file(log_device, (const struct device_attribute *)&dev_attr_log_allocs.attr))
+	{
+		printk(KERN_ERR "Error: failed creating log_allocs-sysfs-file inside log-char-device.\n");
+		destroyLogDevice(fw_class, L_FIFTH_FILE_DES);
+		return -1;
+	}
+
+	//Create log's netlink socket (and its "log_nl_stats"-sysfs file):
+	if (init_log_netlink(log_device) < 0)
+	{
+		destroyLogDevice(fw_class, L_SIXTH_FILE_DES);
+		return -1;
+	}
+	
 	printk(KERN_INFO "fw_log: device successfully initiated.\n");
 
 	return 0;
@@ -2,9 +2,117 @@
 #define _LOG_UTILS_H_
 
 #include "fw.h"
+#include "log_ring_utils.h"
+#include "log_netlink_utils.h"
+#include "log_rollup_utils.h"
+#include <linux/jhash.h>	//For hashing log-rows' aggregation keys
+#include <linux/random.h>
+#include <linux/percpu.h>	//Log-rows are kept per-cpu
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/sort.h>		//For merging cpus' log-rows
+#include <linux/ioctl.h>
+#include <linux/wait.h>
+#include <linux/atomic.h>
+#include <linux/moduleparam.h>
+#include <linux/mempool.h>
+#include <linux/ctype.h>		//For parsing log_rules
 
 #define NUM_OF_FIELDS_IN_LOG_ROW_T (10)
 
+//Log-rows are also kept in a hash-table (by their aggregation key, see are_similar()):
+#define LOG_HASH_BITS (10)
+#define LOG_NUM_BUCKETS (1 << LOG_HASH_BITS)
+
+/**
+ *	Read modes of an opened log-device, set by ioctl(fd, FW_LOG_IOC_SET_MODE, mode):
+ *		LOG_READ_MODE_TEXT - every read() returns one log-row, in LOGROW format (default)
+ *		LOG_READ_MODE_BINARY - every read() returns as many log-rows as fit in
+ *							   the buffer, as fw_log_rec_t records
+ *		LOG_READ_MODE_ROLLUP - every read() returns as many log rollups as fit
+ *							   in the buffer, as fw_log_rollup_rec_t records
+ *							   (see log_rollup_utils.h), taken on first read
+ *
+ *	ioctl(fd, FW_LOG_IOC_FOLLOW) makes an opened log-device "follow" the
+ *	log: from then on, reads return only rows logged (or updated) after
+ *	the previous read, and block until there are such rows (unless
+ *	opened with O_NONBLOCK). poll() reports when there are.
+ *	NOTE: a row updated several times between reads is returned once,
+ *		  with its (cumulative) count - for a record per packet, read the
+ *		  binary log rings (see log_ring_utils.h).
+ **/
+#define FW_LOG_IOC_MAGIC ('f')
+#define FW_LOG_IOC_SET_MODE _IOW(FW_LOG_IOC_MAGIC, 1, int)
+#define FW_LOG_IOC_FOLLOW _IO(FW_LOG_IOC_MAGIC, 2)
+#define LOG_READ_MODE_TEXT (0)
+#define LOG_READ_MODE_BINARY (1)
+#define LOG_READ_MODE_ROLLUP (2)
+#define LOG_BINARY_READ_CHUNK (128)	// Records copied to user at once
+
+/**
+ *	Log capacity - the maximal number of log-rows every cpu keeps (and
+ *	of merged rows returned when log is read). Set by module parameter
+ *	"log_capacity", and at runtime through "log_capacity" sysfs attribute,
+ *	either in rows or as a memory budget (see write_log_capacity()).
+ **/
+//Log-rows reserved for insert_row() (allocated up-front, when memory is tight):
+#define LOG_ROW_POOL_SIZE (256)
+
+#define DEFAULT_LOG_CAPACITY (MAX_LOG_ROWS)
+#define MAX_LOG_CAPACITY (1 << 20)
+
+/**
+ *	Logging policies - which packets are logged (see should_log_row()),
+ *	set by module parameter "log_policy" or through "log_policy" sysfs
+ *	attribute. Packets that pass the policy can be further sampled:
+ *	only 1 in every "log_sample_rate" packets (of a cpu) is logged,
+ *	counted as log_sample_rate packets.
+ **/
+typedef enum {
+	LOG_POLICY_ALL				= 0,	// Every (non-loopback) packet
+	LOG_POLICY_DROPS			= 1,	// Dropped packets only
+	LOG_POLICY_FIRST_AND_DROPS	= 2,	// Dropped packets & packets checked against the rules-table
+										// (TCP: first SYN, other protocols: every packet)
+	LOG_POLICY_RULES			= 3		// Packets matched by a rule flagged in "log_rules"
+} log_policy_t;
+
+#define MAX_LOG_POLICY (LOG_POLICY_RULES)
+#define MAX_LOG_SAMPLE_RATE (1 << 20)
+
+//Log-rows of packets handled by a single cpu (see insert_row()),
+//each cpu keeps up to g_log_capacity rows:
+typedef struct {
+
+	struct list_head	rows;					// Ordered from newest to oldest
+	struct hlist_head	hash[LOG_NUM_BUCKETS];	// Same rows, by aggregation key
+	unsigned int		num_of_rows;
+	unsigned long		seq;					// Rows inserted so far
+	unsigned long		num_of_packets;			// Packets parsed (see init_log_row())
+	unsigned long		num_of_allocs;			// Log-rows allocated
+	spinlock_t			lock;					// Only contended when log is read/cleared
+
+}log_cpu_tab_t;
+
+//Merged log-rows of all cpus, taken when log-device is opened
+//(saved in its file's private_data):
+typedef struct {
+
+	log_row_t*		rows;			// Ordered from newest to oldest (oldest first when following)
+	unsigned int	num_of_rows;
+	unsigned int	num_rows_read;
+	int				read_mode;		// LOG_READ_MODE_TEXT / LOG_READ_MODE_BINARY / LOG_READ_MODE_ROLLUP
+
+	//In LOG_READ_MODE_ROLLUP - merged rollups (NULL until first read):
+	fw_log_rollup_rec_t*	rollups;
+	unsigned int			num_of_rollups;
+	unsigned int			num_rollups_read;
+
+	//When following (see FW_LOG_IOC_FOLLOW) - every cpu's seq when last read:
+	bool			follow;
+	unsigned long*	cursors;
+
+}log_snapshot_t;
+
 /**
  * LOGROW format:
  * <timestamp> <protocol> <action> <hooknum> <src ip> <dst ip> <source port> <dest port> <reason> <count>'\n'. 
@@ -21,17 +129,28 @@
 //used when: - initiating device stopped because of some error 
 //			 - device is destroyed.
 enum l_state_to_fold {
+	L_CACHE_DES,
+	L_POOL_DES,
+	L_TABS_DES,
+	L_RING_DES,
+	L_ROLLUP_DES,
 	L_UNREG_DES,
 	L_DEVICE_DES,
 	L_FIRST_FILE_DES,
+	L_SECOND_FILE_DES,
+	L_THIRD_FILE_DES,
+	L_FOURTH_FILE_DES,
+	L_FIFTH_FILE_DES,
+	L_SIXTH_FILE_DES,
 	L_ALL_DES
 };
 
 
 void print_log_row(log_row_t* logrowPtr);
-log_row_t* init_log_row(struct sk_buff* skb, unsigned char hooknumber,
+bool init_log_row(const packet_hdrs_t* hdrs, unsigned char hooknumber,
 		ack_t* ack, direction_t* direction,	const struct net_device* in,
-		const struct net_device* out);
+		const struct net_device* out, log_row_t* ptr_pckt_lg_info);
+bool should_log_row(log_row_t* row);
 bool insert_row(log_row_t* row);
 int init_log_device(struct class* fw_class);
 void destroy_log_device(struct class* fw_class);
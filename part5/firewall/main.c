@@ -1,5 +1,9 @@
 #include "main.h"
 
+//Creates the tracepoints declared in fw_trace.h (only here):
+#define CREATE_TRACE_POINTS
+#include "fw_trace.h"
+
 /**
  * Based on Reuven Plevinsky's sysfs_example that can be found in: http://course.cs.tau.ac.il//secws17/lectures/ 
  * And on: http://derekmolloy.ie/writing-a-linux-kernel-module-part-2-a-character-device/
@@ -19,6 +23,8 @@ static void destroyFirewall(enum main_state_to_fold stateToFold){
 		case(M_ALL):
 			unRegisterHooks();
 		case(M_ALL_CHAR_DEVS):
+			destroy_conn_sync_device(fw_class);
+		case(M_CONN_TAB_DEV):
 			destroy_conn_tab_device(fw_class);
 		case(M_LOG_DEV):
 			destroy_log_device(fw_class);
@@ -57,6 +63,12 @@ static int __init my_init_func(void){
 		destroyFirewall(M_LOG_DEV);
 		return -1;
 	}
+
+	if (init_conn_sync_device(fw_class) < 0) {
+		//Error msg already been printed inside init_conn_sync_device()
+		destroyFirewall(M_CONN_TAB_DEV);
+		return -1;
+	}
 	
 	if (registerHooks() < 0) {
 		printk(KERN_ERR "Failed registering hooks, init module failed.\n");
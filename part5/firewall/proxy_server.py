@@ -6,6 +6,7 @@ from DLP_data_inspector import *
 
 
 PATH_TO_CONN_TAB_ATTR = "/sys/class/fw/fw/conn_tab"
+PATH_TO_FTP_DATA_EXP_ATTR = "/sys/class/fw/fw/ftp_data_exp"
 
 VLAN_1 = '10.1.1.3'
 VLAN_2 = '10.1.2.3'
@@ -211,13 +212,14 @@ def close_sock(sock, input_sockets, messages_queue, close_immediately=False):
 
 
 def write_new_ftp_data_to_conn_tab(src_ip, src_port, dst_ip, dst_port):
-	buff = "{0} {1} {2} {3}\n".format(src_ip, src_port, dst_ip, dst_port)
+	#Binary ftp_data_exp_t record: <src ip(u32)><src port(u16)><dst ip(u32)><dst port(u16)>, packed, local endianness
+	buff = struct.pack("=IHIH", src_ip, src_port, dst_ip, dst_port)
 	try:
-		with open(PATH_TO_CONN_TAB_ATTR,'w') as f:
+		with open(PATH_TO_FTP_DATA_EXP_ATTR,'wb') as f:
 			f.write(buff)
 			f.close()
 	except EnvironmentError as e:
-		print("Error, opening device for writing to connection-table failed. Error details:")
+		print("Error, opening device for writing FTP-DATA expectation failed. Error details:")
 		print "\t", e
 		return False
 	return True
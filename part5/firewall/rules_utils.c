@@ -1,4 +1,5 @@
 #include "rules_utils.h"
+#include "fw_trace.h"
 
 /** 	
  * Used: http://derekmolloy.ie/writing-a-linux-kernel-module-part-2-a-character-device/
@@ -9,13 +10,20 @@ static rule_t g_all_rules_table[MAX_NUM_OF_RULES];
 static unsigned char g_fw_is_active = FW_OFF;
 static int g_usage_counter = 0;
 
+//Serializes activating/deactivating the firewall (g_fw_is_active follows g_fw_active_key):
+static DEFINE_MUTEX(g_active_mutex);
+
 /** Globals for reading/writing char device **/
 //Contains the data user wrote to device:
 static char* g_write_to_buff = NULL;
 //Will contain the current length of g_write_to_buff, NOT including '\0':
 static long g_write_buff_len = 0; //long to make sure it is signed and enough to contain all unsigned int values
 static int g_bytes_written_so_far = 0;
-static int g_num_rules_have_been_read = 0;
+
+//Protects the rules-table against concurrent changes & copies (by readers),
+//g_rules_generation changes whenever the table does:
+static DEFINE_MUTEX(g_rules_lock);
+static unsigned long g_rules_generation = 0;
 
 static int rules_dev_major_number = 0; // Will contain rules-device's major number - its unique ID
 static struct device* rules_device = NULL;
@@ -43,7 +51,7 @@ static struct file_operations fops = {
 /**
  * Helper function: frees g_write_to_buff and initializes all relevant values
  **/
-static void clean_g_write_buff(bool clear_g_num_rules_have_been_read){
+static void clean_g_write_buff(void){
 
 	if (g_write_to_buff != NULL) {
 		kfree(g_write_to_buff);
@@ -52,9 +60,22 @@ static void clean_g_write_buff(bool clear_g_num_rules_have_been_read){
 	
 	g_write_buff_len = 0; 
 	g_bytes_written_so_far = 0;
-	if (clear_g_num_rules_have_been_read) {
-		g_num_rules_have_been_read = 0;
+}
+
+/**
+ * Helper function: copies the rules-table to reader (if it changed since
+ * reader's copy was taken) and rewinds reader to its first rule.
+ **/
+static void copy_rules_table(rules_reader_t* reader){
+
+	mutex_lock(&g_rules_lock);
+	if (reader->generation != g_rules_generation) {
+		memcpy(reader->rules, g_all_rules_table, g_num_of_valid_rules*sizeof(rule_t));
+		reader->num_of_rules = g_num_of_valid_rules;
+		reader->generation = g_rules_generation;
 	}
+	mutex_unlock(&g_rules_lock);
+	reader->num_rules_read = 0;
 }
 
 //For tests alone! prints rule to kernel
@@ -137,13 +158,21 @@ ssize_t change_active_stat(struct device* dev, struct device_attribute* attr, co
 		return -EPERM; // Returns an error of operation not permitted
 	}
 	
+	mutex_lock(&g_active_mutex);
 	if (buf[0]=='0'){
 		if (g_fw_is_active == FW_OFF){
 			printk(KERN_INFO "User tried do deactivate already-off firewall\n");
 		} else {
 			printk(KERN_INFO "User successfully deactivated firewall\n");
-			delete_all_conn_rows();
+			//Packets stop being checked before the tables are emptied
+			//(hooks run under rcu_read_lock(), so once synchronize_net()
+			//returns, none is still adding rows):
+			static_key_slow_dec(&g_fw_active_key);
 			g_fw_is_active = FW_OFF;
+			synchronize_net();
+			delete_all_conn_rows();
+			delete_all_exp_rows();
+			delete_all_half_open_rows();
 		}
 	} else { //buf[0] =='1'
 		if (g_fw_is_active == FW_ON){
@@ -151,8 +180,10 @@ ssize_t change_active_stat(struct device* dev, struct device_attribute* attr, co
 		} else {
 			printk(KERN_INFO "User successfully activated firewall\n");
 			g_fw_is_active = FW_ON;
+			static_key_slow_inc(&g_fw_active_key);
 		}
 	}
+	mutex_unlock(&g_active_mutex);
 	
 	return sizeof(unsigned char);//because we've changed the value of 1 unsigned char.
 	
@@ -460,7 +491,7 @@ static ssize_t rfw_dev_write(struct file* filp, const char* buffer, size_t len,
 		//Sanity check:
 		if (g_write_to_buff != NULL) {
 			printk (KERN_ERR "Freeing allocated user-input buff, g_bytes_written_so_far was zero\n");
-			clean_g_write_buff(false);
+			clean_g_write_buff();
 		}
 		
 		//Allocate memory for user's input
@@ -478,7 +509,7 @@ static ssize_t rfw_dev_write(struct file* filp, const char* buffer, size_t len,
 		//Sanity check, never supposed to get here:
 		if ((g_write_buff_len - g_bytes_written_so_far) < 0) {
 			printk (KERN_ERR "ERROR In rfw_dev_write(), number of bytes written is larger than buffer allocated\n");
-			clean_g_write_buff(false);
+			clean_g_write_buff();
 			return -ENOMEM;
 		}
 		
@@ -487,7 +518,7 @@ static ssize_t rfw_dev_write(struct file* filp, const char* buffer, size_t len,
 
 	if (copy_from_user(g_write_to_buff+g_bytes_written_so_far, buffer, len )){
 		//Copying from user failed - aborts.
-		clean_g_write_buff(false);
+		clean_g_write_buff();
 		return -EFAULT;
 	}	
 
@@ -502,17 +533,19 @@ static ssize_t rfw_dev_write(struct file* filp, const char* buffer, size_t len,
  *  i.e. data is being sent from the device to the user. 
  * 	We use copy_to_user() function to copy rules (in their string format)
  * 	to buffer.
+ * 	Rules are read from the copy of the rules-table taken when filp was
+ * 	opened, so rules changed meanwhile don't affect this reader.
  * 
  *	rule format:
  * <rule name> <direction> <src ip> <src prefix length> <dst ip> <dst prefix length> <protocol> <source port> <dest port> <ack> <action>'\n'
  * 
- *  @filp - a pointer to a file object (here it's not relevant)
+ *  @filp - a pointer to a file object (its private_data is a rules_reader_t)
  *  @buffer - pointer to the buffer to which this function will write the data
  *  @len - length of the buffer, excluding '\0'. 
  *  @offset - the offset if required (here it's not relevant)
  * 
  * Note: 1. if len isn't enough for one rule, action will fail.
- * 		 2. g_num_rules_have_been_read will be updated (+1) on success.
+ * 		 2. reader's num_rules_read will be updated (+1) on success.
  * 		 3. User should allocate enough space, and if he wants all rules - 
  * 			read until EOF (0).
  * 		 4. In case of consecutive calls, in USER's responsibility to 
@@ -520,23 +553,29 @@ static ssize_t rfw_dev_write(struct file* filp, const char* buffer, size_t len,
  * 
  * Returns: 
  * 		 1. In case there were rules to read 
- * 			(i.e. g_num_rules_have_been_read < g_num_of_valid_rules)
+ * 			(i.e. reader's num_rules_read < its num_of_rules)
  *  		returns the number of bytes written (sent) to buffer.
  * 		 2. In case there were NO rules left to read - returns 0 
+ * 			(and next read starts over, from a fresh copy of the rules-table)
  * 		 3. (-EFAULT) if copy_to_user failed / (-1) if other failure happened
  */
 static ssize_t rfw_dev_read(struct file *filp, char *buffer, size_t len, loff_t *offset){
 	
+	rules_reader_t* reader = (rules_reader_t*)filp->private_data;
 	rule_t* rulePtr;
 	char str[MAX_STRLEN_OF_RULE_FORMAT+2]; //+2: for '\n' and '\0'
 	
+	if (reader == NULL) { //Device wasn't opened for reading
+		return -EINVAL;
+	}
+	
 	//Checks if user already finished reading all rules:
-	if (g_num_rules_have_been_read == g_num_of_valid_rules) { 
-		g_num_rules_have_been_read = 0;//So next user could read
+	if (reader->num_rules_read == reader->num_of_rules) { 
+		copy_rules_table(reader);//So user could read again
 		return 0;
 	}
 	
-	rulePtr = &(g_all_rules_table[g_num_rules_have_been_read]);
+	rulePtr = &(reader->rules[reader->num_rules_read]);
 
 	if (rulePtr == NULL){ //Sanity check
 		printk(KERN_ERR "add_str_rule_to_buffer - NULL pointer\n");
@@ -574,7 +613,7 @@ static ssize_t rfw_dev_read(struct file *filp, char *buffer, size_t len, loff_t
 		return -EFAULT; //Return a bad address message
 	}
 	
-	++g_num_rules_have_been_read;
+	++reader->num_rules_read;
 	return strlen(str);
 	
 }
@@ -582,12 +621,29 @@ static ssize_t rfw_dev_read(struct file *filp, char *buffer, size_t len, loff_t
 /** 
  * 	The device open function (called each time the device is opened):
  * 	
- *	Increments g_usage_counter (although ".owner" is defined so it's not mandatory)
+ *	1. If opened for reading - copies the rules-table to the file's
+ *	   private_data (see rules_reader_t)
+ *	2. Increments g_usage_counter (although ".owner" is defined so it's not mandatory)
  * 
  *	@inodep - pointer to an inode object)
  *  @fp - pointer to a file object
+ *
+ *	Returns 0 on success, negative number if failed.
  */
 static int rfw_dev_open(struct inode *inodep, struct file *fp){
+
+	rules_reader_t* reader = NULL;
+
+	if (fp->f_mode & FMODE_READ) {
+		if ((reader = kmalloc(sizeof(rules_reader_t), GFP_KERNEL)) == NULL) {
+			printk(KERN_ERR "Failed allocating space for rules-device's state.\n");
+			return -ENOMEM;
+		}
+		reader->generation = g_rules_generation - 1; //So it would be copied
+		copy_rules_table(reader);
+	}
+	fp->private_data = reader;
+
 	g_usage_counter++;
 	return 0;
 }
@@ -595,13 +651,14 @@ static int rfw_dev_open(struct inode *inodep, struct file *fp){
 /** 
  * 	The device release function - called whenever the device is 
  *	closed/released by the userspace program.
- * 		1. Decrements g_usage_counter
+ * 		1. Decrements g_usage_counter, frees the file's rules_reader_t
  *		2. If g_write_to_buff - WRITES RULES by that buffer, continuing 
  * 			from last rule.
  * 			USER HAS TO CLEAR RULES BEFORE WRITING NEW ONES IF HE WANTS 
  * 			A NEW LIST OF RULES!
  * 			RULES WOULD BE APPENDED (AT THE LAST!)
- *  	3. If wrote rules - updates g_num_rules_have_been_read to 0.
+ *  	3. If wrote rules - updates g_rules_generation (readers that
+ * 			already opened the device keep reading their own copy).
  * 			 
  *  @inodep - pointer to an inode object
  *  @fp - pointer to a file object
@@ -621,14 +678,20 @@ static int rfw_dev_release(struct inode *inodep, struct file *fp){
 	if (g_usage_counter != 0){
 		g_usage_counter--;
 	}
+	kfree(fp->private_data);
+	fp->private_data = NULL;
 	 
 	// Check if there's anything to write:
 	if ( (g_write_to_buff != NULL) && (g_write_buff_len != 0) ) 
 	{	
+		mutex_lock(&g_rules_lock);
+		++g_rules_generation;
+
 		//Case user wanted to clean rule-table:
 		if ((g_write_buff_len == 1) && g_write_to_buff[0]==CLEAR_RULES){
 			g_num_of_valid_rules = 0;
-			clean_g_write_buff(true);
+			mutex_unlock(&g_rules_lock);
+			clean_g_write_buff();
 			printk(KERN_INFO "fw_rules: All rules were cleaned. Device successfully closed\n");
 			return 0;
 		} 	
@@ -652,11 +715,11 @@ static int rfw_dev_release(struct inode *inodep, struct file *fp){
 			g_write_buff_len = 0; 
 			g_bytes_written_so_far = 0;			
 		} else {
-			clean_g_write_buff(true);
+			clean_g_write_buff();
 		}
 		
 		kfree(ptr_buff_copy);
-		g_num_rules_have_been_read = 0;	
+		mutex_unlock(&g_rules_lock);
 		
 	}
 	
@@ -738,8 +801,6 @@ static bool is_relevant_ack(ack_t rule_ack, ack_t packet_ack){
  * 			 *packet_ack and *packet_direction were initiated
  * 			 (using init_log_row).
  * 		  2. function should be called AFTER making sure packet isn't XMAS
- * 		  3. If packet is the first SYN packet of a TCP connection,
- * 			 and it's a valid connection - adds a new row to connection table.
  **/
 static enum action_t is_relevant_rule(const rule_t* rule,
 		log_row_t* ptr_pckt_lg_info, ack_t* packet_ack,
@@ -775,12 +836,6 @@ static enum action_t is_relevant_rule(const rule_t* rule,
 					(ptr_pckt_lg_info->protocol == PROT_UDP) )
 				{		
 					ptr_pckt_lg_info->action = rule->action;
-					if ( (ptr_pckt_lg_info->protocol == PROT_TCP) && 
-						 (rule->action == NF_ACCEPT) &&
-						 (rule != &g_buildin_rule) ) //since no need to check loopbacks
-					{
-						add_first_SYN_connection(ptr_pckt_lg_info, skb);
-					}
 					return (enum action_t)rule->action;		
 				} 
 			}
@@ -833,6 +888,7 @@ static int get_relevant_rule_num_from_table(log_row_t* ptr_pckt_lg_info,
 		{ 
 			//Rule is relevant, ptr_pckt_lg_info->action was updated in is_relevant_rule()
 			ptr_pckt_lg_info->reason = index;
+			trace_fw_rule_match(ptr_pckt_lg_info);
 			return index;
 		}
 	}
@@ -851,12 +907,12 @@ static int get_relevant_rule_num_from_table(log_row_t* ptr_pckt_lg_info,
  * 			direction_t* packet_direction were initiated!
  **/
 bool is_incoming_Xplico_port(log_row_t* ptr_pckt_lg_info,
-		direction_t packet_direction, struct sk_buff* skb)
+		direction_t packet_direction, const packet_hdrs_t* hdrs)
 {
 	tcp_packet_t tcp_pckt_type;
-	struct tcphdr* tcp_hdr;
+	const struct tcphdr* tcp_hdr;
 	
-	if (ptr_pckt_lg_info == NULL || skb == NULL){
+	if (ptr_pckt_lg_info == NULL || hdrs == NULL){
 		printk(KERN_ERR "Inside is_incoming_port_9876(), got NULL argument.\n");
 		return false;
 	}
@@ -865,7 +921,7 @@ bool is_incoming_Xplico_port(log_row_t* ptr_pckt_lg_info,
 		 packet_direction == DIRECTION_IN &&
 		 ptr_pckt_lg_info->dst_port == 9876)
 	{
-		tcp_hdr = get_tcp_header(skb);
+		tcp_hdr = hdrs->tcp;
 		if (tcp_hdr) { 
 			tcp_pckt_type = get_tcp_packet_type(tcp_hdr);
 			if (tcp_pckt_type == TCP_SYN_PACKET){
@@ -878,6 +934,31 @@ bool is_incoming_Xplico_port(log_row_t* ptr_pckt_lg_info,
 }
 
 
+/**
+ *	Copies (into name, of size len) the name of rule #rule_index,
+ *	or an empty string if there's no such rule.
+ **/
+void get_rule_name(int rule_index, char* name, size_t len){
+	if (rule_index >= 0 && rule_index < g_num_of_valid_rules) {
+		strlcpy(name, g_all_rules_table[rule_index].rule_name, len);
+	} else if (len > 0) {
+		name[0] = '\0';
+	}
+}
+
+/**
+ *	Fast path, tried before decide_packet_action() (see
+ *	check_established_tcp_packet()).
+ *	Returns true if packet was accepted as part of a plain established
+ *	TCP connection (then decide_packet_action() shouldn't be called).
+ **/
+bool decide_established_packet_action(const packet_hdrs_t* hdrs, log_row_t* ptr_pckt_lg_info){
+	if (!is_fw_active()) {
+		return false;
+	}
+	return check_established_tcp_packet(hdrs, ptr_pckt_lg_info);
+}
+
 /**
  *	Decides the action that should be taken on packet:
  *	Updates: ptr_pckt_lg_info->action
@@ -886,32 +967,34 @@ bool is_incoming_Xplico_port(log_row_t* ptr_pckt_lg_info,
  *	Note:	function should be called AFTER ptr_pckt_lg_info,
  * 		  	*packet_ack and *packet_direction were initiated
  * 		  	(using init_log_row).
+ *			hdrs are packet's headers (see parse_packet_headers()).
  **/
-void decide_packet_action(struct sk_buff* skb, log_row_t* ptr_pckt_lg_info,
-		ack_t* packet_ack, direction_t* packet_direction)
+void decide_packet_action(struct sk_buff* skb, const packet_hdrs_t* hdrs,
+		log_row_t* ptr_pckt_lg_info, ack_t* packet_ack, direction_t* packet_direction)
 {
 	tcp_packet_t tcp_pckt_type;
-	struct tcphdr* tcp_hdr;
-	connection_row_t* tcp_conn_row = NULL;
+	const struct tcphdr* tcp_hdr;
+	u64 stage_start;
+	bool checked;
 	
 	if (ptr_pckt_lg_info == NULL){
 		printk(KERN_ERR "Inside decide_packet_action(), got NULL argument: ptr_pckt_lg_info\n");
 		return;
 	}
 	
-	if (g_fw_is_active == FW_OFF) {
+	if (!is_fw_active()) {
 		ptr_pckt_lg_info->action = NF_ACCEPT;
 		ptr_pckt_lg_info->reason = REASON_FW_INACTIVE;
 		return;
 	}
 	
-	if (is_XMAS(skb)){
+	if (is_XMAS(hdrs)){
 		ptr_pckt_lg_info->action = NF_DROP;
 		ptr_pckt_lg_info->reason = REASON_XMAS_PACKET;
 		return;
 	} 
 	
-	if (is_incoming_Xplico_port(ptr_pckt_lg_info, *packet_direction, skb)){
+	if (is_xplico_on() && is_incoming_Xplico_port(ptr_pckt_lg_info, *packet_direction, hdrs)){
 		ptr_pckt_lg_info->action = NF_DROP;
 		ptr_pckt_lg_info->reason = REASON_XPLICO_PACKET;
 		return;
@@ -922,9 +1005,9 @@ void decide_packet_action(struct sk_buff* skb, log_row_t* ptr_pckt_lg_info,
 		ptr_pckt_lg_info->reason = REASON_LOOPBACK_PACKET;
 		return;
 	}
-	//If gets here, g_fw_is_active == FW_ON & packet isn't XMAS & packet isn't a loopback-packet
+	//If gets here, firewall is active & packet isn't XMAS & packet isn't a loopback-packet
 	
-	tcp_hdr = get_tcp_header(skb); //pointer to tcp header
+	tcp_hdr = hdrs->tcp; //pointer to tcp header
 	
 	//Checks and takes care of TCP-packet (that is NOT a SYN packet or
 	//that is a SYN packet with source port==PORT_FTP_DATA):
@@ -937,7 +1020,10 @@ void decide_packet_action(struct sk_buff* skb, log_row_t* ptr_pckt_lg_info,
 				((tcp_pckt_type == TCP_SYN_PACKET) &&
 				(ptr_pckt_lg_info->src_port == PORT_FTP_DATA)) )
 		 {
-			if(!check_tcp_packet(ptr_pckt_lg_info, tcp_pckt_type)){
+			stage_start = hook_latency_start();
+			checked = check_tcp_packet(ptr_pckt_lg_info, tcp_pckt_type);
+			hook_latency_end(LAT_STAGE_CHECK_TCP, stage_start);
+			if(!checked){
 				//An error happened, default is to allow packet, without faking:
 				printk(KERN_ERR "Error: internal error while checking TCP packet, allow it to pass.\n");
 				ptr_pckt_lg_info->action = NF_ACCEPT;
@@ -945,6 +1031,24 @@ void decide_packet_action(struct sk_buff* skb, log_row_t* ptr_pckt_lg_info,
 			}
 			return;
 	 	}
+	} else if (ptr_pckt_lg_info->protocol == PROT_TCP) {
+		//A TCP packet without a TCP header (see parse_packet_headers()):
+		if (!(hdrs->ip->frag_off & htons(IP_OFFSET))) {
+			//Not a fragment of a bigger packet, so its TCP header is truncated:
+			ptr_pckt_lg_info->action = NF_DROP;
+			ptr_pckt_lg_info->reason = REASON_ILLEGAL_VALUE;
+			return;
+		}
+		//A non-first fragment (the hook runs before defragmentation) - it
+		//isn't a SYN, so it only gets the rules' verdict, and never admits
+		//a connection:
+		if ( (get_relevant_rule_num_from_table(ptr_pckt_lg_info,
+							packet_ack, packet_direction, skb)) <  0 )
+		{
+			ptr_pckt_lg_info->action = NF_ACCEPT;
+			ptr_pckt_lg_info->reason = REASON_NO_MATCHING_RULE;
+		}
+		return;
 	}
 	
 	//Gets here if packet is not a loopback packet and is:
@@ -958,14 +1062,16 @@ void decide_packet_action(struct sk_buff* skb, log_row_t* ptr_pckt_lg_info,
 		ptr_pckt_lg_info->action = NF_ACCEPT;
 		ptr_pckt_lg_info->reason = REASON_NO_MATCHING_RULE;
 		
-		if (ptr_pckt_lg_info->protocol == PROT_TCP){ 
-			//Its a SYN packet & no rule was found - since we accept it,
-			//we add it to the connections table:
-			tcp_conn_row = add_first_SYN_connection(ptr_pckt_lg_info, skb);
-		}
-			
 	} //Otherwise, ptr_pckt_lg_info->action & reason were updated during get_relevant_rule_num_from_table()
 
+	if ( (ptr_pckt_lg_info->protocol == PROT_TCP) &&
+		 (ptr_pckt_lg_info->action == NF_ACCEPT) )
+	{
+		//Its a (first) SYN packet that we accept - admit its connection
+		//(might still drop it, if the half-open table is full):
+		admit_first_SYN_connection(ptr_pckt_lg_info, skb);
+	}
+
 }
 
 /**
@@ -1000,18 +1106,16 @@ bool is_loopback(log_row_t* ptr_pckt_lg_info,
  * 	NF_INET_LOCAL_OUT) should be "faked",
  *	and fakes it using handle_outer_tcp_packet().
  * 
- *	Note:
+ *	Note: hdrs are packet's headers (see parse_packet_headers()).
  **/
-void fake_outer_packet_if_needed(struct sk_buff* skb)
+void fake_outer_packet_if_needed(struct sk_buff* skb, const packet_hdrs_t* hdrs)
 {
-	struct tcphdr* tcp_hdr = NULL;
-	
-	if (g_fw_is_active == FW_OFF || skb == NULL) {
+	if (!is_fw_active() || skb == NULL || hdrs == NULL) {
 		return;
 	}
 	
-	if( (tcp_hdr = get_tcp_header(skb)) != NULL ){ //It is a TCP packet:
-		handle_outer_tcp_packet(skb, tcp_hdr);
+	if (hdrs->tcp != NULL) { //It is a TCP packet:
+		handle_outer_tcp_packet(skb, hdrs);
 	}
 }
 
@@ -1022,6 +1126,14 @@ void fake_outer_packet_if_needed(struct sk_buff* skb)
 static void destroyRulesDevice(struct class* fw_class, enum state_to_fold stateToFold){
 	switch (stateToFold){
 		case(ALL_DES):
+			destroy_features(rules_device);
+		case(FIFTH_FILE_DES):
+			destroy_verdict_stats(rules_device);
+		case(FOURTH_FILE_DES):
+			destroy_hook_latency(rules_device);
+		case(THIRD_FILE_DES):
+			destroy_zones(rules_device);
+		case(SECOND_FILE_DES):
 			device_remove_file(rules_device, (const struct device_attribute *)&dev_attr_rules_size.attr);
 		case(FIRST_FILE_DES):
 			device_remove_file(rules_device, (const struct device_attribute *)&dev_attr_active.attr);
@@ -1044,11 +1156,10 @@ int init_rules_device(struct class* fw_class){
 	g_num_of_valid_rules = 0;
 	g_fw_is_active = FW_OFF;
 	g_usage_counter = 0;
-	g_num_rules_have_been_read = 0;
 	g_write_to_buff = NULL;
 	g_write_buff_len = 0;
 	g_bytes_written_so_far = 0;
-	g_num_rules_have_been_read = 0;
+	g_rules_generation = 0;
 	
 	//Create char device
 	rules_dev_major_number = register_chrdev(0, DEVICE_NAME_RULES, &fops);
@@ -1081,6 +1192,34 @@ int init_rules_device(struct class* fw_class){
 		destroyRulesDevice(fw_class, FIRST_FILE_DES);
 		return -1;
 	}
+
+	//Resolve interfaces' zones (and create "zones"-sysfs file):
+	if (init_zones(rules_device) < 0)
+	{
+		destroyRulesDevice(fw_class, SECOND_FILE_DES);
+		return -1;
+	}
+
+	//Allocate hook latency histograms (and create "hook_latency"-sysfs file):
+	if (init_hook_latency(rules_device) < 0)
+	{
+		destroyRulesDevice(fw_class, THIRD_FILE_DES);
+		return -1;
+	}
+
+	//Allocate verdict counters (and create "verdicts"-sysfs file):
+	if (init_verdict_stats(rules_device) < 0)
+	{
+		destroyRulesDevice(fw_class, FOURTH_FILE_DES);
+		return -1;
+	}
+
+	//Create "features"-sysfs file:
+	if (init_features(rules_device) < 0)
+	{
+		destroyRulesDevice(fw_class, FIFTH_FILE_DES);
+		return -1;
+	}
 	
 	printk(KERN_INFO "fw_rules: device successfully initiated.\n");
 
@@ -1091,7 +1230,7 @@ int init_rules_device(struct class* fw_class){
  *	Destroys rule-device
  **/
 void destroy_rules_device(struct class* fw_class){
-	clean_g_write_buff(true);
+	clean_g_write_buff();
 	destroyRulesDevice(fw_class, ALL_DES);
 	printk(KERN_INFO "fw_rules: device destroyed.\n");
 }
@@ -1,6 +1,12 @@
 #ifndef RULES_UTILS_H
 #define RULES_UTILS_H
 #include "conn_tab_utils.h"
+#include "zone_utils.h"
+#include "hook_latency_utils.h"
+#include "verdict_stats_utils.h"
+#include "feature_utils.h"
+#include <linux/mutex.h>
+#include <linux/netdevice.h>	//For synchronize_net()
 
 #define MAX_NUM_OF_RULES (50)
 
@@ -47,9 +53,23 @@ enum state_to_fold {
 	UNREG_DES,
 	DEVICE_DES,
 	FIRST_FILE_DES,
+	SECOND_FILE_DES,
+	THIRD_FILE_DES,
+	FOURTH_FILE_DES,
+	FIFTH_FILE_DES,
 	ALL_DES
 };
 
+//State of an opened rules-device (saved in its file's private_data):
+//a copy of the rules-table, taken when the device was opened for reading,
+//so concurrent readers don't affect each other.
+typedef struct {
+	rule_t			rules[MAX_NUM_OF_RULES];
+	unsigned char	num_of_rules;
+	unsigned char	num_rules_read;
+	unsigned long	generation;		// Of the rules-table, when copied
+} rules_reader_t;
+
 //Firewalls' build-in rule: to allow connection between localhost to itself:
 static const rule_t g_buildin_rule = 
 {
@@ -69,10 +89,12 @@ static const rule_t g_buildin_rule =
 };
 
 //Functions that will be used outside rules_utils: 
-void decide_packet_action(struct sk_buff* skb, log_row_t* ptr_pckt_lg_info, ack_t* packet_ack, direction_t* packet_direction);
-void fake_outer_packet_if_needed(struct sk_buff* skb);
+bool decide_established_packet_action(const packet_hdrs_t* hdrs, log_row_t* ptr_pckt_lg_info);
+void decide_packet_action(struct sk_buff* skb, const packet_hdrs_t* hdrs, log_row_t* ptr_pckt_lg_info, ack_t* packet_ack, direction_t* packet_direction);
+void fake_outer_packet_if_needed(struct sk_buff* skb, const packet_hdrs_t* hdrs);
 int init_rules_device(struct class* fw_class);
 void destroy_rules_device(struct class* fw_class);
+void get_rule_name(int rule_index, char* name, size_t len);
 
 bool is_loopback(log_row_t* ptr_pckt_lg_info, ack_t* packet_ack, direction_t* packet_direction);
 #endif /* RULES_UTILS_H */
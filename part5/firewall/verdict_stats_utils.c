@@ -0,0 +1,131 @@
+#include "verdict_stats_utils.h"
+
+static verdict_stats_cpu_t __percpu* g_verdict_stats = NULL;
+
+//Hooks' numbers, by their index in verdict_stats_cpu_t.counters:
+static const unsigned int g_verdict_hooks[VERDICT_NUM_HOOKS] = {
+	NF_INET_PRE_ROUTING, NF_INET_LOCAL_OUT
+};
+
+/**
+ *	Helper function: returns the slot of a reason (see verdict_stats_utils.h)
+ **/
+static inline unsigned int get_verdict_slot(int reason){
+	if (reason >= 0 && reason < VERDICT_NUM_RULES) {
+		return reason;
+	}
+	if (reason < 0 && reason > -VERDICT_NUM_REASONS) {
+		return VERDICT_NUM_RULES - reason;
+	}
+	return VERDICT_NUM_RULES;	//NO_REASON
+}
+
+/**
+ *	Helper function: returns the reason of a slot (see get_verdict_slot())
+ **/
+static inline int get_slot_reason(unsigned int slot){
+	if (slot < VERDICT_NUM_RULES) {
+		return slot;
+	}
+	if (slot == VERDICT_NUM_RULES) {
+		return NO_REASON;
+	}
+	return VERDICT_NUM_RULES - (int)slot;
+}
+
+/**
+ *	Counts a packet (of len bytes) in current cpu's counters.
+ *
+ *	@hooknum - NF_INET_PRE_ROUTING / NF_INET_LOCAL_OUT
+ *	@verdict - NF_ACCEPT / NF_DROP, as returned by the hook
+ *	@reason - rule index, or values from reason_t (NO_REASON if none)
+ **/
+void record_verdict(unsigned int hooknum, unsigned int verdict, int reason, unsigned int len){
+	unsigned int hook = (hooknum == NF_INET_LOCAL_OUT) ? 1 : 0;
+	unsigned int slot = get_verdict_slot(reason);
+
+	if (g_verdict_stats == NULL || verdict >= VERDICT_NUM_ACTIONS) {
+		return;
+	}
+
+	this_cpu_inc(g_verdict_stats->counters[hook][verdict][slot].packets);
+	this_cpu_add(g_verdict_stats->counters[hook][verdict][slot].bytes, len);
+}
+
+ /**
+ *	This function will be called when user tries to read from "verdicts"
+ *
+ *  NOTE: writes to "buf" a line for every counter that counted packets
+ *		  (summed over all cpus), in (string) format:
+ *			<hooknum> <action> <reason> <packets> <bytes>
+ **/
+ssize_t read_verdicts(struct device* dev, struct device_attribute* attr, char* buf){
+		verdict_counter_t sum;
+		const verdict_counter_t* counter;
+		ssize_t ret = 0;
+		unsigned int hook, action, slot, cpu;
+
+		for (hook = 0; hook < VERDICT_NUM_HOOKS; ++hook) {
+			for (action = 0; action < VERDICT_NUM_ACTIONS; ++action) {
+				for (slot = 0; slot < VERDICT_NUM_SLOTS; ++slot) {
+					sum.packets = 0;
+					sum.bytes = 0;
+					for_each_possible_cpu(cpu) {
+						counter = &per_cpu_ptr(g_verdict_stats, cpu)->counters[hook][action][slot];
+						sum.packets += counter->packets;
+						sum.bytes += counter->bytes;
+					}
+					if (sum.packets == 0) {
+						continue;
+					}
+					ret += scnprintf(buf + ret, PAGE_SIZE - ret, "%u %u %d %llu %llu\n",
+							g_verdict_hooks[hook], action, get_slot_reason(slot),
+							(unsigned long long)sum.packets, (unsigned long long)sum.bytes);
+				}
+			}
+		}
+
+		return ret;
+}
+
+/**
+ * 	Declaring a variable of type struct device_attribute, its name would be "dev_attr_verdicts"
+ * 		.attr.mode = S_IRUSR | S_IROTH, giving the owner and other users read permissions
+ * 		.show = read_verdicts
+ * 		.store = NULL (no writing)
+ **/
+static DEVICE_ATTR(verdicts, S_IRUSR | S_IROTH, read_verdicts, NULL);
+
+/**
+ *	Allocates the counters of all cpus and creates "verdicts" sysfs
+ *	attribute (in rules_dev).
+ *	Returns: 0 on success, -1 if failed.
+ **/
+int init_verdict_stats(struct device* rules_dev){
+
+	//alloc_percpu() zeroes the counters:
+	if ((g_verdict_stats = alloc_percpu(verdict_stats_cpu_t)) == NULL) {
+		printk(KERN_ERR "Error: failed allocating verdict counters.\n");
+		return -1;
+	}
+
+	if (device_create_file(rules_dev, (const struct device_attribute *)&dev_attr_verdicts.attr))
+	{
+		printk(KERN_ERR "Error: failed creating verdicts-sysfs-file inside rules-char-device.\n");
+		free_percpu(g_verdict_stats);
+		g_verdict_stats = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ *	Removes "verdicts" sysfs attribute and frees the counters.
+ *	NOTE: hooks should be unregistered before.
+ **/
+void destroy_verdict_stats(struct device* rules_dev){
+	device_remove_file(rules_dev, (const struct device_attribute *)&dev_attr_verdicts.attr);
+	free_percpu(g_verdict_stats);
+	g_verdict_stats = NULL;
+}
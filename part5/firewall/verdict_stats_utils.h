@@ -0,0 +1,37 @@
+#ifndef _VERDICT_STATS_UTILS_H_
+#define _VERDICT_STATS_UTILS_H_
+
+#include "fw.h"
+#include <linux/percpu.h>
+
+/**
+ *	Verdict counters - packets & bytes of every verdict the hooks returned,
+ *	by hook, action and reason (rule index or reason_t). Counters are
+ *	per-cpu (so counting takes no locks and loses no counts) and are
+ *	summed when "verdicts" sysfs attribute (of rules-device) is read.
+ *
+ *	Reason slots: a rule index is its own slot (0...VERDICT_NUM_RULES-1),
+ *	a reason_t value r is slot VERDICT_NUM_RULES-r, and NO_REASON (or an
+ *	unknown reason) is slot VERDICT_NUM_RULES.
+ **/
+#define VERDICT_NUM_RULES (50)					// As MAX_NUM_OF_RULES (in rules_utils.h)
+#define VERDICT_NUM_REASONS (14)				// NO_REASON, and reason_t values -1...-13
+#define VERDICT_NUM_SLOTS (VERDICT_NUM_RULES + VERDICT_NUM_REASONS)
+#define VERDICT_NUM_ACTIONS (2)					// NF_DROP, NF_ACCEPT
+#define VERDICT_NUM_HOOKS (2)					// NF_INET_PRE_ROUTING, NF_INET_LOCAL_OUT
+
+typedef struct {
+	u64	packets;
+	u64	bytes;
+} verdict_counter_t;
+
+//Counters of packets handled by a single cpu:
+typedef struct {
+	verdict_counter_t	counters[VERDICT_NUM_HOOKS][VERDICT_NUM_ACTIONS][VERDICT_NUM_SLOTS];
+} verdict_stats_cpu_t;
+
+void record_verdict(unsigned int hooknum, unsigned int verdict, int reason, unsigned int len);
+int init_verdict_stats(struct device* rules_dev);
+void destroy_verdict_stats(struct device* rules_dev);
+
+#endif /* _VERDICT_STATS_UTILS_H_ */
@@ -0,0 +1,244 @@
+#include "zone_utils.h"
+
+//Zones assigned to interfaces' names (see write_zones()):
+static zone_iface_t g_zone_ifaces[MAX_NUM_OF_ZONE_IFACES] = {
+	{ .name = IN_NET_DEVICE_NAME, .zone = ZONE_INSIDE, .ifindex = 0 },
+	{ .name = OUT_NET_DEVICE_NAME, .zone = ZONE_OUTSIDE, .ifindex = 0 },
+};
+static unsigned int g_num_of_zone_ifaces = 2;
+
+//Zone of every interface index (below ZONE_TAB_SIZE), read locklessly by packets:
+static u8 g_zone_tab[ZONE_TAB_SIZE];
+
+/**
+ *	Returns the zone of a network interface (ZONE_NONE if dev is NULL)
+ **/
+zone_t get_iface_zone(const struct net_device* dev){
+	unsigned int i;
+	int ifindex;
+
+	if (dev == NULL) {
+		return ZONE_NONE;
+	}
+	ifindex = dev->ifindex;
+	if (ifindex > 0 && ifindex < ZONE_TAB_SIZE) {
+		return (zone_t)ACCESS_ONCE(g_zone_tab[ifindex]);
+	}
+
+	//Rare - a very big index:
+	for (i = 0; i < ACCESS_ONCE(g_num_of_zone_ifaces); ++i) {
+		if (ACCESS_ONCE(g_zone_ifaces[i].ifindex) == ifindex) {
+			return g_zone_ifaces[i].zone;
+		}
+	}
+	return ZONE_NONE;
+}
+
+/**
+ *	Resolves all zones' interfaces to their current indexes, and updates
+ *	g_zone_tab (only entries that changed, so packets never see a zone
+ *	missing).
+ *	NOTE: caller should hold rtnl_lock()!
+ **/
+static void update_zone_tab(void){
+	u8 new_tab[ZONE_TAB_SIZE];
+	struct net_device* dev;
+	unsigned int i;
+	int ifindex;
+
+	memset(new_tab, ZONE_NONE, sizeof(new_tab));
+
+	for (i = 0; i < g_num_of_zone_ifaces; ++i) {
+		dev = __dev_get_by_name(&init_net, g_zone_ifaces[i].name);
+		ifindex = (dev != NULL) ? dev->ifindex : 0;
+		ACCESS_ONCE(g_zone_ifaces[i].ifindex) = ifindex;
+		if (ifindex > 0 && ifindex < ZONE_TAB_SIZE) {
+			new_tab[ifindex] = g_zone_ifaces[i].zone;
+		}
+	}
+
+	for (i = 0; i < ZONE_TAB_SIZE; ++i) {
+		if (g_zone_tab[i] != new_tab[i]) {
+			ACCESS_ONCE(g_zone_tab[i]) = new_tab[i];
+		}
+	}
+}
+
+/**
+ *	Called (holding rtnl_lock()) on network interfaces' events:
+ *	indexes of zones' interfaces are resolved again when an interface
+ *	registers, unregisters or changes its name.
+ **/
+static int zones_netdev_event(struct notifier_block* nb, unsigned long event, void* ptr){
+	struct net_device* dev = netdev_notifier_info_to_dev(ptr);
+
+	switch (event) {
+		case (NETDEV_REGISTER):
+		case (NETDEV_UNREGISTER):
+		case (NETDEV_CHANGENAME):
+			if (!net_eq(dev_net(dev), &init_net)) {
+				return NOTIFY_DONE;
+			}
+			update_zone_tab();
+			return NOTIFY_OK;
+		default:
+			return NOTIFY_DONE;
+	}
+}
+
+static struct notifier_block g_zones_notifier = {
+	.notifier_call = zones_netdev_event,
+};
+
+/**
+ *	Helper function: returns zone's string representation
+ **/
+static const char* tran_zone_to_str(zone_t zone){
+	switch (zone) {
+		case (ZONE_INSIDE):
+			return "inside";
+		case (ZONE_OUTSIDE):
+			return "outside";
+		default:
+			return "none";
+	}
+}
+
+ /**
+ *	This function will be called when user tries to read from "zones"
+ *
+ *  NOTE: writes to "buf" a line for every interface that has a zone, in (string) format:
+ * 		<interface name> <inside/outside> <interface index, 0 if interface doesn't exist>
+ **/
+ssize_t read_zones(struct device* dev, struct device_attribute* attr, char* buf){
+		ssize_t ret = 0;
+		unsigned int i;
+
+		rtnl_lock();
+		for (i = 0; i < g_num_of_zone_ifaces; ++i) {
+			ret += scnprintf(buf + ret, PAGE_SIZE - ret, "%s %s %d\n", g_zone_ifaces[i].name,
+					tran_zone_to_str(g_zone_ifaces[i].zone), g_zone_ifaces[i].ifindex);
+		}
+		rtnl_unlock();
+
+		return ret;
+}
+
+/**
+ *	Helper function: assigns zone to the interface named name
+ *	(ZONE_NONE removes the interface's zone).
+ *	NOTE: caller should hold rtnl_lock()!
+ *
+ *	Returns: true on success, false if there's no room for another interface.
+ **/
+static bool set_iface_zone(const char* name, zone_t zone){
+	unsigned int i;
+
+	for (i = 0; i < g_num_of_zone_ifaces; ++i) {
+		if (strncmp(g_zone_ifaces[i].name, name, IFNAMSIZ) == 0) {
+			break;
+		}
+	}
+
+	if (zone == ZONE_NONE) {
+		if (i < g_num_of_zone_ifaces) {
+			//Last interface takes its place:
+			g_zone_ifaces[i] = g_zone_ifaces[g_num_of_zone_ifaces - 1];
+			--g_num_of_zone_ifaces;
+		}
+	} else {
+		if (i == MAX_NUM_OF_ZONE_IFACES) {
+			return false;
+		}
+		if (i == g_num_of_zone_ifaces) {
+			strlcpy(g_zone_ifaces[i].name, name, IFNAMSIZ);
+			g_zone_ifaces[i].ifindex = 0;
+			++g_num_of_zone_ifaces;
+		}
+		g_zone_ifaces[i].zone = zone;
+	}
+
+	update_zone_tab();
+	return true;
+}
+
+/**
+ *	This function will be called when user tries to write to "zones".
+ *	Assigns a zone to an interface (the interface doesn't have to exist yet),
+ *	buf format:
+ *		<interface name> <inside/outside/none>
+ *
+ *	Returns count on success, negative number if failed.
+ **/
+ssize_t write_zones(struct device* dev, struct device_attribute* attr, const char* buf, size_t count){
+	char name[IFNAMSIZ];
+	char zone_str[MAX_STRLEN_OF_ZONE+1];
+	zone_t zone;
+	bool ret;
+
+	if (sscanf(buf, "%15s %7s", name, zone_str) != 2) {
+		printk(KERN_ERR "Error: zones format is: <interface name> <inside/outside/none>\n");
+		return -EINVAL;
+	}
+
+	if (strcmp(zone_str, "inside") == 0) {
+		zone = ZONE_INSIDE;
+	} else if (strcmp(zone_str, "outside") == 0) {
+		zone = ZONE_OUTSIDE;
+	} else if (strcmp(zone_str, "none") == 0) {
+		zone = ZONE_NONE;
+	} else {
+		printk(KERN_ERR "Error: invalid zone %s (should be inside/outside/none)\n", zone_str);
+		return -EINVAL;
+	}
+
+	rtnl_lock();
+	ret = set_iface_zone(name, zone);
+	rtnl_unlock();
+
+	if (!ret) {
+		printk(KERN_ERR "Error: interfaces can't have more than %d zones\n", MAX_NUM_OF_ZONE_IFACES);
+		return -ENOSPC;
+	}
+	return count;
+}
+
+/**
+ * 	Declaring a variable of type struct device_attribute, its name would be "dev_attr_zones"
+ * 		.attr.mode = S_IRUSR | S_IWUSR | S_IROTH, giving the owner read & write permissions,
+ * 					 and other users read permissions
+ * 		.show = read_zones
+ * 		.store = write_zones
+ **/
+static DEVICE_ATTR(zones, S_IRUSR | S_IWUSR | S_IROTH, read_zones, write_zones);
+
+/**
+ *	Resolves the zones' interfaces, starts following interfaces' events and
+ *	creates "zones" sysfs attribute (in rules_dev).
+ *	Returns: 0 on success, -1 if failed.
+ **/
+int init_zones(struct device* rules_dev){
+
+	//Registering replays NETDEV_REGISTER of existing interfaces (so zones get resolved):
+	if (register_netdevice_notifier(&g_zones_notifier)) {
+		printk(KERN_ERR "Error: failed registering zones' netdevice notifier.\n");
+		return -1;
+	}
+
+	if (device_create_file(rules_dev, (const struct device_attribute *)&dev_attr_zones.attr))
+	{
+		printk(KERN_ERR "Error: failed creating zones-sysfs-file inside rules-char-device.\n");
+		unregister_netdevice_notifier(&g_zones_notifier);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ *	Stops following interfaces' events and removes "zones" sysfs attribute
+ **/
+void destroy_zones(struct device* rules_dev){
+	device_remove_file(rules_dev, (const struct device_attribute *)&dev_attr_zones.attr);
+	unregister_netdevice_notifier(&g_zones_notifier);
+}
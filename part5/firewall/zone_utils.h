@@ -0,0 +1,50 @@
+#ifndef _ZONE_UTILS_H_
+#define _ZONE_UTILS_H_
+
+#include "fw.h"
+#include <linux/netdevice.h>
+#include <linux/notifier.h>
+#include <linux/rtnetlink.h>	//For rtnl_lock()
+#include <linux/version.h>
+
+/**
+ *	Zones - every network interface is either inside (like IN_NET_DEVICE_NAME),
+ *	outside (like OUT_NET_DEVICE_NAME) or in no zone. Packets coming from an
+ *	inside interface (or going to an outside one) are DIRECTION_OUT,
+ *	packets coming from an outside interface (or going to an inside one)
+ *	are DIRECTION_IN, all others are DIRECTION_ANY.
+ *
+ *	Zones are assigned to interfaces by name (through "zones" sysfs
+ *	attribute of rules-device), and resolved to interfaces' indexes when
+ *	assigned and whenever interfaces register, unregister or change their
+ *	name (see zones_netdev_event()), so finding a packet's direction
+ *	takes no string compares.
+ *
+ *	NOTE: zones are only changed while holding rtnl_lock().
+ **/
+#define MAX_NUM_OF_ZONE_IFACES (16)
+#define ZONE_TAB_SIZE (256)			// Interfaces with bigger indexes are looked up in g_zone_ifaces
+#define MAX_STRLEN_OF_ZONE (7)		// maximum length value of("inside","outside","none") = 7
+
+typedef enum {
+	ZONE_NONE		= 0,
+	ZONE_INSIDE		= 1,
+	ZONE_OUTSIDE	= 2
+} zone_t;
+
+typedef struct {
+	char	name[IFNAMSIZ];
+	zone_t	zone;
+	int		ifindex;				// 0 if interface doesn't exist
+} zone_iface_t;
+
+//netdev_notifier_info_to_dev() was added in 3.11, notifiers got the net_device before:
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 11, 0)
+#define netdev_notifier_info_to_dev(ptr) ((struct net_device*)(ptr))
+#endif
+
+zone_t get_iface_zone(const struct net_device* dev);
+int init_zones(struct device* rules_dev);
+void destroy_zones(struct device* rules_dev);
+
+#endif /* _ZONE_UTILS_H_ */
@@ -0,0 +1,212 @@
+#include "log_segment.h"
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+
+/**
+ *	fw_logd - keeps firewall's log on disk, so rows aren't lost when the
+ *	in-kernel log is full or cleared:
+ *
+ *		fw_logd <segments directory>
+ *
+ *	Drains the binary log rings (mapped from PATH_TO_LOG_DEV, see
+ *	log_ring_utils.h in the module), where every logged packet is a record
+ *	of its own, and appends them to log segments (see log_segment.h) - a
+ *	row per logged packet, counting the packets it stands for (more than
+ *	1 when log_sample_rate is set), so a query's counts sum up to its
+ *	packets.
+ *	A segment is written when it's full, when it's LOG_SEGMENT_MAX_SECONDS
+ *	old, and when fw_logd is stopped (SIGINT/SIGTERM).
+ *	Use "main query_log" to search the segments.
+ *
+ *	NOTE: 1. rings should be enabled (log_ring_size module parameter), and
+ *			 records that don't fit in a full ring are lost (fw_logd
+ *			 prints how many). Unless log_ring_wakeup is set, rings are
+ *			 polled every LOGD_POLL_TIMEOUT_MSEC.
+ *		  2. while fw_logd runs, it's the rings' only reader.
+ **/
+
+#define LOGD_POLL_TIMEOUT_MSEC (100)
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void handle_stop_signal(int signum){
+	g_stop = 1;
+}
+
+/**
+ *	Helper function: maps the log rings' area of fd (the log-device),
+ *	fills area_hdr with its header.
+ *
+ *	Returns the area on success, NULL if failed (prints errors, if any, to screen)
+ **/
+static char* map_log_area(int fd, fw_log_area_hdr_t* area_hdr){
+	fw_log_area_hdr_t* ptr_area_hdr;
+	char* area;
+
+	ptr_area_hdr = mmap(NULL, sizeof(fw_log_area_hdr_t), PROT_READ, MAP_SHARED, fd, 0);
+	if (ptr_area_hdr == MAP_FAILED && errno == EBUSY) {
+		printf("Error: log rings are read by another process, only one can read them.\n");
+		return NULL;
+	}
+	if (ptr_area_hdr == MAP_FAILED) {
+		printf("Error occured trying to map log rings (are they disabled?), error number: %d\n", errno);
+		return NULL;
+	}
+	*area_hdr = *ptr_area_hdr;
+	munmap(ptr_area_hdr, sizeof(fw_log_area_hdr_t));
+
+	if (area_hdr->magic != LOG_AREA_MAGIC || area_hdr->version != LOG_AREA_VERSION) {
+		printf("Error: firewall's log rings have an unknown format.\n");
+		return NULL;
+	}
+
+	area = mmap(NULL, area_hdr->area_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (area == MAP_FAILED) {
+		printf("Error occured trying to map log rings, error number: %d\n", errno);
+		return NULL;
+	}
+	return area;
+}
+
+/**
+ *	Helper function: adds rec to seg (as the packets it stands for), writes seg if
+ *	it's full.
+ *
+ *	Returns 0 on success, -1 if failed (prints errors, if any, to screen)
+ **/
+static int add_packet_to_segment(log_segment_t* seg, const fw_log_rec_t* ring_rec,
+		const char* dir_path, time_t* seg_start)
+{
+	fw_log_rec_t rec = *ring_rec;
+
+	rec.count = ring_rec->weight;	// Ring's record count is its log-row's, see log_segment.h
+	if (!add_rec_to_segment(seg, &rec)) {
+		//Segment is full:
+		if (write_log_segment(seg, dir_path) < 0) {
+			return -1;
+		}
+		*seg_start = time(NULL);
+		add_rec_to_segment(seg, &rec);
+	}
+	return 0;
+}
+
+/**
+ *	Drains the log rings into segment files in dir_path, until stopped.
+ *
+ *	Returns 0 if stopped by a signal, -1 if failed (prints errors, if any, to screen)
+ **/
+static int run_logd(const char* dir_path){
+	static log_segment_t seg;
+	fw_log_area_hdr_t area_hdr;
+	volatile fw_log_ring_hdr_t* ring;
+	const fw_log_rec_t* recs;
+	uint32_t* num_of_dropped;
+	struct sigaction sa;
+	struct pollfd pfd;
+	char* area;
+	uint32_t i, head, tail, dropped;
+	time_t seg_start = time(NULL);
+	int ret = 0;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_stop_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	//Opened for writing too, since fw_logd updates rings' tails:
+	int fd = open(PATH_TO_LOG_DEV, O_RDWR);
+	if (fd < 0) {
+		printf("Error occured trying to open the log-device, error number: %d\n", errno);
+		return -1;
+	}
+	if ((area = map_log_area(fd, &area_hdr)) == NULL) {
+		close(fd);
+		return -1;
+	}
+	//Drops already reported (per ring), so only new ones are printed:
+	if ((num_of_dropped = calloc(area_hdr.num_of_rings, sizeof(uint32_t))) == NULL) {
+		printf("Error: failed allocating memory for log rings.\n");
+		munmap(area, area_hdr.area_len);
+		close(fd);
+		return -1;
+	}
+
+	init_log_segment(&seg);
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	printf("Writing firewall's log to %s\n", dir_path);
+
+	while (!g_stop && ret == 0) {
+		if (seg.hdr.num_of_rows > 0 && time(NULL) - seg_start >= LOG_SEGMENT_MAX_SECONDS) {
+			if (write_log_segment(&seg, dir_path) < 0) {
+				ret = -1;
+				break;
+			}
+		}
+		if (seg.hdr.num_of_rows == 0) {
+			seg_start = time(NULL);
+		}
+
+		//Returns at once if any ring has records:
+		if (poll(&pfd, 1, LOGD_POLL_TIMEOUT_MSEC) < 0 && errno != EINTR) {
+			printf("Error occured trying to poll the log-device, error number: %d\n", errno);
+			ret = -1;
+			break;
+		}
+
+		for (i = 0; i < area_hdr.num_of_rings && ret == 0; ++i) {
+			ring = (volatile fw_log_ring_hdr_t*)(area + area_hdr.ring_offset + i*area_hdr.ring_stride);
+			recs = (const fw_log_rec_t*)((char*)ring + area_hdr.recs_offset);
+
+			head = ring->head;
+			__sync_synchronize(); //Records are read only after head
+			tail = ring->tail;
+
+			dropped = ring->dropped;
+			if (dropped != num_of_dropped[i]) {
+				printf("Note: %u records of cpu %u were lost since its ring was full.\n",
+						dropped - num_of_dropped[i], i);
+				num_of_dropped[i] = dropped;
+			}
+
+			for (; tail != head; ++tail) {
+				if (add_packet_to_segment(&seg, &recs[tail & (area_hdr.ring_size - 1)],
+						dir_path, &seg_start) < 0)
+				{
+					ret = -1;
+					break;
+				}
+			}
+
+			__sync_synchronize(); //Records are read before they're released
+			ring->tail = tail;
+		}
+	}
+
+	if (write_log_segment(&seg, dir_path) < 0) {
+		ret = -1;
+	}
+	free(num_of_dropped);
+	munmap(area, area_hdr.area_len);
+	close(fd);
+	return ret;
+}
+
+int main(int argc, char* argv[]){
+
+	struct stat st;
+
+	if (argc != 2) {
+		printf("Wrong usage, format is:\n\t%s <segments directory>\n", argv[0]);
+		return -1;
+	}
+
+	if (stat(argv[1], &st) < 0 || !S_ISDIR(st.st_mode)) {
+		printf("%s isn't a directory.\n", argv[1]);
+		return -1;
+	}
+
+	return run_logd(argv[1]);
+}
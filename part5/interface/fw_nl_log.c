@@ -0,0 +1,143 @@
+#include "user_fw.h"
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <signal.h>
+
+/**
+ *	fw_nl_log - prints firewall's log events as they happen, one JSON
+ *	object per line (to stdout):
+ *
+ *		fw_nl_log
+ *
+ *	Listens to netlink group FW_LOG_NL_GROUP (of NETLINK_FW_LOG), so
+ *	nothing is read from PATH_TO_LOG_DEV. The module only sends events when
+ *	its "log_nl_mode" parameter isn't 0, e.g.:
+ *		echo 2 > /sys/module/firewall/parameters/log_nl_mode
+ *
+ *	Datagrams lost since the receive buffer was full are counted and
+ *	reported (to stderr) when fw_nl_log is stopped (SIGINT/SIGTERM).
+ **/
+
+#define NL_RCVBUF_SIZE (8 << 20)
+#define NL_READ_BUF_SIZE (64 << 10)				// Big enough for a whole datagram of events
+#define NL_STDOUT_BUF_SIZE (1 << 20)
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void handle_stop_signal(int signum){
+	g_stop = 1;
+}
+
+/**
+ *	Helper function: prints an event as a JSON object (in one line)
+ **/
+static void print_nl_event(const fw_log_nl_event_t* event){
+
+	struct in_addr src, dst;
+	char src_str[INET_ADDRSTRLEN], dst_str[INET_ADDRSTRLEN];
+	const fw_log_rec_t* rec = &event->rec;
+
+	src.s_addr = htonl(rec->src_ip);
+	dst.s_addr = htonl(rec->dst_ip);
+	inet_ntop(AF_INET, &src, src_str, sizeof(src_str));
+	inet_ntop(AF_INET, &dst, dst_str, sizeof(dst_str));
+
+	printf("{\"timestamp\":%lu,\"protocol\":%hhu,\"action\":\"%s\",\"hooknum\":%hhu,"
+			"\"src_ip\":\"%s\",\"dst_ip\":\"%s\",\"src_port\":%hu,\"dst_port\":%hu,"
+			"\"reason\":%d,\"rule\":\"%.19s\",\"count\":%u}\n",
+			(unsigned long)rec->timestamp,
+			rec->protocol,
+			(rec->action == NF_ACCEPT) ? "accept" : "drop",
+			rec->hooknum,
+			src_str,
+			dst_str,
+			rec->src_port,
+			rec->dst_port,
+			rec->reason,
+			event->rule_name,
+			rec->count);
+}
+
+/**
+ *	Prints events until stopped.
+ *
+ *	Returns 0 if stopped by a signal, -1 if failed (prints errors, if any, to screen)
+ **/
+static int run_nl_log(void){
+
+	static char buf[NL_READ_BUF_SIZE];
+	struct sockaddr_nl addr;
+	struct sigaction sa;
+	struct nlmsghdr* nlh;
+	ssize_t len;
+	int rcvbuf = NL_RCVBUF_SIZE;
+	unsigned long num_of_events = 0, num_of_overruns = 0;
+	int ret = 0;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_stop_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	int fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_FW_LOG);
+	if (fd < 0) {
+		fprintf(stderr, "Error occured trying to open a netlink socket (is firewall loaded?), error number: %d\n", errno);
+		return -1;
+	}
+
+	//Bursts are absorbed by the receive buffer (bigger than default, if allowed):
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1 << (FW_LOG_NL_GROUP - 1);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "Error occured trying to join firewall's netlink group, error number: %d\n", errno);
+		close(fd);
+		return -1;
+	}
+
+	//Lines are flushed once per datagram, not once per event:
+	setvbuf(stdout, NULL, _IOFBF, NL_STDOUT_BUF_SIZE);
+
+	while (!g_stop) {
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == ENOBUFS) {
+				++num_of_overruns; //Some datagrams were lost
+				continue;
+			}
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error occured trying to read from netlink socket, error number: %d\n", errno);
+			ret = -1;
+			break;
+		}
+
+		for (nlh = (struct nlmsghdr*)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_type == FW_LOG_NL_MSG_EVENT &&
+				nlh->nlmsg_len >= NLMSG_LENGTH(sizeof(fw_log_nl_event_t)))
+			{
+				print_nl_event((const fw_log_nl_event_t*)NLMSG_DATA(nlh));
+				++num_of_events;
+			}
+		}
+		fflush(stdout);
+	}
+
+	fflush(stdout);
+	fprintf(stderr, "%lu events, %lu overruns (datagrams lost)\n", num_of_events, num_of_overruns);
+	close(fd);
+	return ret;
+}
+
+int main(int argc, char* argv[]){
+
+	if (argc != 1) {
+		printf("Wrong usage, format is:\n\t%s\n", argv[0]);
+		return -1;
+	}
+
+	return run_nl_log();
+}
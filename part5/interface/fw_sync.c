@@ -0,0 +1,554 @@
+#define _DEFAULT_SOURCE	// For usleep(), clock_gettime()
+#include "user_fw.h"
+#include "hmac_utils.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <time.h>
+
+/**
+ *	fw_sync - replicates the connection-table of an active firewall to a
+ *	standby firewall, so established connections survive a failover:
+ *
+ *		fw_sync master <local ip> <local port> <peer ip> <peer port> <key file> [bytes per second]
+ *			Reads changes from PATH_TO_CONN_SYNC_DEV and sends them (over UDP)
+ *			to the standby. Every RESYNC_INTERVAL_SECONDS (or when changes
+ *			were lost) the whole table is sent again, so rows the standby
+ *			missed are fixed long before they timeout there.
+ *		fw_sync standby <local ip> <local port> <peer ip> <peer port> <key file>
+ *			Receives those changes (from the master at peer ip:peer port only)
+ *			and writes them to its PATH_TO_CONN_SYNC_DEV.
+ *
+ *	Datagrams are authenticated with HMAC-SHA256, by a key both firewalls
+ *	share (key file holds its raw bytes, see read_hmac_key()). The standby
+ *	drops datagrams that aren't authentic, and replayed ones: a datagram
+ *	should be newer (by seq) than the last one of its master's run
+ *	(session), a new session should be newer (by time) than the last one,
+ *	and its time should be close to the standby's clock.
+ *
+ *	NOTE: 1. messages are sent in the master's local endianness, both
+ *		  	 firewalls are assumed to run on the same architecture.
+ *		  2. both firewalls' clocks should be in sync (e.g. by NTP), up to
+ *			 SYNC_MAX_CLOCK_SKEW_SECONDS.
+ **/
+
+#define SYNC_DGRAM_MAGIC (0x59535746)		// "FWSY" (in little endian)
+#define MAX_MSGS_IN_DGRAM (40)				// Keeps datagrams below 1500 bytes
+#define RESYNC_INTERVAL_SECONDS (10)		// Must be less than rows' timeout (25 seconds)
+#define POLL_INTERVAL_USEC (50000)			// When there are no new changes
+#define SYNC_MAX_CLOCK_SKEW_SECONDS (60)
+#define REJECTED_PRINT_INTERVAL (1000)		// Prints every that many rejected datagrams
+#define STR_MASTER "master"
+#define STR_STANDBY "standby"
+
+// Every datagram is: <sync_dgram_hdr_t><conn_sync_msg_t>*num_of_msgs
+typedef struct {
+	uint32_t magic;			// network endianness
+	uint32_t session;		// network endianness, random for every run of the master
+	uint32_t time;			// network endianness, master's (real) time in seconds
+	uint32_t seq;			// network endianness, increases by 1 for every datagram
+	uint16_t num_of_msgs;	// network endianness
+	uint8_t mac[SHA256_DIGEST_SIZE];	// HMAC of the whole datagram (with mac zeroed)
+} __attribute__((packed)) sync_dgram_hdr_t;
+
+typedef struct {
+	sync_dgram_hdr_t hdr;
+	conn_sync_msg_t msgs[MAX_MSGS_IN_DGRAM];
+} __attribute__((packed)) sync_dgram_t;
+
+// Master's state:
+typedef struct {
+	int sock;
+	struct sockaddr_in peer;
+	hmac_sha256_ctx_t key;
+	sync_dgram_t dgram;
+	uint32_t session;
+	uint32_t dgram_seq;
+	unsigned long bytes_per_second;		// 0 means no limit
+	double tokens;						// Bytes that can be sent now
+	double last_refill;
+} sync_master_t;
+
+//What the standby remembers of the datagrams it applied (to drop replays):
+typedef struct {
+	bool got_first;
+	uint32_t session;		// Of the master's run followed
+	uint32_t expected_seq;	// Of the next datagram in session
+	uint32_t last_time;		// Latest time of an applied datagram
+	unsigned long num_of_lost;
+} sync_standby_state_t;
+
+/**
+ *	Returns current (monotonic) time, in seconds
+ **/
+static double now_seconds(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ *	Helper function: fills addr with ip_str & port_str.
+ *
+ *	Returns true on success, false if ip_str/port_str are invalid.
+ **/
+static bool fill_sockaddr(struct sockaddr_in* addr, const char* ip_str, const char* port_str){
+	char* end;
+	long port = strtol(port_str, &end, 10);
+
+	if (*end != '\0' || port <= 0 || port > 65535) {
+		printf("Invalid port: %s\n", port_str);
+		return false;
+	}
+
+	memset(addr, 0, sizeof(struct sockaddr_in));
+	addr->sin_family = AF_INET;
+	addr->sin_port = htons((uint16_t)port);
+	if (inet_pton(AF_INET, ip_str, &addr->sin_addr) != 1) {
+		printf("Invalid ip address: %s\n", ip_str);
+		return false;
+	}
+	return true;
+}
+
+/**
+ *	Helper function: reads the shared key (from key_path) into key
+ *
+ *	Returns true on success, false if failed (prints errors, if any, to screen)
+ **/
+static bool init_sync_key(hmac_sha256_ctx_t* key, const char* key_path){
+	uint8_t raw_key[HMAC_MAX_KEY_SIZE];
+	int key_len;
+
+	if ((key_len = read_hmac_key(key_path, raw_key)) < 0) {
+		return false;
+	}
+	hmac_sha256_init(key, raw_key, (size_t)key_len);
+	memset(raw_key, 0, sizeof(raw_key));
+	return true;
+}
+
+/**
+ *	Helper function: calculates dgram's mac (of len bytes, mac is zeroed first)
+ **/
+static void calc_dgram_mac(const hmac_sha256_ctx_t* key, sync_dgram_t* dgram, size_t len,
+		uint8_t mac[SHA256_DIGEST_SIZE])
+{
+	memset(dgram->hdr.mac, 0, SHA256_DIGEST_SIZE);
+	hmac_sha256(key, dgram, len, mac);
+}
+
+/**
+ *	Helper function: picks a random session (identifies this run of the
+ *	master, so the standby can tell its datagrams from older runs' ones)
+ *
+ *	Returns true on success, false if failed (prints errors, if any, to screen)
+ **/
+static bool get_random_session(uint32_t* session){
+	int fd = open("/dev/urandom", O_RDONLY);
+	if (fd < 0) {
+		printf("Error occured trying to open /dev/urandom, error number: %d\n", errno);
+		return false;
+	}
+	if (read(fd, session, sizeof(*session)) != sizeof(*session)) {
+		printf("Error occured trying to read from /dev/urandom, error number: %d\n", errno);
+		close(fd);
+		return false;
+	}
+	close(fd);
+	return true;
+}
+
+/**
+ *	Helper function: opens a UDP socket bound to local_ip:local_port.
+ *
+ *	@peer - if not NULL, socket is connected to it (only datagrams
+ *			from peer are received)
+ *
+ *	Returns the socket on success, -1 if failed (prints errors, if any, to screen)
+ **/
+static int open_sync_socket(const char* local_ip, const char* local_port,
+		const struct sockaddr_in* peer)
+{
+	struct sockaddr_in local;
+
+	if (!fill_sockaddr(&local, local_ip, local_port)) {
+		return -1;
+	}
+
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) {
+		printf("Error occured trying to open a socket, error number: %d\n", errno);
+		return -1;
+	}
+
+	if (bind(sock, (struct sockaddr*)&local, sizeof(local)) < 0) {
+		printf("Error occured trying to bind to %s:%s, error number: %d\n", local_ip, local_port, errno);
+		close(sock);
+		return -1;
+	}
+
+	if (peer != NULL && connect(sock, (const struct sockaddr*)peer, sizeof(*peer)) < 0) {
+		printf("Error occured trying to connect to peer, error number: %d\n", errno);
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+/**
+ *	Helper function: waits until master's bandwidth budget allows
+ *	sending num_of_bytes (token bucket, allows bursts of up to 1 second)
+ **/
+static void wait_for_budget(sync_master_t* master, size_t num_of_bytes){
+	double now;
+
+	if (master->bytes_per_second == 0) {
+		return;
+	}
+
+	while (1) {
+		now = now_seconds();
+		master->tokens += (now - master->last_refill) * master->bytes_per_second;
+		master->last_refill = now;
+		if (master->tokens > master->bytes_per_second) {
+			master->tokens = master->bytes_per_second;
+		}
+		if (master->tokens >= num_of_bytes) {
+			master->tokens -= num_of_bytes;
+			return;
+		}
+		usleep((useconds_t)((num_of_bytes - master->tokens) * 1e6 / master->bytes_per_second) + 1);
+	}
+}
+
+/**
+ *	Sends all messages gathered in master->dgram (if any) to the peer.
+ *
+ *	Returns 0 on success, -1 if failed (prints errors, if any, to screen)
+ **/
+static int flush_dgram(sync_master_t* master){
+	uint8_t mac[SHA256_DIGEST_SIZE];
+	ssize_t num_sent;
+	uint16_t num_of_msgs = master->dgram.hdr.num_of_msgs;
+	size_t len = sizeof(sync_dgram_hdr_t) + num_of_msgs*sizeof(conn_sync_msg_t);
+
+	if (num_of_msgs == 0) {
+		return 0;
+	}
+
+	master->dgram.hdr.magic = htonl(SYNC_DGRAM_MAGIC);
+	master->dgram.hdr.session = htonl(master->session);
+	master->dgram.hdr.seq = htonl(master->dgram_seq++);
+	master->dgram.hdr.num_of_msgs = htons(num_of_msgs);
+
+	wait_for_budget(master, len);
+	master->dgram.hdr.time = htonl((uint32_t)time(NULL));
+	calc_dgram_mac(&master->key, &master->dgram, len, mac);
+	memcpy(master->dgram.hdr.mac, mac, SHA256_DIGEST_SIZE);
+	num_sent = sendto(master->sock, &master->dgram, len, 0,
+			(struct sockaddr*)&master->peer, sizeof(master->peer));
+	master->dgram.hdr.num_of_msgs = 0;	// Only after sending, it's part of the datagram
+	if (num_sent < 0) {
+		printf("Error occured trying to send changes to standby, error number: %d\n", errno);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ *	Adds msg to master->dgram, sends it if it's full.
+ *
+ *	Returns 0 on success, -1 if failed
+ **/
+static int add_msg_to_dgram(sync_master_t* master, const conn_sync_msg_t* msg){
+	master->dgram.msgs[master->dgram.hdr.num_of_msgs++] = *msg;
+	if (master->dgram.hdr.num_of_msgs == MAX_MSGS_IN_DGRAM) {
+		return flush_dgram(master);
+	}
+	return 0;
+}
+
+/**
+ *	Sends the whole connection-table (read from PATH_TO_CONN_TAB_DEV) to
+ *	the standby, every row as a CONN_SYNC_OP_UPDATE message.
+ *
+ *	Returns 0 on success, -1 if failed (prints errors, if any, to screen)
+ **/
+static int send_full_resync(sync_master_t* master){
+	conn_snapshot_hdr_t hdr;
+	conn_sync_msg_t msg;
+	ssize_t num_read;
+	uint32_t i;
+	int ret = 0;
+
+	int dev_fd = open(PATH_TO_CONN_TAB_DEV, O_RDONLY);
+	if (dev_fd < 0) {
+		printf("Error occured trying to open the connection-table device for reading, error number: %d\n", errno);
+		return -1;
+	}
+
+	if (read(dev_fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+		hdr.magic != CONN_SNAPSHOT_MAGIC || hdr.version != CONN_SNAPSHOT_VERSION)
+	{
+		printf("Error: got invalid connection-table snapshot.\n");
+		close(dev_fd);
+		return -1;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.op = CONN_SYNC_OP_UPDATE;
+	for (i = 0; i < hdr.num_of_rows && ret == 0; ++i) {
+		num_read = read(dev_fd, &msg.row, sizeof(conn_snapshot_row_t));
+		if (num_read != sizeof(conn_snapshot_row_t)) {
+			printf("Error: connection-table snapshot is shorter than its header declared.\n");
+			ret = -1;
+			break;
+		}
+		ret = add_msg_to_dgram(master, &msg);
+	}
+	close(dev_fd);
+
+	if (ret == 0) {
+		ret = flush_dgram(master);
+	}
+	return ret;
+}
+
+/**
+ *	Runs as the master (active firewall): sends every change of the
+ *	connection-table to peer_ip:peer_port, authenticated by the key in
+ *	key_path.
+ *
+ *	Returns -1 if failed (otherwise runs forever)
+ **/
+static int run_master(const char* local_ip, const char* local_port,
+		const char* peer_ip, const char* peer_port, const char* key_path,
+		const char* rate_str)
+{
+	static sync_master_t master;
+	conn_sync_msg_t msgs[MAX_MSGS_IN_DGRAM];
+	ssize_t num_read;
+	size_t i, num_of_msgs;
+	double last_resync;
+	bool need_resync = true;
+
+	memset(&master, 0, sizeof(master));
+	if (rate_str != NULL) {
+		char* end;
+		master.bytes_per_second = strtoul(rate_str, &end, 10);
+		if (*end != '\0' || master.bytes_per_second < sizeof(sync_dgram_t)) {
+			printf("Invalid bandwidth budget (should be at least %lu bytes per second): %s\n",
+					(unsigned long)sizeof(sync_dgram_t), rate_str);
+			return -1;
+		}
+	}
+	if (!fill_sockaddr(&master.peer, peer_ip, peer_port) ||
+		!init_sync_key(&master.key, key_path) ||
+		!get_random_session(&master.session))
+	{
+		return -1;
+	}
+	if ((master.sock = open_sync_socket(local_ip, local_port, NULL)) < 0) {
+		return -1;
+	}
+	master.last_refill = now_seconds();
+	last_resync = master.last_refill;
+
+	//Start recording changes before taking the first snapshot, so none is missed:
+	int sync_fd = open(PATH_TO_CONN_SYNC_DEV, O_RDONLY);
+	if (sync_fd < 0) {
+		printf("Error occured trying to open the connection-sync device for reading, error number: %d\n", errno);
+		close(master.sock);
+		return -1;
+	}
+
+	printf("Sending connection-table changes to %s:%s\n", peer_ip, peer_port);
+
+	while (1) {
+		if (need_resync || now_seconds() - last_resync >= RESYNC_INTERVAL_SECONDS) {
+			if (send_full_resync(&master) < 0) {
+				break;
+			}
+			last_resync = now_seconds();
+			need_resync = false;
+		}
+
+		if ((num_read = read(sync_fd, msgs, sizeof(msgs))) < 0) {
+			printf("Error occured trying to read from the connection-sync device, error number: %d\n", errno);
+			break;
+		}
+		if (num_read == 0) {
+			usleep(POLL_INTERVAL_USEC);
+			continue;
+		}
+
+		num_of_msgs = num_read / sizeof(conn_sync_msg_t);
+		for (i = 0; i < num_of_msgs; ++i) {
+			if (msgs[i].op == CONN_SYNC_OP_OVERRUN) {
+				printf("Note: connection-table changes were lost, resyncing standby.\n");
+				need_resync = true;
+			} else if (add_msg_to_dgram(&master, &msgs[i]) < 0) {
+				break;
+			}
+		}
+		if (i < num_of_msgs || flush_dgram(&master) < 0) {
+			break;
+		}
+	}
+
+	close(sync_fd);
+	close(master.sock);
+	return -1;
+}
+
+/**
+ *	Helper function: checks dgram (of num_read bytes) is valid & authentic
+ *	(its mac was calculated with key).
+ *
+ *	Returns the number of messages in it if it is, 0 otherwise.
+ **/
+static uint16_t check_dgram(const hmac_sha256_ctx_t* key, sync_dgram_t* dgram, ssize_t num_read){
+	uint8_t mac[SHA256_DIGEST_SIZE], expected_mac[SHA256_DIGEST_SIZE];
+	uint16_t num_of_msgs;
+
+	if ((size_t)num_read < sizeof(sync_dgram_hdr_t) ||
+		ntohl(dgram->hdr.magic) != SYNC_DGRAM_MAGIC)
+	{
+		return 0;
+	}
+	num_of_msgs = ntohs(dgram->hdr.num_of_msgs);
+	if (num_of_msgs == 0 || num_of_msgs > MAX_MSGS_IN_DGRAM ||
+		(size_t)num_read != sizeof(sync_dgram_hdr_t) + num_of_msgs*sizeof(conn_sync_msg_t))
+	{
+		return 0;
+	}
+
+	memcpy(mac, dgram->hdr.mac, SHA256_DIGEST_SIZE);
+	calc_dgram_mac(key, dgram, (size_t)num_read, expected_mac);
+	return hmac_equal(mac, expected_mac) ? num_of_msgs : 0;
+}
+
+/**
+ *	Helper function: checks an authentic datagram isn't a replay, updates
+ *	state by it if it isn't.
+ *
+ *	Returns true if hdr's datagram should be applied, false otherwise.
+ **/
+static bool check_dgram_order(sync_standby_state_t* state, const sync_dgram_hdr_t* hdr){
+	uint32_t session = ntohl(hdr->session);
+	uint32_t seq = ntohl(hdr->seq);
+	uint32_t dgram_time = ntohl(hdr->time);
+	int64_t skew = (int64_t)time(NULL) - (int64_t)dgram_time;
+
+	if (skew > SYNC_MAX_CLOCK_SKEW_SECONDS || skew < -SYNC_MAX_CLOCK_SKEW_SECONDS) {
+		return false;
+	}
+
+	if (state->got_first && session == state->session) {
+		if ((int32_t)(seq - state->expected_seq) < 0) {
+			return false;	// Replayed (or reordered, its changes are stale anyway)
+		}
+		//Lost CREATE/UPDATE messages are fixed by master's next full resync,
+		//but rows whose DELETE/FLUSH was lost are only removed by their timeout:
+		if (seq != state->expected_seq) {
+			state->num_of_lost += (uint32_t)(seq - state->expected_seq);
+			printf("Note: %lu datagrams lost so far, waiting for next resync.\n", state->num_of_lost);
+		}
+	} else if (state->got_first && dgram_time <= state->last_time) {
+		return false;	// An older run of the master (or the same second it started in)
+	} else {
+		if (state->got_first) {
+			printf("Note: master was restarted, following its new session.\n");
+		}
+		state->got_first = true;
+		state->session = session;
+	}
+
+	state->expected_seq = seq + 1;
+	if (dgram_time > state->last_time) {
+		state->last_time = dgram_time;
+	}
+	return true;
+}
+
+/**
+ *	Runs as the standby: applies every change received (on
+ *	local_ip:local_port, from peer_ip:peer_port, authenticated by the key
+ *	in key_path) to the local connection-table.
+ *
+ *	Returns -1 if failed (otherwise runs forever)
+ **/
+static int run_standby(const char* local_ip, const char* local_port,
+		const char* peer_ip, const char* peer_port, const char* key_path)
+{
+	static sync_dgram_t dgram;
+	struct sockaddr_in peer;
+	hmac_sha256_ctx_t key;
+	sync_standby_state_t state;
+	ssize_t num_read;
+	size_t len;
+	uint16_t num_of_msgs;
+	unsigned long num_of_rejected = 0;
+
+	memset(&state, 0, sizeof(state));
+	if (!fill_sockaddr(&peer, peer_ip, peer_port) || !init_sync_key(&key, key_path)) {
+		return -1;
+	}
+
+	//Connected, so datagrams from any other address are dropped by the kernel:
+	int sock = open_sync_socket(local_ip, local_port, &peer);
+	if (sock < 0) {
+		return -1;
+	}
+
+	int sync_fd = open(PATH_TO_CONN_SYNC_DEV, O_WRONLY);
+	if (sync_fd < 0) {
+		printf("Error occured trying to open the connection-sync device for writing, error number: %d\n", errno);
+		close(sock);
+		return -1;
+	}
+
+	printf("Waiting for connection-table changes from %s:%s on %s:%s\n",
+			peer_ip, peer_port, local_ip, local_port);
+
+	while ((num_read = recv(sock, &dgram, sizeof(dgram), 0)) >= 0) {
+		num_of_msgs = check_dgram(&key, &dgram, num_read);
+		if (num_of_msgs == 0 || !check_dgram_order(&state, &dgram.hdr)) {
+			if (++num_of_rejected % REJECTED_PRINT_INTERVAL == 1) {
+				printf("Note: %lu invalid, unauthentic or replayed datagrams dropped so far.\n",
+						num_of_rejected);
+			}
+			continue;
+		}
+
+		len = num_of_msgs*sizeof(conn_sync_msg_t);
+		if (write(sync_fd, dgram.msgs, len) != (ssize_t)len) {
+			printf("Error occured trying to write to the connection-sync device, error number: %d\n", errno);
+			break;
+		}
+	}
+
+	if (num_read < 0) {
+		printf("Error occured trying to receive changes, error number: %d\n", errno);
+	}
+	close(sync_fd);
+	close(sock);
+	return -1;
+}
+
+int main(int argc, char* argv[]){
+
+	if ((argc == 7 || argc == 8) && strcmp(argv[1], STR_MASTER) == 0) {
+		return run_master(argv[2], argv[3], argv[4], argv[5], argv[6], (argc == 8) ? argv[7] : NULL);
+	}
+
+	if (argc == 7 && strcmp(argv[1], STR_STANDBY) == 0) {
+		return run_standby(argv[2], argv[3], argv[4], argv[5], argv[6]);
+	}
+
+	printf("Wrong usage, format is:\n"
+			"\t%s master <local ip> <local port> <peer ip> <peer port> <key file> [bytes per second]\n"
+			"\t%s standby <local ip> <local port> <peer ip> <peer port> <key file>\n", argv[0], argv[0]);
+	return -1;
+}
@@ -0,0 +1,195 @@
+#include "hmac_utils.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+static const uint32_t g_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/**
+ *	Helper function: hashes a single (full) block into ctx->state
+ **/
+static void sha256_transform(sha256_ctx_t* ctx, const uint8_t* block){
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, h, t1, t2;
+	int i;
+
+	for (i = 0; i < 16; ++i) {
+		w[i] = ((uint32_t)block[4*i] << 24) | ((uint32_t)block[4*i + 1] << 16) |
+				((uint32_t)block[4*i + 2] << 8) | (uint32_t)block[4*i + 3];
+	}
+	for (i = 16; i < 64; ++i) {
+		w[i] = w[i - 16] + (ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+				w[i - 7] + (ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10));
+	}
+
+	a = ctx->state[0]; b = ctx->state[1]; c = ctx->state[2]; d = ctx->state[3];
+	e = ctx->state[4]; f = ctx->state[5]; g = ctx->state[6]; h = ctx->state[7];
+
+	for (i = 0; i < 64; ++i) {
+		t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) +
+				g_sha256_k[i] + w[i];
+		t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	ctx->state[0] += a; ctx->state[1] += b; ctx->state[2] += c; ctx->state[3] += d;
+	ctx->state[4] += e; ctx->state[5] += f; ctx->state[6] += g; ctx->state[7] += h;
+}
+
+void sha256_init(sha256_ctx_t* ctx){
+	static const uint32_t initial_state[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	memcpy(ctx->state, initial_state, sizeof(initial_state));
+	ctx->num_of_bytes = 0;
+	ctx->block_len = 0;
+}
+
+void sha256_update(sha256_ctx_t* ctx, const void* data, size_t len){
+	const uint8_t* bytes = data;
+	size_t to_copy;
+
+	ctx->num_of_bytes += len;
+	while (len > 0) {
+		to_copy = SHA256_BLOCK_SIZE - ctx->block_len;
+		if (to_copy > len) {
+			to_copy = len;
+		}
+		memcpy(ctx->block + ctx->block_len, bytes, to_copy);
+		ctx->block_len += to_copy;
+		bytes += to_copy;
+		len -= to_copy;
+		if (ctx->block_len == SHA256_BLOCK_SIZE) {
+			sha256_transform(ctx, ctx->block);
+			ctx->block_len = 0;
+		}
+	}
+}
+
+void sha256_final(sha256_ctx_t* ctx, uint8_t digest[SHA256_DIGEST_SIZE]){
+	uint64_t num_of_bits = ctx->num_of_bytes * 8;
+	uint8_t padding[SHA256_BLOCK_SIZE + 8];
+	size_t padding_len;
+	int i;
+
+	//Pads with 0x80, zeroes, and the message's length (in bits, big endian):
+	padding_len = ((ctx->block_len < 56) ? 56 : 120) - ctx->block_len;
+	memset(padding, 0, sizeof(padding));
+	padding[0] = 0x80;
+	for (i = 0; i < 8; ++i) {
+		padding[padding_len + i] = (uint8_t)(num_of_bits >> (56 - 8*i));
+	}
+	sha256_update(ctx, padding, padding_len + 8);
+
+	for (i = 0; i < 8; ++i) {
+		digest[4*i] = (uint8_t)(ctx->state[i] >> 24);
+		digest[4*i + 1] = (uint8_t)(ctx->state[i] >> 16);
+		digest[4*i + 2] = (uint8_t)(ctx->state[i] >> 8);
+		digest[4*i + 3] = (uint8_t)ctx->state[i];
+	}
+}
+
+/**
+ *	Prepares ctx for calculating MACs with key (hashes the padded key
+ *	once, so every MAC only hashes its data).
+ *
+ *	NOTE: key_len should be at most HMAC_MAX_KEY_SIZE
+ **/
+void hmac_sha256_init(hmac_sha256_ctx_t* ctx, const uint8_t* key, size_t key_len){
+	uint8_t pad[SHA256_BLOCK_SIZE];
+	size_t i;
+
+	memset(pad, 0, sizeof(pad));
+	memcpy(pad, key, key_len);
+	for (i = 0; i < SHA256_BLOCK_SIZE; ++i) {
+		pad[i] ^= 0x36;
+	}
+	sha256_init(&ctx->inner);
+	sha256_update(&ctx->inner, pad, sizeof(pad));
+
+	for (i = 0; i < SHA256_BLOCK_SIZE; ++i) {
+		pad[i] ^= 0x36 ^ 0x5c;
+	}
+	sha256_init(&ctx->outer);
+	sha256_update(&ctx->outer, pad, sizeof(pad));
+
+	memset(pad, 0, sizeof(pad));
+}
+
+/**
+ *	Calculates data's MAC (with the key key_ctx was initiated with)
+ **/
+void hmac_sha256(const hmac_sha256_ctx_t* key_ctx, const void* data, size_t len,
+		uint8_t mac[SHA256_DIGEST_SIZE])
+{
+	sha256_ctx_t ctx = key_ctx->inner;
+	uint8_t inner_digest[SHA256_DIGEST_SIZE];
+
+	sha256_update(&ctx, data, len);
+	sha256_final(&ctx, inner_digest);
+
+	ctx = key_ctx->outer;
+	sha256_update(&ctx, inner_digest, sizeof(inner_digest));
+	sha256_final(&ctx, mac);
+}
+
+/**
+ *	Compares 2 MACs in constant time (so the time it takes doesn't tell
+ *	how many bytes of a forged MAC are right).
+ **/
+bool hmac_equal(const uint8_t mac1[SHA256_DIGEST_SIZE], const uint8_t mac2[SHA256_DIGEST_SIZE]){
+	uint8_t diff = 0;
+	int i;
+
+	for (i = 0; i < SHA256_DIGEST_SIZE; ++i) {
+		diff |= mac1[i] ^ mac2[i];
+	}
+	return (diff == 0);
+}
+
+/**
+ *	Reads a shared key from the file in path (its raw bytes, up to
+ *	HMAC_MAX_KEY_SIZE, e.g. made by:
+ *		head -c 32 /dev/urandom > fw_sync.key)
+ *
+ *	Returns the key's length on success, -1 if failed (prints errors, if
+ *	any, to screen)
+ **/
+int read_hmac_key(const char* path, uint8_t key[HMAC_MAX_KEY_SIZE]){
+	size_t key_len;
+	int extra;
+
+	FILE* key_file = fopen(path, "rb");
+	if (key_file == NULL) {
+		printf("Error occured trying to open key file %s, error number: %d\n", path, errno);
+		return -1;
+	}
+
+	key_len = fread(key, 1, HMAC_MAX_KEY_SIZE, key_file);
+	extra = fgetc(key_file);
+	fclose(key_file);
+
+	if (extra != EOF) {
+		printf("Error: key file %s is longer than %d bytes.\n", path, HMAC_MAX_KEY_SIZE);
+		return -1;
+	}
+	if (key_len < HMAC_MIN_KEY_SIZE) {
+		printf("Error: key file %s is shorter than %d bytes.\n", path, HMAC_MIN_KEY_SIZE);
+		return -1;
+	}
+	return (int)key_len;
+}
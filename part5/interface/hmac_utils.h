@@ -0,0 +1,40 @@
+#ifndef _HMAC_UTILS_H_
+#define _HMAC_UTILS_H_
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ *	HMAC-SHA256 (RFC 2104, FIPS 180-4) - used by fw_sync to authenticate
+ *	its datagrams with a key shared by both firewalls.
+ *	Kept here (and not taken from a crypto library), so the interface
+ *	has no dependencies.
+ **/
+#define SHA256_BLOCK_SIZE (64)
+#define SHA256_DIGEST_SIZE (32)
+#define HMAC_MIN_KEY_SIZE (16)		// Shorter shared keys are refused
+#define HMAC_MAX_KEY_SIZE (SHA256_BLOCK_SIZE)
+
+typedef struct {
+	uint32_t state[8];
+	uint64_t num_of_bytes;				// Hashed so far
+	uint8_t block[SHA256_BLOCK_SIZE];	// Bytes that don't fill a block yet
+	size_t block_len;
+} sha256_ctx_t;
+
+typedef struct {
+	sha256_ctx_t inner;
+	sha256_ctx_t outer;
+} hmac_sha256_ctx_t;
+
+void sha256_init(sha256_ctx_t* ctx);
+void sha256_update(sha256_ctx_t* ctx, const void* data, size_t len);
+void sha256_final(sha256_ctx_t* ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+void hmac_sha256_init(hmac_sha256_ctx_t* ctx, const uint8_t* key, size_t key_len);
+void hmac_sha256(const hmac_sha256_ctx_t* key_ctx, const void* data, size_t len,
+		uint8_t mac[SHA256_DIGEST_SIZE]);
+bool hmac_equal(const uint8_t mac1[SHA256_DIGEST_SIZE], const uint8_t mac2[SHA256_DIGEST_SIZE]);
+int read_hmac_key(const char* path, uint8_t key[HMAC_MAX_KEY_SIZE]);
+
+#endif /* _HMAC_UTILS_H_ */
@@ -537,6 +537,12 @@ static bool tran_reason_to_str(int reason, char* str){
 		case(REASON_PART_OF_PROXY_HANDSHAKE):
 			strncpy(str, "Packet's part of proxy handshake", MAX_STRLEN_OF_REASON+1);
 			break;		
+		case(REASON_XPLICO_PACKET):
+			strncpy(str, "Xplico packet", MAX_STRLEN_OF_REASON+1);
+			break;
+		case(REASON_HALF_OPEN_LIMIT):
+			strncpy(str, "Half-open limit reached", MAX_STRLEN_OF_REASON+1);
+			break;
 		default: //reason is an index
 			snprintf(str, MAX_STRLEN_OF_REASON, "Rule number: %d", reason);
 	}
@@ -1251,50 +1257,61 @@ int clear_log(void){
 }
 
 /**
- *	Gets a buffer that contain all fw's log-rows,
- * 	in format:
- * 
- * 	FORMAT:
- * 		Buffer := [log_row]\n...[log_row]\n
- * 		log_row := <timestamp> <protocol> <action> <hooknum> <src ip> <dst ip> <source port> <dest port> <reason> <count>
+ *	Reads all fw's log-rows, in binary mode (LOG_READ_MODE_BINARY):
+ *	every read() returns as many rows as fit in the buffer, which is
+ *	doubled whenever it's full (the log holds up to log_capacity rows per
+ *	cpu), until read() returns 0.
  *
- *	Returns: buffer on success, NULL if error happened 
+ *	@ptr_num_of_rows - updated to the number of rows read
  *
- *	Note: user should free memory allocated for string returned!
+ *	Returns: array of rows on success, NULL if error happened
+ *
+ *	Note: user should free memory allocated for array returned!
  **/
-static char* get_log_rows_from_fw(){
-	int curr_read_bytes = 0;
+static fw_log_rec_t* get_log_rows_from_fw(size_t* ptr_num_of_rows){
+	ssize_t curr_read_bytes = 0;
 	size_t total_bytes_read = 0;
+	fw_log_rec_t* bigger_recs;
 	
-	//Allocates room for MAX_NUM_OF_LOG_ROWS+1 (to make sure there's enough room)
-	//+1 is for '\0': 
-	size_t enough_len = (MAX_STRLEN_OF_LOGROW_FORMAT*(MAX_NUM_OF_LOG_ROWS+1)) + 1; 
-	char* buffer = calloc(enough_len,sizeof(char));
-	if (buffer == NULL) {
-		printf("Error: allocation failed, couldn't get all rules from fw\n");
+	*ptr_num_of_rows = 0;
+
+	//Starts with room for MAX_NUM_OF_LOG_ROWS, grows when needed:
+	size_t recs_len = sizeof(fw_log_rec_t)*MAX_NUM_OF_LOG_ROWS;
+	fw_log_rec_t* recs = calloc(MAX_NUM_OF_LOG_ROWS, sizeof(fw_log_rec_t));
+	if (recs == NULL) {
+		printf("Error: allocation failed, couldn't get all log-rows from fw\n");
 		return NULL;
 	}
 	
-	size_t len_to_read = enough_len-1;
 	// Open device with read only permissions:
 	int fd = open(PATH_TO_LOG_DEV,O_RDONLY);
 	if (fd < 0){
 		printf("Error accured trying to open the log-device for reading all log-rows, error number: %d\n", errno);
-		free(buffer);
+		free(recs);
 		return NULL;
 	}
 
-	while ( (len_to_read >= MAX_STRLEN_OF_LOGROW_FORMAT+1 ) &&
-			((curr_read_bytes = read(fd, buffer+total_bytes_read, len_to_read)) > 0) )
+	if (ioctl(fd, FW_LOG_IOC_SET_MODE, LOG_READ_MODE_BINARY) < 0){
+		printf("Error accured trying to set the log-device to binary mode, error number: %d\n", errno);
+		free(recs);
+		close(fd);
+		return NULL;
+	}
+
+	while ((curr_read_bytes = read(fd, (char*)recs + total_bytes_read,
+					recs_len - total_bytes_read)) > 0)
 	{
-		total_bytes_read+=curr_read_bytes;
-		if (curr_read_bytes <= len_to_read){
-			len_to_read = len_to_read - curr_read_bytes;
-		} else {
-			printf("No room to read any more data from fw (log device)\n");
-			len_to_read = 0;
+		total_bytes_read += curr_read_bytes;
+		if (total_bytes_read + sizeof(fw_log_rec_t) > recs_len) {
+			if ((bigger_recs = realloc(recs, 2*recs_len)) == NULL) {
+				printf("Error: allocation failed, couldn't get all log-rows from fw\n");
+				free(recs);
+				close(fd);
+				return NULL;
+			}
+			recs = bigger_recs;
+			recs_len *= 2;
 		}
-		
 	}
 
 	close(fd);
@@ -1302,11 +1319,12 @@ static char* get_log_rows_from_fw(){
 	if (curr_read_bytes < 0) {
 		//Some error accured
 		printf("Failed reading log-rows from fw.\n");
-		free(buffer);
+		free(recs);
 		return NULL;
 	}
 	
-	return buffer;
+	*ptr_num_of_rows = total_bytes_read / sizeof(fw_log_rec_t);
+	return recs;
 }
 
 
@@ -1400,6 +1418,32 @@ static bool print_log_row_format(char* log_token){
 	
 }
 
+/**
+ *	Helper function: prints a binary log record (read from the log-device
+ *	or from a log ring) in its string representation.
+ *
+ *	Returns true on success.
+ **/
+static bool print_log_rec(const fw_log_rec_t* rec){
+	
+	char str[MAX_STRLEN_OF_LOGROW_FORMAT+1];
+	
+	snprintf(str, MAX_STRLEN_OF_LOGROW_FORMAT+1,
+			"%lu %hhu %hhu %hhu %u %u %hu %hu %d %u",
+			(unsigned long)rec->timestamp,
+			rec->protocol,
+			rec->action,
+			rec->hooknum,
+			rec->src_ip,
+			rec->dst_ip,
+			rec->src_port,
+			rec->dst_port,
+			rec->reason,
+			rec->count);
+	
+	return print_log_row_format(str);
+}
+
 /**
  *	Reads all log-rows from fw and prints them by format:
  *	<rule name> <direction> <src ip>/<nps> <dst ip>/<nps> <protocol> <source port> <dest port> <ack> <action>'\n'...
@@ -1408,27 +1452,21 @@ static bool print_log_row_format(char* log_token){
  **/
 int print_all_log_rows(void){
 	
-	char* log_token = NULL;
-	char* ptr_copy_buffer;
-	char* buffer = get_log_rows_from_fw();
+	size_t num_of_rows, i;
+	fw_log_rec_t* recs = get_log_rows_from_fw(&num_of_rows);
 	bool error_occured = false;
 
-	if (buffer == NULL) {
+	if (recs == NULL) {
 		return -1;
 	}
 	
-	//Since strsep ruin buffer:
-	ptr_copy_buffer = buffer;
-	
-	while ((log_token = strsep(&buffer, DELIMETER_STR)) != NULL
-			&& (strlen(log_token) > 0)) //Last token is empty if valid format recieved
-	{
-		if (!print_log_row_format(log_token)) {
+	for (i = 0; i < num_of_rows; ++i) {
+		if (!print_log_rec(&recs[i])) {
 			error_occured = true;
 		}
 	}	
 	
-	free(ptr_copy_buffer);
+	free(recs);
 	
 	if (error_occured) {
 		printf("Some of the log-rows weren't printed.\n");
@@ -1480,3 +1518,363 @@ int get_num_log_rows(void){
 }
 
 
+/**
+ *	Maps firewall's binary log rings (from PATH_TO_LOG_DEV), prints every
+ *	logged packet that wasn't read yet (ring by ring) and marks it as read.
+ *
+ *	Returns 0 on success, -1 if failed
+ **/
+int dump_log_ring(void){
+	
+	fw_log_area_hdr_t area_hdr;
+	fw_log_area_hdr_t* ptr_area_hdr;
+	volatile fw_log_ring_hdr_t* ring;
+	const fw_log_rec_t* recs;
+	char* area;
+	uint32_t i, head, tail;
+	
+	//Opened for writing too, since user updates rings' tails:
+	int fd = open(PATH_TO_LOG_DEV, O_RDWR);
+	if (fd < 0){
+		printf("Error occured trying to open the log-device, error number: %d\n", errno);
+		return -1;
+	}
+	
+	ptr_area_hdr = mmap(NULL, sizeof(fw_log_area_hdr_t), PROT_READ, MAP_SHARED, fd, 0);
+	if (ptr_area_hdr == MAP_FAILED && errno == EBUSY){
+		printf("Error: log rings are read by another process (fw_logd?), only one can read them.\n");
+		close(fd);
+		return -1;
+	}
+	if (ptr_area_hdr == MAP_FAILED){
+		printf("Error occured trying to map log rings (are they disabled?), error number: %d\n", errno);
+		close(fd);
+		return -1;
+	}
+	area_hdr = *ptr_area_hdr;
+	munmap(ptr_area_hdr, sizeof(fw_log_area_hdr_t));
+	
+	if (area_hdr.magic != LOG_AREA_MAGIC || area_hdr.version != LOG_AREA_VERSION){
+		printf("Error: firewall's log rings have an unknown format.\n");
+		close(fd);
+		return -1;
+	}
+	
+	area = mmap(NULL, area_hdr.area_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (area == MAP_FAILED){
+		printf("Error occured trying to map log rings, error number: %d\n", errno);
+		close(fd);
+		return -1;
+	}
+	
+	for (i = 0; i < area_hdr.num_of_rings; ++i){
+		ring = (volatile fw_log_ring_hdr_t*)(area + area_hdr.ring_offset + i*area_hdr.ring_stride);
+		recs = (const fw_log_rec_t*)((char*)ring + area_hdr.recs_offset);
+		
+		head = ring->head;
+		__sync_synchronize(); //Records are read only after head
+		tail = ring->tail;
+		
+		if (ring->dropped > 0){
+			printf("Note: %u records of cpu %u were dropped since its ring was full.\n", ring->dropped, i);
+		}
+		for (; tail != head; ++tail){
+			print_log_rec(&recs[tail & (area_hdr.ring_size - 1)]);
+		}
+		
+		__sync_synchronize(); //Records are read before they're released
+		ring->tail = tail;
+	}
+	
+	munmap(area, area_hdr.area_len);
+	close(fd);
+	return 0;
+}
+
+/**
+ *	Follows firewall's log: prints every packet logged from now on
+ *	(as its updated log-row), until interrupted (or an error occurs).
+ *
+ *	Returns -1 (only returns if failed).
+ **/
+int follow_log(void){
+	
+	fw_log_rec_t recs[LOG_FOLLOW_BATCH];
+	ssize_t curr_read_bytes;
+	size_t i;
+	
+	int fd = open(PATH_TO_LOG_DEV, O_RDONLY);
+	if (fd < 0){
+		printf("Error occured trying to open the log-device, error number: %d\n", errno);
+		return -1;
+	}
+	
+	if (ioctl(fd, FW_LOG_IOC_SET_MODE, LOG_READ_MODE_BINARY) < 0 ||
+			ioctl(fd, FW_LOG_IOC_FOLLOW) < 0){
+		printf("Error occured trying to follow the log-device, error number: %d\n", errno);
+		close(fd);
+		return -1;
+	}
+	
+	//Every read blocks until new rows are logged:
+	while ((curr_read_bytes = read(fd, recs, sizeof(recs))) > 0){
+		for (i = 0; i < curr_read_bytes / sizeof(fw_log_rec_t); ++i){
+			print_log_rec(&recs[i]);
+		}
+		fflush(stdout);
+	}
+	
+	printf("Stopped following the log, error number: %d\n", errno);
+	close(fd);
+	return -1;
+}
+
+/**
+ *	Prints firewall's log rollups (packets per interval, by rule/reason,
+ *	protocol and action), oldest interval first, by format:
+ *	<interval start> <interval seconds> <reason> <protocol> <action> <packets>'\n'...
+ *	(packets of keys that didn't fit in their interval are printed as "others")
+ *
+ *	Returns 0 on success, -1 if failed
+ **/
+int print_log_rollups(void){
+	
+	fw_log_rollup_rec_t recs[LOG_ROLLUP_READ_BATCH];
+	char protocol_str[MAX_STRLEN_OF_PROTOCOL+1];
+	char action_str[MAX_STRLEN_OF_ACTION+1];
+	char reason_str[MAX_STRLEN_OF_REASON+1];
+	ssize_t curr_read_bytes;
+	size_t i;
+	
+	int fd = open(PATH_TO_LOG_DEV, O_RDONLY);
+	if (fd < 0){
+		printf("Error occured trying to open the log-device, error number: %d\n", errno);
+		return -1;
+	}
+	
+	if (ioctl(fd, FW_LOG_IOC_SET_MODE, LOG_READ_MODE_ROLLUP) < 0){
+		printf("Error occured trying to read log rollups, error number: %d\n", errno);
+		close(fd);
+		return -1;
+	}
+	
+	while ((curr_read_bytes = read(fd, recs, sizeof(recs))) > 0){
+		for (i = 0; i < curr_read_bytes / sizeof(fw_log_rollup_rec_t); ++i){
+			if (recs[i].flags & LOG_ROLLUP_FLAG_OTHERS){
+				printf("%lu %u others - - %u\n", (unsigned long)recs[i].interval_start,
+						recs[i].interval_secs, recs[i].packets);
+				continue;
+			}
+			if ( !(tran_reason_to_str(recs[i].reason, reason_str))
+				|| !(tran_prot_t_to_str(recs[i].protocol, protocol_str))
+				|| !(tran_action_to_str(recs[i].action, action_str)) )
+			{
+				continue;
+			}
+			printf("%lu %u \"%s\" %s %s %u\n", (unsigned long)recs[i].interval_start,
+					recs[i].interval_secs, reason_str, protocol_str, action_str, recs[i].packets);
+		}
+	}
+	
+	if (curr_read_bytes < 0){
+		printf("Error occured trying to read log rollups, error number: %d\n", errno);
+		close(fd);
+		return -1;
+	}
+	
+	close(fd);
+	return 0;
+}
+
+//A verdict counter, as read from PATH_TO_VERDICTS_ATTR:
+typedef struct {
+	unsigned int		hooknum;
+	unsigned int		action;
+	int					reason;
+	unsigned long long	packets;
+	unsigned long long	bytes;
+} verdict_line_t;
+
+/**
+ *	Helper function: reads all verdict counters (from PATH_TO_VERDICTS_ATTR)
+ *	into lines (of MAX_NUM_OF_VERDICT_LINES), by format:
+ *	<hooknum> <action> <reason> <packets> <bytes>'\n'...
+ *	and updates *ts to the (monotonic) time they were read.
+ *
+ *	Returns number of counters read, -1 if failed (prints errors, if any, to screen)
+ **/
+static int read_verdict_lines(verdict_line_t* lines, struct timespec* ts){
+	
+	char *buff, *str, *curr_token;
+	int num_of_lines = 0;
+	unsigned int p_size = (unsigned int)getpagesize();
+	
+	if ( (buff = calloc(p_size,sizeof(char))) == NULL){
+		printf("Allocating buffer for getting verdict counters failed.\n");
+		return -1;
+	}
+	
+	// Open device with read only permissions:
+	int fd = open(PATH_TO_VERDICTS_ATTR,O_RDONLY);
+	if (fd < 0){
+		printf("Error occured trying to open the verdict counters for reading, error number: %d\n", errno);
+		free(buff);
+		return -1;
+	}
+	
+	if (read(fd, buff, p_size-1) < 0){
+		printf("Error occured trying to read verdict counters, error number: %d\n", errno);
+		free(buff);
+		close(fd);
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	close(fd);
+	
+	str = buff;
+	while ((curr_token = strsep(&str, DELIMETER_STR)) != NULL && num_of_lines < MAX_NUM_OF_VERDICT_LINES){
+		if (sscanf(curr_token, "%u %u %d %llu %llu", &lines[num_of_lines].hooknum,
+				&lines[num_of_lines].action, &lines[num_of_lines].reason,
+				&lines[num_of_lines].packets, &lines[num_of_lines].bytes) == 5)
+		{
+			++num_of_lines;
+		}
+	}
+	
+	free(buff);
+	return num_of_lines;
+}
+
+/**
+ *	Prints firewall's verdict counters (packets & bytes, by hook, action and
+ *	rule/reason) and their rates: counters are read twice,
+ *	VERDICTS_RATE_INTERVAL_USEC apart, so rates are of that interval.
+ *	Ends with the total packets rate and the drop rate.
+ *
+ *	Returns 0 on success, -1 if failed
+ **/
+int print_verdict_rates(void){
+	
+	static verdict_line_t prev_lines[MAX_NUM_OF_VERDICT_LINES];
+	static verdict_line_t lines[MAX_NUM_OF_VERDICT_LINES];
+	char action_str[MAX_STRLEN_OF_ACTION+1];
+	char reason_str[MAX_STRLEN_OF_REASON+1];
+	struct timespec prev_ts, ts;
+	unsigned long long packets, bytes;
+	double elapsed, pps, total_pps = 0, drop_pps = 0;
+	int num_of_prev_lines, num_of_lines, i, j;
+	
+	if ((num_of_prev_lines = read_verdict_lines(prev_lines, &prev_ts)) < 0){
+		return -1;
+	}
+	usleep(VERDICTS_RATE_INTERVAL_USEC);
+	if ((num_of_lines = read_verdict_lines(lines, &ts)) < 0){
+		return -1;
+	}
+	
+	elapsed = (ts.tv_sec - prev_ts.tv_sec) + (ts.tv_nsec - prev_ts.tv_nsec) / 1e9;
+	if (elapsed <= 0){
+		elapsed = VERDICTS_RATE_INTERVAL_USEC / 1e6;
+	}
+	
+	printf("%-11s %-6s %-33s %14s %16s %12s %14s\n", "hook", "action", "reason",
+			"packets", "bytes", "packets/sec", "bits/sec");
+	
+	for (i = 0; i < num_of_lines; ++i){
+		packets = lines[i].packets;
+		bytes = lines[i].bytes;
+		for (j = 0; j < num_of_prev_lines; ++j){
+			if (prev_lines[j].hooknum == lines[i].hooknum &&
+				prev_lines[j].action == lines[i].action &&
+				prev_lines[j].reason == lines[i].reason)
+			{
+				packets -= prev_lines[j].packets;
+				bytes -= prev_lines[j].bytes;
+				break;
+			}
+		}
+		
+		if (!tran_action_to_str((unsigned char)lines[i].action, action_str)){
+			continue;
+		}
+		if (lines[i].reason == VERDICT_NO_REASON){
+			strncpy(reason_str, "No reason", MAX_STRLEN_OF_REASON+1);
+		} else {
+			tran_reason_to_str(lines[i].reason, reason_str);
+		}
+		
+		pps = packets / elapsed;
+		total_pps += pps;
+		if (lines[i].action == NF_DROP){
+			drop_pps += pps;
+		}
+		printf("%-11s %-6s %-33s %14llu %16llu %12.0f %14.0f\n",
+				(lines[i].hooknum == NF_INET_LOCAL_OUT) ? "local_out" : "pre_routing",
+				action_str, reason_str, lines[i].packets, lines[i].bytes,
+				pps, bytes * 8 / elapsed);
+	}
+	
+	printf("Total: %.0f packets/sec, dropped: %.0f packets/sec (%.2f%%)\n", total_pps,
+			drop_pps, (total_pps > 0) ? (100 * drop_pps / total_pps) : 0.0);
+	return 0;
+}
+
+/**
+ *	Answers a query over the log segments written by fw_logd: prints
+ *	every log-row that matches all given filters.
+ *
+ *	@argc, @argv - <segments directory> [from <timestamp>] [to <timestamp>]
+ *				   [ip <ip>] [rule <rule index / reason>]
+ *
+ *	Returns 0 on success, -1 if failed
+ **/
+int query_log(int argc, char* argv[]){
+	
+	log_query_t query;
+	log_query_stats_t stats;
+	struct in_addr addr;
+	char* end;
+	int i;
+	
+	memset(&query, 0, sizeof(query));
+	
+	for (i = 1; i + 1 < argc; i += 2){
+		if (strcmp(argv[i], STR_QUERY_FROM) == 0){
+			query.has_from = true;
+			query.from = strtoull(argv[i+1], &end, 10);
+		} else if (strcmp(argv[i], STR_QUERY_TO) == 0){
+			query.has_to = true;
+			query.to = strtoull(argv[i+1], &end, 10);
+		} else if (strcmp(argv[i], STR_QUERY_RULE) == 0){
+			query.has_reason = true;
+			query.reason = (int32_t)strtol(argv[i+1], &end, 10);
+		} else if (strcmp(argv[i], STR_QUERY_IP) == 0){
+			if (inet_pton(AF_INET, argv[i+1], &addr) != 1){
+				printf("Invalid ip address: %s\n", argv[i+1]);
+				return -1;
+			}
+			query.has_ip = true;
+			query.ip = ntohl(addr.s_addr);
+			continue;
+		} else {
+			break;
+		}
+		if (*end != '\0'){
+			printf("Invalid value of %s: %s\n", argv[i], argv[i+1]);
+			return -1;
+		}
+	}
+	
+	if (i != argc){
+		printf("Wrong usage, format is: query_log <segments directory> [from <timestamp>] [to <timestamp>] [ip <ip>] [rule <rule index / reason>]\n");
+		return -1;
+	}
+	
+	if (query_log_segments(argv[0], &query, print_log_rec, &stats) < 0){
+		return -1;
+	}
+	
+	printf("%lu log-rows matched (%lu of %lu segments were read).\n",
+			stats.num_of_rows, stats.num_of_segments_read, stats.num_of_segments);
+	return 0;
+}
@@ -1,6 +1,8 @@
 #ifndef _INPUT_UTILS_H_
 #define _INPUT_UTILS_H_
 #include "user_fw.h"
+#include "log_segment.h"
+#include <time.h>		//For clock_gettime()
 
 #define MAX_NUM_OF_RULES (50)
 // Constants for rule-string-format:"<rule name> <direction> <src ip>/<nps> <dst ip>/<nps> <protocol> <dource port> <dest port> <ack> <action>"
@@ -51,8 +53,21 @@
 #define STR_SHOW_LOG "show_log"
 #define STR_CLEAR_LOG "clear_log"
 #define STR_GET_LOG_SIZE "get_log_size"
+#define STR_DUMP_LOG_RING "dump_log_ring"
+#define STR_FOLLOW_LOG "follow_log"
+#define STR_SHOW_LOG_ROLLUPS "show_log_rollups"
+#define STR_QUERY_LOG "query_log"
+#define STR_QUERY_FROM "from"
+#define STR_QUERY_TO "to"
+#define STR_QUERY_IP "ip"
+#define STR_QUERY_RULE "rule"
 #define STR_GET_RULES_SIZE "get_rules_size"
 #define STR_SHOW_CONN_TAB "show_connection_table"
+#define STR_SHOW_CONN_STATS "show_conn_stats"
+#define STR_SHOW_HOOK_LATENCY "show_hook_latency"
+#define STR_SHOW_VERDICTS "show_verdicts"
+#define STR_SAVE_CONN_TAB "save_conn_tab"
+#define STR_LOAD_CONN_TAB "load_conn_tab"
 
 /**
  * LOGROW format:
@@ -61,7 +76,12 @@
  * 
  * NOTE: MAX_STRLEN_OF_LOGROW_FORMAT includes '\n' and spaces (thats why I added NUM_OF_FIELDS_IN_LOF_ROW_T)
  **/
-#define MAX_NUM_OF_LOG_ROWS (1000)
+#define MAX_NUM_OF_LOG_ROWS (1000)				//log-rows show_log's buffer starts with (it grows as needed)
+#define LOG_FOLLOW_BATCH (64)				//log-rows read at once when following the log
+#define LOG_ROLLUP_READ_BATCH (256)			//log rollups read at once
+#define MAX_NUM_OF_VERDICT_LINES (256)		//Hooks*actions*reasons counted by the module
+#define VERDICTS_RATE_INTERVAL_USEC (1000000)	//Time between the 2 reads of show_verdicts
+#define CONN_STATS_RATE_INTERVAL_USEC (1000000)	//Time between the 2 reads of show_conn_stats
 #define NUM_OF_FIELDS_IN_LOG_ROW_T (10)
 #define MAX_STRLEN_OF_ULONG (20)			//MAX_U_LONG = 2^64-1 = 18446744073709551615, 20 digits
 #define MAX_STRLEN_OF_LOGROW_FORMAT (MAX_STRLEN_OF_ULONG + 3*MAX_STRLEN_OF_U8 + 4*MAX_STRLEN_OF_BE32 + 2*MAX_STRLEN_OF_BE16 + NUM_OF_FIELDS_IN_LOG_ROW_T)
@@ -81,6 +101,11 @@ int clear_rules(void);
 int clear_log(void);
 int print_all_log_rows(void);
 int get_num_log_rows(void);
+int dump_log_ring(void);
+int follow_log(void);
+int print_log_rollups(void);
+int print_verdict_rates(void);
+int query_log(int argc, char* argv[]);
 bool tran_uint_to_ipv4str(unsigned int ip, char* str, size_t len_str);
 
 #endif // _INPUT_UTILS_H_
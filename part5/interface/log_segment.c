@@ -0,0 +1,345 @@
+#include "log_segment.h"
+
+/**
+ *	Helper function (for qsort() & bsearch()): compares 2 ips
+ **/
+static int cmp_ips(const void* a, const void* b){
+	uint32_t ip_a = *(const uint32_t*)a;
+	uint32_t ip_b = *(const uint32_t*)b;
+	return (ip_a < ip_b) ? -1 : (ip_a > ip_b);
+}
+
+/**
+ *	Helper function: fills seg->ips with the distinct ips of its rows
+ *	(sorted), updates seg->hdr.num_of_ips.
+ **/
+static void build_ip_list(log_segment_t* seg){
+	uint32_t n = seg->hdr.num_of_rows, i, num_of_ips = 0;
+
+	memcpy(seg->ips, seg->src_ip, n*sizeof(uint32_t));
+	memcpy(seg->ips + n, seg->dst_ip, n*sizeof(uint32_t));
+	qsort(seg->ips, 2*n, sizeof(uint32_t), cmp_ips);
+
+	for (i = 0; i < 2*n; ++i) {
+		if (num_of_ips == 0 || seg->ips[i] != seg->ips[num_of_ips - 1]) {
+			seg->ips[num_of_ips++] = seg->ips[i];
+		}
+	}
+	seg->hdr.num_of_ips = num_of_ips;
+	seg->ips[num_of_ips] = 0;	// The padding, if num_of_ips is odd
+}
+
+/**
+ *	Helper function: returns the number of values in an ip list of
+ *	num_of_ips ips (with its padding)
+ **/
+static uint32_t get_padded_num_of_ips(uint32_t num_of_ips){
+	return (num_of_ips + 1) & ~1u;
+}
+
+/**
+ *	Returns true if ip is in a segment's ip list (of num_of_ips ips)
+ **/
+static bool has_ip(const uint32_t* ips, uint32_t num_of_ips, uint32_t ip){
+	return (bsearch(&ip, ips, num_of_ips, sizeof(uint32_t), cmp_ips) != NULL);
+}
+
+/**
+ *	Returns false if no row of the segment (of hdr) has reason
+ **/
+static bool may_have_reason(const log_segment_hdr_t* hdr, int32_t reason){
+	if (reason >= 0 && reason < 64) {
+		return (hdr->rules_mask & (1ULL << reason)) != 0;
+	}
+	if (reason < 0 && reason > -64) {
+		return (hdr->reasons_mask & (1ULL << -reason)) != 0;
+	}
+	return true;
+}
+
+/**
+ *	Initiates seg to an empty segment
+ **/
+void init_log_segment(log_segment_t* seg){
+	memset(&seg->hdr, 0, sizeof(log_segment_hdr_t));
+	seg->hdr.magic = LOG_SEGMENT_MAGIC;
+	seg->hdr.version = LOG_SEGMENT_VERSION;
+}
+
+/**
+ *	Adds rec to seg (and to its header's indexes).
+ *
+ *	Returns false if seg is full (rec wasn't added).
+ **/
+bool add_rec_to_segment(log_segment_t* seg, const fw_log_rec_t* rec){
+	log_segment_hdr_t* hdr = &seg->hdr;
+	uint32_t i = hdr->num_of_rows;
+
+	if (i == LOG_SEGMENT_MAX_ROWS) {
+		return false;
+	}
+
+	seg->timestamp[i] = rec->timestamp;
+	seg->src_ip[i] = rec->src_ip;
+	seg->dst_ip[i] = rec->dst_ip;
+	seg->count[i] = rec->count;
+	seg->reason[i] = rec->reason;
+	seg->src_port[i] = rec->src_port;
+	seg->dst_port[i] = rec->dst_port;
+	seg->protocol[i] = rec->protocol;
+	seg->action[i] = rec->action;
+	seg->hooknum[i] = rec->hooknum;
+
+	if (i == 0 || rec->timestamp < hdr->min_timestamp) {
+		hdr->min_timestamp = rec->timestamp;
+	}
+	if (i == 0 || rec->timestamp > hdr->max_timestamp) {
+		hdr->max_timestamp = rec->timestamp;
+	}
+	if (rec->reason >= 0 && rec->reason < 64) {
+		hdr->rules_mask |= (1ULL << rec->reason);
+	} else if (rec->reason < 0 && rec->reason > -64) {
+		hdr->reasons_mask |= (1ULL << -rec->reason);
+	}
+
+	++hdr->num_of_rows;
+	return true;
+}
+
+/**
+ *	Helper function: writes len bytes of buff to fd.
+ *	Returns true on success.
+ **/
+static bool write_all(int fd, const void* buff, size_t len){
+	const char* ptr = buff;
+	ssize_t curr_written;
+
+	while (len > 0) {
+		if ((curr_written = write(fd, ptr, len)) <= 0) {
+			if (curr_written < 0 && errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		ptr += curr_written;
+		len -= curr_written;
+	}
+	return true;
+}
+
+/**
+ *	Writes seg (if it has any rows) as a new segment file in dir_path,
+ *	named <min timestamp>-<pid>-<segment number>.fwseg. The file is
+ *	written under a temporary name and then renamed, so queries never
+ *	see a partial segment.
+ *	seg is emptied afterwards (on success).
+ *
+ *	Returns 0 on success, -1 if failed (prints errors, if any, to screen)
+ **/
+int write_log_segment(log_segment_t* seg, const char* dir_path){
+	char path[MAX_LEN_SEGMENT_PATH];
+	char tmp_path[MAX_LEN_SEGMENT_PATH + sizeof(LOG_SEGMENT_TMP_SUFFIX)];
+	uint32_t n = seg->hdr.num_of_rows;
+	bool written;
+
+	if (n == 0) {
+		return 0;
+	}
+
+	if (snprintf(path, sizeof(path), "%s/%020llu-%ld-%u" LOG_SEGMENT_SUFFIX, dir_path,
+			(unsigned long long)seg->hdr.min_timestamp, (long)getpid(),
+			seg->num_of_segments) >= (int)sizeof(path))
+	{
+		printf("Error: segments directory's path is too long.\n");
+		return -1;
+	}
+	snprintf(tmp_path, sizeof(tmp_path), "%s" LOG_SEGMENT_TMP_SUFFIX, path);
+	build_ip_list(seg);
+
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		printf("Error occured trying to create segment file %s, error number: %d\n", tmp_path, errno);
+		return -1;
+	}
+
+	written = (write_all(fd, &seg->hdr, sizeof(log_segment_hdr_t)) &&
+			write_all(fd, seg->ips, get_padded_num_of_ips(seg->hdr.num_of_ips)*sizeof(uint32_t)) &&
+			write_all(fd, seg->timestamp, n*sizeof(uint64_t)) &&
+			write_all(fd, seg->src_ip, n*sizeof(uint32_t)) &&
+			write_all(fd, seg->dst_ip, n*sizeof(uint32_t)) &&
+			write_all(fd, seg->count, n*sizeof(uint32_t)) &&
+			write_all(fd, seg->reason, n*sizeof(int32_t)) &&
+			write_all(fd, seg->src_port, n*sizeof(uint16_t)) &&
+			write_all(fd, seg->dst_port, n*sizeof(uint16_t)) &&
+			write_all(fd, seg->protocol, n) &&
+			write_all(fd, seg->action, n) &&
+			write_all(fd, seg->hooknum, n));
+
+	if (close(fd) < 0 || !written || rename(tmp_path, path) < 0) {
+		printf("Error occured trying to write segment file %s, error number: %d\n", path, errno);
+		unlink(tmp_path);
+		return -1;
+	}
+
+	++seg->num_of_segments;
+	init_log_segment(seg);
+	return 0;
+}
+
+/**
+ *	Helper function: returns true if a segment with hdr might have rows
+ *	that match query (ip is checked later, by the segment's ip list)
+ **/
+static bool segment_may_match(const log_segment_hdr_t* hdr, const log_query_t* query){
+	return ((!query->has_from || hdr->max_timestamp >= query->from) &&
+			(!query->has_to || hdr->min_timestamp <= query->to) &&
+			(!query->has_reason || may_have_reason(hdr, query->reason)));
+}
+
+/**
+ *	Helper function: calls on_rec for every row of a (mapped) segment
+ *	that matches query. Only the columns needed for filtering are read
+ *	for rows that don't match.
+ *
+ *	Returns number of rows that matched (and on_rec succeeded on).
+ **/
+static long scan_segment(const char* seg_data, const log_query_t* query,
+		bool (*on_rec)(const fw_log_rec_t* rec))
+{
+	const log_segment_hdr_t* hdr = (const log_segment_hdr_t*)seg_data;
+	uint32_t n = hdr->num_of_rows, i;
+	const uint64_t* timestamp = (const uint64_t*)(seg_data + sizeof(log_segment_hdr_t) +
+			get_padded_num_of_ips(hdr->num_of_ips)*sizeof(uint32_t));
+	const uint32_t* src_ip = (const uint32_t*)(timestamp + n);
+	const uint32_t* dst_ip = src_ip + n;
+	const uint32_t* count = dst_ip + n;
+	const int32_t* reason = (const int32_t*)(count + n);
+	const uint16_t* src_port = (const uint16_t*)(reason + n);
+	const uint16_t* dst_port = src_port + n;
+	const uint8_t* protocol = (const uint8_t*)(dst_port + n);
+	const uint8_t* action = protocol + n;
+	const uint8_t* hooknum = action + n;
+	fw_log_rec_t rec;
+	long num_matched = 0;
+
+	memset(&rec, 0, sizeof(rec));
+	for (i = 0; i < n; ++i) {
+		if ((query->has_from && timestamp[i] < query->from) ||
+			(query->has_to && timestamp[i] > query->to) ||
+			(query->has_reason && reason[i] != query->reason) ||
+			(query->has_ip && src_ip[i] != query->ip && dst_ip[i] != query->ip))
+		{
+			continue;
+		}
+
+		rec.timestamp = timestamp[i];
+		rec.src_ip = src_ip[i];
+		rec.dst_ip = dst_ip[i];
+		rec.count = count[i];
+		rec.reason = reason[i];
+		rec.src_port = src_port[i];
+		rec.dst_port = dst_port[i];
+		rec.protocol = protocol[i];
+		rec.action = action[i];
+		rec.hooknum = hooknum[i];
+		if (on_rec(&rec)) {
+			++num_matched;
+		}
+	}
+	return num_matched;
+}
+
+/**
+ *	Helper function: returns the length of a segment file with num_of_rows
+ *	rows and num_of_ips ips
+ **/
+static size_t get_segment_len(uint32_t num_of_rows, uint32_t num_of_ips){
+	return sizeof(log_segment_hdr_t) + (size_t)get_padded_num_of_ips(num_of_ips)*sizeof(uint32_t) +
+			(size_t)num_of_rows*(sizeof(uint64_t) +
+			4*sizeof(uint32_t) + 2*sizeof(uint16_t) + 3*sizeof(uint8_t));
+}
+
+/**
+ *	Answers a query over the segment files in dir_path: calls on_rec for
+ *	every row that matches query. A segment is only read (mapped) if its
+ *	header shows it might have such rows.
+ *	Rows are reported segment by segment (in no specific order).
+ *	Updates *stats.
+ *
+ *	Returns 0 on success, -1 if failed (prints errors, if any, to screen)
+ **/
+int query_log_segments(const char* dir_path, const log_query_t* query,
+		bool (*on_rec)(const fw_log_rec_t* rec), log_query_stats_t* stats)
+{
+	char path[MAX_LEN_SEGMENT_PATH];
+	log_segment_hdr_t hdr;
+	struct dirent* entry;
+	struct stat st;
+	size_t name_len, seg_len;
+	char* seg_data;
+	int ret = 0;
+
+	memset(stats, 0, sizeof(log_query_stats_t));
+
+	DIR* dir = opendir(dir_path);
+	if (dir == NULL) {
+		printf("Error occured trying to open segments directory %s, error number: %d\n", dir_path, errno);
+		return -1;
+	}
+
+	while (ret == 0 && (entry = readdir(dir)) != NULL) {
+		name_len = strlen(entry->d_name);
+		if (name_len <= strlen(LOG_SEGMENT_SUFFIX) ||
+			strcmp(entry->d_name + name_len - strlen(LOG_SEGMENT_SUFFIX), LOG_SEGMENT_SUFFIX) != 0)
+		{
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+
+		int fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			printf("Error occured trying to open segment file %s, error number: %d\n", path, errno);
+			continue;
+		}
+		++stats->num_of_segments;
+
+		if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+			hdr.magic != LOG_SEGMENT_MAGIC || hdr.version != LOG_SEGMENT_VERSION ||
+			hdr.num_of_rows > LOG_SEGMENT_MAX_ROWS || hdr.num_of_ips > 2*hdr.num_of_rows ||
+			fstat(fd, &st) < 0 ||
+			(size_t)st.st_size < (seg_len = get_segment_len(hdr.num_of_rows, hdr.num_of_ips)))
+		{
+			printf("Note: skipping invalid segment file %s\n", path);
+			close(fd);
+			continue;
+		}
+
+		if (!segment_may_match(&hdr, query)) {
+			close(fd);
+			continue;
+		}
+
+		seg_data = mmap(NULL, seg_len, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (seg_data == MAP_FAILED) {
+			printf("Error occured trying to map segment file %s, error number: %d\n", path, errno);
+			ret = -1;
+			break;
+		}
+
+		//Only the ip list's pages are read if ip isn't in the segment:
+		if (query->has_ip && !has_ip((const uint32_t*)(seg_data + sizeof(log_segment_hdr_t)),
+				hdr.num_of_ips, query->ip))
+		{
+			munmap(seg_data, seg_len);
+			continue;
+		}
+
+		++stats->num_of_segments_read;
+		stats->num_of_rows += scan_segment(seg_data, query, on_rec);
+		munmap(seg_data, seg_len);
+	}
+
+	closedir(dir);
+	return ret;
+}
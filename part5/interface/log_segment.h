@@ -0,0 +1,92 @@
+#ifndef _LOG_SEGMENT_H_
+#define _LOG_SEGMENT_H_
+#include "user_fw.h"
+#include <dirent.h>
+
+/**
+ *	Log segments - firewall's log, drained from PATH_TO_LOG_DEV (by fw_logd)
+ *	into append-only files, one file per segment (up to LOG_SEGMENT_MAX_ROWS
+ *	log-rows). A segment file is:
+ *
+ *		log_segment_hdr_t
+ *		the segment's distinct ip addresses (source & destination), sorted,
+ *		num_of_ips values (4 bytes), padded with a 0 to an even number of
+ *		values (so the columns stay 8 bytes aligned)
+ *		a column for every field of fw_log_rec_t, num_of_rows values each,
+ *		in this order: timestamp (8 bytes), src_ip, dst_ip, count, reason
+ *		(4 bytes), src_port, dst_port (2 bytes), protocol, action, hooknum
+ *		(1 byte)
+ *
+ *	count is the number of packets a row stands for. fw_logd writes a row
+ *	per logged packet, with its weight (1, or log_sample_rate when it was
+ *	sampled), so summing count over a query's rows gives its packets. NOTE: unlike in log-rows (and ring/follow records),
+ *	where count is the log-row's running total, it is never cumulative here.
+ *
+ *	The header lets a query skip whole segments: it has the segment's
+ *	time range and the rules/reasons its rows have. A query by ip is
+ *	answered from the ip list (a binary search, exact however diverse
+ *	the traffic is) and skips the segment's columns if ip isn't there.
+ *	All values are in LOCAL endianness.
+ **/
+#define LOG_SEGMENT_MAGIC (0x47535746)			// "FWSG" (in little endian)
+#define LOG_SEGMENT_VERSION (2)
+#define LOG_SEGMENT_MAX_ROWS (1 << 16)
+#define LOG_SEGMENT_MAX_SECONDS (60)			// A segment is sealed (written) at least once a minute
+#define LOG_SEGMENT_SUFFIX ".fwseg"
+#define LOG_SEGMENT_TMP_SUFFIX ".tmp"
+#define MAX_LEN_SEGMENT_PATH (4096)
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_of_rows;
+	uint32_t num_of_ips;					// In the ip list (at most 2*num_of_rows)
+	uint64_t min_timestamp;
+	uint64_t max_timestamp;
+	uint64_t rules_mask;					// bit i: some row's reason is rule #i (i < 64)
+	uint64_t reasons_mask;					// bit i: some row's reason is -i (a reason_t, i < 64)
+} log_segment_hdr_t;
+
+// Rows of a segment that wasn't written yet, column by column:
+typedef struct {
+	log_segment_hdr_t hdr;
+	uint64_t timestamp[LOG_SEGMENT_MAX_ROWS];
+	uint32_t src_ip[LOG_SEGMENT_MAX_ROWS];
+	uint32_t dst_ip[LOG_SEGMENT_MAX_ROWS];
+	uint32_t count[LOG_SEGMENT_MAX_ROWS];
+	int32_t reason[LOG_SEGMENT_MAX_ROWS];
+	uint16_t src_port[LOG_SEGMENT_MAX_ROWS];
+	uint16_t dst_port[LOG_SEGMENT_MAX_ROWS];
+	uint8_t protocol[LOG_SEGMENT_MAX_ROWS];
+	uint8_t action[LOG_SEGMENT_MAX_ROWS];
+	uint8_t hooknum[LOG_SEGMENT_MAX_ROWS];
+	uint32_t ips[2*LOG_SEGMENT_MAX_ROWS + 1];	// The ip list (& its padding), built when the segment is written
+	unsigned int num_of_segments;			// Segments written so far (for naming them)
+} log_segment_t;
+
+// Filters of a query, a field that's not "has_..." isn't filtered:
+typedef struct {
+	bool has_from;
+	uint64_t from;							// First timestamp (included)
+	bool has_to;
+	uint64_t to;							// Last timestamp (included)
+	bool has_ip;
+	uint32_t ip;							// Source OR destination ip
+	bool has_reason;
+	int32_t reason;							// rule#index, or a reason_t value
+} log_query_t;
+
+// Numbers of a finished query:
+typedef struct {
+	unsigned long num_of_segments;
+	unsigned long num_of_segments_read;		// Segments not skipped by their header or ip list
+	unsigned long num_of_rows;				// Rows that matched
+} log_query_stats_t;
+
+void init_log_segment(log_segment_t* seg);
+bool add_rec_to_segment(log_segment_t* seg, const fw_log_rec_t* rec);
+int write_log_segment(log_segment_t* seg, const char* dir_path);
+int query_log_segments(const char* dir_path, const log_query_t* query,
+		bool (*on_rec)(const fw_log_rec_t* rec), log_query_stats_t* stats);
+
+#endif // _LOG_SEGMENT_H_
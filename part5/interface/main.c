@@ -244,21 +244,406 @@ static int get_conn_tab(){
 	return 0;
 }
 
+//Statistics (of PATH_TO_CONN_STATS_ATTR) that get_conn_stats() prints a rate of:
+static const char* g_rated_conn_stats[] = {"inserts", "deletes", "expiries", "fast_path"};
+#define NUM_OF_RATED_CONN_STATS (sizeof(g_rated_conn_stats)/sizeof(g_rated_conn_stats[0]))
+
+/**
+ *	Helper function: returns the index of name in g_rated_conn_stats,
+ *	-1 if it isn't there.
+ **/
+static int get_rated_conn_stat_index(const char* name){
+	int i;
+	for (i = 0; i < (int)NUM_OF_RATED_CONN_STATS; ++i){
+		if (strcmp(name, g_rated_conn_stats[i]) == 0){
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ *	Helper function: reads connection table's statistics (from
+ *	PATH_TO_CONN_STATS_ATTR) into buff (of p_size bytes), and updates *ts
+ *	to the (monotonic) time they were read.
+ *
+ *	Returns 0 on success, -1 if failed (prints errors, if any, to screen)
+ **/
+static int read_conn_stats_buff(char* buff, unsigned int p_size, struct timespec* ts){
+
+	memset(buff, 0, p_size);
+
+	// Open device with read only permissions:
+	int fd = open(PATH_TO_CONN_STATS_ATTR,O_RDONLY);
+	if (fd < 0){
+		printf("Error occured trying to open the connection-table statistics for reading, error number: %d\n", errno);
+		return -1;
+	}
+
+	if (read(fd, buff, p_size-1) < 0){
+		printf("Error occured trying to read connection table's statistics, error number: %d\n", errno);
+		close(fd);
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	close(fd);
+	return 0;
+}
+
+/**
+ *	Gets and prints connection table's statistics
+ *	(reads from PATH_TO_CONN_STATS_ATTR)
+ *
+ *	Statistics' format is a line per value: "<name> <value(s)>'\n'",
+ *	counters are totals since module's load: they are read twice,
+ *	CONN_STATS_RATE_INTERVAL_USEC apart, so inserts/deletes/expiries/fast_path
+ *	are printed with their rate of that interval (like show_verdicts).
+ *	Two lines are translated to be human-readable:
+ *		state_rows - number of rows in each TCP state
+ *		probe_depth - histogram of number of rows passed per lookup
+ *
+ *	Returns 0 on success, -1 if failed
+ *
+ *	Note: function prints errors, if any, to screen
+ **/
+static int get_conn_stats(){
+
+	const char* states[] = {"CLOSED", "LISTEN", "SYN-SENT", "SYN-RCVD",
+			"ESTABLISHED", "FIN-WAIT1", "CLOSE-WAIT", "FIN-WAIT2",
+			"LAST-ACK", "TIME-WAIT"};
+	const char* depths[] = {"0", "1", "2-3", "4-7", "8-15", "16-31",
+			"32-63", "64+"};
+	unsigned long prev_totals[NUM_OF_RATED_CONN_STATS];
+	bool has_prev_total[NUM_OF_RATED_CONN_STATS];
+	char *buff, *str, *curr_token, *value;
+	struct timespec prev_ts, ts;
+	unsigned long num;
+	double elapsed;
+	int i, offset;
+	unsigned int p_size = (unsigned int)getpagesize();
+
+	if ( (buff = calloc(p_size,sizeof(char))) == NULL){
+		printf("Allocating buffer for getting connection table's statistics failed.\n");
+		return -1;
+	}
+
+	//First read - only the totals that get a rate are kept:
+	if (read_conn_stats_buff(buff, p_size, &prev_ts) < 0){
+		free(buff);
+		return -1;
+	}
+	memset(has_prev_total, 0, sizeof(has_prev_total));
+	str = buff;
+	while ((curr_token = strsep(&str, "\n")) != NULL){
+		if ((value = strchr(curr_token, ' ')) == NULL){
+			continue;
+		}
+		*value = '\0';
+		if ((i = get_rated_conn_stat_index(curr_token)) >= 0 &&
+			sscanf(value + 1, "%lu", &prev_totals[i]) == 1)
+		{
+			has_prev_total[i] = true;
+		}
+	}
+
+	usleep(CONN_STATS_RATE_INTERVAL_USEC);
+	if (read_conn_stats_buff(buff, p_size, &ts) < 0){
+		free(buff);
+		return -1;
+	}
+
+	elapsed = (ts.tv_sec - prev_ts.tv_sec) + (ts.tv_nsec - prev_ts.tv_nsec) / 1e9;
+	if (elapsed <= 0){
+		elapsed = CONN_STATS_RATE_INTERVAL_USEC / 1e6;
+	}
+
+	str = buff;
+	while ((curr_token = strsep(&str, "\n")) != NULL){
+
+		if(strlen(curr_token) == 0){
+			continue; //skip empty lines
+		}
+
+		if ((value = strchr(curr_token, ' ')) == NULL){
+			printf("Couldn't parse statistics line: %s\n", curr_token);
+			continue;
+		}
+		*value = '\0';
+		++value;
+
+		if (strcmp(curr_token, "state_rows") == 0){
+			printf("Rows per TCP state:\n");
+			for (i = 0; i < (int)(sizeof(states)/sizeof(states[0])); ++i){
+				if (sscanf(value, "%lu%n", &num, &offset) < 1){
+					break;
+				}
+				printf("\t%s: %lu\n", states[i], num);
+				value += offset;
+			}
+		} else if (strcmp(curr_token, "probe_depth") == 0){
+			printf("Rows passed per lookup:\n");
+			for (i = 0; i < (int)(sizeof(depths)/sizeof(depths[0])); ++i){
+				if (sscanf(value, "%lu%n", &num, &offset) < 1){
+					break;
+				}
+				printf("\t%s: %lu\n", depths[i], num);
+				value += offset;
+			}
+		} else if ((i = get_rated_conn_stat_index(curr_token)) >= 0 &&
+				has_prev_total[i] && sscanf(value, "%lu", &num) == 1)
+		{
+			//Totals never decrease, but don't print a negative rate if module was reloaded:
+			printf("%s: %lu (%.0f/sec)\n", curr_token, num,
+					(num >= prev_totals[i]) ? (num - prev_totals[i]) / elapsed : 0.0);
+		} else {
+			printf("%s: %s\n", curr_token, value);
+		}
+	}
+
+	free(buff);
+	return 0;
+}
+
+/**
+ *	Helper function: prints a stage's latency percentiles, from its log2
+ *	histogram (bucket b holds samples of [2^(b-1), 2^b) nanoseconds).
+ **/
+static void print_latency_percentiles(const char* stage, unsigned long samples,
+		unsigned long long total_ns, const unsigned long* buckets, int num_of_buckets)
+{
+	const unsigned int per_mille[] = {500, 900, 990, 999};
+	const char* names[] = {"p50", "p90", "p99", "p99.9"};
+	unsigned long count = 0, target, sum;
+	int i, b;
+
+	for (b = 0; b < num_of_buckets; ++b){
+		count += buckets[b];
+	}
+	if (samples == 0 || count == 0){
+		printf("%s: no samples\n", stage);
+		return;
+	}
+
+	printf("%s: %lu samples, mean %lluns", stage, samples, total_ns / samples);
+	for (i = 0; i < (int)(sizeof(per_mille)/sizeof(per_mille[0])); ++i){
+		target = (count*per_mille[i] + 999) / 1000;
+		sum = 0;
+		for (b = 0; b < num_of_buckets - 1; ++b){
+			sum += buckets[b];
+			if (sum >= target){
+				break;
+			}
+		}
+		printf(", %s <%lluns", names[i], (b == 0) ? 1ULL : (1ULL << b));
+	}
+	printf("\n");
+}
+
+/**
+ *	Gets and prints the hook's latency percentiles, per stage
+ *	(reads from PATH_TO_HOOK_LATENCY_ATTR)
+ *
+ *	Format is a line: "enabled <0/1>'\n'", and a line per stage:
+ *	"<stage> <samples> <total ns> <bucket 0> ... <last non-empty bucket>'\n'"
+ *	Percentiles are upper bounds (of their log2 bucket).
+ *
+ *	Returns 0 on success, -1 if failed
+ *
+ *	Note: function prints errors, if any, to screen
+ **/
+static int get_hook_latency(){
+
+	char *buff, *str, *curr_token;
+	char stage[32];
+	unsigned long buckets[HOOK_LATENCY_NUM_BUCKETS];
+	unsigned long samples;
+	unsigned long long total_ns;
+	int enabled, num_of_buckets, offset;
+	unsigned int p_size = (unsigned int)getpagesize();
+
+	if ( (buff = calloc(p_size,sizeof(char))) == NULL){
+		printf("Allocating buffer for getting hook latency failed.\n");
+		return -1;
+	}
+
+	// Open device with read only permissions:
+	int fd = open(PATH_TO_HOOK_LATENCY_ATTR,O_RDONLY);
+	if (fd < 0){
+		printf("Error occured trying to open the hook latency for reading, error number: %d\n", errno);
+		free(buff);
+		return -1;
+	}
+
+	if (read(fd, buff, p_size-1) < 0){
+		printf("Error occured trying to read hook latency, error number: %d\n", errno);
+		free(buff);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	str = buff;
+	while ((curr_token = strsep(&str, "\n")) != NULL){
+
+		if(strlen(curr_token) == 0){
+			continue; //skip empty lines
+		}
+
+		if (sscanf(curr_token, "enabled %d", &enabled) == 1){
+			if (!enabled){
+				printf("Hook latency isn't measured (to measure: echo 1 > %s)\n", PATH_TO_HOOK_LATENCY_ATTR);
+			}
+			continue;
+		}
+
+		if (sscanf(curr_token, "%31s %lu %llu%n", stage, &samples, &total_ns, &offset) < 3){
+			printf("Couldn't parse hook latency line: %s\n", curr_token);
+			continue;
+		}
+		curr_token += offset;
+		memset(buckets, 0, sizeof(buckets));
+		for (num_of_buckets = 0; num_of_buckets < HOOK_LATENCY_NUM_BUCKETS; ++num_of_buckets){
+			if (sscanf(curr_token, "%lu%n", &buckets[num_of_buckets], &offset) < 1){
+				break;
+			}
+			curr_token += offset;
+		}
+		print_latency_percentiles(stage, samples, total_ns, buckets, HOOK_LATENCY_NUM_BUCKETS);
+	}
+
+	free(buff);
+	return 0;
+}
+
+/**
+ *	Helper function: copies everything that can be read from src_fd to dst_fd.
+ *
+ *	Returns 0 on success, -1 if failed (prints errors, if any, to screen)
+ **/
+static int copy_fd(int src_fd, int dst_fd){
+
+	char buff[BUFSIZ];
+	ssize_t num_read, num_written, total_written;
+
+	while ((num_read = read(src_fd, buff, sizeof(buff))) > 0){
+		total_written = 0;
+		while (total_written < num_read){
+			num_written = write(dst_fd, buff + total_written, num_read - total_written);
+			if (num_written <= 0){
+				printf("Error occured trying to write connection-table snapshot, error number: %d\n", errno);
+				return -1;
+			}
+			total_written += num_written;
+		}
+	}
+
+	if (num_read < 0){
+		printf("Error occured trying to read connection-table snapshot, error number: %d\n", errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ *	Saves a (binary) snapshot of the connection table to a file
+ *	(reads it from PATH_TO_CONN_TAB_DEV).
+ *	Use it before unloading the firewall module, and load_conn_tab
+ *	after loading it again - so existing connections won't be dropped.
+ *
+ *	Returns 0 on success, -1 if failed
+ *
+ *	Note: function prints errors, if any, to screen
+ **/
+static int save_conn_tab(const char* file_path){
+
+	int dev_fd = open(PATH_TO_CONN_TAB_DEV, O_RDONLY);
+	if (dev_fd < 0){
+		printf("Error occured trying to open the connection-table device for reading, error number: %d\n", errno);
+		return -1;
+	}
+
+	int file_fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (file_fd < 0){
+		printf("Error occured trying to open %s for writing, error number: %d\n", file_path, errno);
+		close(dev_fd);
+		return -1;
+	}
+
+	int ret = copy_fd(dev_fd, file_fd);
+	close(file_fd);
+	close(dev_fd);
+
+	if (ret == 0){
+		printf("Connection table saved to %s\n", file_path);
+	}
+	return ret;
+}
+
+/**
+ *	Restores the connection table from a snapshot file saved by save_conn_tab
+ *	(writes it to PATH_TO_CONN_TAB_DEV).
+ *	Rows that already exist in the table are updated.
+ *
+ *	Returns 0 on success, -1 if failed
+ *
+ *	Note: function prints errors, if any, to screen
+ **/
+static int load_conn_tab(const char* file_path){
+
+	int file_fd = open(file_path, O_RDONLY);
+	if (file_fd < 0){
+		printf("Error occured trying to open %s for reading, error number: %d\n", file_path, errno);
+		return -1;
+	}
+
+	int dev_fd = open(PATH_TO_CONN_TAB_DEV, O_WRONLY);
+	if (dev_fd < 0){
+		printf("Error occured trying to open the connection-table device for writing, error number: %d\n", errno);
+		close(file_fd);
+		return -1;
+	}
+
+	int ret = copy_fd(file_fd, dev_fd);
+	close(dev_fd);
+	close(file_fd);
+
+	if (ret == 0){
+		printf("Connection table loaded from %s. Use show_connection_table command to see it\n", file_path);
+	}
+	return ret;
+}
+
 
 int main(int argc, char* argv[]){
 
+	if (argc >= 3 && strcmp(argv[1], STR_QUERY_LOG) == 0) {
+		return query_log(argc - 2, argv + 2);
+	}
+
 	if( (argc < 2 || argc > 3) || 
-		((argc == 3) && (strcmp(argv[1], STR_LOAD_RULES) != 0)) )
+		((argc == 3) && (strcmp(argv[1], STR_LOAD_RULES) != 0) &&
+		 (strcmp(argv[1], STR_SAVE_CONN_TAB) != 0) &&
+		 (strcmp(argv[1], STR_LOAD_CONN_TAB) != 0)) ||
+		((argc == 2) && ((strcmp(argv[1], STR_SAVE_CONN_TAB) == 0) ||
+		 (strcmp(argv[1], STR_LOAD_CONN_TAB) == 0))) )
 	{
-		printf("Wrong usage, format is: <command> <path to rules file, only if cmd is load_rules>\n");
+		printf("Wrong usage, format is: <command> <path to file, only if cmd is load_rules/save_conn_tab/load_conn_tab>\n"
+				"\tor: query_log <segments directory> [from <timestamp>] [to <timestamp>] [ip <ip>] [rule <rule index / reason>]\n");
 		return -1;
 	} 
 
-	if (argc == 3){ //load_rules
+	if (argc == 3){ //load_rules, save_conn_tab or load_conn_tab
+		if (strcmp(argv[1], STR_SAVE_CONN_TAB) == 0) {
+			return save_conn_tab(argv[2]);
+		}
 		if (!valid_file_path(argv[2])) {
 			printf("File doesn't exist. Please try again\n");
 			return -1;
 		}
+		if (strcmp(argv[1], STR_LOAD_CONN_TAB) == 0) {
+			return load_conn_tab(argv[2]);
+		}
 		return load_rules(argv[2]);
 	}
 	
@@ -293,11 +678,35 @@ int main(int argc, char* argv[]){
 	if (strcmp(argv[1], STR_GET_LOG_SIZE) == 0) {
 		return get_log_size();
 	}
+
+	if (strcmp(argv[1], STR_DUMP_LOG_RING) == 0) {
+		return dump_log_ring();
+	}
+
+	if (strcmp(argv[1], STR_FOLLOW_LOG) == 0) {
+		return follow_log();
+	}
+
+	if (strcmp(argv[1], STR_SHOW_LOG_ROLLUPS) == 0) {
+		return print_log_rollups();
+	}
 	
 	if (strcmp(argv[1], STR_SHOW_CONN_TAB) == 0) {
 		return get_conn_tab();
 	}
 
+	if (strcmp(argv[1], STR_SHOW_CONN_STATS) == 0) {
+		return get_conn_stats();
+	}
+
+	if (strcmp(argv[1], STR_SHOW_HOOK_LATENCY) == 0) {
+		return get_hook_latency();
+	}
+
+	if (strcmp(argv[1], STR_SHOW_VERDICTS) == 0) {
+		return print_verdict_rates();
+	}
+
 	printf ("Invalid command.\n");
 	return -1;
 	
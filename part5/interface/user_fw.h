@@ -11,6 +11,9 @@
 #include <stdlib.h> 	// For calloc()
 #include <arpa/inet.h>	//For inet_pton()
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/mman.h>	//For mmap() of the log rings
+#include <sys/ioctl.h>
 #include <linux/netfilter.h> //For NF_ACCEPT, NF_DROP
 #include <ctype.h> //For isdigit()
 
@@ -21,6 +24,13 @@
 #define PATH_TO_LOG_SIZE_ATTR "/sys/class/fw/fw_log/log_size"
 #define PATH_TO_LOG_CLEAR_ATTR "/sys/class/fw/fw_log/log_clear"
 #define PATH_TO_CONN_TAB_ATTR "/sys/class/fw/fw/conn_tab"
+#define PATH_TO_CONN_TAB_DEV "/dev/fw"
+#define PATH_TO_CONN_STATS_ATTR "/sys/class/fw/fw/conn_stats"
+#define PATH_TO_CONN_SYNC_DEV "/dev/fw_conn_sync"
+#define PATH_TO_HOOK_LATENCY_ATTR "/sys/class/fw/fw_rules/hook_latency"
+#define HOOK_LATENCY_NUM_BUCKETS (32)	// As in hook_latency_utils.h (in the module)
+#define PATH_TO_VERDICTS_ATTR "/sys/class/fw/fw_rules/verdicts"
+#define VERDICT_NO_REASON (-777)		// NO_REASON (in the module), reason of verdicts without one
 #define DEACTIVATE_STRING "0"
 #define ACTIVATE_STRING "1"
 #define ACTIVE_STR_LEN (1)
@@ -52,6 +62,8 @@ typedef enum {
 	REASON_CONN_TAB_ERR = -9,
 	REASON_LOOPBACK_PACKET = -10,
 	REASON_PART_OF_PROXY_HANDSHAKE = -11,
+	REASON_XPLICO_PACKET = -12,
+	REASON_HALF_OPEN_LIMIT = -13,
 } reason_t;
 	
 
@@ -128,4 +140,119 @@ typedef struct {
 	unsigned int count;        		// counts this line's hits
 } log_row_t;
 
+// connection-table snapshot, as read from / written to PATH_TO_CONN_TAB_DEV:
+// <conn_snapshot_hdr_t><conn_snapshot_row_t>*num_of_rows (local endianness,
+// ips & ports too). remaining_seconds is counted from export_time.
+#define CONN_SNAPSHOT_MAGIC (0x54435746)
+#define CONN_SNAPSHOT_VERSION (2)
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_of_rows;
+	uint64_t export_time;				// seconds since epoch, when snapshot was taken
+} __attribute__((packed)) conn_snapshot_hdr_t;
+
+typedef struct {
+	uint32_t src_ip;
+	uint16_t src_port;
+	uint32_t dst_ip;
+	uint16_t dst_port;
+	uint8_t tcp_state;
+	uint8_t remaining_seconds;			// until the row timesout
+	uint32_t fake_src_ip;
+	uint16_t fake_src_port;
+	uint32_t fake_dst_ip;
+	uint16_t fake_dst_port;
+	uint8_t need_to_fake_connection;
+	uint8_t fake_tcp_state;
+} __attribute__((packed)) conn_snapshot_row_t;
+
+// connection-table changes, as read from / written to PATH_TO_CONN_SYNC_DEV:
+typedef enum {
+	CONN_SYNC_OP_CREATE		= 1,
+	CONN_SYNC_OP_UPDATE		= 2,
+	CONN_SYNC_OP_DELETE		= 3,
+	CONN_SYNC_OP_FLUSH		= 4,
+	CONN_SYNC_OP_OVERRUN	= 5		// messages were lost, peer should be resynced
+} conn_sync_op_t;
+
+typedef struct {
+	uint32_t seq;
+	uint8_t op;							// values from: conn_sync_op_t
+	conn_snapshot_row_t row;
+} __attribute__((packed)) conn_sync_msg_t;
+
+// read modes of PATH_TO_LOG_DEV, set by ioctl(fd, FW_LOG_IOC_SET_MODE, mode):
+#define FW_LOG_IOC_MAGIC ('f')
+#define FW_LOG_IOC_SET_MODE _IOW(FW_LOG_IOC_MAGIC, 1, int)
+#define FW_LOG_IOC_FOLLOW _IO(FW_LOG_IOC_MAGIC, 2)			// reads return only new rows, blocking
+#define LOG_READ_MODE_TEXT (0)
+#define LOG_READ_MODE_BINARY (1)			// rows are read as fw_log_rec_t records
+#define LOG_READ_MODE_ROLLUP (2)			// rollups are read as fw_log_rollup_rec_t records
+
+// binary log rings, mapped from PATH_TO_LOG_DEV (see log_ring_utils.h in the module):
+#define LOG_AREA_MAGIC (0x474C5746)
+#define LOG_AREA_VERSION (2)
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_of_rings;				// one for every possible cpu
+	uint32_t ring_size;					// records in each ring, a power of 2
+	uint32_t ring_offset;				// offset of the first ring
+	uint32_t ring_stride;				// bytes between 2 rings
+	uint32_t recs_offset;				// offset of a ring's first record (from the ring's start)
+	uint32_t area_len;					// bytes to map
+} fw_log_area_hdr_t;
+
+typedef struct {
+	uint32_t head;						// written by kernel - next record to write
+	uint32_t pad_head[15];
+	uint32_t tail;						// written by user - next record to read
+	uint32_t pad_tail[15];
+	uint32_t dropped;					// records dropped since ring was full
+} fw_log_ring_hdr_t;
+
+typedef struct {
+	uint64_t timestamp;
+	uint32_t src_ip;
+	uint32_t dst_ip;
+	uint16_t src_port;
+	uint16_t dst_port;
+	int32_t reason;						// rule#index, or values from: reason_t
+	uint8_t protocol;
+	uint8_t action;
+	uint8_t hooknum;
+	uint8_t reserved;
+	uint32_t count;						// count of its log-row, after this packet
+	uint32_t weight;					// packets it stands for (log_sample_rate if sampled, 1
+										// otherwise), a log-row's count when a log-row is read
+	uint32_t reserved2;
+} fw_log_rec_t;
+
+// log events multicast over netlink (see log_netlink_utils.h in the module):
+#define NETLINK_FW_LOG (29)
+#define FW_LOG_NL_GROUP (1)
+#define FW_LOG_NL_MSG_EVENT (0x10 + 1)			// NLMSG_MIN_TYPE + 1
+
+typedef struct {
+	fw_log_rec_t rec;
+	char rule_name[20];					// empty if reason isn't a rule's index
+} fw_log_nl_event_t;
+
+// log rollups - packets per interval, by rule/reason, protocol & action (see log_rollup_utils.h in the module):
+#define LOG_ROLLUP_FLAG_OTHERS (1)			// packets of keys that didn't fit (key fields are 0)
+
+typedef struct {
+	uint64_t interval_start;
+	uint32_t interval_secs;
+	int32_t reason;						// rule#index, or values from: reason_t
+	uint8_t protocol;
+	uint8_t action;
+	uint8_t flags;
+	uint8_t reserved;
+	uint32_t packets;
+} fw_log_rollup_rec_t;
+
 #endif // _USER_FW_H_